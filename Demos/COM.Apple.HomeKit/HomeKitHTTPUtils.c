@@ -36,7 +36,7 @@
 #define kCRLFNewLine     "\r\n"
 #define kCRLFLineEnding  "\r\n\r\n"
 
-#define kMIMEType_HAP_JSON   "application/hap+json"
+#define kHKJsonBodyReadLength  256
 
 extern bool verify_otp(void);
 
@@ -52,134 +52,173 @@ security_session_t *HKSNewSecuritySession(void)
   return session;
 }
 
-int HKSecureSocketSend( int sockfd, void *buf, size_t len, security_session_t *session)
+static OSStatus _HKSecureSealFrame( security_session_t *session, uint8_t *frame, size_t frameLen )
 {
-  OSStatus       err = kNoErr;
-  uint8_t*       encryptedData = NULL;
-  uint64_t       encryptedDataLen;
+  OSStatus err;
 
-  if(session->established == false)
-    return SocketSend( sockfd, buf, len );
-
-  encryptedData = malloc(len + crypto_aead_chacha20poly1305_ABYTES + sizeof(uint16_t));
-  require_action(encryptedData, exit, err = kNoMemoryErr);
-  *(uint16_t *)encryptedData = len;
-  err =  crypto_aead_chacha20poly1305_encrypt(encryptedData + sizeof(uint16_t), &encryptedDataLen, (uint8_t *)buf, len,
-                                              (const uint8_t *)encryptedData, sizeof(uint16_t), 
-                                              NULL, (uint8_t *)(&session->outputSeqNo),
-                                              (const unsigned char *)session->OutputKey);
+  frame[0] = (uint8_t)( frameLen & 0xFF );
+  frame[1] = (uint8_t)( frameLen >> 8 );
+  err = crypto_aead_chacha20poly1305_encrypt_detached( frame + 2, frame + 2 + frameLen, NULL, frame + 2, frameLen,
+                                                       frame, 2, NULL, (uint8_t *)(&session->outputSeqNo),
+                                                       (const unsigned char *)session->OutputKey );
+  require_noerr_string( err, exit, "crypto_aead_chacha20poly1305_encrypt_detached failed" );
   session->outputSeqNo++;
-  require_noerr_string(err, exit, "crypto_aead_chacha20poly1305_encrypt failed");
-  require_string(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == len, exit, "encryptedDataLen is not properly set");
-
-  err = SocketSend( sockfd, encryptedData, encryptedDataLen + sizeof(uint16_t) );
-  require_noerr( err, exit );
 
-  exit:
-    if(encryptedData) free(encryptedData);
-    return err;
+exit:
+  return err;
 }
 
-int HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len)
+OSStatus HKSecureSocketSendv( int sockfd, const SocketIOVec_t *inVec, int inVecCount, void *inContext )
 {
-  OSStatus    err = kNoErr;
-  uint16_t         packageLength;
-  ssize_t          length = 0;
-  size_t         recvLength = 0;
-  size_t         recvLengthTmp = 0;
-  uint8_t*       *encryptedData = NULL;
-
-  fd_set      readfds;
-  int         returnLength = 0;
-  int         selectResult;
-  struct      timeval_t t;
-  t.tv_sec  =  20;
-  t.tv_usec =  0;
-
-  if(session->established == true){
-    if(session->recvedDataLen){
-      returnLength += min(len, session->recvedDataLen);
-      memcpy(buf, session->recvedDataBuffer, returnLength);
-      session->recvedDataLen -= returnLength;
-      if(session->recvedDataLen)
-        memmove(session->recvedDataBuffer, session->recvedDataBuffer+returnLength, session->recvedDataLen);
-      else{
-        free(session->recvedDataBuffer);
-        session->recvedDataBuffer = NULL;
-      }
-      goto exit;
-    }else{
-      while( recvLengthTmp < sizeof(uint16_t)){
-        FD_ZERO( &readfds );
-        FD_SET( sockfd, &readfds );
-        selectResult = select( sockfd + 1, &readfds, NULL, NULL, &t );
-        require(selectResult >= 1, exit);
-        length = read( sockfd, (uint8_t *)&packageLength + recvLengthTmp, sizeof(uint16_t) - recvLengthTmp);
-        if( length > 0 ) recvLengthTmp += length;
-        else { err = kConnectionErr; goto exit; }
+  OSStatus err = kNoErr;
+  security_session_t *session = inContext;
+  uint8_t *frame = session->txBuffer;
+  uint8_t * const txEnd = session->txBuffer + sizeof( session->txBuffer );
+  size_t frameLen = 0;
+  const uint8_t *src;
+  size_t srcLen, n;
+  int i;
+
+  if(session->established == false)
+    return SocketSendv( sockfd, inVec, inVecCount );
+
+  // All segments are packed into as few frames as possible, sealed in place in txBuffer and sent
+  // back to back, so a small response is a single frame and a single send.
+  for( i = 0; i < inVecCount; i++ ){
+    src = inVec[ i ].base;
+    srcLen = inVec[ i ].len;
+    while( srcLen ){
+      n = min( srcLen, kHKSecureFrameLengthMax - frameLen );
+      memcpy( frame + 2 + frameLen, src, n );
+      frameLen += n;
+      src += n;
+      srcLen -= n;
+      if( frameLen < kHKSecureFrameLengthMax ) continue;
+
+      err = _HKSecureSealFrame( session, frame, frameLen );
+      require_noerr( err, exit );
+      frame += frameLen + kHKSecureFrameOverhead;
+      frameLen = 0;
+      if( txEnd - frame < kHKSecureFrameSizeMax ){
+        err = SocketSend( sockfd, session->txBuffer, frame - session->txBuffer );
+        require_noerr( err, exit );
+        frame = session->txBuffer;
       }
+    }
+  }
 
-      recvLength = packageLength + crypto_aead_chacha20poly1305_ABYTES;
-      recvLengthTmp = 0;
+  if( frameLen ){
+    err = _HKSecureSealFrame( session, frame, frameLen );
+    require_noerr( err, exit );
+    frame += frameLen + kHKSecureFrameOverhead;
+  }
+  if( frame > session->txBuffer )
+    err = SocketSend( sockfd, session->txBuffer, frame - session->txBuffer );
 
-      encryptedData = malloc(recvLength);
-      require(encryptedData, exit);
+exit:
+  return err;
+}
 
-      while( recvLengthTmp < recvLength){
-        FD_ZERO( &readfds );
-        FD_SET( sockfd, &readfds );
-        selectResult = select( sockfd + 1, &readfds, NULL, NULL, &t );
-        require(selectResult >= 1, exit);
+int HKSecureSocketSend( int sockfd, void *buf, size_t len, security_session_t *session)
+{
+  SocketIOVec_t vec;
 
-        length = read( sockfd, encryptedData + recvLengthTmp, recvLength - recvLengthTmp );
-        if( length > 0 ) recvLengthTmp += length;
-        else { err = kConnectionErr; goto exit; }
-      }
+  vec.base = (const uint8_t *)buf;
+  vec.len = len;
+  return HKSecureSocketSendv( sockfd, &vec, 1, session );
+}
 
-      session->recvedDataBuffer = malloc(packageLength);
-      require(session->recvedDataBuffer, exit);
+/* Decrypts, in place, every complete frame received after rxSealed. The
+   length and tag are left around each plaintext and skipped when reading. */
+static OSStatus _HKSecureOpenFrames( security_session_t *session )
+{
+  OSStatus err = kNoErr;
+  uint8_t *frame;
+  size_t frameLen;
+
+  while( session->rxLen - session->rxSealed >= kHKSecureFrameOverhead ){
+    frame = session->rxBuffer + session->rxSealed;
+    frameLen = frame[0] | ( (size_t)frame[1] << 8 );
+    require_action( frameLen <= kHKSecureFrameLengthMax, exit, err = kMalformedErr );
+    if( session->rxLen - session->rxSealed < frameLen + kHKSecureFrameOverhead ) break;
+
+    err = crypto_aead_chacha20poly1305_decrypt_detached( frame + 2, NULL, frame + 2, frameLen, frame + 2 + frameLen,
+                                                         frame, 2, (uint8_t *)(&session->inputSeqNo),
+                                                         (const unsigned char *)session->InputKey );
+    require_noerr_action( err, exit, err = kAuthenticationErr );
+    session->inputSeqNo++;
+    session->rxSealed += frameLen + kHKSecureFrameOverhead;
+    session->recvedDataLen += frameLen;
+  }
 
+exit:
+  return err;
+}
 
-      err =  crypto_aead_chacha20poly1305_decrypt(session->recvedDataBuffer, &session->recvedDataLen, NULL, 
-                                                     (const unsigned char *)encryptedData, recvLength, (uint8_t *)&packageLength, 2,  
-                                                     (uint8_t *)(&session->inputSeqNo), (const unsigned char *)session->InputKey);
+OSStatus HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len, size_t *outLen)
+{
+  OSStatus    err = kNoErr;
+  ssize_t     length;
+  size_t      returnLength = 0;
+  size_t      frameLen, n;
+  uint8_t     *frame;
+
+  *outLen = 0;
+  if(session->established == false){
+    require_action_quiet( session->canRead, exit, err = EWOULDBLOCK );
+    session->canRead = false;
+    length = read( sockfd, buf, len );
+    require_action( length > 0, exit, err = kConnectionErr );
+    *outLen = (size_t)length;
+    goto exit;
+  }
 
-      session->inputSeqNo++;
+  // Refill only when everything decrypted has been returned. The partial
+  // frame left at the end, if any, is moved to the front first.
+  if( session->recvedDataLen == 0 ){
+    require_action_quiet( session->canRead, exit, err = EWOULDBLOCK );
+    session->canRead = false;
+    if( session->rxSealed ){
+      session->rxLen -= session->rxSealed;
+      if( session->rxLen )
+        memmove( session->rxBuffer, session->rxBuffer + session->rxSealed, session->rxLen );
+      session->rxSealed = 0;
+      session->rxFrame = 0;
+      session->rxFrameUsed = 0;
+    }
 
-      require_noerr(err, exit);
-      require(session->recvedDataLen == recvLength - crypto_aead_chacha20poly1305_ABYTES, exit);
-
-      free(encryptedData);
-      encryptedData = NULL;
-
-      returnLength += min(len, session->recvedDataLen);
-      memcpy(buf, session->recvedDataBuffer, returnLength);
-      session->recvedDataLen -= returnLength;
-      if(session->recvedDataLen)
-        memmove(session->recvedDataBuffer, session->recvedDataBuffer+returnLength, session->recvedDataLen);
-      else{
-        free(session->recvedDataBuffer);
-        session->recvedDataBuffer = NULL;
-      }
+    // Read ahead as much as fits, every frame completed by this read is decrypted now. A partial
+    // frame stays in rxBuffer until the socket is readable again.
+    length = read( sockfd, session->rxBuffer + session->rxLen, sizeof( session->rxBuffer ) - session->rxLen );
+    require_action( length > 0, exit, err = kConnectionErr );
+    session->rxLen += length;
 
-      goto exit;
+    err = _HKSecureOpenFrames( session );
+    require_noerr( err, exit );
+    require_action_quiet( session->recvedDataLen > 0, exit, err = EWOULDBLOCK );
+  }
 
+  while( returnLength < len && session->recvedDataLen ){
+    frame = session->rxBuffer + session->rxFrame;
+    frameLen = frame[0] | ( (size_t)frame[1] << 8 );
+    n = min( len - returnLength, frameLen - session->rxFrameUsed );
+    memcpy( (uint8_t *)buf + returnLength, frame + 2 + session->rxFrameUsed, n );
+    returnLength += n;
+    session->recvedDataLen -= n;
+    session->rxFrameUsed += n;
+    if( session->rxFrameUsed == frameLen ){
+      session->rxFrame += frameLen + kHKSecureFrameOverhead;
+      session->rxFrameUsed = 0;
     }
+  }
+  *outLen = returnLength;
 
-    exit:
-      if(err == kNoErr)
-        return returnLength;
-      else{
-        if(encryptedData) free(encryptedData);
-        if(session->recvedDataBuffer) {
-          free(session->recvedDataBuffer);
-          session->recvedDataBuffer = NULL;
-        }
-        return 0;
-      }
+exit:
+  if( err != kNoErr && err != EWOULDBLOCK && session->established ){
+    session->recvedDataLen = 0;
+    session->rxFrame = session->rxFrameUsed = session->rxSealed = session->rxLen = 0;
   }
-  else
-    return read( sockfd, buf, len);
+  return err;
 }
 
 
@@ -191,16 +230,31 @@ int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session
   char *          lim;
   char *          end;
   ssize_t          len;
-  ssize_t         n;
+  size_t          n;
   const char *    value;
   size_t          valueSize;
+  size_t          bufferLen;
   
   
   buf = inHeader->buf;
   dst = buf + inHeader->len;
   lim = buf + sizeof( inHeader->buf );
+
+  /* HTTPHeaderClear could not keep the data pipelined behind the last request */
+  if( inHeader->firstErr != kNoErr ){
+    err = inHeader->firstErr;
+    inHeader->firstErr = kNoErr;
+    goto exit;
+  }
+
   for( ;; )
   {
+    // Only the bytes appended since the last read are parsed, nothing is rescanned.
+    err = HTTPHeaderParseIncremental( inHeader, &end );
+    if( err == kNoErr ) break;
+    require( err == kInProgressErr, exit );
+    require_action( dst < lim, exit, err = kNoSpaceErr );
+    
     // If there's data from a previous read, move it to the front to search it first.
     len = inHeader->extraDataLen;
     if( len > 0 )
@@ -211,20 +265,17 @@ int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session
     }
     else
     {
-      n = HKSecureRead( session, inSock, dst, (size_t)( lim - dst ) );
-      if(      n  > 0 ) len = (size_t) n;
-      else  { err = kConnectionErr; goto exit; }
+      // Reads the socket once per wakeup, then only what is already decrypted, so a partial
+      // header returns EWOULDBLOCK instead of blocking the server.
+      err = HKSecureRead( session, inSock, dst, (size_t)( lim - dst ), &n );
+      require_noerr_quiet( err, exit );
+      len = (ssize_t) n;
     }
     dst += len;
     inHeader->len += len;
-    
-    if(findHeader( inHeader,  &end ))
-      break ;
   }
   
   inHeader->len = (size_t)( end - buf );
-  err = HTTPHeaderParse( inHeader );
-  require_noerr( err, exit );
   inHeader->extraDataLen = (size_t)( dst - end );
   if(inHeader->extraDataPtr) {
     free((uint8_t *)inHeader->extraDataPtr);
@@ -236,20 +287,33 @@ int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session
     inHeader->otaDataPtr = 0;
   }
   
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPHeaderGetField( inHeader, "Content-Type", &value, &valueSize );
   
   if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
     hkhttp_utils_log("Receive OTA data!");        
     err = MicoFlashInitialize(MICO_FLASH_FOR_UPDATE);
     require_noerr(err, exit);
-    err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)end, inHeader->extraDataLen);
+    err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)end, min(inHeader->extraDataLen, inHeader->contentLength));
     require_noerr(err, exit);
+    /* The body goes to flash, only data pipelined behind it is kept */
+    bufferLen = ( inHeader->extraDataLen > inHeader->contentLength ) ? inHeader->extraDataLen : 0;
+  }else if(inHeader->contentLength > 0 && HTTPHeaderIsJsonBody(inHeader)){
+    /* JSON body is parsed as it arrives, extraDataPtr is only a small read buffer */
+    err = HTTPHeaderJsonBodyInput(inHeader, 0, (uint8_t *)end, min(inHeader->extraDataLen, inHeader->contentLength));
+    require_noerr(err, exit);
+    inHeader->isCallbackSupported = true;
+    bufferLen = max(kHKJsonBodyReadLength, inHeader->extraDataLen);
   }else{
-    inHeader->extraDataPtr = calloc(inHeader->contentLength, sizeof(uint8_t));
+    bufferLen = max(inHeader->contentLength, inHeader->extraDataLen);
+  }
+
+  /* Data pipelined behind the body stays at its offset in extraDataPtr, HTTPHeaderClear moves it back to buf */
+  if(bufferLen > 0){
+    inHeader->extraDataPtr = calloc(bufferLen, sizeof(uint8_t));
     require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
     memcpy((uint8_t *)inHeader->extraDataPtr, end, inHeader->extraDataLen);
-    err = kNoErr;
   }
+  err = kNoErr;
   
 exit:   
   return err;
@@ -260,9 +324,7 @@ exit:
 int HKSocketReadHTTPBody  ( int inSock, HTTPHeader_t *inHeader, security_session_t *session )
 {
   OSStatus err = kParamErr;
-  ssize_t readResult;
-  int selectResult;
-  fd_set readSet;
+  size_t readResult;
   const char *    value;
   size_t          valueSize;
   
@@ -271,46 +333,47 @@ int HKSocketReadHTTPBody  ( int inSock, HTTPHeader_t *inHeader, security_session
   err = kNotReadableErr;
   
   
+  // Reads what has arrived and returns EWOULDBLOCK, the reactor calls again with the progress
+  // kept in extraDataLen when the socket is readable, so a slow body never blocks other sessions.
   while ( inHeader->extraDataLen < inHeader->contentLength )
   {
-    if(session->recvedDataLen == 0){
-      FD_ZERO( &readSet );
-      FD_SET( inSock, &readSet );
-      selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-      require( selectResult >= 1, exit );      
-    }
-    
-    err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+    err = HTTPHeaderGetField( inHeader, "Content-Type", &value, &valueSize );
     require_noerr(err, exit);
     if( strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0 ){
       inHeader->otaDataPtr = calloc(OTA_Data_Length_per_read, sizeof(uint8_t)); 
       require_action(inHeader->otaDataPtr, exit, err = kNoMemoryErr);
       if((inHeader->contentLength - inHeader->extraDataLen)<OTA_Data_Length_per_read){
-        readResult = HKSecureRead(  session, inSock,
-                                    (uint8_t*)( inHeader->otaDataPtr ),
-                                    ( inHeader->contentLength - inHeader->extraDataLen ) );
+        err = HKSecureRead( session, inSock,
+                            (uint8_t*)( inHeader->otaDataPtr ),
+                            ( inHeader->contentLength - inHeader->extraDataLen ), &readResult );
       }else{
-        readResult = HKSecureRead(  session, inSock,
-                                    (uint8_t*)( inHeader->otaDataPtr ),
-                                    OTA_Data_Length_per_read);
+        err = HKSecureRead( session, inSock,
+                            (uint8_t*)( inHeader->otaDataPtr ),
+                            OTA_Data_Length_per_read, &readResult );
       }
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else  { err = kConnectionErr; goto exit; }
+      require_noerr_quiet( err, exit );
+      inHeader->extraDataLen += readResult;
       
       err = MicoFlashWrite(MICO_FLASH_FOR_UPDATE, &flashStorageAddress, (uint8_t *)inHeader->otaDataPtr, readResult);
       require_noerr(err, exit);
       
       free(inHeader->otaDataPtr);
       inHeader->otaDataPtr = 0;
+    }else if(inHeader->isCallbackSupported == true){
+      err = HKSecureRead( session, inSock,
+                          (uint8_t*)( inHeader->extraDataPtr ),
+                          min( inHeader->contentLength - inHeader->extraDataLen, kHKJsonBodyReadLength ), &readResult );
+      require_noerr_quiet( err, exit );
+      inHeader->extraDataLen += readResult;
+
+      err = HTTPHeaderJsonBodyInput( inHeader, inHeader->extraDataLen - readResult, (uint8_t *)inHeader->extraDataPtr, readResult );
+      require_noerr(err, exit);
     }else{
-      readResult = HKSecureRead( session, inSock,
-                                (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
-                                ( inHeader->contentLength - inHeader->extraDataLen ) );
-      
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else if( readResult == 0 ) { err = kConnectionErr; goto exit; }
-      else goto exit;
+      err = HKSecureRead( session, inSock,
+                          (uint8_t*)( inHeader->extraDataPtr + inHeader->extraDataLen ),
+                          ( inHeader->contentLength - inHeader->extraDataLen ), &readResult );
+      require_noerr_quiet( err, exit );
+      inHeader->extraDataLen += readResult;
     }
   }
   
@@ -327,36 +390,27 @@ exit:
 OSStatus HKSendResponseMessage(int sockfd, int status, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
-  const char *buffer = NULL;
-  int bufferLen;
-
-  buffer = (const char *)payload;
-  bufferLen = payloadLen;
-
-  err = CreateHTTPRespondMessageNoCopy( status, kMIMEType_HAP_JSON, bufferLen, &httpResponse, &httpResponseLen );
+  HTTPWriter_t writer;
 
+  err = HTTPWriterBeginResponse( &writer, sockfd, status, kMIMEType_HAP_JSON, payloadLen );
   require_noerr( err, exit );
-  require( httpResponse, exit );
+  writer.sendv = HKSecureSocketSendv;
+  writer.sendContext = session;
 
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  err = HTTPWriterWrite( &writer, payload, payloadLen );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
-  }
+  err = HTTPWriterEnd( &writer );
 
 exit:
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
 OSStatus HKSendNotifyMessage( int sockfd, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
+  char httpResponse[ kHTTPWriterHeaderMax ];
   size_t httpResponseLen = 0;
+  SocketIOVec_t vec[2];
   const char *buffer = NULL;
   int bufferLen;
   require_action( session->established == true, exit, err = kAuthenticationErr );
@@ -366,33 +420,29 @@ OSStatus HKSendNotifyMessage( int sockfd, uint8_t *payload, int payloadLen, secu
   
   require( bufferLen >= 0, exit );
   
-  err = kNoMemoryErr;
-  httpResponse = malloc( 200 );
-  require( httpResponse, exit );
-  
   // Create HTTP Response
   if(bufferLen)
-    snprintf( (char *)httpResponse, 200, 
+    snprintf( httpResponse, sizeof(httpResponse), 
             "%s %d %s%s%s %s%s%s %d%s",
             "EVENT/1.0", 200, "OK", kCRLFNewLine, 
             "Content-Type:", kMIMEType_HAP_JSON, kCRLFNewLine,
             "Content-Length:", (int)payloadLen, kCRLFLineEnding );
   else
-    snprintf( (char *)httpResponse, 200, 
+    snprintf( httpResponse, sizeof(httpResponse), 
         "%s %d %s%s",
         "EVENT/1.0", 200, "OK", kCRLFLineEnding);
   
-  httpResponseLen = strlen( (char*)httpResponse );
-
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  httpResponseLen = strlen( httpResponse );
+
+  // Header and body go out together, in one frame when they fit.
+  vec[0].base = (const uint8_t *)httpResponse;
+  vec[0].len = httpResponseLen;
+  vec[1].base = (const uint8_t *)buffer;
+  vec[1].len = bufferLen;
+  err = HKSecureSocketSendv( sockfd, vec, 2, session );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
-  }
 
 exit:
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
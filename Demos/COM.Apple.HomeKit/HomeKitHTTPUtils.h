@@ -28,23 +28,55 @@
 
 #include "HTTPUtils.h"
 
+#define kMIMEType_HAP_JSON   "application/hap+json"
+
+/* A secured HAP frame is a 2-byte little endian length, up to 1024 bytes of
+   ciphertext and a 16-byte Poly1305 tag. */
+#define kHKSecureFrameLengthMax   1024
+#define kHKSecureFrameOverhead    ( 2 + 16 )
+#define kHKSecureFrameSizeMax     ( kHKSecureFrameLengthMax + kHKSecureFrameOverhead )
+
+/* Number of full frames the per-session buffers hold. RX reads ahead up to
+   kHKSecureRxFrames frames per read(), TX sends up to kHKSecureTxFrames
+   frames per send. */
+#if( !defined( kHKSecureRxFrames ) )
+  #define kHKSecureRxFrames       2
+#endif
+
+#if( !defined( kHKSecureTxFrames ) )
+  #define kHKSecureTxFrames       2
+#endif
+
 typedef struct _security_session_t {
   bool          established;
+  bool          canRead;            // The socket is readable and was not read since, HKSecureRead reads it once.
   char          controllerIdentifier[64];
   uint8_t       OutputKey[32];
   uint8_t       InputKey[32];
-  uint64_t      recvedDataLen;
-  uint8_t*      recvedDataBuffer;
   uint64_t      outputSeqNo;
   uint64_t      inputSeqNo;
+  size_t        recvedDataLen;      // Decrypted bytes in rxBuffer not returned by HKSecureRead yet.
+  size_t        rxFrame;            // Offset of the decrypted frame HKSecureRead is returning.
+  size_t        rxFrameUsed;        // Bytes of that frame already returned.
+  size_t        rxSealed;           // Offset of the first frame not decrypted yet.
+  size_t        rxLen;              // Bytes received into rxBuffer.
+  uint8_t       rxBuffer[kHKSecureRxFrames * kHKSecureFrameSizeMax];
+  uint8_t       txBuffer[kHKSecureTxFrames * kHKSecureFrameSizeMax];
 } security_session_t;
 
 security_session_t *HKSNewSecuritySession(void);
 
 int HKSecureSocketSend( int sockfd, void *buf, size_t len, security_session_t *session);
 
-int HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len);
+OSStatus HKSecureSocketSendv( int sockfd, const SocketIOVec_t *inVec, int inVecCount, void *inContext );
+
+/* Returns up to len bytes of (decrypted) data. The socket is read at most once
+   per canRead, EWOULDBLOCK is returned when that read does not complete a
+   frame, kConnectionErr when the peer closed the connection. */
+OSStatus HKSecureRead(security_session_t *session, int sockfd, void *buf, size_t len, size_t *outLen);
 
+/* Both return EWOULDBLOCK when the data received so far is not enough, the
+   header or the body read so far is kept in inHeader for the next call. */
 int HKSocketReadHTTPHeader( int inSock, HTTPHeader_t *inHeader, security_session_t *session );
 
 int HKSocketReadHTTPBody  ( int inSock, HTTPHeader_t *inHeader, security_session_t *session );
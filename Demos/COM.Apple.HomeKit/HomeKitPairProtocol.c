@@ -21,6 +21,32 @@
 #define pair_log(M, ...) custom_log("HomeKitPair", M, ##__VA_ARGS__)
 #define pair_log_trace() custom_log_trace("HomeKitPair")
 
+#define kHKSRPSaltMaxLen                32
+#define kHKAccessoryIdentifierMaxLen    17      // MAC string: "XX:XX:XX:XX:XX:XX"
+
+/* Pair setup messages are built in buffers sized for the largest values they can carry */
+#define kHKPairSetupSubTLVMaxLen        ( kTLVHeaderLen + MaxControllerNameLen + kTLVHeaderLen + 32 + kTLVHeaderLen + 64 )
+#define kHKPairSetupM2MaxLen            ( kTLVHeaderLen + 1 + kTLVHeaderLen + kHKSRPSaltMaxLen + 2 * kTLVHeaderLen + kHKSRPPublicKeyMaxLen )
+#define kHKPairSetupM4MaxLen            ( kTLVHeaderLen + 1 + kTLVHeaderLen + 64 )
+#define kHKPairSetupM6MaxLen            ( kTLVHeaderLen + 1 + kTLVHeaderLen + kHKPairSetupSubTLVMaxLen + crypto_aead_chacha20poly1305_ABYTES )
+
+/* Pair setup M5/M6 work on the HomeKit reactor stack, so their buffers live on the heap */
+typedef struct
+{
+  uint8_t decryptedData[ kHKPairSetupSubTLVMaxLen ];
+  char    controllerIdentifier[ MaxControllerNameLen ];
+  /* Signature, HKDF, identifier and LTPK, as crypto_sign_open expects them */
+  uint8_t signature[ crypto_sign_BYTES + 32 + MaxControllerNameLen + crypto_sign_PUBLICKEYBYTES ];
+} HKPairSetupM5Buffers_t;
+
+typedef struct
+{
+  uint8_t outTLVResponse[ kHKPairSetupM6MaxLen ];
+  uint8_t subTLVBuffer[ kHKPairSetupSubTLVMaxLen ];
+  uint8_t XYZ[ 32 + kHKAccessoryIdentifierMaxLen + 32 ];
+  uint8_t signature[ crypto_sign_BYTES + 32 + kHKAccessoryIdentifierMaxLen + 32 ];
+} HKPairSetupM6Buffers_t;
+
 typedef enum
 {
   eState_M1_VerifyStartRequest      = 1,
@@ -89,6 +115,27 @@ static size_t         _len_salt = 0;
 static HAPairSetupState_t haPairSetupState = eState_M1_SRPStartRequest;
 const char* hkSRPUser = "Pair-Setup";
 
+/* hkdf() keeps an HMACContext (two SHA-512 contexts) on the stack, and hkdfExpandContext()
+   clones another one: keep the PRK context on the heap instead */
+static OSStatus _HKDF_SHA512( const char *salt, const uint8_t *ikm, int ikmLen, const char *info, uint8_t *okm, int okmLen )
+{
+  OSStatus err;
+  HMACContext *prkContext = malloc( sizeof(HMACContext) );
+  require_action( prkContext, exit, err = kNoMemoryErr );
+
+  err = hkdfExtractContext( prkContext, SHA512, (const unsigned char *)salt, strlen(salt), ikm, ikmLen );
+  require_noerr( err, exit );
+  err = hkdfExpandContext( prkContext, (const unsigned char *)info, strlen(info), okm, okmLen );
+  require_noerr( err, exit );
+
+exit:
+  if( prkContext ){
+    memset( prkContext, 0x0, sizeof(HMACContext) );
+    free( prkContext );
+  }
+  return err;
+}
+
 OSStatus _HandleState_WaitingForSRPStartRequest( HTTPHeader_t* inHeader, pairInfo_t** inInfo, mico_Context_t * const inContext );
 OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_Context_t * const inContext);
 OSStatus _HandleState_WaitingForSRPVerifyRequest(HTTPHeader_t* inHeader, pairInfo_t* inInfo, mico_Context_t * const inContext );
@@ -126,9 +173,6 @@ void HKCleanPairSetupInfo(pairInfo_t **info, mico_Context_t * const inContext){
       
     srp_server_delete(&(*info)->SRPServer );
     //if((*info)->SRPUser) free((*info)->SRPUser);
-    if((*info)->SRPControllerPublicKey) free((*info)->SRPControllerPublicKey);
-    if((*info)->SRPControllerProof) free((*info)->SRPControllerProof);
-    if((*info)->HKDF_Key) free((*info)->HKDF_Key);
     free((*info));   
     *info = 0; 
   }
@@ -164,45 +208,27 @@ OSStatus HKPairSetupEngine( int inFd, HTTPHeader_t* inHeader, pairInfo_t** inInf
 {
   OSStatus err = kNoErr;
 
-  uint8_t *outTLVResponse = NULL;
-  size_t outTLVResponseLen = 0;
-  uint8_t *tlvPtr;
+  uint8_t outTLVResponse[ 2 * ( kTLVHeaderLen + sizeof(uint8_t) ) ];
+  TLVWriter_t tlv;
 
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
 
 
   if(pairErrorNum>=10){
-    outTLVResponse = NULL;
-
-    /* Build tlv: state and encrypted data */
-    outTLVResponseLen = 0;
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
-
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_State;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = eState_M2_SRPStartRespond;
-
-    *tlvPtr++ = kTLVType_Error;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = kTLVError_MaxTries;
+    /* Build tlv: state and error */
+    TLVWriterInit( &tlv, outTLVResponse, sizeof(outTLVResponse) );
+    TLVWriterAppendUInt8( &tlv, kTLVType_State, eState_M2_SRPStartRespond );
+    TLVWriterAppendUInt8( &tlv, kTLVType_Error, kTLVError_MaxTries );
 
     haPairSetupState = eState_M1_SRPStartRequest;
 
-    err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend( inFd, httpResponse, httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+    err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, tlv.buf, tlv.len );
     require_noerr( err, exit );
     goto exit;
   }
 
+  /* M3 and M5 continue the pair setup of the session that sent M1, refuse them from any other session */
+  require_action( haPairSetupState == eState_M1_SRPStartRequest || *inInfo, exit, err = kStateErr );
+
   switch ( haPairSetupState ){
     case eState_M1_SRPStartRequest:
       err = _HandleState_WaitingForSRPStartRequest( inHeader, inInfo, inContext );
@@ -245,11 +271,8 @@ OSStatus _HandleState_WaitingForSRPStartRequest( HTTPHeader_t* inHeader, pairInf
 {
   pair_log_trace();
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t * const       end = src + inHeader->extraDataLen;
-  uint8_t                     eid;
-  const uint8_t *             ptr;
-  size_t                      len;
-  char *                      tmp;
+  const uint8_t * const       end = src + inHeader->contentLength;
+  TLVItem_t                   item;
 
   OSStatus err = kNoErr;
 
@@ -266,24 +289,17 @@ OSStatus _HandleState_WaitingForSRPStartRequest( HTTPHeader_t* inHeader, pairInf
   require_action(*inInfo, exit, err = kNoMemoryErr);
   inContext->appStatus.haPairSetupRunning = true;
 
-  while( TLVGetNext( src, end, &eid, &ptr, &len, &src ) == kNoErr )
+  while( TLVGetNextItem( src, end, &item, &src ) == kNoErr )
   {
-    tmp = calloc( len + 1, sizeof( uint8_t ) );
-    require_action( tmp, exit, err = kNoMemoryErr );
-    memcpy( tmp, ptr, len );
-
-    switch( eid )
+    switch( item.type )
     {
       case kTLVType_State:
-        require_action(haPairSetupState == *(uint8_t *)tmp, exit, err = kStateErr);
-        free(tmp);
-      break;
-        case kTLVType_Method:
-        free(tmp);
+        require_action(item.len == sizeof(uint8_t) && haPairSetupState == item.data[0], exit, err = kStateErr);
+        break;
+      case kTLVType_Method:
         break;
       default:
-        free( tmp );
-        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", eid );
+        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", item.type );
         break;
     }
   }
@@ -299,13 +315,9 @@ OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_C
 {
   pair_log_trace();
   OSStatus err;
-  int i, j;
   uint8_t *outTLVResponse = NULL;
-  size_t outTLVResponseLen = 0;
-  uint8_t *tlvPtr;
+  TLVWriter_t tlv;
   char *tempString = NULL;
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
 
   require_action(_verifier||_password, exit, err = kParamErr);
   inInfo->SRPServer = srp_server_setup( SRP_SHA512, SRP_NG_3072, inInfo->SRPUser, 
@@ -326,54 +338,30 @@ OSStatus _HandleState_HandleSRPStartRespond(int inFd, pairInfo_t* inInfo, mico_C
   free(tempString);
 #endif
 
-  outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-  for(i = inInfo->SRPServer->len_B/kHATLV_MaxStringSize; i>0; i--)
-    outTLVResponseLen += kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
-  outTLVResponseLen += inInfo->SRPServer->len_B%kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
-  outTLVResponseLen += inInfo->SRPServer->len_s + kHATLV_TypeLengthSize;
-
-  outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
+  outTLVResponse = malloc( kHKPairSetupM2MaxLen );
   require_action( outTLVResponse, exit, err = kNoMemoryErr );
-
-  tlvPtr = outTLVResponse;
+  TLVWriterInit( &tlv, outTLVResponse, kHKPairSetupM2MaxLen );
 
   /* Send pair state - M2 */
-  *tlvPtr++ = kTLVType_State;
-  *tlvPtr++ = sizeof(uint8_t);
-  *tlvPtr++ = (uint8_t)eState_M2_SRPStartRespond;
+  err = TLVWriterAppendUInt8( &tlv, kTLVType_State, eState_M2_SRPStartRespond );
+  require_noerr( err, exit );
   
   /* Send 16+ bytes of random salt */
-  *tlvPtr++ = kTLVType_Salt;
-  *tlvPtr++ = inInfo->SRPServer->len_s;
-  memcpy( tlvPtr, inInfo->SRPServer->bytes_s, inInfo->SRPServer->len_s );
-  tlvPtr += inInfo->SRPServer->len_s;
-
-  /* Send accessory's SRP public key */
-  j = inInfo->SRPServer->len_B/kHATLV_MaxStringSize;
-  for(i = 0; i < j; i++){
-    *tlvPtr++ = kTLVType_PublicKey;
-    *tlvPtr++ = kHATLV_MaxStringSize;
-    memcpy( tlvPtr, inInfo->SRPServer->bytes_B+i*kHATLV_MaxStringSize, kHATLV_MaxStringSize );
-    tlvPtr += kHATLV_MaxStringSize;
-  }
-  *tlvPtr++ = kTLVType_PublicKey;
-  *tlvPtr++ = inInfo->SRPServer->len_B%kHATLV_MaxStringSize;
-  memcpy( tlvPtr, inInfo->SRPServer->bytes_B+kHATLV_MaxStringSize*j, inInfo->SRPServer->len_B%kHATLV_MaxStringSize );
-  tlvPtr += inInfo->SRPServer->len_B%kHATLV_MaxStringSize;
-  
-  /* Send */
-  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
+  err = TLVWriterAppend( &tlv, kTLVType_Salt, inInfo->SRPServer->bytes_s, inInfo->SRPServer->len_s );
   require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
+
+  /* Send accessory's SRP public key, split into fragments by the writer */
+  err = TLVWriterAppend( &tlv, kTLVType_PublicKey, inInfo->SRPServer->bytes_B, inInfo->SRPServer->len_B );
   require_noerr( err, exit );
-  err = SocketSend( inFd, outTLVResponse, outTLVResponseLen );
+  
+  /* Send */
+  err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, tlv.buf, tlv.len );
   require_noerr( err, exit );
 
   haPairSetupState = eState_M3_SRPVerifyRequest;
 
 exit:
   if(outTLVResponse) free(outTLVResponse);
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
@@ -381,53 +369,30 @@ OSStatus _HandleState_WaitingForSRPVerifyRequest( HTTPHeader_t* inHeader, pairIn
 {
   pair_log_trace();
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t * const       end = src + inHeader->extraDataLen;
-  uint8_t                     eid;
-  const uint8_t *             ptr;
-  size_t                      len;
-  char *                      tmp;
+  const uint8_t * const       end = src + inHeader->contentLength;
+  TLVItem_t                   item;
   OSStatus err = kNoErr;
 
-  while( TLVGetNext( src, end, &eid, &ptr, &len, &src ) == kNoErr )
+  while( TLVGetNextItem( src, end, &item, &src ) == kNoErr )
   {
 
-    switch( eid )
+    switch( item.type )
     {
       case kTLVType_State:
-        tmp = calloc( len, sizeof( uint8_t ) );
-        require_action( tmp, exit, err = kNoMemoryErr );
-        memcpy( tmp, ptr, len );
-        require_action(haPairSetupState == *(uint8_t *)tmp, exit, err = kStateErr);
-        free(tmp);
-      break;
-        case kTLVType_PublicKey:
-        if(inInfo->SRPControllerPublicKey == NULL){
-          inInfo->SRPControllerPublicKey = calloc( len, sizeof( uint8_t ) );
-          require_action( inInfo->SRPControllerPublicKey, exit, err = kNoMemoryErr );
-          memcpy( inInfo->SRPControllerPublicKey, ptr, len );
-          inInfo->SRPControllerPublicKeyLen = len;
-        }else{
-          inInfo->SRPControllerPublicKey = realloc( inInfo->SRPControllerPublicKey, inInfo->SRPControllerPublicKeyLen+len );
-          require_action( inInfo->SRPControllerPublicKey, exit, err = kNoMemoryErr );
-          memcpy( inInfo->SRPControllerPublicKey+inInfo->SRPControllerPublicKeyLen, ptr, len );
-          inInfo->SRPControllerPublicKeyLen += len;
-        }
+        require_action(item.len == sizeof(uint8_t) && haPairSetupState == item.data[0], exit, err = kStateErr);
+        break;
+      case kTLVType_PublicKey:
+        err = TLVItemCopyData( &item, inInfo->SRPControllerPublicKey, sizeof(inInfo->SRPControllerPublicKey) );
+        require_noerr( err, exit );
+        inInfo->SRPControllerPublicKeyLen = item.len;
         break;
       case kTLVType_Proof:
-        if(inInfo->SRPControllerProof == NULL){
-          inInfo->SRPControllerProof = calloc( len, sizeof( uint8_t ) );
-          require_action( inInfo->SRPControllerProof, exit, err = kNoMemoryErr );
-          memcpy( inInfo->SRPControllerProof, ptr, len );
-          inInfo->SRPControllerProofLen = len;
-        }else{
-          inInfo->SRPControllerProof = realloc( inInfo->SRPControllerProof, inInfo->SRPControllerProofLen+len );
-          require_action( inInfo->SRPControllerProof, exit, err = kNoMemoryErr );
-          memcpy( inInfo->SRPControllerProof+inInfo->SRPControllerProofLen, ptr, len );
-          inInfo->SRPControllerProofLen += len;
-        }
+        err = TLVItemCopyData( &item, inInfo->SRPControllerProof, sizeof(inInfo->SRPControllerProof) );
+        require_noerr( err, exit );
+        inInfo->SRPControllerProofLen = item.len;
         break;
       default:
-        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", eid );
+        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", item.type );
         break;
     }
   }
@@ -445,9 +410,12 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
 {
   pair_log_trace();
   OSStatus err = kNoErr;
-  uint8_t *outTLVResponse = NULL;
-  size_t outTLVResponseLen = 0;
-  uint8_t *tlvPtr;
+  uint8_t outTLVBuffer[ kHKPairSetupM4MaxLen ];
+  uint8_t *outTLVResponse = outTLVBuffer;
+  size_t outTLVResponseLen = sizeof(outTLVBuffer);
+  TLVWriter_t tlv;
+  TLVWriter_t subTLV;
+  size_t subTLVLen = 0;
   uint8_t signMFiChallenge[32];
   uint8_t signMFiChallengeSHA[20];
   SHA_CTX ctx;
@@ -456,11 +424,8 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
   uint8_t *outCertificatePtr = NULL;
   size_t outCertificateLen;
   uint8_t *encryptedData = NULL;
-  unsigned long long encryptedDataLen;
-  int i, j;
+  unsigned long long encryptedDataLen = 0;
 
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
 
   const uint8_t * bytes_HAMK = 0;
 
@@ -471,30 +436,16 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
   srp_server_verify_session( inInfo->SRPServer,  inInfo->SRPControllerProof,  &bytes_HAMK );
 
   if ( !bytes_HAMK ){
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
-
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_State;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = eState_M4_SRPVerifyRespond;
-
-    *tlvPtr++ = kTLVType_Error;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = kTLVError_Authentication;
+    TLVWriterInit( &tlv, outTLVResponse, outTLVResponseLen );
+    TLVWriterAppendUInt8( &tlv, kTLVType_State, eState_M4_SRPVerifyRespond );
+    TLVWriterAppendUInt8( &tlv, kTLVType_Error, kTLVError_Authentication );
     pair_log("Send: kTLVType_Error: 0x%x", kTLVError_Authentication);
     haPairSetupState = eState_M1_SRPStartRequest;
   }
   else{
     /* Generate session key */
-    inInfo->HKDF_Key = malloc(32);
-    require_action(inInfo->HKDF_Key, exit, err = kNoMemoryErr);
-    err = hkdf(SHA512,  (const unsigned char *)hkdfSetupSalt, strlen(hkdfSetupSalt),
-                        inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
-                        (const unsigned char *)hkdfSetupInfo, strlen(hkdfSetupInfo), inInfo->HKDF_Key, 32);
+    err = _HKDF_SHA512( hkdfSetupSalt, inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
+                        hkdfSetupInfo, inInfo->HKDF_Key, 32 );
     require_noerr(err, exit);
 
 
@@ -502,9 +453,8 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
       err = MicoMFiAuthInitialize( MICO_I2C_CP );
       require_noerr(err, exit);
 
-      err = hkdf(SHA512,  (const unsigned char *)hkdfMFiSalt, strlen(hkdfMFiSalt),
-                          inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
-                          (const unsigned char *)hkdfMFiInfo, strlen(hkdfMFiInfo), signMFiChallenge, 32);
+      err = _HKDF_SHA512( hkdfMFiSalt, inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
+                          hkdfMFiInfo, signMFiChallenge, 32 );
       require_noerr(err, exit);  
       SHA1_Init( &ctx );
       SHA1_Update( &ctx, signMFiChallenge, 32 );
@@ -516,100 +466,54 @@ OSStatus _HandleState_HandleSRPVerifyRespond(int inFd, pairInfo_t* inInfo, mico_
       err = MicoMFiAuthCopyCertificate( &outCertificatePtr, &outCertificateLen );
       require_noerr(err, exit);
 
-      /* Build MFi sub-TLV */
-      outTLVResponseLen = 0;
-      outTLVResponseLen += MFiProofLen + kHATLV_TypeLengthSize;
-      for(i = outCertificateLen/kHATLV_MaxStringSize; i>0; i--)
-        outTLVResponseLen += kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
-      outTLVResponseLen += outCertificateLen%kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
+      /* The certificate size is only known now: size the response once and
+         keep the plain sub-TLV behind it in the same buffer */
+      subTLVLen = TLVSizeOf( MFiProofLen ) + TLVSizeOf( outCertificateLen );
+      encryptedDataLen = subTLVLen + crypto_aead_chacha20poly1305_ABYTES;
+      outTLVResponseLen = TLVSizeOf( sizeof(uint8_t) ) + TLVSizeOf( inInfo->SRPServer->len_AMK ) + TLVSizeOf( encryptedDataLen );
 
-      outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
+      outTLVResponse = malloc( outTLVResponseLen + subTLVLen );
       require_action( outTLVResponse, exit, err = kNoMemoryErr );
 
-      tlvPtr = outTLVResponse;
-      *tlvPtr++ = kTLVType_Signature;
-      *tlvPtr++ = MFiProofLen;
-      memcpy(tlvPtr, MFiProof, MFiProofLen);
-      tlvPtr+= MFiProofLen;
-
-      j = outCertificateLen/kHATLV_MaxStringSize;
-      for(i = 0; i < j; i++){
-        *tlvPtr++ = kTLVType_Certificate;
-        *tlvPtr++ = kHATLV_MaxStringSize;
-        memcpy( tlvPtr, outCertificatePtr+i*kHATLV_MaxStringSize, kHATLV_MaxStringSize );
-        tlvPtr += kHATLV_MaxStringSize;
-      }
-
-      *tlvPtr++ = kTLVType_Certificate;
-      *tlvPtr++ = outCertificateLen%kHATLV_MaxStringSize;
-      memcpy( tlvPtr, outCertificatePtr+kHATLV_MaxStringSize*j, outCertificateLen%kHATLV_MaxStringSize );
-      tlvPtr += outCertificateLen%kHATLV_MaxStringSize;  
-  
-      encryptedData = calloc(outTLVResponseLen + 16, sizeof(uint8_t));
-      require_action(encryptedData, exit, err = kNoMemoryErr);
-
-      err =  crypto_aead_chacha20poly1305_encrypt(encryptedData, &encryptedDataLen, outTLVResponse, outTLVResponseLen,
-                                                  NULL, 0, NULL, (const unsigned char *)AEAD_Nonce_Setup04,
-                                                  (const unsigned char *)inInfo->HKDF_Key);
-
-      require_noerr_action(err, exit, pair_log("crypto_aead_chacha20poly1305_encrypt failed"));
-      require_action(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == outTLVResponseLen, exit, pair_log("encryptedDataLen is not properly set"));
-      free(outTLVResponse);
-      outTLVResponse = NULL;      
-
+      /* Build MFi sub-TLV */
+      TLVWriterInit( &subTLV, outTLVResponse + outTLVResponseLen, subTLVLen );
+      err = TLVWriterAppend( &subTLV, kTLVType_Signature, MFiProof, MFiProofLen );
+      require_noerr( err, exit );
+      err = TLVWriterAppend( &subTLV, kTLVType_Certificate, outCertificatePtr, outCertificateLen );
+      require_noerr( err, exit );
     }
 
-    outTLVResponseLen = 0;
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-    outTLVResponseLen += inInfo->SRPServer->len_AMK + kHATLV_TypeLengthSize;
-    if(inContext->appStatus.useMFiAuth == true){
-      for(i = encryptedDataLen/kHATLV_MaxStringSize; i>0; i--)
-        outTLVResponseLen += kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
-      outTLVResponseLen += encryptedDataLen%kHATLV_MaxStringSize + kHATLV_TypeLengthSize;
-    }
+    TLVWriterInit( &tlv, outTLVResponse, outTLVResponseLen );
+    err = TLVWriterAppendUInt8( &tlv, kTLVType_State, eState_M4_SRPVerifyRespond );
+    require_noerr( err, exit );
 
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
+    err = TLVWriterAppend( &tlv, kTLVType_Proof, bytes_HAMK, inInfo->SRPServer->len_AMK );
+    require_noerr( err, exit );
 
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_State;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = eState_M4_SRPVerifyRespond;
+    if(inContext->appStatus.useMFiAuth == true){
+      /* Encrypt straight into the response, the writer inserts the fragment headers afterwards */
+      encryptedData = TLVWriterReserve( &tlv, encryptedDataLen );
+      require_action( encryptedData, exit, err = kSizeErr );
 
-    *tlvPtr++ = kTLVType_Proof;
-    *tlvPtr++ = inInfo->SRPServer->len_AMK;
-    memcpy( tlvPtr, bytes_HAMK, inInfo->SRPServer->len_AMK );
-    tlvPtr += inInfo->SRPServer->len_AMK;
+      err =  crypto_aead_chacha20poly1305_encrypt(encryptedData, &encryptedDataLen, subTLV.buf, subTLV.len,
+                                                  NULL, 0, NULL, (const unsigned char *)AEAD_Nonce_Setup04,
+                                                  (const unsigned char *)inInfo->HKDF_Key);
 
-    if(inContext->appStatus.useMFiAuth == true){
-      j = encryptedDataLen/kHATLV_MaxStringSize;
-      for(i = 0; i < j; i++){
-        *tlvPtr++ = kTLVType_EncryptedData;
-        *tlvPtr++ = kHATLV_MaxStringSize;
-        memcpy( tlvPtr, encryptedData+i*kHATLV_MaxStringSize, kHATLV_MaxStringSize );
-        tlvPtr += kHATLV_MaxStringSize;
-      }
+      require_noerr_action(err, exit, pair_log("crypto_aead_chacha20poly1305_encrypt failed"));
+      require_action(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == subTLV.len, exit, pair_log("encryptedDataLen is not properly set"));
 
-      *tlvPtr++ = kTLVType_EncryptedData;
-      *tlvPtr++ = encryptedDataLen%kHATLV_MaxStringSize;
-      memcpy( tlvPtr, encryptedData+kHATLV_MaxStringSize*j, encryptedDataLen%kHATLV_MaxStringSize );
-      tlvPtr += encryptedDataLen%kHATLV_MaxStringSize;
+      err = TLVWriterCommit( &tlv, kTLVType_EncryptedData, encryptedDataLen );
+      require_noerr( err, exit );
     }
 
     haPairSetupState = eState_M5_ExchangeRequest;
   }
 
-  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, tlv.buf, tlv.len );
   require_noerr( err, exit );
 
 exit:
-  if(outTLVResponse) free(outTLVResponse);
-  if(encryptedData) free(encryptedData);
-  if(httpResponse) free(httpResponse);
+  if(outTLVResponse != outTLVBuffer) free(outTLVResponse);
   if(MFiProof) free(MFiProof);
   if(outCertificatePtr) free(outCertificatePtr);
 
@@ -622,121 +526,104 @@ OSStatus _HandleState_WaitingForExchangeRequest( HTTPHeader_t* inHeader, pairInf
   pair_log_trace();
   UNUSED_PARAMETER(inContext);
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t *             end = src + inHeader->extraDataLen;
-  uint8_t                     eid;
-  const uint8_t *             ptr;
-  size_t                      len;
-  char *                      tmp;
+  const uint8_t *             end = src + inHeader->contentLength;
+  TLVItem_t                   item;
   OSStatus                    err = kNoErr;
-  unsigned char *             encryptedData = NULL;
-  unsigned long long          encryptedDataLen;
-  unsigned char *             authTag = NULL;
-
-  unsigned char *             decryptedData = NULL;
+  uint8_t *                   encryptedData = NULL;
+  size_t                      encryptedDataLen = 0;
+  HKPairSetupM5Buffers_t *    buf = NULL;
   unsigned long long          decryptedDataLen = 0;
-
-  char *                      controllerIdentifier = NULL;
   size_t                      controllerIdentifierLen = 0;
-  uint8_t *                   controllerLTPK = NULL;
+  uint8_t                     controllerLTPK[ crypto_sign_PUBLICKEYBYTES ];
+  size_t                      controllerLTPKLen = 0;
+  size_t                      signatureLen = 0;
 
-  uint8_t *                   signature = NULL;
-
-  uint8_t                     signHKDF[32];
-
-  pair_list_in_flash_t        *pairList = NULL;
-
-  while( TLVGetNext( src, end, &eid, &ptr, &len, &src ) == kNoErr )
+  while( TLVGetNextItem( src, end, &item, &src ) == kNoErr )
   {
 
-    switch( eid )
+    switch( item.type )
     {
       case kTLVType_State:
-        tmp = calloc( len, sizeof( uint8_t ) );
-        require_action( tmp, exit, err = kNoMemoryErr );
-        memcpy( tmp, ptr, len );
-        require_action(haPairSetupState == *(uint8_t *)tmp, exit, err = kStateErr);
-        free(tmp);
-      break;
+        require_action(item.len == sizeof(uint8_t) && haPairSetupState == item.data[0], exit, err = kStateErr);
+        break;
       case kTLVType_EncryptedData:
-        encryptedData = calloc( len, sizeof( uint8_t ) );
-        require_action( encryptedData, exit, err = kNoMemoryErr );
-        memcpy( encryptedData, ptr, len );
-        encryptedDataLen = len;
+        /* Join the fragments in place, over the item's own headers in the request body */
+        encryptedData = (uint8_t *)item.data - kTLVHeaderLen;
+        err = TLVItemCopyData( &item, encryptedData, item.len );
+        require_noerr( err, exit );
+        encryptedDataLen = item.len;
         break;
       default:
-        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", eid );
+        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", item.type );
         break;
     }
   }
 
-  decryptedData = malloc( encryptedDataLen-crypto_aead_chacha20poly1305_ABYTES );
-  require_action(decryptedData, exit, err = kNoMemoryErr);
-  err =  crypto_aead_chacha20poly1305_decrypt(decryptedData, &decryptedDataLen, NULL, 
+  require_action(encryptedData && encryptedDataLen > crypto_aead_chacha20poly1305_ABYTES, exit, err = kMalformedErr);
+  require_action(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES <= kHKPairSetupSubTLVMaxLen, exit, err = kSizeErr);
+
+  buf = malloc( sizeof(HKPairSetupM5Buffers_t) );
+  require_action( buf, exit, err = kNoMemoryErr );
+
+  err =  crypto_aead_chacha20poly1305_decrypt(buf->decryptedData, &decryptedDataLen, NULL, 
                                               (const unsigned char *)encryptedData, encryptedDataLen, NULL, 0,  
                                               (const unsigned char *)AEAD_Nonce_Setup05, (const unsigned char *)inInfo->HKDF_Key);
   require_noerr_action(err, exit, pair_log("crypto_aead_chacha20poly1305_decrypt failed"));
 
-  free(encryptedData);
-  encryptedData = NULL;
-
   /* Parse sub-tlv */ 
-  src = (const uint8_t *) decryptedData;
+  src = (const uint8_t *) buf->decryptedData;
   end = src + decryptedDataLen;
-  while( TLVGetNext( src, end, &eid, &ptr, &len, &src ) == kNoErr )
+  while( TLVGetNextItem( src, end, &item, &src ) == kNoErr )
   {
-    tmp = calloc( len + 1, sizeof( uint8_t ) ); // +1 can give an end to a C string
-    require_action( tmp, exit, err = kNoMemoryErr );
-    memcpy( tmp, ptr, len );
-
-    switch( eid )
+    switch( item.type )
     {
       case kTLVType_Identifier:
-        controllerIdentifier = tmp;
-        controllerIdentifierLen = len;
+        require_action( item.len < MaxControllerNameLen, exit, err = kSizeErr );
+        TLVItemCopyData( &item, (uint8_t *)buf->controllerIdentifier, item.len );
+        buf->controllerIdentifier[item.len] = 0x0; // give an end to a C string
+        controllerIdentifierLen = item.len;
         break;
       case kTLVType_PublicKey:
-        controllerLTPK = (uint8_t *)tmp;
+        err = TLVItemCopyData( &item, controllerLTPK, sizeof(controllerLTPK) );
+        require_noerr( err, exit );
+        controllerLTPKLen = item.len;
         break;
       case kTLVType_Signature:
-        signature = (uint8_t *)tmp;
+        err = TLVItemCopyData( &item, buf->signature, crypto_sign_BYTES );
+        require_noerr( err, exit );
+        signatureLen = item.len;
         break;
       default:
-        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", eid );
+        pair_log( "Warning: Ignoring unsupported pair setup EID 0x%02X", item.type );
         break;
     }
   }  
 
-  free(decryptedData);
-  decryptedData = NULL;
+  require_action(controllerIdentifierLen && controllerLTPKLen == sizeof(controllerLTPK) && signatureLen == crypto_sign_BYTES,
+                 exit, err = kMalformedErr);
 
   /* Check aead sign */
-  err = hkdf(SHA512,  (const unsigned char *)hkdfSetupCSignSalt, strlen(hkdfSetupCSignSalt),
-                      inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
-                      (const unsigned char *)hkdfSetupCSignInfo, strlen(hkdfSetupCSignInfo), signHKDF, 32);
+  err = _HKDF_SHA512( hkdfSetupCSignSalt, inInfo->SRPServer->session_key, inInfo->SRPServer->len_session_key,
+                      hkdfSetupCSignInfo, buf->signature+64, 32 );
   require_noerr(err, exit);  
 
-  signature = realloc(signature, 64 + 32 + controllerIdentifierLen + 32);
-  memcpy(signature+64,    signHKDF, 32);
-  memcpy(signature+64+32, controllerIdentifier, controllerIdentifierLen);
-  memcpy(signature+64+32+controllerIdentifierLen, controllerLTPK, 32);
+  memcpy(buf->signature+64+32, buf->controllerIdentifier, controllerIdentifierLen);
+  memcpy(buf->signature+64+32+controllerIdentifierLen, controllerLTPK, 32);
 
-  err = crypto_sign_open(NULL, NULL, signature, 64 + 32 + controllerIdentifierLen + 32, controllerLTPK);
+  err = crypto_sign_open(NULL, NULL, buf->signature, 64 + 32 + controllerIdentifierLen + 32, controllerLTPK);
   require_noerr_string(err, exit, "Signature verify failed");
 
   /* Insert pair info */
-  if(HKInsertPairInfo(controllerIdentifier, controllerLTPK, true) == kNoSpaceErr)
+  if(HKInsertPairInfo(buf->controllerIdentifier, controllerLTPK, true) == kNoSpaceErr)
     inInfo->pairListFull = true;
 
   haPairSetupState = eState_M6_ExchangeRespond;
 
 exit:
-  if(encryptedData) free(encryptedData);
-  if(decryptedData) free(decryptedData);
-  if(controllerIdentifier) free(controllerIdentifier);
-  if(controllerLTPK) free(controllerLTPK);
-  if(signature) free(signature);
-  if(authTag) free(authTag);
-  if(pairList) free(pairList);
+  if(buf){
+    memset(buf, 0x0, sizeof(HKPairSetupM5Buffers_t));
+    free(buf);
+  }
   return err; 
 }
 
@@ -744,33 +631,27 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
 {
   pair_log_trace();
   OSStatus err = kNoErr;
-  uint8_t *outTLVResponse = NULL;
-  size_t outTLVResponseLen = 0;
-  uint8_t *tlvPtr;
+  HKPairSetupM6Buffers_t *buf = NULL;
+  TLVWriter_t tlv;
+  TLVWriter_t subTLV;
 
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
-  uint8_t  signHKDF[32];
   uint8_t LTPK[32];
-  unsigned char *       encryptedData = NULL;
+  uint8_t *encryptedData;
   unsigned long long  encryptedDataLen;
-  uint8_t *signature = NULL;
   unsigned long long signatureLen;
-  uint8_t *XYZ = NULL;
   size_t XYZLen = 0;
-  char *accessoryName = NULL;
+  const char *accessoryName = inContext->micoStatus.mac;
+  size_t accessoryNameLen = strlen(accessoryName);
+
+  buf = malloc( sizeof(HKPairSetupM6Buffers_t) );
+  require_action( buf, exit, err = kNoMemoryErr );
+
+  TLVWriterInit( &tlv, buf->outTLVResponse, sizeof(buf->outTLVResponse) );
 
   if((*inInfo)->pairListFull == true){
     pair_log("Pair list is full!");
 
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
-
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_Error;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = kTLVError_MaxPeers;
+    TLVWriterAppendUInt8( &tlv, kTLVType_Error, kTLVError_MaxPeers );
     pair_log("Send: kTLVType_Status: 0x%x", kTLVError_MaxPeers);
   }else{
 
@@ -781,92 +662,53 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
       require_noerr(err, exit);     
     }
 
-    accessoryName = __strdup_trans_dot(inContext->micoStatus.mac);
-
-    err = hkdf(SHA512,  (const unsigned char *)hkdfSetupASignSalt, strlen(hkdfSetupASignSalt),
-                      (*inInfo)->SRPServer->session_key, (*inInfo)->SRPServer->len_session_key,
-                      (const unsigned char *)hkdfSetupASignInfo, strlen(hkdfSetupASignInfo), signHKDF, 32);
-    require_noerr(err, exit);  
+    /* The MAC string has no dot to escape, so it is the identifier as it is */
+    require_action(accessoryNameLen <= kHKAccessoryIdentifierMaxLen, exit, err = kSizeErr);
 
     /* XYZ: HKDF/identifier/LTPK */
-    XYZLen = 32+strlen(accessoryName)+32;
-
-    signature = calloc(64+XYZLen, sizeof(uint8_t));
-    require_action(signature, exit, err=kNoMemoryErr);
-
-    XYZ = calloc(XYZLen, sizeof(uint8_t));
-    require_action(XYZ, exit, err=kNoMemoryErr);
+    err = _HKDF_SHA512( hkdfSetupASignSalt, (*inInfo)->SRPServer->session_key, (*inInfo)->SRPServer->len_session_key,
+                        hkdfSetupASignInfo, buf->XYZ, 32 );
+    require_noerr(err, exit);  
 
-    memcpy(XYZ, signHKDF, 32);
-    memcpy(XYZ+32, accessoryName, strlen(accessoryName));
-    memcpy(XYZ+32+strlen(accessoryName), LTPK, 32);
+    XYZLen = 32+accessoryNameLen+32;
+    memcpy(buf->XYZ+32, accessoryName, accessoryNameLen);
+    memcpy(buf->XYZ+32+accessoryNameLen, LTPK, 32);
     
-    err = crypto_sign(signature,&signatureLen, XYZ, XYZLen, inContext->flashContentInRam.appConfig.LTSK );
+    err = crypto_sign(buf->signature,&signatureLen, buf->XYZ, XYZLen, inContext->flashContentInRam.appConfig.LTSK );
     require_noerr_string(err, exit, "crypto sign failed");
     require_string(signatureLen == 64+XYZLen, exit, "crypto sign failed");
 
     /* Build sub-tlv: identifier, LTPK and signature */
-    outTLVResponseLen += strlen(accessoryName) + kHATLV_TypeLengthSize; //identifier
-    outTLVResponseLen += 32 + kHATLV_TypeLengthSize;  //LTPK
-    outTLVResponseLen += 64 + kHATLV_TypeLengthSize;  //signature
+    TLVWriterInit( &subTLV, buf->subTLVBuffer, sizeof(buf->subTLVBuffer) );
+    err = TLVWriterAppend( &subTLV, kTLVType_Identifier, accessoryName, accessoryNameLen );
+    require_noerr( err, exit );
+    err = TLVWriterAppend( &subTLV, kTLVType_PublicKey, LTPK, 32 );
+    require_noerr( err, exit );
+    err = TLVWriterAppend( &subTLV, kTLVType_Signature, buf->signature, 64 );
+    require_noerr( err, exit );
 
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
+    /* Build tlv: state and encrypted data */
+    err = TLVWriterAppendUInt8( &tlv, kTLVType_State, eState_M6_ExchangeRespond );
+    require_noerr( err, exit );
 
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_Identifier;
-    *tlvPtr++ = strlen(accessoryName);
-    memcpy( tlvPtr, accessoryName, strlen(accessoryName) );
-    tlvPtr += strlen(accessoryName);
-    free(accessoryName);
-    accessoryName = NULL;
-
-    *tlvPtr++ = kTLVType_PublicKey;
-    *tlvPtr++ = 32;
-    memcpy( tlvPtr, LTPK, 32 );
-    tlvPtr += 32;
-
-    *tlvPtr++ = kTLVType_Signature;
-    *tlvPtr++ = 64;
-    memcpy( tlvPtr, signature, 64 );
-
-    encryptedData = calloc(outTLVResponseLen + 16, sizeof(uint8_t));
-
-    require_action((*inInfo)->HKDF_Key, exit, err = kParamErr);
-    err =  crypto_aead_chacha20poly1305_encrypt(encryptedData, &encryptedDataLen, outTLVResponse, outTLVResponseLen,
+    encryptedDataLen = subTLV.len + crypto_aead_chacha20poly1305_ABYTES;
+    encryptedData = TLVWriterReserve( &tlv, encryptedDataLen );
+    require_action( encryptedData, exit, err = kSizeErr );
+
+    err =  crypto_aead_chacha20poly1305_encrypt(encryptedData, &encryptedDataLen, subTLV.buf, subTLV.len,
                                                 NULL, 0, NULL, (const unsigned char *)AEAD_Nonce_Setup06,
                                                 (const unsigned char *)(*inInfo)->HKDF_Key);
 
     require_noerr_action(err, exit, pair_log("crypto_aead_chacha20poly1305_encrypt failed"));
-    require_action(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == outTLVResponseLen, exit, pair_log("encryptedDataLen is not properly set"));
-    free(outTLVResponse);
-    outTLVResponse = NULL;
-
-    /* Build tlv: state and encrypted data */
-    outTLVResponseLen = 0;
-    outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
-    outTLVResponseLen += encryptedDataLen + kHATLV_TypeLengthSize;
-
-    outTLVResponse = calloc( outTLVResponseLen, sizeof( uint8_t ) );
-    require_action( outTLVResponse, exit, err = kNoMemoryErr );
-
-    tlvPtr = outTLVResponse;
-    *tlvPtr++ = kTLVType_State;
-    *tlvPtr++ = sizeof(uint8_t);
-    *tlvPtr++ = eState_M6_ExchangeRespond;
+    require_action(encryptedDataLen - crypto_aead_chacha20poly1305_ABYTES == subTLV.len, exit, pair_log("encryptedDataLen is not properly set"));
 
-    *tlvPtr++ = kTLVType_EncryptedData;
-    *tlvPtr++ = encryptedDataLen;
-    memcpy( tlvPtr, encryptedData, encryptedDataLen);
+    err = TLVWriterCommit( &tlv, kTLVType_EncryptedData, encryptedDataLen );
+    require_noerr( err, exit );
   }
 
   haPairSetupState = eState_M1_SRPStartRequest;
 
-  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, tlv.buf, tlv.len );
   require_noerr( err, exit );
 
   /*Save accessory's LPSK*/
@@ -880,12 +722,10 @@ OSStatus _HandleState_HandleExchangeRespond(int inFd, pairInfo_t** inInfo, mico_
   inContext->appStatus.haPairSetupRunning = false;
 
 exit:
-  if(outTLVResponse) free(outTLVResponse);
-  if(httpResponse) free(httpResponse);
-  if(signature) free(signature);
-  if(accessoryName) free(accessoryName);
-  if(XYZ) free(XYZ);
-  if(encryptedData) free(encryptedData);
+  if(buf){
+    memset(buf, 0x0, sizeof(HKPairSetupM6Buffers_t));
+    free(buf);
+  }
   return err;
 
 }
@@ -926,7 +766,7 @@ OSStatus _HandleState_WaitingForVerifyStartRequest( HTTPHeader_t* inHeader, pair
   pair_log_trace();
   OSStatus                    err = kNoErr;
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t * const       end = src + inHeader->extraDataLen;
+  const uint8_t * const       end = src + inHeader->contentLength;
   uint8_t                     eid;
   const uint8_t *             ptr;
   size_t                      len;
@@ -965,8 +805,6 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
   uint8_t             *outTLVResponse = NULL;
   size_t              outTLVResponseLen = 0;
   uint8_t             *tlvPtr;
-  uint8_t             *httpResponse = NULL;
-  size_t              httpResponseLen = 0;
   uint8_t             *ABC = NULL;
   size_t              ABCLen = 0;
   uint8_t             *signature = NULL;
@@ -988,7 +826,7 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
   /* Generate new, random Curve25519 key pair */
   err = PlatformRandomBytes( inInfo->pAccessoryCurve25519SK, 32 );
   require_noerr( err, exit );
-  curve25519_donna( inInfo->pAccessoryCurve25519PK, inInfo->pAccessoryCurve25519SK, NULL );
+  curve25519_donna_base( inInfo->pAccessoryCurve25519PK, inInfo->pAccessoryCurve25519SK );
 
   /* Generate shared secret */
   curve25519_donna( inInfo->pSharedSecret, inInfo->pAccessoryCurve25519SK, inInfo->pControllerCurve25519PK );
@@ -1036,9 +874,7 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
   signature = NULL;
 
   /* Derive encryption key from Curve25519 shared secret */
-  err = hkdf(SHA512,  (const unsigned char *) hkdfVerifySalt, strlen(hkdfVerifySalt),
-                      inInfo->pSharedSecret, 32,
-                      (const unsigned char *)hkdfVerifyInfo, strlen(hkdfVerifyInfo), inInfo->pHKDFKey, 32);
+  err = _HKDF_SHA512( hkdfVerifySalt, inInfo->pSharedSecret, 32, hkdfVerifyInfo, inInfo->pHKDFKey, 32 );
   require_noerr_string(err, exit, "Generate HKDK key failed");
 
   /* Encrypt sub-TLV and generate an auth tag*/
@@ -1077,11 +913,7 @@ OSStatus _HandleState_WaitingForVerifyStartRespond(int inFd, pairVerifyInfo_t* i
   *tlvPtr++ = encryptedDataLen;
   memcpy( tlvPtr, encryptedData, encryptedDataLen );
 
-  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend(inFd, outTLVResponse, outTLVResponseLen);
+  err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, outTLVResponse, outTLVResponseLen );
   require_noerr( err, exit );
   inInfo->haPairVerifyState = eState_M3_VerifyFinishRequest;
 
@@ -1091,7 +923,6 @@ exit:
   if(signature) free(signature);
   if(encryptedData) free(encryptedData);
   if(outTLVResponse) free(outTLVResponse);
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
@@ -1101,7 +932,7 @@ OSStatus _HandleState_WaitingForVerifyFinishRequest(HTTPHeader_t* inHeader, pair
   OSStatus                    err = kNoErr;
   (void)                      inContext;
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t *             end = src + inHeader->extraDataLen;
+  const uint8_t *             end = src + inHeader->contentLength;
   uint8_t                     eid;
   const uint8_t *             ptr;
   size_t                      len;
@@ -1195,9 +1026,8 @@ OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t*
   uint8_t *outTLVResponse = NULL;
   size_t outTLVResponseLen = 0;
   uint8_t *tlvPtr;
+  HMACContext *controlKey = NULL;
 
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
 
   outTLVResponseLen += sizeof(uint8_t) + kHATLV_TypeLengthSize;
 
@@ -1210,58 +1040,52 @@ OSStatus _HandleState_WaitingForVerifyFinishRespond(int inFd, pairVerifyInfo_t*
   *tlvPtr++ = eState_M4_SRPVerifyRespond;
 
   inInfo->verifySuccess = true;
+
+  /* Both control keys use the same salt and shared secret: extract the PRK once, expand each key from it */
+  controlKey = malloc( sizeof(HMACContext) );
+  require_action( controlKey, exit, err = kNoMemoryErr );
+  err = hkdfExtractContext(controlKey, SHA512, (const unsigned char *) hkdfA2CKeySalt, strlen(hkdfA2CKeySalt),
+                           inInfo->pSharedSecret, 32);
+  require_noerr(err, exit);
+
   inInfo->A2CKey = malloc(32);
   require_action(inInfo->A2CKey, exit, err = kNoMemoryErr);
-  err = hkdf(SHA512,  (const unsigned char *) hkdfA2CKeySalt, strlen(hkdfA2CKeySalt),
-                            inInfo->pSharedSecret, 32,
-                            (const unsigned char *)hkdfA2CInfo, strlen(hkdfA2CInfo), inInfo->A2CKey, 32);
+  err = hkdfExpandContext(controlKey, (const unsigned char *)hkdfA2CInfo, strlen(hkdfA2CInfo), inInfo->A2CKey, 32);
   require_noerr(err, exit);
 
   inInfo->C2AKey = malloc(32);
   require_action(inInfo->C2AKey, exit, err = kNoMemoryErr);
-  err = hkdf(SHA512,  (const unsigned char *) hkdfC2AKeySalt, strlen(hkdfC2AKeySalt),
-                            inInfo->pSharedSecret, 32,
-                            (const unsigned char *)hkdfC2AInfo, strlen(hkdfC2AInfo), inInfo->C2AKey, 32);
+  err = hkdfExpandContext(controlKey, (const unsigned char *)hkdfC2AInfo, strlen(hkdfC2AInfo), inInfo->C2AKey, 32);
   require_noerr(err, exit);
 
-  err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_Pairing_TLV8, outTLVResponseLen, &httpResponse, &httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, httpResponse, httpResponseLen );
-  require_noerr( err, exit );
-  err = SocketSend( inFd, outTLVResponse, outTLVResponseLen );
+  err = HTTPResponseSend( inFd, kStatusOK, kMIMEType_Pairing_TLV8, outTLVResponse, outTLVResponseLen );
   require_noerr( err, exit );
 
 exit:
   if(outTLVResponse) free(outTLVResponse);
-  if(httpResponse) free(httpResponse);
+  if(controlKey){
+    /* Keyed with the shared secret's PRK: do not leave it behind in the heap */
+    memset(controlKey, 0x0, sizeof(HMACContext));
+    free(controlKey);
+  }
   return err;
 }
 
 OSStatus HKSendPairResponseMessage(int sockfd, int status, uint8_t *payload, int payloadLen, security_session_t *session )
 {
   OSStatus err;
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
-  const char *buffer = NULL;
-  int bufferLen;
-
-  buffer = (const char *)payload;
-  bufferLen = payloadLen;
-
-  err = CreateHTTPRespondMessageNoCopy( status, kMIMEType_Pairing_TLV8, bufferLen, &httpResponse, &httpResponseLen );
+  HTTPWriter_t writer;
 
+  err = HTTPWriterBeginResponse( &writer, sockfd, status, kMIMEType_Pairing_TLV8, payloadLen );
   require_noerr( err, exit );
-  require( httpResponse, exit );
+  writer.sendv = HKSecureSocketSendv;
+  writer.sendContext = session;
 
-  err = HKSecureSocketSend( sockfd, httpResponse, httpResponseLen, session );
+  err = HTTPWriterWrite( &writer, payload, payloadLen );
   require_noerr( err, exit );
-  if(bufferLen){
-    err = HKSecureSocketSend( sockfd, (uint8_t *)buffer, bufferLen, session );
-    require_noerr( err, exit ); 
-  }
+  err = HTTPWriterEnd( &writer );
 
 exit:
-  if(httpResponse) free(httpResponse);
   return err;
 }
 
@@ -1282,7 +1106,7 @@ OSStatus HKPairAddRemoveEngine( int inFd, HTTPHeader_t* inHeader, security_sessi
   bool needSeparator = false;
 
   const uint8_t *             src = (const uint8_t *) inHeader->extraDataPtr;
-  const uint8_t * const       end = src + inHeader->extraDataLen;
+  const uint8_t * const       end = src + inHeader->contentLength;
   uint8_t                     eid;
   const uint8_t *             ptr;
   size_t                      len;
@@ -9,15 +9,18 @@
 
 
 
+#define kHKSRPPublicKeyMaxLen   384   // 3072-bit SRP group
+#define kHKSRPProofMaxLen       64    // SHA-512
+
 /*Pair setup info*/
 typedef struct _pairInfo_t {
   char              *SRPUser;
   srp_server_t      *SRPServer;
-  uint8_t           *SRPControllerPublicKey;
+  uint8_t           SRPControllerPublicKey[kHKSRPPublicKeyMaxLen];
   ssize_t           SRPControllerPublicKeyLen;
-  uint8_t           *SRPControllerProof;
+  uint8_t           SRPControllerProof[kHKSRPProofMaxLen];
   ssize_t           SRPControllerProofLen;
-  uint8_t           *HKDF_Key;
+  uint8_t           HKDF_Key[32];
   bool              pairListFull;
 } pairInfo_t;
 
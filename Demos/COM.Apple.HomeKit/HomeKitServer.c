@@ -41,7 +41,30 @@
 #define kRWCharacter        "/characteristics" 
 #define kIdentity           "/identify"  
 
+typedef enum {
+  eHKRoutePairSetup = 0,
+  eHKRoutePairVerify,
+  eHKRoutePairings,
+  eHKRouteIdentify,
+  eHKRouteReadAccessories,
+  eHKRouteReadCharacteristics,
+  eHKRouteWriteCharacteristics,
+} HKRoute_t;
+
+/* HAP resources, resolved by path and method in one pass */
+static const URLRoute_t hkRoutes[] = {
+  { "POST", kPAIRSETUP,   NULL, eHKRoutePairSetup },
+  { "POST", kPAIRVERIFY,  NULL, eHKRoutePairVerify },
+  { "POST", kPAIRINGS,    NULL, eHKRoutePairings },
+  { "POST", kIdentity,    NULL, eHKRouteIdentify },
+  { "GET",  kReadAcc,     NULL, eHKRouteReadAccessories },
+  { "GET",  kRWCharacter, NULL, eHKRouteReadCharacteristics },
+  { "PUT",  kRWCharacter, NULL, eHKRouteWriteCharacteristics },
+};
+static URLRouter_t *hkRouter = NULL;
+
 #define min(a,b) ((a) < (b) ? (a) : (b))
+#define max(a,b) ((a) > (b) ? (a) : (b))
 
 /* Raw type password */
 static const char *password = "454-45-454";
@@ -81,6 +104,8 @@ typedef struct _HK_Context_t {
   pairInfo_t          *pairInfo;
   pairVerifyInfo_t    *pairVerifyInfo;
   security_session_t  *session;
+  bool                readingBody;      // Header is parsed, the body is still arriving
+  bool                hasPipelined;     // httpHeader->buf holds a request sent behind the last one
 } HK_Context_t;
 
 typedef struct _HK_Char_ID_t {
@@ -97,6 +122,14 @@ typedef struct _HK_Notify{
   struct _HK_Notify *next;
 } HK_Notify_t;
 
+/* One controller connection, all of them are served by homeKitListener_thread */
+typedef struct _HK_Session_t {
+  int                 fd;
+  HTTPHeader_t        *httpHeader;
+  HK_Notify_t         *notifyList;
+  HK_Context_t        hkContext;
+} HK_Session_t;
+
 extern void HKCharacteristicInit(mico_Context_t * const inContext);
 extern HkStatus HKReadCharacteristicValue(int accessoryID, int serviceID, int characteristicID, value_union *value, mico_Context_t * const inContext);
 extern void HKWriteCharacteristicValue(int accessoryID, int serviceID, int characteristicID, value_union value, bool moreComing, mico_Context_t * const inContext);
@@ -104,10 +137,74 @@ extern HkStatus HKReadCharacteristicStatus(int accessoryID, int serviceID, int c
 extern HkStatus HKExcuteUnpairedIdentityRoutine( mico_Context_t * const inContext );
 
 
-static void homeKitClient_thread(void *inFd);
 static mico_Context_t *Context;
+static HK_Session_t *hkSessions[HA_MAX_CONNECTIONS];
+static int hkSessionCount = 0;
+static OSStatus HKSessionCreate( int fd, HK_Session_t **outSession );
+static void HKSessionClose( HK_Session_t **session );
+static OSStatus HKSessionSendEvents( HK_Session_t *session, uint32_t changed[][MAXServicePerAccessory], uint32_t changeTime );
+
+/* Characteristics changed since the last EVENT messages were sent, one bit per
+   characteristic, set by HKCharacteristicChanged from any thread */
+static uint32_t hkChanged[NumberofAccessories][MAXServicePerAccessory];
+static uint32_t hkChangeTime = 0;       // mico_get_time() of the first change, 0 if nothing changed
+static mico_mutex_t hkChangeMutex = NULL;
+static int hkWakeupFd = -1;             // Sends the wakeup datagram to the loopback port, used under hkChangeMutex
+/* iid -> service and characteristic of every accessory, filled once by
+   HKCreateIIDIndex so a lookup does not walk the profile. A service iid has
+   characteristicID 0, unused iids are all 0. */
+#define kHKMaxIIDPerAccessory   ( MAXServicePerAccessory * ( MAXCharacteristicPerService + 1 ) )
+
+/* The iid index and the attribute database slots keep aid, service,
+   characteristic and iid in a byte, hkChanged keeps a bit per characteristic */
+#if( NumberofAccessories > 255 || kHKMaxIIDPerAccessory > 255 )
+  #error "HomeKit profile too large: aid and iid must fit in uint8_t"
+#endif
+#if( MAXCharacteristicPerService > 32 )
+  #error "HomeKit profile too large: hkChanged has 32 bits per service"
+#endif
+
+typedef struct _HK_IIDEntry_t {
+  uint8_t     serviceID;
+  uint8_t     characteristicID;
+} HK_IIDEntry_t;
+
+static HK_IIDEntry_t hkIIDIndex[NumberofAccessories][kHKMaxIIDPerAccessory + 1];
+
+/* Serialized attribute database for GET /accessories. The text holds
+   everything that never changes, the slots mark where the current value
+   and ev fields are inserted, in text order. */
+#define kHKDBFieldValue     0
+#define kHKDBFieldEvent     1
+#define kHKDBChunkSize      ( kHKSecureFrameLengthMax - 16 )  //Chunk size line and CRLF fit in the same frame
+
+typedef struct _HK_DBSlot_t {
+  uint16_t    offset;
+  uint8_t     aid;
+  uint8_t     serviceID;
+  uint8_t     characteristicID;
+  uint8_t     iid;
+  uint8_t     field;
+} HK_DBSlot_t;
+
+typedef struct _HK_DBBuffer_t {
+  uint8_t       *buf;
+  size_t        len;
+  size_t        size;
+  HTTPWriter_t  *writer;
+  HK_DBSlot_t   *slots;
+  int           slotCount;
+} HK_DBBuffer_t;
+
+static char *hkDBText = NULL;
+static size_t hkDBTextLen = 0;
+static HK_DBSlot_t *hkDBSlots = NULL;
+static int hkDBSlotCount = 0;
+
 static OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notify_t** notifyList, HK_Context_t *inHkContext, mico_Context_t * const inContext);
-static OSStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t *inHapObject,  HK_Notify_t* notifyList, json_object **OutHapObjectJson,  mico_Context_t * const inContext);
+static void HKCreateIIDIndex( struct _hapAccessory_t inHapObject[] );
+static OSStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t inHapObject[] );
+static OSStatus HKSendHAPAttriDataBase( int sockfd, HK_Notify_t* notifyList, security_session_t *session, mico_Context_t * const inContext );
 static OSStatus HKCreateHAPReadRespond( struct _hapAccessory_t inHapObject[],  json_object **OutHapObjectJson, 
                                                 int accessoryID, int serviceID, int characteristicID, mico_Context_t * const inContext);
 static OSStatus HKCreateHAPWriteRespond( struct _hapAccessory_t inHapObject[],  json_object *inputHapObjectJson, json_object **OutHapObjectJson,
@@ -118,23 +215,49 @@ void _HKWriteCharacteristicValue_respond(struct _hapAccessory_t inHapObject[], i
                                         int characteristicID, json_object **OutHapObjectJson, mico_Context_t * const inContext);
 
 
+/* Accepts controllers and serves every session from this one thread: each
+   pass selects on the listener and all sessions, runs HKhandleIncomeingMessage
+   for the readable ones and sends the EVENT messages for characteristics
+   changed in the last HA_EVENT_COALESCE_MS. A session with decrypted data
+   still buffered, or a pipelined request, is handled without waiting for select. */
 void homeKitListener_thread(void *inContext)
 {
   ha_log_trace();
   OSStatus err = kUnknownErr;
-  int j;
+  int i, j, maxFd;
   Context = inContext;
   struct sockaddr_t addr;
   int sockaddr_t_size;
   fd_set readfds;
+  struct timeval_t t;
+  struct timeval_t *pt;
   char ip_address[16];
+  bool hasBufferedData;
+  uint32_t now, changeTime;
+  uint32_t changed[NumberofAccessories][MAXServicePerAccessory];
+  uint8_t wakeup[4];
+  HK_Session_t *session;
   
   int homeKitlistener_fd = -1;
+  int event_loopBack_fd = -1;
   //HKSetPassword (password, strlen(password));
   HKSetVerifier(verifier, sizeof(verifier), salt, sizeof(salt));
 
   Context->appStatus.haPairSetupRunning = false;
+  err = mico_rtos_init_mutex( &hkChangeMutex );
+  require_noerr( err, exit );
   HKCharacteristicInit(inContext);
+
+  HKCreateIIDIndex( hapObjects );
+  if(hkDBText == NULL){
+    err = HKCreateHAPAttriDataBase( hapObjects );
+    require_noerr( err, exit );
+  }
+
+  if(hkRouter == NULL){
+    err = URLRouterCreate( hkRoutes, sizeof(hkRoutes)/sizeof(URLRoute_t), &hkRouter );
+    require_noerr( err, exit );
+  }
   /*Establish a TCP server fd that accept the tcp clients connections*/ 
   homeKitlistener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
   require_action(IsValidSocket( homeKitlistener_fd ), exit, err = kNoResourcesErr );
@@ -147,11 +270,53 @@ void homeKitListener_thread(void *inContext)
   require_noerr( err, exit );
 
   ha_log("HomeKit Server established at port: %d, fd: %d", HA_SERVER_PORT, homeKitlistener_fd);
+
+  /* HKCharacteristicChanged wakes this thread up through the loopback socket */
+  event_loopBack_fd = socket( AF_INET, SOCK_DGRM, IPPROTO_UDP );
+  require_action(IsValidSocket( event_loopBack_fd ), exit, err = kNoResourcesErr );
+  addr.s_ip = IPADDR_LOOPBACK;
+  addr.s_port = HA_EVENT_LOOPBACK_PORT;
+  err = bind( event_loopBack_fd, &addr, sizeof(addr) );
+  require_noerr( err, exit );
+
+  mico_rtos_lock_mutex( &hkChangeMutex );
+  hkWakeupFd = socket( AF_INET, SOCK_DGRM, IPPROTO_UDP );
+  mico_rtos_unlock_mutex( &hkChangeMutex );
+  require_action(IsValidSocket( hkWakeupFd ), exit, err = kNoResourcesErr );
   
   while(1){
     FD_ZERO(&readfds);
     FD_SET(homeKitlistener_fd, &readfds);
-    select(1, &readfds, NULL, NULL, NULL);
+    FD_SET(event_loopBack_fd, &readfds);
+    maxFd = max(homeKitlistener_fd, event_loopBack_fd);
+    hasBufferedData = false;
+    for(i = 0; i < HA_MAX_CONNECTIONS; i++){
+      if(hkSessions[i] == NULL) continue;
+      FD_SET(hkSessions[i]->fd, &readfds);
+      maxFd = max(maxFd, hkSessions[i]->fd);
+      if(hkSessions[i]->hkContext.session->recvedDataLen > 0 || hkSessions[i]->hkContext.hasPipelined)
+        hasBufferedData = true;
+    }
+
+    /* Sleep until a socket is readable, or until the pending changes are due to be sent */
+    mico_rtos_lock_mutex( &hkChangeMutex );
+    changeTime = hkChangeTime;
+    mico_rtos_unlock_mutex( &hkChangeMutex );
+    now = mico_get_time();
+    pt = &t;
+    if(hasBufferedData || (changeTime && (int32_t)(changeTime + HA_EVENT_COALESCE_MS - now) <= 0)){
+      t.tv_sec = 0;
+      t.tv_usec = 0;
+    }else if(changeTime){
+      t.tv_sec = 0;
+      t.tv_usec = (changeTime + HA_EVENT_COALESCE_MS - now) * 1000;
+    }else
+      pt = NULL;
+    if(select(maxFd + 1, &readfds, NULL, NULL, pt) < 0)
+      FD_ZERO(&readfds);
+
+    if(FD_ISSET(event_loopBack_fd, &readfds))
+      recv( event_loopBack_fd, wakeup, sizeof(wakeup), 0 );
 
     /*Check tcp connection requests */
     if(FD_ISSET(homeKitlistener_fd, &readfds)){
@@ -160,53 +325,121 @@ void homeKitListener_thread(void *inContext)
       if (j > 0) {
         inet_ntoa(ip_address, addr.s_ip );
         ha_log("HomeKit Client %s:%d connected, fd: %d", ip_address, addr.s_port, j);
-        ha_log("memory>>>>>>>>: %d", mico_memory_info()->free_memory);
-        err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "HomeKit Client", homeKitClient_thread, 0x1000, &j);  
+        err = HKSessionCreate(j, &session);
         if(err != kNoErr){
-          ha_log("HomeKit Client for fd %d create failed", j);
+          ha_log("HomeKit Client for fd %d create failed, err = %d", j, err);
           SocketClose(&j);
         }
       }
     }
-   }
+
+    /*Serve every session that has data to read */
+    for(i = 0; i < HA_MAX_CONNECTIONS; i++){
+      session = hkSessions[i];
+      if(session == NULL) continue;
+      if(!FD_ISSET(session->fd, &readfds) && session->hkContext.session->recvedDataLen == 0 && !session->hkContext.hasPipelined) continue;
+      session->hkContext.session->canRead = FD_ISSET(session->fd, &readfds) ? true : false;
+      err = HKhandleIncomeingMessage(session->fd, session->httpHeader, &session->notifyList, &session->hkContext, Context);
+      if(err != kNoErr)
+        HKSessionClose(&hkSessions[i]);
+    }
+
+    /* Send the changes collected in the last HA_EVENT_COALESCE_MS, one EVENT message per session */
+    mico_rtos_lock_mutex( &hkChangeMutex );
+    changeTime = hkChangeTime;
+    if(changeTime && (int32_t)(changeTime + HA_EVENT_COALESCE_MS - mico_get_time()) <= 0){
+      memcpy(changed, hkChanged, sizeof(changed));
+      memset(hkChanged, 0x0, sizeof(hkChanged));
+      hkChangeTime = 0;
+    }else
+      changeTime = 0;
+    mico_rtos_unlock_mutex( &hkChangeMutex );
+
+    if(changeTime){
+      for(i = 0; i < HA_MAX_CONNECTIONS; i++){
+        if(hkSessions[i] == NULL || hkSessions[i]->hkContext.session->established == false) // No nofification in no paired session
+          continue;
+        err = HKSessionSendEvents(hkSessions[i], changed, changeTime);
+        if(err != kNoErr)
+          HKSessionClose(&hkSessions[i]);
+      }
+    }
+  }
 
 exit:
+    if(hkChangeMutex != NULL){
+      mico_rtos_lock_mutex( &hkChangeMutex );
+      if(hkWakeupFd != -1) SocketClose(&hkWakeupFd);
+      mico_rtos_unlock_mutex( &hkChangeMutex );
+    }
+    if(event_loopBack_fd != -1) SocketClose(&event_loopBack_fd);
     ha_log("Exit: HomeKit Server exit with err = %d", err);
     mico_rtos_delete_thread(NULL);
     return;
 }
 
-void FindCharacteristicByIID(struct _hapAccessory_t inHapObject[], int aid, int iid, int *serviceID, int *characteristicID)
+/* Marks a characteristic changed. The first change after the last EVENT
+   messages wakes the server thread, which sends everything changed within
+   HA_EVENT_COALESCE_MS to the subscribed sessions. */
+void HKCharacteristicChanged( int accessoryID, int serviceID, int characteristicID )
 {
-  int serviceIndex, characteristicIndex, tmpIID;
-  tmpIID = 1;
-  *serviceID = 0;
-  *characteristicID = 0;
+  uint8_t wakeup = 1;
+  struct sockaddr_t addr;
 
-  for(serviceIndex = 0; serviceIndex < MAXServicePerAccessory; serviceIndex++){
-    if(inHapObject[aid-1].services[serviceIndex].type == 0 || tmpIID > iid)
-      return;
-    if(tmpIID == iid){
-      *serviceID = serviceIndex + 1;
-      return;
+  if(hkChangeMutex == NULL) return;  //Server not started, nobody is subscribed
+  if(accessoryID < 1 || accessoryID > NumberofAccessories || serviceID < 1 || serviceID > MAXServicePerAccessory ||
+     characteristicID < 1 || characteristicID > MAXCharacteristicPerService)
+    return;
+
+  mico_rtos_lock_mutex( &hkChangeMutex );
+  hkChanged[accessoryID-1][serviceID-1] |= 1UL << (characteristicID-1);
+  if(hkChangeTime == 0){
+    hkChangeTime = mico_get_time() | 1;
+    if(hkWakeupFd != -1){
+      addr.s_ip = IPADDR_LOOPBACK;
+      addr.s_port = HA_EVENT_LOOPBACK_PORT;
+      sendto( hkWakeupFd, &wakeup, 1, 0, &addr, sizeof(addr) );
     }
-    tmpIID ++;
+  }
+  mico_rtos_unlock_mutex( &hkChangeMutex );
+}
 
-    for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
-      if(inHapObject[aid-1].services[serviceIndex].characteristic[characteristicIndex].type == 0 )
+/* Fills the iid index of every accessory, numbering the services and their
+   characteristics from 1 in profile order like the attribute database. */
+static void HKCreateIIDIndex( struct _hapAccessory_t inHapObject[] )
+{
+  int accessoryIndex, serviceIndex, characteristicIndex, iid;
+
+  memset(hkIIDIndex, 0x0, sizeof(hkIIDIndex));
+  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+    for(serviceIndex = 0, iid = 1; serviceIndex < MAXServicePerAccessory; serviceIndex++){
+      if(inHapObject[accessoryIndex].services[serviceIndex].type == 0)
         break;
-      if(tmpIID > iid)
-        return;
-      if(tmpIID == iid){
-        *serviceID = serviceIndex + 1;
-        *characteristicID = characteristicIndex + 1;;
-        return;
+      hkIIDIndex[accessoryIndex][iid++].serviceID = serviceIndex + 1;
+
+      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
+        if(inHapObject[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex].type == 0)
+          break;
+        hkIIDIndex[accessoryIndex][iid].serviceID = serviceIndex + 1;
+        hkIIDIndex[accessoryIndex][iid++].characteristicID = characteristicIndex + 1;
       }
-      tmpIID ++;
     }
   }
 }
 
+/* Resolves aid.iid to 1-based service and characteristic IDs, both 0 if the
+   iid does not exist and characteristicID 0 for a service iid. */
+void FindCharacteristicByIID(int aid, int iid, int *serviceID, int *characteristicID)
+{
+  *serviceID = 0;
+  *characteristicID = 0;
+
+  if(aid < 1 || aid > NumberofAccessories || iid < 1 || iid > kHKMaxIIDPerAccessory)
+    return;
+  *serviceID = hkIIDIndex[aid-1][iid].serviceID;
+  *characteristicID = hkIIDIndex[aid-1][iid].characteristicID;
+}
+
 OSStatus HKNotificationAdd( int aid, int iid, value_union value, HK_Notify_t** notifyList )
 {
   OSStatus err = kNoErr;
@@ -310,315 +543,440 @@ exit:
   return kNoErr;
 }
 
-void homeKitClient_thread(void *inFd)
+static OSStatus HKSessionCreate( int fd, HK_Session_t **outSession )
 {
-  ha_log_trace();
-  OSStatus err;
-  int clientFd = *(int *)inFd;
-  struct timeval_t t;
-  HTTPHeader_t *httpHeader = NULL;
-  int selectResult;
-  fd_set      readfds;
-  HK_Context_t hkContext;
+  OSStatus err = kNoErr;
+  HK_Session_t *session = NULL;
+  int i;
+
+  for(i = 0; i < HA_MAX_CONNECTIONS; i++)
+    if(hkSessions[i] == NULL) break;
+  require_action(i < HA_MAX_CONNECTIONS, exit, err = kNoResourcesErr);
+
+  session = calloc(1, sizeof(HK_Session_t));
+  require_action(session, exit, err = kNoMemoryErr);
+  session->fd = fd;
+
+  session->hkContext.session = HKSNewSecuritySession();
+  require_action(session->hkContext.session, exit, err = kNoMemoryErr);
+
+  session->httpHeader = calloc(1, sizeof( HTTPHeader_t ) );
+  require_action(session->httpHeader, exit, err = kNoMemoryErr);
+
+  hkSessions[i] = session;
+  hkSessionCount++;
+  *outSession = session;
+  ha_log("HomeKit sessions: %d, free memory: %d", hkSessionCount, mico_memory_info()->free_memory);
+
+exit:
+  if(err != kNoErr && session){
+    if(session->hkContext.session) free(session->hkContext.session);
+    free(session);
+  }
+  return err;
+}
+
+static void HKSessionClose( HK_Session_t **session )
+{
+  HK_Session_t *temp = *session;
+
+  *session = NULL;
+  SocketClose(&temp->fd);
+  HTTPHeaderClear( temp->httpHeader );
+  free(temp->httpHeader);
+  HKNotificationClean( &temp->notifyList );
+  HKCleanPairSetupInfo(&temp->hkContext.pairInfo, Context);
+  HKCleanPairVerifyInfo(&temp->hkContext.pairVerifyInfo);
+  free(temp->hkContext.session);
+  free(temp);
+  hkSessionCount--;
+  ha_log("HomeKit sessions: %d, free memory: %d", hkSessionCount, mico_memory_info()->free_memory);
+}
+
+/* Sends the changed characteristics the session subscribed to in one EVENT
+   message. Values that did not really change are skipped. */
+static OSStatus HKSessionSendEvents( HK_Session_t *session, uint32_t changed[][MAXServicePerAccessory], uint32_t changeTime )
+{
+  OSStatus err = kNoErr;
   int aid, iid, serviceID, characteristicID;
   value_union value, newValue;
-  struct _hapCharacteristic_t pCharacteristic;
-  json_object *outEventJsonObject = NULL, *outCharacteristics, *outCharacteristic;
+  struct _hapCharacteristic_t *pCharacteristic;
+  json_object *outEventJsonObject = NULL, *outCharacteristics, *outCharacteristic, *valueObject;
+  HK_Notify_t *temp;
   const char *buffer = NULL;
+  int count;
+
+  if(session->notifyList == NULL) return kNoErr;
 
-  memset(&hkContext, 0x0, sizeof(HK_Context_t));
-  hkContext.session = HKSNewSecuritySession();
-  require_action(hkContext.session, exit, err = kNoMemoryErr);
+  outEventJsonObject = json_object_new_object();
+  require_action(outEventJsonObject, exit, err = kNoMemoryErr);
+  outCharacteristics = json_object_new_array();
+  require_action(outCharacteristics, exit, err = kNoMemoryErr);
+  json_object_object_add( outEventJsonObject, "characteristics", outCharacteristics);
+  temp = session->notifyList;
 
-  httpHeader = calloc(1, sizeof( HTTPHeader_t ) );
-  require_action( httpHeader, exit, err = kNoMemoryErr );
+  while(HKNotifyGetNext( temp, &aid, &iid, &value, &temp) == kNoErr){
+    FindCharacteristicByIID(aid, iid, &serviceID, &characteristicID);
+    if(serviceID == 0 || characteristicID == 0) continue;
+    if(!(changed[aid-1][serviceID-1] & (1UL << (characteristicID-1)))) continue;
+    if(HKReadCharacteristicValue(aid, serviceID, characteristicID, &newValue, Context) != kHKNoErr) continue;
+    pCharacteristic = &((hapObjects[aid-1]).services[serviceID-1]).characteristic[characteristicID-1];
+
+    switch(pCharacteristic->valueType){
+      case ValueType_bool:
+        valueObject = ( value.boolValue != newValue.boolValue )? json_object_new_boolean(newValue.boolValue) : NULL;
+        break;
+      case ValueType_int:
+        valueObject = ( value.intValue != newValue.intValue )? json_object_new_int(newValue.intValue) : NULL;
+        break;
+      case ValueType_float:
+        valueObject = ( value.floatValue != newValue.floatValue )? json_object_new_double(newValue.floatValue) : NULL;
+        break;
+      /* Strings are kept by pointer in the notify list, so a change can't be checked */
+      case ValueType_string:
+        valueObject = json_object_new_string(newValue.stringValue);
+        break;
+      case ValueType_date:
+        valueObject = json_object_new_string(newValue.dateValue);
+        break;
+      default:
+        valueObject = NULL;
+        break;
+    }
+    if(valueObject == NULL) continue;
+
+    outCharacteristic = json_object_new_object();
+    json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
+    json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
+    json_object_object_add( outCharacteristic, "value", valueObject);
+    json_object_array_add( outCharacteristics, outCharacteristic );
+    HKNotificationAdd( aid, iid, newValue, &session->notifyList );
+  }
 
-  HK_Notify_t *notifyList = NULL, *temp;
+  count = json_object_array_length(outCharacteristics);
+  if(count){
+    buffer = json_object_to_json_string(outEventJsonObject);
+    ha_log("EVENT: %d characteristics to fd %d, %d ms after the first change", count, session->fd, (int)(mico_get_time() - changeTime));
+    err = HKSendNotifyMessage( session->fd, (uint8_t *)buffer, strlen(buffer), session->hkContext.session );
+    require_noerr(err, exit);
+  }
 
-  bool isChanged;
+exit:
+  if(outEventJsonObject) json_object_put(outEventJsonObject);
+  return err;
+}
 
-  t.tv_sec = 1;
-  t.tv_usec = 0;  //Check for notify every 1 second
-  ha_log("Free memory1: %d", mico_memory_info()->free_memory);
 
-  while(1){
-    if(hkContext.session->established == true && hkContext.session->recvedDataLen > 0){
-       err = HKhandleIncomeingMessage(clientFd, httpHeader, &notifyList, &hkContext, Context);
-    }else{
-      FD_ZERO(&readfds);
-      FD_SET(clientFd, &readfds);
-      selectResult = select(clientFd + 1, &readfds, NULL, NULL, &t);
-      require( selectResult >= 0, exit );
-      if(FD_ISSET(clientFd, &readfds)){
-        err = HKhandleIncomeingMessage(clientFd, httpHeader, &notifyList, &hkContext, Context);
-        require_noerr(err, exit);
-      }
 
-      if(hkContext.session->established == false) // No nofification in no paired session
-        continue;
-
-      outEventJsonObject = json_object_new_object();
-      require_action(outEventJsonObject, exit, err = kNoMemoryErr);
-      outCharacteristics = json_object_new_array();
-      require_action(outCharacteristics, exit, err = kNoMemoryErr);
-      json_object_object_add( outEventJsonObject, "characteristics", outCharacteristics);
-      temp = notifyList;
-
-      while(HKNotifyGetNext( temp, &aid, &iid, &value, &temp) == kNoErr){
-        FindCharacteristicByIID(hapObjects, aid, iid, &serviceID, &characteristicID);   
-        if(HKReadCharacteristicValue(aid, serviceID, characteristicID, &newValue, Context)==kHKNoErr){
-          pCharacteristic = ((hapObjects[aid-1]).services[serviceID-1]).characteristic[characteristicID-1];
-
-          switch(pCharacteristic.valueType){
-            case ValueType_bool:
-              if( value.boolValue != newValue.boolValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_boolean(newValue.boolValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_int:
-              if( value.intValue != newValue.intValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_int(newValue.intValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_float:
-              if( value.floatValue != newValue.floatValue ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_double(newValue.floatValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_string:
-              if( !strcmp(value.stringValue, newValue.stringValue) ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_string(newValue.stringValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            case ValueType_date:
-              if( !strcmp(value.dateValue, newValue.dateValue) ){
-                outCharacteristic = json_object_new_object();
-                json_object_object_add( outCharacteristic, "aid", json_object_new_int(aid));
-                json_object_object_add( outCharacteristic, "iid", json_object_new_int(iid));
-                json_object_object_add( outCharacteristic, "value", json_object_new_string(newValue.dateValue));
-                json_object_array_add( outCharacteristics, outCharacteristic );
-                HKNotificationAdd( aid, iid, newValue, &notifyList );
-              }
-              break;
-            default:
-              break;
-          }
-        }
-      }
-            
-      if(json_object_array_length(outCharacteristics)){
-        buffer = json_object_to_json_string(outEventJsonObject);
-        ha_log("Notification json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer);  
-        err = HKSendNotifyMessage( clientFd, (uint8_t *)buffer, strlen(buffer), hkContext.session );
-        require_noerr(err, exit);
 
-      }
-      
-      json_object_put(outEventJsonObject);
-      outEventJsonObject = NULL;
-          //err = HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext);
-          //require_noerr(err, exit);
+/* Writes to a template or response buffer. With buf NULL nothing is stored,
+   only len and slotCount are counted, so the template can be sized first.
+   With a writer a full buffer is sent as one chunk and reused. */
+static OSStatus _HKDBWrite( HK_DBBuffer_t *b, const char *data, size_t len )
+{
+  OSStatus err = kNoErr;
+  size_t n;
+
+  if(b->buf == NULL){
+    b->len += len;
+    goto exit;
+  }
+
+  while(len){
+    if(b->len == b->size){
+      require_action( b->writer, exit, err = kNoSpaceErr );
+      err = HTTPWriterWrite( b->writer, b->buf, b->len );
+      require_noerr( err, exit );
+      b->len = 0;
     }
+    n = min( len, b->size - b->len );
+    memcpy( b->buf + b->len, data, n );
+    b->len += n;
+    data += n;
+    len -= n;
   }
 
 exit:
-  SocketClose(&clientFd);
-  HTTPHeaderClear( httpHeader );
-  if(httpHeader)    free(httpHeader);
-  HKNotificationClean( &notifyList );
-  if(outEventJsonObject) json_object_put(outEventJsonObject);
-  HKCleanPairSetupInfo(&hkContext.pairInfo, Context);
-  HKCleanPairVerifyInfo(&hkContext.pairVerifyInfo);
-  free(hkContext.session);
-  ha_log("Last Free memory1: %d", mico_memory_info()->free_memory);
-  mico_rtos_delete_thread(NULL);
-  return;
+  return err;
 }
 
+static OSStatus _HKDBPrintf( HK_DBBuffer_t *b, const char *format, ... )
+{
+  char tmp[ 64 ];
+  va_list args;
+  int n;
+
+  va_start( args, format );
+  n = vsnprintf( tmp, sizeof(tmp), format, args );
+  va_end( args );
+  if( n < 0 || n >= (int)sizeof(tmp) ) return kSizeErr;
+  return _HKDBWrite( b, tmp, n );
+}
+
+/* Quoted and escaped the same way json-c does */
+static OSStatus _HKDBWriteString( HK_DBBuffer_t *b, const char *str )
+{
+  OSStatus err;
+  const char *start;
+  char escape[ 7 ];
 
+  if(str == NULL) return _HKDBWrite( b, "null", 4 );
 
+  err = _HKDBWrite( b, "\"", 1 );
+  require_noerr( err, exit );
+  for( start = str; *str; str++ ){
+    if( (uint8_t)*str >= ' ' && *str != '"' && *str != '\\' && *str != '/' ) continue;
+    err = _HKDBWrite( b, start, str - start );
+    require_noerr( err, exit );
+    switch( *str ){
+      case '"':  strcpy( escape, "\\\"" ); break;
+      case '\\': strcpy( escape, "\\\\" ); break;
+      case '/':  strcpy( escape, "\\/" ); break;
+      case '\b': strcpy( escape, "\\b" ); break;
+      case '\n': strcpy( escape, "\\n" ); break;
+      case '\r': strcpy( escape, "\\r" ); break;
+      case '\t': strcpy( escape, "\\t" ); break;
+      default:   snprintf( escape, sizeof(escape), "\\u%04x", (uint8_t)*str ); break;
+    }
+    err = _HKDBWrite( b, escape, strlen(escape) );
+    require_noerr( err, exit );
+    start = str + 1;
+  }
+  err = _HKDBWrite( b, start, str - start );
+  require_noerr( err, exit );
+  err = _HKDBWrite( b, "\"", 1 );
 
+exit:
+  return err;
+}
 
-static HkStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t inHapObject[], HK_Notify_t* notifyList, json_object **OutHapObjectJson, mico_Context_t * const inContext)
+static OSStatus _HKDBWriteValue( HK_DBBuffer_t *b, valueType type, value_union value )
 {
-  HkStatus err = kNoErr;
-  uint32_t accessoryIndex, serviceIndex, characteristicIndex;
-  uint32_t aid = 1;
-  uint32_t iid = 1;
-  struct _hapCharacteristic_t             pCharacteristic;
-  bool hasConstraint = false;
-  value_union value;
-  bool event;
+  switch(type){
+    case ValueType_bool:
+      return _HKDBPrintf( b, "%s", value.boolValue? "true" : "false" );
+    case ValueType_int:
+      return _HKDBPrintf( b, "%d", value.intValue );
+    case ValueType_float:
+      return _HKDBPrintf( b, "%g", value.floatValue );
+    case ValueType_string:
+      return _HKDBWriteString( b, value.stringValue );
+    case ValueType_date:
+      return _HKDBWriteString( b, value.dateValue );
+    default:
+      return _HKDBWrite( b, "null", 4 );
+  }
+}
 
-  json_object *hapJsonObject, *accessories, *accessory, *services, *service, *characteristics, *characteristic, *properties;
-  json_object *constraints, *metaData;
+/* Marks where a value or ev field is filled in for every response */
+static void _HKDBAddSlot( HK_DBBuffer_t *b, int aid, int serviceID, int characteristicID, int iid, uint8_t field )
+{
+  HK_DBSlot_t *slot;
+
+  if(b->slots){
+    slot = &b->slots[b->slotCount];
+    slot->offset = b->len;
+    slot->aid = aid;
+    slot->serviceID = serviceID;
+    slot->characteristicID = characteristicID;
+    slot->iid = iid;
+    slot->field = field;
+  }
+  b->slotCount++;
+}
 
-  hapJsonObject = json_object_new_object();
-  accessories = json_object_new_array();
-  json_object_object_add( hapJsonObject, "accessories", accessories ); 
+/* Serializes everything in the attribute database that never changes:
+   types, iids, perms, formats, metadata and static values. */
+static OSStatus _HKDBSerialize( struct _hapAccessory_t inHapObject[], HK_DBBuffer_t *b )
+{
+  OSStatus err = kNoErr;
+  int accessoryIndex, serviceIndex, characteristicIndex;
+  int iid, count;
+  const struct _hapCharacteristic_t *pCharacteristic;
 
-  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+#define _HKDBCheck( X ) do { err = (X); require_noerr( err, exit ); } while(0)
 
-    accessory = json_object_new_object();
-    json_object_array_add (accessories, accessory);
+  _HKDBCheck( _HKDBPrintf( b, "{\"accessories\":[" ) );
 
-    json_object_object_add( accessory, "aid", json_object_new_int(aid++) );   
-    services = json_object_new_array();
-    json_object_object_add( accessory, "services", services);
+  for(accessoryIndex = 0; accessoryIndex < NumberofAccessories; accessoryIndex++){
+    _HKDBCheck( _HKDBPrintf( b, "%s{\"aid\":%d,\"services\":[", accessoryIndex? ",":"", accessoryIndex+1 ) );
 
     for(serviceIndex = 0, iid = 1; serviceIndex < MAXServicePerAccessory; serviceIndex++){
       if(inHapObject[accessoryIndex].services[serviceIndex].type == 0)
         break;
-      service = json_object_new_object();
+      _HKDBCheck( _HKDBPrintf( b, "%s{\"type\":", serviceIndex? ",":"" ) );
+      _HKDBCheck( _HKDBWriteString( b, inHapObject[accessoryIndex].services[serviceIndex].type ) );
+      _HKDBCheck( _HKDBPrintf( b, ",\"iid\":%d,\"characteristics\":[", iid++ ) );
 
-      json_object_object_add( service, "type", json_object_new_string(inHapObject[0].services[serviceIndex].type));
-      json_object_object_add( service, "iid",  json_object_new_int(iid++));
+      for(characteristicIndex = 0, count = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
+        pCharacteristic = &inHapObject[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex];
+        if(pCharacteristic->type == NULL)  //Same as HKCreateIIDIndex: the list ends at the first empty entry
+          break;
 
-      characteristics = json_object_new_array();
+        _HKDBCheck( _HKDBPrintf( b, "%s{\"type\":", count++? ",":"" ) );
+        _HKDBCheck( _HKDBWriteString( b, pCharacteristic->type ) );
+        _HKDBCheck( _HKDBPrintf( b, ",\"iid\":%d,\"value\":", iid ) );
+        if(pCharacteristic->hasStaticValue)
+          _HKDBCheck( _HKDBWriteValue( b, pCharacteristic->valueType, pCharacteristic->value ) );
+        else
+          _HKDBAddSlot( b, accessoryIndex+1, serviceIndex+1, characteristicIndex+1, iid, kHKDBFieldValue );
+
+        _HKDBCheck( _HKDBPrintf( b, ",\"perms\":[%s%s%s]",
+                                 pCharacteristic->secureRead? "\"pr\"" : "",
+                                 pCharacteristic->secureRead && pCharacteristic->secureWrite? "," : "",
+                                 pCharacteristic->secureWrite? "\"pw\"" : "" ) );
+
+        if(pCharacteristic->hasEvents){
+          _HKDBCheck( _HKDBPrintf( b, ",\"ev\":" ) );
+          _HKDBAddSlot( b, accessoryIndex+1, serviceIndex+1, characteristicIndex+1, iid, kHKDBFieldEvent );
+        }
 
-      json_object_object_add( service, "characteristics",  characteristics);
+        if(pCharacteristic->valueType == ValueType_int){
+          if(pCharacteristic->hasMinimumValue)
+            _HKDBCheck( _HKDBPrintf( b, ",\"minValue\":%d", pCharacteristic->minimumValue.intValue ) );
+          if(pCharacteristic->hasMaximumValue)
+            _HKDBCheck( _HKDBPrintf( b, ",\"maxValue\":%d", pCharacteristic->maximumValue.intValue ) );
+          if(pCharacteristic->hasMinimumStep)
+            _HKDBCheck( _HKDBPrintf( b, ",\"minStep\":%d", pCharacteristic->minimumStep.intValue ) );
+        }else if(pCharacteristic->valueType == ValueType_float){
+          if(pCharacteristic->hasMinimumValue)
+            _HKDBCheck( _HKDBPrintf( b, ",\"minValue\":%g", pCharacteristic->minimumValue.floatValue ) );
+          if(pCharacteristic->hasMaximumValue)
+            _HKDBCheck( _HKDBPrintf( b, ",\"maxValue\":%g", pCharacteristic->maximumValue.floatValue ) );
+          if(pCharacteristic->hasMinimumStep)
+            _HKDBCheck( _HKDBPrintf( b, ",\"minStep\":%g", pCharacteristic->minimumStep.floatValue ) );
+        }
 
-      for(characteristicIndex = 0; characteristicIndex < MAXCharacteristicPerService; characteristicIndex++){
-        pCharacteristic = inHapObject[accessoryIndex].services[serviceIndex].characteristic[characteristicIndex];
-        if(pCharacteristic.type){
-          characteristic = json_object_new_object();
-          json_object_array_add( characteristics, characteristic ); 
-          /*Type*/
-          json_object_object_add( characteristic, "type", json_object_new_string(pCharacteristic.type));
-
-          /*Instance ID*/
-          json_object_object_add( characteristic, "iid", json_object_new_int(iid++));
-
-          HKReadCharacteristicValue(accessoryIndex+1, serviceIndex+1, characteristicIndex+1, &value, inContext);
-          /*Value*/
-          if(pCharacteristic.hasStaticValue)
-            value = pCharacteristic.value;
-
-          switch(pCharacteristic.valueType){
-            case ValueType_bool:
-              json_object_object_add( characteristic, "value", json_object_new_boolean(value.boolValue));
-              break;
-            case ValueType_int:
-              json_object_object_add( characteristic, "value", json_object_new_int(value.intValue));
-              break;
-            case ValueType_float:
-              json_object_object_add( characteristic, "value", json_object_new_double(value.floatValue));
-              break;
-            case ValueType_string:
-              json_object_object_add( characteristic, "value", json_object_new_string(value.stringValue));
-              break;
-            case ValueType_date:
-              json_object_object_add( characteristic, "value", json_object_new_string(value.dateValue));
-              break;
-            case ValueType_null:
-              json_object_object_add( characteristic, "value", NULL);
-              break;
-            default:
-              break;
-          }
+        if(pCharacteristic->hasMaxLength)
+          _HKDBCheck( _HKDBPrintf( b, ",\"maxLen\":%d", pCharacteristic->maxLength ) );
+        if(pCharacteristic->hasMaxDataLength)
+          _HKDBCheck( _HKDBPrintf( b, ",\"maxDataLen\":%d", pCharacteristic->maxDataLength ) );
+        if(pCharacteristic->description){
+          _HKDBCheck( _HKDBPrintf( b, ",\"description\":" ) );
+          _HKDBCheck( _HKDBWriteString( b, pCharacteristic->description ) );
+        }
+        if(pCharacteristic->format){
+          _HKDBCheck( _HKDBPrintf( b, ",\"format\":" ) );
+          _HKDBCheck( _HKDBWriteString( b, pCharacteristic->format ) );
+        }
+        if(pCharacteristic->unit){
+          _HKDBCheck( _HKDBPrintf( b, ",\"unit\":" ) );
+          _HKDBCheck( _HKDBWriteString( b, pCharacteristic->unit ) );
+        }
+        _HKDBCheck( _HKDBPrintf( b, "}" ) );
+        iid++;
+      }
+      _HKDBCheck( _HKDBPrintf( b, "]}" ) );
+    }
+    _HKDBCheck( _HKDBPrintf( b, "]}" ) );
+  }
+  _HKDBCheck( _HKDBPrintf( b, "]}" ) );
 
-          properties = json_object_new_array();
-          if(pCharacteristic.secureRead)
-            json_object_array_add( properties, json_object_new_string("pr") );
-          if(pCharacteristic.secureWrite)
-            json_object_array_add( properties, json_object_new_string("pw") );
-          json_object_object_add( characteristic, "perms", properties);
+#undef _HKDBCheck
 
-          if(pCharacteristic.hasEvents){
-            if(HKNotificationFind(aid, iid, notifyList)==kNoErr)
-              json_object_object_add( characteristic, "ev", json_object_new_boolean(true));
-            else
-              json_object_object_add( characteristic, "ev", json_object_new_boolean(false));
-          }
+exit:
+  return err;
+}
 
-          if(pCharacteristic.hasMinimumValue){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "minValue",  json_object_new_int(pCharacteristic.minimumValue.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "minValue",  json_object_new_double(pCharacteristic.minimumValue.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
+/* Builds the attribute database template once: the text is measured in a
+   first pass, then written to a buffer of exactly that size. */
+static OSStatus HKCreateHAPAttriDataBase( struct _hapAccessory_t inHapObject[] )
+{
+  OSStatus err;
+  HK_DBBuffer_t b;
 
-          if(pCharacteristic.hasMaximumValue){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "maxValue",  json_object_new_int(pCharacteristic.maximumValue.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "maxValue",  json_object_new_double(pCharacteristic.maximumValue.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
+  memset( &b, 0x0, sizeof(b) );
+  err = _HKDBSerialize( inHapObject, &b );
+  require_noerr( err, exit );
+  require_action( b.len <= 0xFFFF, exit, err = kSizeErr );
+
+  hkDBText = malloc( b.len );
+  require_action( hkDBText, exit, err = kNoMemoryErr );
+  hkDBSlots = calloc( b.slotCount, sizeof(HK_DBSlot_t) );
+  require_action( hkDBSlots || b.slotCount == 0, exit, err = kNoMemoryErr );
+
+  b.size = b.len;
+  b.buf = (uint8_t *)hkDBText;
+  b.slots = hkDBSlots;
+  b.len = 0;
+  b.slotCount = 0;
+  err = _HKDBSerialize( inHapObject, &b );
+  require_noerr( err, exit );
 
-          if(pCharacteristic.hasMinimumStep){
-            switch(pCharacteristic.valueType){
-              case ValueType_int:
-                json_object_object_add( characteristic, "minStep",  json_object_new_int(pCharacteristic.minimumStep.intValue) );
-                break;
-              case ValueType_float:
-                json_object_object_add( characteristic, "minStep",  json_object_new_double(pCharacteristic.minimumStep.floatValue) );
-                break;
-              default:
-                break;
-            }
-          }
-               
-          if(pCharacteristic.hasMaxLength)
-            json_object_object_add( characteristic, "maxLen",     json_object_new_int(pCharacteristic.maxLength));
+  hkDBTextLen = b.len;
+  hkDBSlotCount = b.slotCount;
+  ha_log("Attribute database template: %d bytes, %d dynamic fields", (int)hkDBTextLen, hkDBSlotCount);
 
-          if(pCharacteristic.hasMaxDataLength)
-            json_object_object_add( characteristic, "maxDataLen",     json_object_new_int(pCharacteristic.maxDataLength));
+exit:
+  if(err != kNoErr){
+    if(hkDBText) free(hkDBText);
+    if(hkDBSlots) free(hkDBSlots);
+    hkDBText = NULL;
+    hkDBSlots = NULL;
+  }
+  return err;
+}
 
-          if(pCharacteristic.description)
-            json_object_object_add( characteristic, "description", json_object_new_string(pCharacteristic.description));
+/* Sends the attribute database: the template text with the current values
+   and the session's ev flags filled in, streamed as chunks of one secure
+   frame each, without building a json_object tree. */
+static OSStatus HKSendHAPAttriDataBase( int sockfd, HK_Notify_t* notifyList, security_session_t *session, mico_Context_t * const inContext )
+{
+  OSStatus err;
+  HTTPWriter_t writer;
+  HK_DBBuffer_t b;
+  HK_DBSlot_t *slot;
+  const struct _hapCharacteristic_t *pCharacteristic;
+  value_union value;
+  size_t pos = 0;
+  int i;
 
-          if(pCharacteristic.format)
-            json_object_object_add( characteristic, "format", json_object_new_string(pCharacteristic.format));
+  memset( &b, 0x0, sizeof(b) );
+  require_action( hkDBText, exit, err = kNotPreparedErr );
 
-          if(pCharacteristic.unit)
-            json_object_object_add( characteristic, "unit", json_object_new_string(pCharacteristic.unit));
-        }
-      }
-      
-      json_object_array_add( services, service ); 
-    }    
+  b.size = kHKDBChunkSize;
+  b.buf = malloc( b.size );
+  require_action( b.buf, exit, err = kNoMemoryErr );
+  b.writer = &writer;
+
+  err = HTTPWriterBeginResponse( &writer, sockfd, kStatusOK, kMIMEType_HAP_JSON, kHTTPBodyLengthChunked );
+  require_noerr( err, exit );
+  writer.sendv = HKSecureSocketSendv;
+  writer.sendContext = session;
+
+  for(i = 0; i < hkDBSlotCount; i++){
+    slot = &hkDBSlots[i];
+    err = _HKDBWrite( &b, hkDBText + pos, slot->offset - pos );
+    require_noerr( err, exit );
+    pos = slot->offset;
+
+    if(slot->field == kHKDBFieldValue){
+      pCharacteristic = &hapObjects[slot->aid-1].services[slot->serviceID-1].characteristic[slot->characteristicID-1];
+      memset( &value, 0x0, sizeof(value) );
+      if(HKReadCharacteristicValue(slot->aid, slot->serviceID, slot->characteristicID, &value, inContext) == kHKNoErr)
+        err = _HKDBWriteValue( &b, pCharacteristic->valueType, value );
+      else
+        err = _HKDBWrite( &b, "null", 4 );
+    }else
+      err = _HKDBPrintf( &b, "%s", HKNotificationFind(slot->aid, slot->iid, notifyList)==kNoErr? "true" : "false" );
+    require_noerr( err, exit );
   }
-  
-  *OutHapObjectJson = hapJsonObject;
+  err = _HKDBWrite( &b, hkDBText + pos, hkDBTextLen - pos );
+  require_noerr( err, exit );
 
-  return err;
+  err = HTTPWriterWrite( &writer, b.buf, b.len );
+  require_noerr( err, exit );
+  err = HTTPWriterEnd( &writer );
+  require_noerr( err, exit );
 
+exit:
+  if(b.buf) free(b.buf);
+  return err;
 }
 
 
 
+/* Parses the next "aid.iid" of a comma separated id list in place, anything but digits and one '.' is malformed */
 OSStatus IDGetNext( 
         const uint8_t *     inSrc, 
         const uint8_t *     inEnd, 
@@ -626,15 +984,22 @@ OSStatus IDGetNext(
         int *               outIID, 
         const uint8_t **    outNext )
 {
-  char tmp;
+  const uint8_t *idStart = inSrc;
+  int *field = outAID;
+
   if(inSrc>=inEnd) return kNotFoundErr;
-  uint8_t *endPoint = memchr((const char *)inSrc, ',', inEnd - inSrc);
-  if(!endPoint) endPoint = (uint8_t *)inEnd;
-  tmp = *endPoint;
-  *endPoint = 0x0;
-  sscanf((const char *)inSrc, "%d.%d", outAID, outIID);
-  *endPoint = tmp;
-  *outNext = endPoint + 1;
+  *outAID = 0;
+  *outIID = 0;
+  for( ; inSrc < inEnd && *inSrc != ','; inSrc++ ){
+    if(*inSrc == '.' && field == outAID && inSrc > idStart)
+      field = outIID;
+    else if(*inSrc >= '0' && *inSrc <= '9' && *field < 0x10000)
+      *field = *field * 10 + (*inSrc - '0');
+    else
+      return kMalformedErr;
+  }
+  if(field != outIID || inSrc[-1] == '.') return kMalformedErr;
+  *outNext = inSrc + 1;
   return kNoErr;
 }
 
@@ -648,18 +1013,22 @@ HkStatus _HKCreateReadResponsePerCharacteristic(struct _hapAccessory_t inHapObje
   value_union value;
   bool event;
   static json_object *characteristic;
-  struct _hapCharacteristic_t pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
+  struct _hapCharacteristic_t pCharacteristic;
   
   characteristic = json_object_new_object();
   json_object_array_add(inHapReadRespondJson, characteristic);
   json_object_object_add( characteristic, "aid", json_object_new_int(id.aid));
   json_object_object_add( characteristic, "iid", json_object_new_int(id.iid));
 
+  if(id.serviceID == 0 || id.characteristicID == 0){
+    json_object_object_add( characteristic, "status", json_object_new_int(kHKNotExistErr));
+    return kHKNotExistErr;
+  }
+  pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
+
   if(pCharacteristic.secureRead == false){
     hkErr = kHKReadFromWOErr;
-  }else if(id.serviceID == 0)
-    hkErr = kHKNotExistErr;
-  else{
+  }else{
     if(pCharacteristic.hasStaticValue)
       value = pCharacteristic.value;
     else
@@ -822,7 +1191,6 @@ void _HKCreateWriteEVPerCharacteristic(struct _hapAccessory_t inHapObject[], HK_
   
   if( pCharacteristic.hasEvents == true && id.serviceID && id.characteristicID ){
     if(enableNotify){
-      FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
       HKReadCharacteristicValue(id.aid, id.serviceID, id.characteristicID, &value, inContext);
       HKNotificationAdd(id.aid, id.iid, value, notifyList);
     }else{
@@ -839,7 +1207,7 @@ HkStatus _HKCreateWriteResponsePerCharacteristic(struct _hapAccessory_t inHapObj
   bool event;
   int httpStatus = kStatusOK;
   static json_object *characteristic;
-  struct _hapCharacteristic_t pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
+  struct _hapCharacteristic_t pCharacteristic;
   
   characteristic = json_object_new_object();
   json_object_array_add(inHapReadRespondJson, characteristic);
@@ -848,6 +1216,7 @@ HkStatus _HKCreateWriteResponsePerCharacteristic(struct _hapAccessory_t inHapObj
 
   if(id.serviceID == 0 || id.characteristicID == 0)
     return kHKNotExistErr;
+  pCharacteristic = ((inHapObject[id.aid-1]).services[id.serviceID-1]).characteristic[id.characteristicID-1];
 
   if(check_value){
     if(pCharacteristic.secureWrite == false){
@@ -877,7 +1246,10 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
   printbuf *buffer = NULL;
   uint32_t idx;
   size_t arrayLen;
-  err = HKSocketReadHTTPHeader( sockfd, httpHeader, inHkContext->session );
+  /* A request whose body is still arriving resumes with the body, its header is already parsed */
+  inHkContext->hasPipelined = false;
+  if(inHkContext->readingBody == false)
+    err = HKSocketReadHTTPHeader( sockfd, httpHeader, inHkContext->session );
   int accessoryID, serviceID, characteristicID;
   json_object *characteristics, *characteristic, *outCharacteristics, *outCharacteristic, *event_obj;
   json_object *value_obj = NULL;
@@ -887,26 +1259,32 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
   int status = kStatusOK;
   int aid, iid;
   HK_Char_ID_t id;
+  URLRouteMatch_t route;
 
   switch ( err )
   {
     case kNoErr:
+        inHkContext->readingBody = true;
         err = HKSocketReadHTTPBody( sockfd, httpHeader, inHkContext->session );
+        // Body not complete yet, continue when more data arrives
+        if(err == EWOULDBLOCK) return kNoErr;
+        inHkContext->readingBody = false;
         require_noerr(err, exit);
-        /*Pair set engine*/
-        if(HTTPHeaderMatchURL( httpHeader, kPAIRSETUP ) == kNoErr) {
-          err = HTTPHeaderMatchMethod( httpHeader, "POST");
-          require_noerr_action(err, exit, status = kStatusMethodNotAllowed);
 
+        err = URLRouterMatch( hkRouter, httpHeader->methodPtr, httpHeader->methodLen, &httpHeader->url, &route );
+        /*Known URL path but wrong method*/
+        require_action( err != kUnsupportedErr, exit, status = kStatusMethodNotAllowed );
+        /*Unknow URL path*/
+        require_action( err == kNoErr, exit, status = kStatusNotFound );
+
+        /*Pair set engine*/
+        if(route.route->tag == eHKRoutePairSetup) {
           err = HKPairSetupEngine( sockfd, httpHeader, &inHkContext->pairInfo, inContext );
           require_noerr( err, exit );
           if(inContext->appStatus.haPairSetupRunning == false){err = kConnectionErr; goto exit;};
         }
         /*Pair verify engine*/ 
-        else if(HTTPHeaderMatchURL( httpHeader, kPAIRVERIFY ) == kNoErr){
-          err = HTTPHeaderMatchMethod( httpHeader, "POST");
-          require_noerr_action(err, exit, status = kStatusMethodNotAllowed);
-
+        else if(route.route->tag == eHKRoutePairVerify){
           if(inHkContext->pairVerifyInfo == NULL){
             inHkContext->pairVerifyInfo = HKCreatePairVerifyInfo();
             require_action( inHkContext->pairVerifyInfo, exit, err = kNoMemoryErr );
@@ -922,20 +1300,14 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
           }
         }
         /* Add or remove pairs */ 
-        else if(HTTPHeaderMatchURL( httpHeader, kPAIRINGS ) == kNoErr){
-          err = HTTPHeaderMatchMethod( httpHeader, "POST");
-          require_noerr_action(err, exit, status = kStatusMethodNotAllowed);
-
+        else if(route.route->tag == eHKRoutePairings){
           require_action( inHkContext->session->established == true, exit, err = kAuthenticationErr; status = kStatusAuthenticationErr );
 
           err = HKPairAddRemoveEngine( sockfd, httpHeader, inHkContext->session );
           require_noerr( err, exit );
         }
         /* Identity routine under unpaired */
-        else if(HTTPHeaderMatchURL( httpHeader, kIdentity ) == kNoErr){
-          err = HTTPHeaderMatchMethod( httpHeader, "POST");
-          require_noerr_action(err, exit, status = kStatusMethodNotAllowed);
-
+        else if(route.route->tag == eHKRouteIdentify){
           require_action( inHkContext->session->established == false, exit, err = kAuthenticationErr; status = kStatusBadRequest; hkErr = kHKPrivilegeErr );
 
           HKExcuteUnpairedIdentityRoutine( inContext );
@@ -944,27 +1316,18 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
           require_noerr(err, exit);
         }
         /*Read accessories database*/
-        else if(HTTPHeaderMatchURL( httpHeader, kReadAcc ) == kNoErr){
-          err = HTTPHeaderMatchMethod( httpHeader, "GET");
-          require_noerr_action(err, exit, status = kStatusMethodNotAllowed);
-
+        else if(route.route->tag == eHKRouteReadAccessories){
           require_action( inHkContext->session->established == true, exit, err = kAuthenticationErr; status = kStatusAuthenticationErr );
 
-          err = HKCreateHAPAttriDataBase(hapObjects, *notifyList, &outhapJsonObject, inContext);
-          require_noerr( err, exit );
-          buffer = json_object_to_json_string_ex(outhapJsonObject);
-          ha_log("Json cstring generated, memory remains %d, %s", mico_memory_info()->free_memory, buffer->buf);
-          json_object_put(outhapJsonObject);
-          outhapJsonObject = NULL;
-          err = HKSendResponseMessage(sockfd, status, (uint8_t *)buffer->buf, strlen(buffer->buf), inHkContext->session);
+          err = HKSendHAPAttriDataBase(sockfd, *notifyList, inHkContext->session, inContext);
           require_noerr(err, exit);
         }
         /*Read or write characteristics*/
-        else if (HTTPHeaderMatchPartialURL( httpHeader, kRWCharacter ) != NULL){
+        else if (route.route->tag == eHKRouteReadCharacteristics || route.route->tag == eHKRouteWriteCharacteristics){
 
           require_action( inHkContext->session->established == true, exit, err = kAuthenticationErr; status = kStatusAuthenticationErr );
 
-          if(HTTPHeaderMatchMethod( httpHeader, "GET")!=kNotFoundErr){ //Read
+          if(route.route->tag == eHKRouteReadCharacteristics){ //Read
             hkErr = kNoErr;
             outhapJsonObject = json_object_new_object();
             outCharacteristics = json_object_new_array();
@@ -978,7 +1341,8 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             void *idPtr = memmem((void *)httpHeader->url.queryPtr, httpHeader->url.queryLen, "id=", strlen("id="));
             require_action(idPtr, exit, err = kNotFoundErr; status = kStatusBadRequest);
             void *idPtrEnd = (void *)(httpHeader->url.queryPtr + httpHeader->url.queryLen);
-            if(memchr(idPtrEnd, '&', (uint8_t *)idPtrEnd - (uint8_t *)idPtr)) idPtrEnd = memchr(idPtrEnd, '&', (uint8_t *)idPtrEnd - (uint8_t *)idPtr);
+            void *idAmpPtr = memchr(idPtr, '&', (uint8_t *)idPtrEnd - (uint8_t *)idPtr);
+            if(idAmpPtr) idPtrEnd = idAmpPtr;
 
             bool needMeta = metaPtr? *(uint8_t *)((uint8_t *)metaPtr+strlen("meta="))-0x30 :false;
             bool needPerms = permsPtr? *(uint8_t *)((uint8_t *)permsPtr+strlen("perms="))-0x30 :false;
@@ -989,19 +1353,19 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             const uint8_t *         src = (const uint8_t *) idPtr + strlen("id=");
             const uint8_t * const   end = idPtrEnd;
 
-            while( IDGetNext( src, end, &id.aid, &id.iid, &src ) == kNoErr ) //Not support ev, perm...
+            while( ( err = IDGetNext( src, end, &id.aid, &id.iid, &src ) ) == kNoErr ) //Not support ev, perm...
             {
-              FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
-              if(id.characteristicID == 0){ //Read every haracteristic in one service
+              FindCharacteristicByIID(id.aid, id.iid, &id.serviceID, &id.characteristicID);
+              if(id.serviceID && id.characteristicID == 0){ //Read every haracteristic in one service, their iids follow the service's
                 for(id.characteristicID = 1; id.characteristicID <= MAXCharacteristicPerService; id.characteristicID++){
                   if(hapObjects[id.aid-1].services[id.serviceID-1].characteristic[id.characteristicID-1].type == 0 )
                     break;
+                  id.iid++;
 
                   if(_HKCreateReadResponsePerCharacteristic(hapObjects, id, 
                                                             needMeta, needPerms, needType, needEv, *notifyList,
                                                             outCharacteristics, inContext)!=kHKNoErr)
                     status = kStatusPartialContent;
-                  id.characteristicID ++;
                 }
               }else{ //Read single haracteristic
                 if(_HKCreateReadResponsePerCharacteristic(hapObjects, id, 
@@ -1010,6 +1374,14 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
                   status = kStatusPartialContent;
               }
             }
+            /* A malformed id list is answered with 400, not with the ids that parsed before it */
+            if(err != kNotFoundErr){
+              json_object_put(outhapJsonObject);
+              outhapJsonObject = NULL;
+              status = kStatusBadRequest;
+              goto exit;
+            }
+            err = kNoErr;
             
             /* Remove status object if no error occured */
             if(status != kStatusPartialContent){
@@ -1029,8 +1401,8 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             require_noerr(err, exit);
           }
         /* Write characteristic */
-        else if(HTTPHeaderMatchMethod( httpHeader, "PUT")!=kNotFoundErr){
-          inhapJsonObject = json_tokener_parse(httpHeader->extraDataPtr);
+        else if(route.route->tag == eHKRouteWriteCharacteristics){
+          inhapJsonObject = HTTPHeaderTakeJsonBody(httpHeader);
           require_action(inhapJsonObject, exit, err = kMalformedErr);
           characteristics = json_object_object_get(inhapJsonObject, "characteristics");
           require_action(characteristics, exit, err = kMalformedErr);
@@ -1049,7 +1421,7 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             characteristic = json_object_array_get_idx(characteristics, idx);
             id.aid = json_object_get_int(json_object_object_get(characteristic, "aid"));
             id.iid = json_object_get_int(json_object_object_get(characteristic, "iid"));
-            FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);      
+            FindCharacteristicByIID(id.aid, id.iid, &id.serviceID, &id.characteristicID);      
 
             value_obj = json_object_object_get(characteristic, "value");
             event_obj = json_object_object_get(characteristic, "ev");
@@ -1068,11 +1440,16 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
             characteristic = json_object_array_get_idx(characteristics, idx);
             id.aid = json_object_get_int(json_object_object_get(characteristic, "aid"));
             id.iid = json_object_get_int(json_object_object_get(characteristic, "iid"));
-            FindCharacteristicByIID(hapObjects, id.aid, id.iid, &id.serviceID, &id.characteristicID);
+            FindCharacteristicByIID(id.aid, id.iid, &id.serviceID, &id.characteristicID);
 
             value_obj = json_object_object_get(characteristic, "value");
             event_obj = json_object_object_get(characteristic, "ev");
 
+            /* The writer already knows the new value, keep it from coming back as an event */
+            if(value_obj && id.characteristicID && HKNotificationFind(id.aid, id.iid, *notifyList) == kNoErr &&
+               HKReadCharacteristicValue(id.aid, id.serviceID, id.characteristicID, &value, inContext) == kHKNoErr)
+              HKNotificationAdd(id.aid, id.iid, value, notifyList);
+
             if(_HKCreateWriteResponsePerCharacteristic(hapObjects, id, outCharacteristics, value_obj, event_obj, inContext)!=kHKNoErr)
               status = kStatusPartialContent;               
           }
@@ -1110,8 +1487,8 @@ OSStatus HKhandleIncomeingMessage(int sockfd, HTTPHeader_t *httpHeader, HK_Notif
     break;
 
     case EWOULDBLOCK:
-        // NO-OP, keep reading
-    break;
+        // Header not complete yet, keep what was read and continue when more data arrives
+        return kNoErr;
 
     case kNoSpaceErr:
       status = kStatusBadRequest;
@@ -1140,6 +1517,8 @@ exit:
   }
 
   HTTPHeaderClear( httpHeader );
+  /* Serve what HTTPHeaderClear carried over, or report that it could not */
+  inHkContext->hasPipelined = ( httpHeader->len > 0 || httpHeader->firstErr != kNoErr );
   if(outhapJsonObject) json_object_put(outhapJsonObject);
   if(inhapJsonObject) json_object_put(inhapJsonObject);
   if(buffer) printbuf_free(buffer);
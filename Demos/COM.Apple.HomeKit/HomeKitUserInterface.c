@@ -5,6 +5,7 @@
 #include "MDNSUtils.h"
 
 extern void HKBonjourUpdateStateNumber( mico_Context_t * const inContext );
+extern void HKCharacteristicChanged( int accessoryID, int serviceID, int characteristicID );
 
 
 HkStatus HKExcuteUnpairedIdentityRoutine( mico_Context_t * const inContext )
@@ -173,6 +174,11 @@ void HKWriteCharacteristicValue(int accessoryID, int serviceID, int characterist
 
   /*You can store the new value in xxxx_new and operate target later when moreComing == false
     or write to target right now!*/
+
+  /*Subscribed controllers are notified after the write. Call HKCharacteristicChanged the same way
+    when the accessory changes a value by itself (buttons, sensors...)*/
+  HKCharacteristicChanged( accessoryID, serviceID, characteristicID );
+
   if(serviceID == 1){
     if(characteristicID == 1)
       strncpy(inContext->flashContentInRam.micoSystemConfig.name, value.stringValue, 64);
@@ -339,4 +345,4 @@ void HKCharacteristicInit(mico_Context_t * const inContext)
 int verify_otp(void)
 {
   return 1;
-}
\ No newline at end of file
+}
\ No newline at end of file
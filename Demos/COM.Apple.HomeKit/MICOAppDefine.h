@@ -51,6 +51,7 @@
 #define LOCAL_TCP_SERVER_LOOPBACK_PORT      1000
 #define REMOTE_TCP_CLIENT_LOOPBACK_PORT     1002
 #define RECVED_UART_DATA_LOOPBACK_PORT      1003
+#define HA_EVENT_LOOPBACK_PORT              1004
 
 #define BONJOUR_SERVICE         "_hap._tcp.local."
 
@@ -58,6 +59,8 @@
 #define HA_PV               "1.0"
 #define HA_SV               "1.0"
 #define HA_SERVER_PORT      1200  
+#define HA_MAX_CONNECTIONS  8     // Controller sessions served at once by the HomeKit server thread
+#define HA_EVENT_COALESCE_MS 20   // Characteristic changes within this window are sent in one EVENT message
 
 typedef enum
 {
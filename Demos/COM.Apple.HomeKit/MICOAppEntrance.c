@@ -65,7 +65,9 @@ OSStatus MICOStartApplication( mico_Context_t * const inContext )
   if(inContext->flashContentInRam.micoSystemConfig.bonjourEnable == true)
     MICOStartBonjourService( Station, inContext );
 
-  err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "HomeKit Server", homeKitListener_thread, 0x500, (void*)inContext );
+  /* Every HomeKit session runs on this thread. Pair setup/verify keep their TLV buffers and
+     HKDF contexts on the heap, so this stack only has to carry the SRP and ed25519 calls */
+  err = mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "HomeKit Server", homeKitListener_thread, 0x1200, (void*)inContext );
   require_noerr_action( err, exit, app_log("ERROR: Unable to start the Homekit thread.") );
 
 exit:
@@ -55,6 +55,31 @@
 #define kCONFIGURLResetCloudDevInfo    "/dev-cloud_reset"
 #define kCONFIGURLDevFWUpdate          "/dev-fw_update"
 
+typedef enum {
+  eConfigRouteRead = 0,
+  eConfigRouteWrite,
+  eConfigRouteDevState,
+  eConfigRouteDevActivate,
+  eConfigRouteDevAuthorize,
+  eConfigRouteResetCloudDevInfo,
+  eConfigRouteDevFWUpdate,
+  eConfigRouteOTA,
+} configRoute_t;
+
+static const URLRoute_t configRoutes[] = {
+  { NULL, kCONFIGURLRead,              NULL, eConfigRouteRead },
+  { NULL, kCONFIGURLWrite,             NULL, eConfigRouteWrite },
+  { NULL, kCONFIGURLDevState,          NULL, eConfigRouteDevState },
+  { NULL, kCONFIGURLDevActivate,       NULL, eConfigRouteDevActivate },
+  { NULL, kCONFIGURLDevAuthorize,      NULL, eConfigRouteDevAuthorize },
+  { NULL, kCONFIGURLResetCloudDevInfo, NULL, eConfigRouteResetCloudDevInfo },
+#ifdef MICO_FLASH_FOR_UPDATE
+  { NULL, kCONFIGURLDevFWUpdate,       NULL, eConfigRouteDevFWUpdate },
+  { NULL, kCONFIGURLOTA,               NULL, eConfigRouteOTA },
+#endif
+};
+static URLRouter_t *configRouter = NULL;
+
 extern OSStatus     ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext );
 extern json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext );
 extern OSStatus getMVDActivateRequestData(const char *input, MVDActivateRequestData_t *activateData);
@@ -86,6 +111,11 @@ void localConfiglistener_thread(void *inContext)
   
   int localConfiglistener_fd = -1;
 
+  if(configRouter == NULL){
+    err = URLRouterCreate( configRoutes, sizeof(configRoutes)/sizeof(URLRoute_t), &configRouter );
+    require_noerr( err, exit );
+  }
+
   /*Establish a TCP server fd that accept the tcp clients connections*/ 
   localConfiglistener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
   require_action(IsValidSocket( localConfiglistener_fd ), exit, err = kNoResourcesErr );
@@ -215,6 +245,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
   uint8_t *httpResponse = NULL;
   size_t httpResponseLen = 0;
   json_object* report = NULL;
+  URLRouteMatch_t route;
   config_log_trace();
   
   MVDActivateRequestData_t devActivateRequestData;
@@ -236,25 +267,24 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
 #endif
 
   //config_log("recv=%s", inHeader->buf);
-  if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLRead ) == kNoErr){    
+  if(URLRouterMatch( configRouter, inHeader->methodPtr, inHeader->methodLen, &inHeader->url, &route ) != kNoErr){
+    return kNotFoundErr;
+  }
+  
+  if(route.route->tag == eConfigRouteRead){    
     report = ConfigCreateReportJsonMessage( inContext );
     require( report, exit );
     json_str = json_object_to_json_string(report);
     require_action( json_str, exit, err = kNoMemoryErr );
     config_log("Send config object=%s", json_str);
-    err =  ECS_CreateSimpleHTTPMessageNoCopy( ECS_kMIMEType_JSON, strlen(json_str), &httpResponse, &httpResponseLen );
-    require_noerr( err, exit );
-    require( httpResponse, exit );
-    err = SocketSend( fd, httpResponse, httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend( fd, (uint8_t *)json_str, strlen(json_str) );
+    err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
     require_noerr( err, exit );
     config_log("Current configuration sent");
     SocketClose(&fd);
     err = kConnectionErr; //Return an err to close the current thread
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr){
+  else if(route.route->tag == eConfigRouteWrite){
     if(inHeader->contentLength > 0){
       config_log("Recv new configuration, apply and reset");
       err = ConfigIncommingJsonMessage( inHeader->extraDataPtr, inContext);
@@ -271,7 +301,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
     }
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLDevState ) == kNoErr){
+  else if(route.route->tag == eConfigRouteDevState){
     if(inHeader->contentLength > 0){
       config_log("Recv device getState request.");
       memset((void*)&devGetStateRequestData, '\0', sizeof(devGetStateRequestData));
@@ -285,17 +315,14 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
       
-      err =  ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str), 
-                                     &httpResponse, &httpResponseLen );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       
       err = kConnectionErr; //Return an err to close the current thread
     }
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLDevActivate ) == kNoErr){
+  else if(route.route->tag == eConfigRouteDevActivate){
     if(inHeader->contentLength > 0){
       config_log("Recv device activate request.");
       memset((void*)&devActivateRequestData, '\0', sizeof(devActivateRequestData));
@@ -314,11 +341,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
       
-      err =  ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str), 
-                                     &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       
       inContext->micoStatus.sys_state = eState_Software_Reset;
@@ -327,7 +350,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
     }
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLDevAuthorize ) == kNoErr){
+  else if(route.route->tag == eConfigRouteDevAuthorize){
     if(inHeader->contentLength > 0){
       config_log("Recv device authorize request.");
       memset((void*)&devAuthorizeRequestData, '\0', sizeof(devAuthorizeRequestData));
@@ -346,10 +369,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
       
-      err =  ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str), 
-                                     &httpResponse, &httpResponseLen );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       
       err = kConnectionErr; //Return an err to close the current thread
@@ -360,7 +380,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
     }
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLResetCloudDevInfo ) == kNoErr){
+  else if(route.route->tag == eConfigRouteResetCloudDevInfo){
     if(inHeader->contentLength > 0){
       config_log("Recv cloud device info reset request.");
       memset((void*)&devResetRequestData, '\0', sizeof(devResetRequestData));
@@ -384,7 +404,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
     goto exit;
   }
 #ifdef MICO_FLASH_FOR_UPDATE
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLDevFWUpdate ) == kNoErr){
+  else if(route.route->tag == eConfigRouteDevFWUpdate){
     if(inHeader->contentLength > 0){
       config_log("Recv device fw_update request.");
       memset((void*)&devOTARequestData, '\0', sizeof(devOTARequestData));
@@ -426,7 +446,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
       
     goto exit;
   }
-  else if(ECS_HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr){
+  else if(route.route->tag == eConfigRouteOTA){
     if(inHeader->contentLength > 0){
       config_log("Receive OTA data!");
       mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -388,13 +388,11 @@ exit:
   return mainObject;
 }
 
-OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
+OSStatus ConfigIncommingJsonObject( json_object *new_obj, mico_Context_t * const inContext )
 {
   OSStatus err = kNoErr;
-  json_object *new_obj;
   config_delegate_log_trace();
 
-  new_obj = json_tokener_parse(input);
   require_action(new_obj, exit, err = kUnknownErr);
   config_delegate_log("Recv config object=%s", json_object_to_json_string(new_obj));
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -441,13 +439,27 @@ OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const i
     }else{
     }
   }
-  json_object_put(new_obj);
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
 
 exit:
   return err; 
 }
 
+OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  json_object *new_obj;
+  config_delegate_log_trace();
+
+  new_obj = json_tokener_parse(input);
+  require_action(new_obj, exit, err = kUnknownErr);
+  err = ConfigIncommingJsonObject(new_obj, inContext);
+  json_object_put(new_obj);
+
+exit:
+  return err; 
+}
+
 /*******************************************************************************
  * get json data of fogcloud local tcp request 
  * for device state/activate/authorize/reset/ota
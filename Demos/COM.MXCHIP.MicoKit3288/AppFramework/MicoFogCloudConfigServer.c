@@ -219,10 +219,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
       fogcloud_config_log("get device state success!");
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
-      err = ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str),
-                                        &httpResponse, &httpResponseLen );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       err = kConnectionErr; //Return an err to close the current thread
     }
@@ -243,11 +240,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
                              json_object_new_string(inContext->flashContentInRam.appConfig.fogcloudConfig.deviceId));
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
-      err = ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str),
-                                        &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       err = kConnectionErr; //Return an err to close the current thread
       //inContext->micoStatus.sys_state = eState_Software_Reset;
@@ -271,10 +264,7 @@ OSStatus _LocalConfigRespondInComingMessage(int fd, ECS_HTTPHeader_t* inHeader,
                              json_object_new_string(inContext->flashContentInRam.appConfig.fogcloudConfig.deviceId));
       json_str = (char*)json_object_to_json_string(report);
       //config_log("json_str=%s", json_str);
-      err = ECS_CreateSimpleHTTPMessage( ECS_kMIMEType_JSON, (uint8_t*)json_str, strlen(json_str),
-                                        &httpResponse, &httpResponseLen );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
+      err = ECS_HTTPResponseSend( fd, ECS_kStatusOK, ECS_kMIMEType_JSON, (const uint8_t*)json_str, strlen(json_str) );
       SocketClose(&fd);
       err = kConnectionErr; //Return an err to close the current thread
       // inContext->micoStatus.sys_state = eState_Software_Reset;
@@ -322,13 +322,11 @@ exit:
   return mainObject;
 }
 
-OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
+OSStatus ConfigIncommingJsonObject( json_object *new_obj, mico_Context_t * const inContext )
 {
   OSStatus err = kNoErr;
-  json_object *new_obj;
   config_delegate_log_trace();
 
-  new_obj = json_tokener_parse(input);
   require_action(new_obj, exit, err = kUnknownErr);
   config_delegate_log("Recv config object=%s", json_object_to_json_string(new_obj));
   mico_rtos_lock_mutex(&inContext->flashContentInRam_mutex);
@@ -374,9 +372,23 @@ OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const i
       inContext->flashContentInRam.appConfig.USART_BaudRate = json_object_get_int(val);
     }
   }
-  json_object_put(new_obj);
   mico_rtos_unlock_mutex(&inContext->flashContentInRam_mutex);
 
+exit:
+  return err; 
+}
+
+OSStatus ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  json_object *new_obj;
+  config_delegate_log_trace();
+
+  new_obj = json_tokener_parse(input);
+  require_action(new_obj, exit, err = kUnknownErr);
+  err = ConfigIncommingJsonObject(new_obj, inContext);
+  json_object_put(new_obj);
+
 exit:
   return err; 
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+/*
+	File:    chacha20poly1305-test.c
+
+	Known-answer tests and a per-frame-size benchmark for chacha20poly1305.c.
+
+	The benchmark only uses the public API, so linking this file against Library/MicoCrypto.a instead of
+	chacha20poly1305.c gives the numbers for the binary library to compare with.
+*/
+
+#include "Common.h"
+#include "Debug.h"
+#include "MICORTOS.h"
+#include "MICOCrypto/crypto_aead_chacha20poly1305.h"
+#include "MICOCrypto/crypto_stream_chacha20.h"
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+OSStatus	chacha20poly1305_test( int print );
+OSStatus	chacha20poly1305_bench( int print );
+
+//===========================================================================================================================
+//	Test Vectors
+//===========================================================================================================================
+
+// ChaCha20 keystream for an all-zero key and nonce.
+
+static const uint8_t		kChaCha20ZeroKeystream[ 64 ] =
+{
+	0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90, 0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+	0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a, 0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+	0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d, 0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+	0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c, 0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86
+};
+
+// RFC 7539 section 2.4.2. Its 96-bit nonce 00:00:00:00:00:00:00:4a:00:00:00:00 with block counter 1 is the same state
+// as the 64-bit nonce 00:00:00:4a:00:00:00:00 with initial counter 1.
+
+static const uint8_t		kChaCha20RFCNonce[ 8 ] = { 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00 };
+static const char			kChaCha20RFCPlaintext[] =
+	"Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+
+static const uint8_t		kChaCha20RFCCiphertext[ 114 ] =
+{
+	0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+	0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+	0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+	0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+	0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+	0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+	0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+	0x87, 0x4d
+};
+
+// ChaCha20-Poly1305 from RFC 7539 section 2.8.2, with the plaintext of section 2.4.2. The RFC's 96-bit nonce starts
+// with the constant 07:00:00:00, which a 64-bit nonce can't express (those bits are the high half of the block
+// counter). The constant is 0 here, as in HomeKit, and the 64-bit nonce is the RFC's IV. The result was checked with
+// a reference implementation that reproduces the RFC's tag 1a:e1:0b:59:... with the original nonce.
+
+static const uint8_t		kAEADKey[ 32 ] =
+{
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f
+};
+static const uint8_t		kAEADNonce[ 8 ]			= { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+static const uint8_t		kAEADAD[ 12 ]			= { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+#define kAEADPlaintext			( (const uint8_t *) kChaCha20RFCPlaintext )
+#define kAEADPlaintextSize		sizeof( kChaCha20RFCCiphertext )
+static const uint8_t		kAEADCiphertext[ 114 + 16 ] =
+{
+	0xa4, 0x79, 0xcb, 0x54, 0x62, 0x89, 0x46, 0xd6, 0xf4, 0x04, 0x2a, 0x8e, 0x38, 0x4e, 0xf4, 0xbd,
+	0x2f, 0xbc, 0x73, 0x30, 0xb8, 0xbe, 0x55, 0xeb, 0x2d, 0x8d, 0xc1, 0x8a, 0xaa, 0x51, 0xd6, 0x6a,
+	0x8e, 0xc1, 0xf8, 0xd3, 0x61, 0x9a, 0x25, 0x8d, 0xb0, 0xac, 0x56, 0x95, 0x60, 0x15, 0xb7, 0xb4,
+	0x93, 0x7e, 0x9b, 0x8e, 0x6a, 0xa9, 0x57, 0xb3, 0xdc, 0x02, 0x14, 0xd8, 0x03, 0xd7, 0x76, 0x60,
+	0xaa, 0xbc, 0x91, 0x30, 0x92, 0x97, 0x1d, 0xa8, 0xf2, 0x07, 0x17, 0x1c, 0xe7, 0x84, 0x36, 0x08,
+	0x16, 0x2e, 0x2e, 0x75, 0x9d, 0x8e, 0xfc, 0x25, 0xd8, 0xd0, 0x93, 0x69, 0x90, 0xaf, 0x63, 0xc8,
+	0x20, 0xba, 0x87, 0xe8, 0xa9, 0x55, 0xb5, 0xc8, 0x27, 0x4e, 0xf7, 0xd1, 0x0f, 0x6f, 0xaf, 0xd0,
+	0x46, 0x47, 0x2d, 0xbf, 0x18, 0x9b, 0x66, 0x8b, 0xd4, 0x30, 0xae, 0xf9, 0x14, 0x7e, 0x99, 0xcb,
+	0x6c, 0x89
+};
+
+// A 300-byte message, so the multi-block path and a tail are both used. Key byte i is i * 7 + 3, message byte i is
+// i * 13 + 1. The tag covers the ciphertext, so checking the first block and the tag checks all of it.
+
+static const uint8_t		kAEADLongNonce[ 8 ]		= { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 };
+static const uint8_t		kAEADLongAD[ 12 ]		= { 0xf3, 0x33, 0x88, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4e, 0x91 };
+static const uint8_t		kAEADLongFirstBlock[ 16 ] =
+{
+	0x73, 0x90, 0xf6, 0xfe, 0xe2, 0x46, 0x7a, 0x5d, 0x99, 0x3b, 0x20, 0xe1, 0xee, 0x06, 0xc7, 0x5f
+};
+static const uint8_t		kAEADLongTag[ 16 ] =
+{
+	0x88, 0x86, 0x64, 0x80, 0xd1, 0xa8, 0x9f, 0xbf, 0xc5, 0x05, 0xb5, 0xee, 0xb4, 0x68, 0x98, 0x7e
+};
+
+//===========================================================================================================================
+//	chacha20poly1305_test
+//===========================================================================================================================
+
+OSStatus	chacha20poly1305_test( int print )
+{
+	OSStatus				err;
+	uint8_t					key[ 32 ], nonce[ 8 ];
+	uint8_t					buf[ 300 + 16 ], buf2[ 300 + 16 ], tag[ 16 ];
+	unsigned long long		len;
+	size_t					i, n;
+
+	// ChaCha20 keystream, out of place and in place.
+
+	memset( key, 0, sizeof( key ) );
+	memset( nonce, 0, sizeof( nonce ) );
+	crypto_stream_chacha20( buf, sizeof( kChaCha20ZeroKeystream ), nonce, key );
+	require_action( memcmp( buf, kChaCha20ZeroKeystream, sizeof( kChaCha20ZeroKeystream ) ) == 0, exit, err = kMismatchErr );
+
+	for( i = 0; i < 32; ++i ) key[ i ] = (uint8_t) i;
+	crypto_stream_chacha20_xor_ic( buf, (const uint8_t *) kChaCha20RFCPlaintext, sizeof( kChaCha20RFCCiphertext ),
+		kChaCha20RFCNonce, 1, key );
+	require_action( memcmp( buf, kChaCha20RFCCiphertext, sizeof( kChaCha20RFCCiphertext ) ) == 0, exit, err = kMismatchErr );
+
+	memcpy( buf, kChaCha20RFCPlaintext, sizeof( kChaCha20RFCCiphertext ) );
+	crypto_stream_chacha20_xor_ic( buf, buf, sizeof( kChaCha20RFCCiphertext ), kChaCha20RFCNonce, 1, key );
+	require_action( memcmp( buf, kChaCha20RFCCiphertext, sizeof( kChaCha20RFCCiphertext ) ) == 0, exit, err = kMismatchErr );
+
+	// AEAD: combined, in place, detached and decryption.
+
+	err = crypto_aead_chacha20poly1305_encrypt( buf, &len, kAEADPlaintext, kAEADPlaintextSize,
+		kAEADAD, sizeof( kAEADAD ), NULL, kAEADNonce, kAEADKey );
+	require_noerr( err, exit );
+	require_action( len == sizeof( kAEADCiphertext ), exit, err = kSizeErr );
+	require_action( memcmp( buf, kAEADCiphertext, sizeof( kAEADCiphertext ) ) == 0, exit, err = kMismatchErr );
+
+	memcpy( buf, kAEADPlaintext, kAEADPlaintextSize );
+	err = crypto_aead_chacha20poly1305_encrypt( buf, &len, buf, kAEADPlaintextSize,
+		kAEADAD, sizeof( kAEADAD ), NULL, kAEADNonce, kAEADKey );
+	require_noerr( err, exit );
+	require_action( memcmp( buf, kAEADCiphertext, sizeof( kAEADCiphertext ) ) == 0, exit, err = kMismatchErr );
+
+	memcpy( buf, kAEADPlaintext, kAEADPlaintextSize );
+	err = crypto_aead_chacha20poly1305_encrypt_detached( buf, tag, &len, buf, kAEADPlaintextSize,
+		kAEADAD, sizeof( kAEADAD ), NULL, kAEADNonce, kAEADKey );
+	require_noerr( err, exit );
+	require_action( len == sizeof( tag ), exit, err = kSizeErr );
+	require_action( memcmp( buf, kAEADCiphertext, kAEADPlaintextSize ) == 0, exit, err = kMismatchErr );
+	require_action( memcmp( tag, &kAEADCiphertext[ kAEADPlaintextSize ], 16 ) == 0, exit, err = kMismatchErr );
+
+	err = crypto_aead_chacha20poly1305_decrypt_detached( buf, NULL, buf, kAEADPlaintextSize, tag,
+		kAEADAD, sizeof( kAEADAD ), kAEADNonce, kAEADKey );
+	require_noerr( err, exit );
+	require_action( memcmp( buf, kAEADPlaintext, kAEADPlaintextSize ) == 0, exit, err = kMismatchErr );
+
+	memcpy( buf, kAEADCiphertext, sizeof( kAEADCiphertext ) );
+	err = crypto_aead_chacha20poly1305_decrypt( buf, &len, NULL, buf, sizeof( kAEADCiphertext ),
+		kAEADAD, sizeof( kAEADAD ), kAEADNonce, kAEADKey );
+	require_noerr( err, exit );
+	require_action( len == kAEADPlaintextSize, exit, err = kSizeErr );
+	require_action( memcmp( buf, kAEADPlaintext, kAEADPlaintextSize ) == 0, exit, err = kMismatchErr );
+
+	// Every modified bit of ciphertext, tag or AD must be rejected.
+
+	for( i = 0; i < sizeof( kAEADCiphertext ) * 8; ++i )
+	{
+		memcpy( buf, kAEADCiphertext, sizeof( kAEADCiphertext ) );
+		buf[ i / 8 ] ^= (uint8_t)( 1 << ( i % 8 ) );
+		err = crypto_aead_chacha20poly1305_decrypt( buf2, &len, NULL, buf, sizeof( kAEADCiphertext ),
+			kAEADAD, sizeof( kAEADAD ), kAEADNonce, kAEADKey );
+		require_action( err != 0 && len == 0, exit, err = kIntegrityErr );
+	}
+	err = crypto_aead_chacha20poly1305_decrypt( buf2, &len, NULL, kAEADCiphertext, sizeof( kAEADCiphertext ),
+		kAEADAD, sizeof( kAEADAD ) - 1, kAEADNonce, kAEADKey );
+	require_action( err != 0, exit, err = kIntegrityErr );
+
+	// Long message.
+
+	for( i = 0; i < 32; ++i )  key[ i ] = (uint8_t)( i * 7 + 3 );
+	for( i = 0; i < 300; ++i ) buf[ i ] = (uint8_t)( i * 13 + 1 );
+	err = crypto_aead_chacha20poly1305_encrypt( buf, &len, buf, 300, kAEADLongAD, sizeof( kAEADLongAD ), NULL,
+		kAEADLongNonce, key );
+	require_noerr( err, exit );
+	require_action( memcmp( buf, kAEADLongFirstBlock, 16 ) == 0, exit, err = kMismatchErr );
+	require_action( memcmp( &buf[ 300 ], kAEADLongTag, 16 ) == 0, exit, err = kMismatchErr );
+
+	// Out of place and in place must agree for every length through the multi-block and tail paths.
+
+	for( n = 0; n <= 300; ++n )
+	{
+		for( i = 0; i < n; ++i ) buf[ i ] = (uint8_t)( i * 13 + 1 );
+		err = crypto_aead_chacha20poly1305_encrypt( buf2, &len, buf, n, kAEADLongAD, sizeof( kAEADLongAD ), NULL,
+			kAEADLongNonce, key );
+		require_noerr( err, exit );
+
+		err = crypto_aead_chacha20poly1305_encrypt_detached( buf, tag, NULL, buf, n, kAEADLongAD, sizeof( kAEADLongAD ),
+			NULL, kAEADLongNonce, key );
+		require_noerr( err, exit );
+		require_action( memcmp( buf, buf2, n ) == 0, exit, err = kMismatchErr );
+		require_action( memcmp( tag, &buf2[ n ], 16 ) == 0, exit, err = kMismatchErr );
+
+		err = crypto_aead_chacha20poly1305_decrypt( buf2, &len, NULL, buf2, n + 16, kAEADLongAD, sizeof( kAEADLongAD ),
+			kAEADLongNonce, key );
+		require_noerr( err, exit );
+		for( i = 0; i < n; ++i ) require_action( buf2[ i ] == (uint8_t)( i * 13 + 1 ), exit, err = kMismatchErr );
+	}
+
+	err = chacha20poly1305_bench( print );
+	require_noerr( err, exit );
+
+exit:
+	printf( "%s: %s\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	chacha20poly1305_bench
+//
+//	Encrypts frames of the sizes HomeKit sends (the 2-byte length is the AD, frames are up to 1024 bytes).
+//===========================================================================================================================
+
+OSStatus	chacha20poly1305_bench( int print )
+{
+	static const size_t		kFrameSizes[] = { 16, 64, 256, 1024 };
+	OSStatus				err;
+	uint8_t *				frame;
+	uint8_t					key[ 32 ], nonce[ 8 ], ad[ 2 ];
+	unsigned long long		len;
+	uint32_t				start, ms, count;
+	size_t					i, size;
+
+	frame = (uint8_t *) malloc( 1024 + crypto_aead_chacha20poly1305_ABYTES );
+	require_action( frame, exit, err = kNoMemoryErr );
+	memset( frame, 0x5A, 1024 );
+	memset( key, 0xA5, sizeof( key ) );
+	memset( nonce, 0, sizeof( nonce ) );
+
+	for( i = 0; i < sizeof( kFrameSizes ) / sizeof( kFrameSizes[ 0 ] ); ++i )
+	{
+		size  = kFrameSizes[ i ];
+		ad[ 0 ] = (uint8_t)( size & 0xFF );
+		ad[ 1 ] = (uint8_t)( size >> 8 );
+		count = 0;
+		start = mico_get_time();
+		do
+		{
+			nonce[ 0 ] = (uint8_t) count;
+			err = crypto_aead_chacha20poly1305_encrypt( frame, &len, frame, size, ad, sizeof( ad ), NULL, nonce, key );
+			require_noerr( err, exit );
+			++count;
+			ms = mico_get_time() - start;
+
+		}	while( ms < 1000 );
+
+		if( print ) printf( "%4u byte frames: %u us/frame, %u KB/s\r\n", (unsigned int) size,
+			(unsigned int)( ( ms * 1000 ) / count ), (unsigned int)( ( size * count ) / ms ) );
+	}
+	err = kNoErr;
+
+exit:
+	if( frame ) free( frame );
+	return( err );
+}
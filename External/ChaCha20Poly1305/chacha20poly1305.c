@@ -0,0 +1,595 @@
+/*
+ * chacha20poly1305.c: ChaCha20, Poly1305 and the ChaCha20-Poly1305 AEAD
+ *
+ * Source implementation of the crypto_stream_chacha20 and
+ * crypto_aead_chacha20poly1305 API in include/MICOCrypto (the RFC 7539
+ * construction with a 64-bit nonce, as used by HomeKit), so it can replace
+ * those objects from Library/MicoCrypto.a. The rest of MicoCrypto.a
+ * (crypto_sign) is still taken from the library.
+ *
+ * ChaCha20 is D. J. Bernstein's cipher with a 64-bit block counter in words
+ * 12-13 and the nonce in words 14-15. Long messages are encrypted
+ * CHACHA20_LANES blocks at a time with the quarter rounds of all the blocks
+ * interleaved, which lets the compiler keep independent work in flight (or
+ * vectorize it) instead of waiting on each add-xor-rotate chain. The tail,
+ * and the Poly1305 key block, use the single block function.
+ *
+ * Poly1305 follows Andrew Moon's public domain poly1305-donna-32: the
+ * accumulator is kept in five 26-bit limbs, each block only propagates one
+ * carry chain and the full carry and reduction mod 2^130 - 5 are deferred to
+ * poly1305_finish.
+ *
+ * All functions accept c == m (and m == c when decrypting) for in-place
+ * operation. The _detached variants write the 16-byte tag to a separate
+ * buffer so frames can be encrypted in place without room after the data.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "MICOCrypto/crypto_aead_chacha20poly1305.h"
+#include "MICOCrypto/crypto_stream_chacha20.h"
+
+// CHACHA20_LANES
+//
+// Number of blocks computed together by chacha20_blocks for long messages, between 1 and 8. Each lane takes 192 bytes
+// of stack. 1 uses only the single block function.
+
+#if( !defined( CHACHA20_LANES ) )
+	#define	CHACHA20_LANES		4
+#endif
+
+#if( ( CHACHA20_LANES < 1 ) || ( CHACHA20_LANES > 8 ) )
+	#error "CHACHA20_LANES must be between 1 and 8"
+#endif
+
+static uint32_t
+load32_le(const uint8_t *p) {
+  return ((uint32_t) p[0]) | ((uint32_t) p[1] << 8) |
+         ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void
+store32_le(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t) v;
+  p[1] = (uint8_t) (v >> 8);
+  p[2] = (uint8_t) (v >> 16);
+  p[3] = (uint8_t) (v >> 24);
+}
+
+static void
+store64_le(uint8_t *p, uint64_t v) {
+  store32_le(p, (uint32_t) v);
+  store32_le(p + 4, (uint32_t) (v >> 32));
+}
+
+/* Wipe memory the compiler cannot prove is dead. */
+static void
+secure_zero(void *p, size_t len) {
+  volatile uint8_t *vp = (volatile uint8_t *) p;
+  while (len--) *vp++ = 0;
+}
+
+// -----------------------------------------------------------------------------
+// ChaCha20
+// -----------------------------------------------------------------------------
+
+#define ROTL32(v, c) (((v) << (c)) | ((v) >> (32 - (c))))
+
+#define QUARTERROUND(a, b, c, d)                  \
+  a += b; d = ROTL32(d ^ a, 16);                  \
+  c += d; b = ROTL32(b ^ c, 12);                  \
+  a += b; d = ROTL32(d ^ a, 8);                   \
+  c += d; b = ROTL32(b ^ c, 7);
+
+static void
+chacha20_init(uint32_t input[16], const uint8_t *k, const uint8_t *n,
+              uint64_t ic) {
+  unsigned i;
+
+  input[0] = 0x61707865;
+  input[1] = 0x3320646e;
+  input[2] = 0x79622d32;
+  input[3] = 0x6b206574;
+  for (i = 0; i < 8; ++i) input[4 + i] = load32_le(k + 4 * i);
+  input[12] = (uint32_t) ic;
+  input[13] = (uint32_t) (ic >> 32);
+  input[14] = load32_le(n);
+  input[15] = load32_le(n + 4);
+}
+
+static void
+chacha20_next_counter(uint32_t input[16], unsigned blocks) {
+  uint64_t counter = input[12] | ((uint64_t) input[13] << 32);
+
+  counter += blocks;
+  input[12] = (uint32_t) counter;
+  input[13] = (uint32_t) (counter >> 32);
+}
+
+/* Write one keystream block to out and advance the block counter. */
+static void
+chacha20_block(uint32_t input[16], uint8_t out[64]) {
+  uint32_t x[16];
+  unsigned i;
+
+  for (i = 0; i < 16; ++i) x[i] = input[i];
+  for (i = 0; i < 10; ++i) {
+    QUARTERROUND(x[0], x[4], x[ 8], x[12])
+    QUARTERROUND(x[1], x[5], x[ 9], x[13])
+    QUARTERROUND(x[2], x[6], x[10], x[14])
+    QUARTERROUND(x[3], x[7], x[11], x[15])
+    QUARTERROUND(x[0], x[5], x[10], x[15])
+    QUARTERROUND(x[1], x[6], x[11], x[12])
+    QUARTERROUND(x[2], x[7], x[ 8], x[13])
+    QUARTERROUND(x[3], x[4], x[ 9], x[14])
+  }
+  for (i = 0; i < 16; ++i) store32_le(out + 4 * i, x[i] + input[i]);
+
+  chacha20_next_counter(input, 1);
+  secure_zero(x, sizeof(x));
+}
+
+#if( CHACHA20_LANES > 1 )
+/* Write CHACHA20_LANES consecutive keystream blocks to out and advance the
+ * block counter past them. Word i of every block is kept together in x[i] and
+ * each quarter round step is applied to all the lanes before the next one.
+ */
+#define QUARTERROUND_LANES(a, b, c, d)                                        \
+  for (l = 0; l < CHACHA20_LANES; ++l) {                                      \
+    QUARTERROUND(x[a][l], x[b][l], x[c][l], x[d][l])                          \
+  }
+
+static void
+chacha20_blocks(uint32_t input[16], uint8_t *out) {
+  uint32_t x[16][CHACHA20_LANES];
+  uint32_t start[16][CHACHA20_LANES];
+  uint64_t counter = input[12] | ((uint64_t) input[13] << 32);
+  unsigned i, l;
+
+  for (i = 0; i < 16; ++i) {
+    for (l = 0; l < CHACHA20_LANES; ++l) start[i][l] = input[i];
+  }
+  for (l = 0; l < CHACHA20_LANES; ++l) {
+    start[12][l] = (uint32_t) (counter + l);
+    start[13][l] = (uint32_t) ((counter + l) >> 32);
+  }
+  memcpy(x, start, sizeof(x));
+
+  for (i = 0; i < 10; ++i) {
+    QUARTERROUND_LANES(0, 4,  8, 12)
+    QUARTERROUND_LANES(1, 5,  9, 13)
+    QUARTERROUND_LANES(2, 6, 10, 14)
+    QUARTERROUND_LANES(3, 7, 11, 15)
+    QUARTERROUND_LANES(0, 5, 10, 15)
+    QUARTERROUND_LANES(1, 6, 11, 12)
+    QUARTERROUND_LANES(2, 7,  8, 13)
+    QUARTERROUND_LANES(3, 4,  9, 14)
+  }
+
+  for (l = 0; l < CHACHA20_LANES; ++l) {
+    for (i = 0; i < 16; ++i) store32_le(out + 4 * i, x[i][l] + start[i][l]);
+    out += 64;
+  }
+
+  chacha20_next_counter(input, CHACHA20_LANES);
+  secure_zero(x, sizeof(x));
+  secure_zero(start, sizeof(start));
+}
+#endif
+
+/* out = in ^ keystream, a word at a time. out may equal in. */
+static void
+xor_keystream(uint8_t *out, const uint8_t *in, const uint8_t *keystream,
+              size_t len) {
+  uint32_t a, b;
+
+  for (; len >= 4; len -= 4) {
+    memcpy(&a, in, 4);
+    memcpy(&b, keystream, 4);
+    a ^= b;
+    memcpy(out, &a, 4);
+    in += 4;
+    keystream += 4;
+    out += 4;
+  }
+  while (len--) *out++ = *in++ ^ *keystream++;
+}
+
+static void
+chacha20_xor(uint8_t *c, const uint8_t *m, unsigned long long mlen,
+             const uint8_t *n, uint64_t ic, const uint8_t *k) {
+  uint32_t input[16];
+  uint8_t keystream[64 * CHACHA20_LANES];
+  size_t len;
+
+  chacha20_init(input, k, n, ic);
+#if( CHACHA20_LANES > 1 )
+  while (mlen >= sizeof(keystream)) {
+    chacha20_blocks(input, keystream);
+    xor_keystream(c, m, keystream, sizeof(keystream));
+    c += sizeof(keystream);
+    m += sizeof(keystream);
+    mlen -= sizeof(keystream);
+  }
+#endif
+  /* The rest a block at a time, so short messages only pay for the blocks
+   * they use. */
+  while (mlen > 0) {
+    len = (mlen < 64) ? (size_t) mlen : 64;
+    chacha20_block(input, keystream);
+    xor_keystream(c, m, keystream, len);
+    c += len;
+    m += len;
+    mlen -= len;
+  }
+  secure_zero(input, sizeof(input));
+  secure_zero(keystream, sizeof(keystream));
+}
+
+size_t
+crypto_stream_chacha20_keybytes(void) {
+  return crypto_stream_chacha20_KEYBYTES;
+}
+
+size_t
+crypto_stream_chacha20_noncebytes(void) {
+  return crypto_stream_chacha20_NONCEBYTES;
+}
+
+int
+crypto_stream_chacha20(unsigned char *c, unsigned long long clen,
+                       const unsigned char *n, const unsigned char *k) {
+  if (clen == 0) return 0;
+  memset(c, 0, (size_t) clen);
+  chacha20_xor(c, c, clen, n, 0, k);
+  return 0;
+}
+
+int
+crypto_stream_chacha20_xor_ic(unsigned char *c, const unsigned char *m,
+                              unsigned long long mlen,
+                              const unsigned char *n, uint64_t ic,
+                              const unsigned char *k) {
+  if (mlen == 0) return 0;
+  chacha20_xor(c, m, mlen, n, ic, k);
+  return 0;
+}
+
+int
+crypto_stream_chacha20_xor(unsigned char *c, const unsigned char *m,
+                           unsigned long long mlen, const unsigned char *n,
+                           const unsigned char *k) {
+  return crypto_stream_chacha20_xor_ic(c, m, mlen, n, 0, k);
+}
+
+// -----------------------------------------------------------------------------
+// Poly1305
+// -----------------------------------------------------------------------------
+
+typedef struct {
+  uint32_t r[5];
+  uint32_t h[5];
+  uint32_t pad[4];
+  size_t leftover;
+  uint8_t buffer[16];
+} poly1305_state;
+
+static void
+poly1305_init(poly1305_state *st, const uint8_t key[32]) {
+  /* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+  st->r[0] = (load32_le(key + 0)) & 0x3ffffff;
+  st->r[1] = (load32_le(key + 3) >> 2) & 0x3ffff03;
+  st->r[2] = (load32_le(key + 6) >> 4) & 0x3ffc0ff;
+  st->r[3] = (load32_le(key + 9) >> 6) & 0x3f03fff;
+  st->r[4] = (load32_le(key + 12) >> 8) & 0x00fffff;
+
+  memset(st->h, 0, sizeof(st->h));
+
+  st->pad[0] = load32_le(key + 16);
+  st->pad[1] = load32_le(key + 20);
+  st->pad[2] = load32_le(key + 24);
+  st->pad[3] = load32_le(key + 28);
+
+  st->leftover = 0;
+}
+
+/* h = (h + m) * r for each 16-byte block of m. hibit is 2^128 in limb 4 for
+ * full blocks and 0 for the padded final block. Each block does a single
+ * carry pass, which keeps every limb below 2^26 + 2^24 and is enough for the
+ * 64-bit products of the next block; the full carry is left to the end.
+ */
+static void
+poly1305_blocks(poly1305_state *st, const uint8_t *m, size_t bytes,
+                uint32_t hibit) {
+  const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2],
+                 r3 = st->r[3], r4 = st->r[4];
+  const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3],
+           h4 = st->h[4];
+  uint64_t d0, d1, d2, d3, d4;
+  uint32_t c;
+
+  while (bytes >= 16) {
+    h0 += (load32_le(m + 0)) & 0x3ffffff;
+    h1 += (load32_le(m + 3) >> 2) & 0x3ffffff;
+    h2 += (load32_le(m + 6) >> 4) & 0x3ffffff;
+    h3 += (load32_le(m + 9) >> 6) & 0x3ffffff;
+    h4 += (load32_le(m + 12) >> 8) | hibit;
+
+    d0 = ((uint64_t) h0 * r0) + ((uint64_t) h1 * s4) + ((uint64_t) h2 * s3) +
+         ((uint64_t) h3 * s2) + ((uint64_t) h4 * s1);
+    d1 = ((uint64_t) h0 * r1) + ((uint64_t) h1 * r0) + ((uint64_t) h2 * s4) +
+         ((uint64_t) h3 * s3) + ((uint64_t) h4 * s2);
+    d2 = ((uint64_t) h0 * r2) + ((uint64_t) h1 * r1) + ((uint64_t) h2 * r0) +
+         ((uint64_t) h3 * s4) + ((uint64_t) h4 * s3);
+    d3 = ((uint64_t) h0 * r3) + ((uint64_t) h1 * r2) + ((uint64_t) h2 * r1) +
+         ((uint64_t) h3 * r0) + ((uint64_t) h4 * s4);
+    d4 = ((uint64_t) h0 * r4) + ((uint64_t) h1 * r3) + ((uint64_t) h2 * r2) +
+         ((uint64_t) h3 * r1) + ((uint64_t) h4 * r0);
+
+                 c = (uint32_t) (d0 >> 26); h0 = (uint32_t) d0 & 0x3ffffff;
+    d1 += c;     c = (uint32_t) (d1 >> 26); h1 = (uint32_t) d1 & 0x3ffffff;
+    d2 += c;     c = (uint32_t) (d2 >> 26); h2 = (uint32_t) d2 & 0x3ffffff;
+    d3 += c;     c = (uint32_t) (d3 >> 26); h3 = (uint32_t) d3 & 0x3ffffff;
+    d4 += c;     c = (uint32_t) (d4 >> 26); h4 = (uint32_t) d4 & 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26;              h0 &= 0x3ffffff;
+    h1 += c;
+
+    m += 16;
+    bytes -= 16;
+  }
+
+  st->h[0] = h0;
+  st->h[1] = h1;
+  st->h[2] = h2;
+  st->h[3] = h3;
+  st->h[4] = h4;
+}
+
+static void
+poly1305_update(poly1305_state *st, const uint8_t *m,
+                unsigned long long bytes) {
+  size_t i, want;
+
+  if (st->leftover) {
+    want = 16 - st->leftover;
+    if (want > bytes) want = (size_t) bytes;
+    for (i = 0; i < want; ++i) st->buffer[st->leftover + i] = m[i];
+    bytes -= want;
+    m += want;
+    st->leftover += want;
+    if (st->leftover < 16) return;
+    poly1305_blocks(st, st->buffer, 16, 1UL << 24);
+    st->leftover = 0;
+  }
+
+  while (bytes >= 16) {
+    /* Bounded so the count fits a size_t on 32-bit targets. */
+    want = (bytes > 0x40000000) ? 0x40000000 : (size_t) (bytes & ~15ULL);
+    poly1305_blocks(st, m, want, 1UL << 24);
+    m += want;
+    bytes -= want;
+  }
+
+  if (bytes) {
+    for (i = 0; i < bytes; ++i) st->buffer[i] = m[i];
+    st->leftover = (size_t) bytes;
+  }
+}
+
+static void
+poly1305_finish(poly1305_state *st, uint8_t mac[16]) {
+  uint32_t h0, h1, h2, h3, h4, c;
+  uint32_t g0, g1, g2, g3, g4;
+  uint32_t mask;
+  uint64_t f;
+
+  if (st->leftover) {
+    size_t i = st->leftover;
+    st->buffer[i++] = 1;
+    for (; i < 16; ++i) st->buffer[i] = 0;
+    poly1305_blocks(st, st->buffer, 16, 0);
+  }
+
+  h0 = st->h[0];
+  h1 = st->h[1];
+  h2 = st->h[2];
+  h3 = st->h[3];
+  h4 = st->h[4];
+
+  /* Full carry */
+               c = h1 >> 26; h1 &= 0x3ffffff;
+  h2 += c;     c = h2 >> 26; h2 &= 0x3ffffff;
+  h3 += c;     c = h3 >> 26; h3 &= 0x3ffffff;
+  h4 += c;     c = h4 >> 26; h4 &= 0x3ffffff;
+  h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+  h1 += c;
+
+  /* g = h + -p = h - (2^130 - 5) */
+  g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+  g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+  g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+  g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+  g4 = h4 + c - (1UL << 26);
+
+  /* h = (h < p) ? h : g, without branching */
+  mask = (g4 >> 31) - 1;
+  g0 &= mask;
+  g1 &= mask;
+  g2 &= mask;
+  g3 &= mask;
+  g4 &= mask;
+  mask = ~mask;
+  h0 = (h0 & mask) | g0;
+  h1 = (h1 & mask) | g1;
+  h2 = (h2 & mask) | g2;
+  h3 = (h3 & mask) | g3;
+  h4 = (h4 & mask) | g4;
+
+  /* h = h % 2^128, then mac = h + pad */
+  h0 = (h0) | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+
+  f = (uint64_t) h0 + st->pad[0];             h0 = (uint32_t) f;
+  f = (uint64_t) h1 + st->pad[1] + (f >> 32); h1 = (uint32_t) f;
+  f = (uint64_t) h2 + st->pad[2] + (f >> 32); h2 = (uint32_t) f;
+  f = (uint64_t) h3 + st->pad[3] + (f >> 32); h3 = (uint32_t) f;
+
+  store32_le(mac + 0, h0);
+  store32_le(mac + 4, h1);
+  store32_le(mac + 8, h2);
+  store32_le(mac + 12, h3);
+
+  secure_zero(st, sizeof(*st));
+}
+
+static int
+poly1305_verify(const uint8_t a[16], const uint8_t b[16]) {
+  unsigned diff = 0;
+  unsigned i;
+
+  for (i = 0; i < 16; ++i) diff |= a[i] ^ b[i];
+  return (int) ((1 & ((diff - 1) >> 8)) - 1);
+}
+
+// -----------------------------------------------------------------------------
+// ChaCha20-Poly1305
+//
+// The RFC 7539 construction with a 64-bit nonce, as used by HomeKit and by
+// MicoCrypto.a: the Poly1305 key is the first 32 bytes of keystream block 0,
+// the message is encrypted starting at block 1 and the tag covers
+// ad || pad16(ad) || c || pad16(c) || le64(adlen) || le64(clen).
+// -----------------------------------------------------------------------------
+
+size_t
+crypto_aead_chacha20poly1305_keybytes(void) {
+  return crypto_aead_chacha20poly1305_KEYBYTES;
+}
+
+size_t
+crypto_aead_chacha20poly1305_nsecbytes(void) {
+  return crypto_aead_chacha20poly1305_NSECBYTES;
+}
+
+size_t
+crypto_aead_chacha20poly1305_npubbytes(void) {
+  return crypto_aead_chacha20poly1305_NPUBBYTES;
+}
+
+size_t
+crypto_aead_chacha20poly1305_abytes(void) {
+  return crypto_aead_chacha20poly1305_ABYTES;
+}
+
+static void
+aead_mac(uint8_t mac[16], const uint8_t *c, unsigned long long clen,
+         const uint8_t *ad, unsigned long long adlen, const uint8_t *npub,
+         const uint8_t *k) {
+  static const uint8_t zeros[16] = { 0 };
+  poly1305_state st;
+  uint32_t input[16];
+  uint8_t block0[64];
+  uint8_t slen[16];
+
+  chacha20_init(input, k, npub, 0);
+  chacha20_block(input, block0);
+  poly1305_init(&st, block0);
+  secure_zero(input, sizeof(input));
+  secure_zero(block0, sizeof(block0));
+
+  if (adlen) poly1305_update(&st, ad, adlen);
+  poly1305_update(&st, zeros, (0x10 - adlen) & 0xf);
+  if (clen) poly1305_update(&st, c, clen);
+  poly1305_update(&st, zeros, (0x10 - clen) & 0xf);
+  store64_le(slen, adlen);
+  store64_le(slen + 8, clen);
+  poly1305_update(&st, slen, sizeof(slen));
+  poly1305_finish(&st, mac);
+}
+
+int
+crypto_aead_chacha20poly1305_encrypt_detached(unsigned char *c,
+                                              unsigned char *mac,
+                                              unsigned long long *maclen_p,
+                                              const unsigned char *m,
+                                              unsigned long long mlen,
+                                              const unsigned char *ad,
+                                              unsigned long long adlen,
+                                              const unsigned char *nsec,
+                                              const unsigned char *npub,
+                                              const unsigned char *k) {
+  (void) nsec;
+
+  if (mlen) chacha20_xor(c, m, mlen, npub, 1, k);
+  aead_mac(mac, c, mlen, ad, adlen, npub, k);
+  if (maclen_p != NULL) *maclen_p = crypto_aead_chacha20poly1305_ABYTES;
+  return 0;
+}
+
+int
+crypto_aead_chacha20poly1305_encrypt(unsigned char *c,
+                                     unsigned long long *clen,
+                                     const unsigned char *m,
+                                     unsigned long long mlen,
+                                     const unsigned char *ad,
+                                     unsigned long long adlen,
+                                     const unsigned char *nsec,
+                                     const unsigned char *npub,
+                                     const unsigned char *k) {
+  crypto_aead_chacha20poly1305_encrypt_detached(c, c + mlen, NULL, m, mlen,
+                                                ad, adlen, nsec, npub, k);
+  if (clen != NULL) *clen = mlen + crypto_aead_chacha20poly1305_ABYTES;
+  return 0;
+}
+
+int
+crypto_aead_chacha20poly1305_decrypt_detached(unsigned char *m,
+                                              unsigned char *nsec,
+                                              const unsigned char *c,
+                                              unsigned long long clen,
+                                              const unsigned char *mac,
+                                              const unsigned char *ad,
+                                              unsigned long long adlen,
+                                              const unsigned char *npub,
+                                              const unsigned char *k) {
+  uint8_t computed[16];
+  int ret;
+
+  (void) nsec;
+
+  aead_mac(computed, c, clen, ad, adlen, npub, k);
+  ret = poly1305_verify(computed, mac);
+  secure_zero(computed, sizeof(computed));
+  if (ret != 0) {
+    if (m != NULL && clen) memset(m, 0, (size_t) clen);
+    return -1;
+  }
+  if (m != NULL && clen) chacha20_xor(m, c, clen, npub, 1, k);
+  return 0;
+}
+
+int
+crypto_aead_chacha20poly1305_decrypt(unsigned char *m,
+                                     unsigned long long *mlen,
+                                     unsigned char *nsec,
+                                     const unsigned char *c,
+                                     unsigned long long clen,
+                                     const unsigned char *ad,
+                                     unsigned long long adlen,
+                                     const unsigned char *npub,
+                                     const unsigned char *k) {
+  int ret = -1;
+
+  if (clen >= crypto_aead_chacha20poly1305_ABYTES) {
+    ret = crypto_aead_chacha20poly1305_decrypt_detached(
+        m, nsec, c, clen - crypto_aead_chacha20poly1305_ABYTES,
+        c + clen - crypto_aead_chacha20poly1305_ABYTES, ad, adlen, npub, k);
+  }
+  if (mlen != NULL) {
+    *mlen = (ret == 0) ? clen - crypto_aead_chacha20poly1305_ABYTES : 0;
+  }
+  return ret;
+}
@@ -163,7 +163,7 @@ OSStatus	curve25519_test( int print )
 	OSStatus			err;
 	uint8_t				e[ 32 ], k[ 32 ], ek[ 32 ], ek2[ 32 ];
 	size_t				i, j, len;
-	CFAbsoluteTime		t = 0;
+	CFAbsoluteTime		t = 0, tLadder, tBase;
 	
 	for( i = 0; i < countof( kCurve25519TestVectors ); ++i )
 	{
@@ -185,6 +185,13 @@ OSStatus	curve25519_test( int print )
 		curve25519_donna( ek2, e, k );
 		require_action( memcmp( ek, ek2, 32 ) == 0, exit, err = kMismatchErr );
 		
+		// The fixed-base version must match the ladder with the default base point.
+		
+		curve25519_donna( ek, e, NULL );
+		memset( ek2, 0, sizeof( ek2 ) );
+		curve25519_donna_base( ek2, e );
+		require_action( memcmp( ek, ek2, 32 ) == 0, exit, err = kMismatchErr );
+		
 		if( print )
 		{
 			for( j = 0; j < 32; ++j ) printf( "%02x", e[ j ] );  printf( " " );
@@ -193,6 +200,26 @@ OSStatus	curve25519_test( int print )
 		}
 	}
 	
+	// Cross-check the fixed-base version against the ladder over a chain of scalars and compare their speed.
+	
+	memset( e, 0x5A, sizeof( e ) );
+	tLadder = 0;
+	tBase   = 0;
+	for( i = 0; i < 1000; ++i )
+	{
+		t = CFAbsoluteTimeGetCurrent();
+		curve25519_donna( ek, e, NULL );
+		tLadder += CFAbsoluteTimeGetCurrent() - t;
+		
+		t = CFAbsoluteTimeGetCurrent();
+		curve25519_donna_base( ek2, e );
+		tBase += CFAbsoluteTimeGetCurrent() - t;
+		
+		require_action( memcmp( ek, ek2, 32 ) == 0, exit, err = kMismatchErr );
+		for( j = 0; j < 32; ++j ) e[ j ] ^= ek[ j ];
+	}
+	if( print ) FPrintF( stdout, "Ladder: %f seconds, fixed-base: %f seconds (1000 keys)\n", tLadder, tBase );
+	
 	t = CFAbsoluteTimeGetCurrent();
 	err = curve25519_djb_test( print );
 	require_noerr( err, exit );
@@ -80,10 +80,24 @@
 	#endif
 #endif
 
+// CURVE25519_BASE_TABLES
+//
+// Number of precomputed rows used by curve25519_donna_base: 1, 2, 4, 8, 16, or 32. Each row is 960 bytes of const
+// data and halving the rows doubles the number of point doublings. Not used by the 64-bit version.
+
+#if( !defined( CURVE25519_BASE_TABLES ) )
+	#define	CURVE25519_BASE_TABLES		16
+#endif
+
 // Conditionally include the 64-bit version if we're building for a 64-bit platform.
 
 #if( CURVE25519_64_BIT )
 	#include "curve25519-donna-c64.c"
+
+void
+curve25519_donna_base(unsigned char *mypublic, const unsigned char *secret) {
+  curve25519_donna(mypublic, secret, NULL);
+}
 #else
 
 // 32-bit/portable version...
@@ -827,6 +841,204 @@ curve25519_donna(u8 *mypublic, const u8 *secret, const u8 *basepoint) {
   fcontract(mypublic, z);
 }
 
+// -----------------------------------------------------------------------------
+// Fixed-base scalar multiplication
+//
+// Public keys are always secret * 9, so rather than running the ladder we work
+// on the birationally equivalent twisted Edwards curve (Ed25519) and use a
+// signed 4-bit comb over the const table in curve25519-donna-table.h: the
+// scalar is recoded into 64 digits in [-8, 8] and digit i = STRIDE*j + r is
+// looked up in row j (16^(STRIDE*j) * B multiples) during round r. Rounds are
+// separated by 4 doublings, so there are 4 * (STRIDE - 1) doublings and 64
+// mixed additions in total. Table lookups scan every entry of the row with
+// masks so the memory access pattern does not depend on the secret. The
+// result is mapped back to the Montgomery u-coordinate as (Z + Y) / (Z - Y).
+// -----------------------------------------------------------------------------
+
+#if( ( CURVE25519_BASE_TABLES < 1 ) || ( CURVE25519_BASE_TABLES > 32 ) || \
+	 ( ( CURVE25519_BASE_TABLES & ( CURVE25519_BASE_TABLES - 1 ) ) != 0 ) )
+	#error "CURVE25519_BASE_TABLES must be 1, 2, 4, 8, 16, or 32"
+#endif
+
+#define CURVE25519_BASE_ROW_STEP	( 32 / CURVE25519_BASE_TABLES )
+#define CURVE25519_BASE_STRIDE		( 64 / CURVE25519_BASE_TABLES )
+
+#include "curve25519-donna-table.h"
+
+/* Working state, kept off the stack like the ladder's temporaries. The point
+ * is X:Y:Z:T in extended coordinates (x = X/Z, y = Y/Z, x*y = T/Z) and the
+ * completed result of an addition or doubling is kept in x3..t3 with
+ * x = x3/z3, y = y3/t3 until it is converted back. Arrays are 11 limbs so
+ * they can be passed to freduce_coefficients directly.
+ */
+typedef struct {
+  limb X[11], Y[11], Z[11], T[11];
+  limb x3[11], y3[11], z3[11], t3[11];
+  limb ypx[10], ymx[10], xy2d[10];
+  limb t0[11];
+  signed char digits[64];
+  u8 e[32];
+} base_state;
+
+/* output = a + b, without reducing */
+static void fadd(limb *output, const limb *a, const limb *b) {
+  unsigned i;
+  for (i = 0; i < 10; ++i) output[i] = a[i] + b[i];
+}
+
+/* output = a - b, without reducing */
+static void fsub(limb *output, const limb *a, const limb *b) {
+  unsigned i;
+  for (i = 0; i < 10; ++i) output[i] = a[i] - b[i];
+}
+
+/* output = in if mask is all ones, unchanged if mask is zero. */
+static void
+fcmov(limb *output, const s32 *in, s32 mask) {
+  unsigned i;
+  for (i = 0; i < 10; ++i) {
+    s32 x = (s32) output[i];
+    output[i] = x ^ ((x ^ in[i]) & mask);
+  }
+}
+
+/* Load digit * row[0] into ypx, ymx, xy2d in constant time. A zero digit gives
+ * the identity (1, 1, 0); a negative digit swaps y+x and y-x and negates
+ * 2*d*x*y, which is the negation of the point.
+ */
+static void
+base_select(base_state *s, const s32 row[8][3][10], signed char digit) {
+  const u8 negative = ((u8) digit) >> 7;
+  const u8 absolute = (u8) (digit - 2 * (((s32) -negative) & digit));
+  const s32 negmask = -((s32) negative);
+  unsigned i;
+
+  memset(s->ypx, 0, sizeof(s->ypx));
+  memset(s->ymx, 0, sizeof(s->ymx));
+  memset(s->xy2d, 0, sizeof(s->xy2d));
+  s->ypx[0] = 1;
+  s->ymx[0] = 1;
+
+  for (i = 0; i < 8; ++i) {
+    const s32 mask = -((s32) ((((uint32_t) (absolute ^ (i + 1))) - 1) >> 31));
+    fcmov(s->ypx, row[i][0], mask);
+    fcmov(s->ymx, row[i][1], mask);
+    fcmov(s->xy2d, row[i][2], mask);
+  }
+
+  for (i = 0; i < 10; ++i) {
+    const s32 a = (s32) s->ypx[i], b = (s32) s->ymx[i], c = (s32) s->xy2d[i];
+    const s32 swap = (a ^ b) & negmask;
+    s->ypx[i] = a ^ swap;
+    s->ymx[i] = b ^ swap;
+    s->xy2d[i] = c ^ ((c ^ -c) & negmask);
+  }
+}
+
+/* x3..t3 = X:Y:Z:T + (ypx, ymx, xy2d), 7M */
+static void
+base_madd(base_state *s) {
+  fadd(s->x3, s->Y, s->X);
+  fsub(s->y3, s->Y, s->X);
+  fmul(s->z3, s->x3, s->ypx);
+  fmul(s->y3, s->y3, s->ymx);
+  fmul(s->t3, s->xy2d, s->T);
+  fadd(s->t0, s->Z, s->Z);
+  fsub(s->x3, s->z3, s->y3);
+  fadd(s->y3, s->z3, s->y3);
+  fadd(s->z3, s->t0, s->t3);
+  fsub(s->t3, s->t0, s->t3);
+  freduce_coefficients(s->z3);
+  freduce_coefficients(s->t3);
+}
+
+/* x3..t3 = 2 * X:Y:Z, 4S */
+static void
+base_double(base_state *s) {
+  fsquare(s->x3, s->X);
+  fsquare(s->z3, s->Y);
+  fsquare(s->t3, s->Z);
+  fsum(s->t3, s->t3);
+  fadd(s->y3, s->X, s->Y);
+  fsquare(s->t0, s->y3);
+  fadd(s->y3, s->z3, s->x3);
+  fsub(s->z3, s->z3, s->x3);
+  fsub(s->x3, s->t0, s->y3);
+  fsub(s->t3, s->t3, s->z3);
+  freduce_coefficients(s->x3);
+  freduce_coefficients(s->t3);
+}
+
+/* X:Y:Z(:T) = x3..t3. T is only needed as the input to an addition. */
+static void
+base_complete(base_state *s, int withT) {
+  fmul(s->X, s->x3, s->t3);
+  fmul(s->Y, s->y3, s->z3);
+  fmul(s->Z, s->z3, s->t3);
+  if (withT) fmul(s->T, s->x3, s->y3);
+}
+
+void
+curve25519_donna_base(u8 *mypublic, const u8 *secret) {
+  base_state *s;
+  signed char carry;
+  int i, j, r;
+
+  s = (base_state *) calloc(1, sizeof(*s));
+  if (s == NULL) {
+    curve25519_donna(mypublic, secret, NULL);
+    return;
+  }
+
+  for (i = 0; i < 32; ++i) s->e[i] = secret[i];
+  s->e[0] &= 248;
+  s->e[31] &= 127;
+  s->e[31] |= 64;
+
+  /* Radix-16 digits in [-8, 8]. The top digit is at most 8 because bit 255
+   * is clear, so there is no carry out of it. */
+  for (i = 0; i < 32; ++i) {
+    s->digits[2 * i + 0] = s->e[i] & 15;
+    s->digits[2 * i + 1] = (s->e[i] >> 4) & 15;
+  }
+  carry = 0;
+  for (i = 0; i < 63; ++i) {
+    s->digits[i] += carry;
+    carry = (signed char) ((s->digits[i] + 8) >> 4);
+    s->digits[i] -= (signed char) (carry << 4);
+  }
+  s->digits[63] += carry;
+
+  /* Start from the identity 0:1:1:0. */
+  s->Y[0] = 1;
+  s->Z[0] = 1;
+
+  for (r = CURVE25519_BASE_STRIDE - 1; r >= 0; --r) {
+    if (r != CURVE25519_BASE_STRIDE - 1) {
+      for (i = 0; i < 4; ++i) {
+        base_double(s);
+        base_complete(s, i == 3);
+      }
+    }
+    for (j = 0; j < CURVE25519_BASE_TABLES; ++j) {
+      base_select(s, kCurve25519BaseTable[j], s->digits[CURVE25519_BASE_STRIDE * j + r]);
+      base_madd(s);
+      base_complete(s, 1);
+    }
+  }
+
+  /* u = (1 + y) / (1 - y) = (Z + Y) / (Z - Y) */
+  fadd(s->x3, s->Z, s->Y);
+  fsub(s->z3, s->Z, s->Y);
+  crecip(s->t0, s->z3);
+  fmul(s->x3, s->x3, s->t0);
+  freduce_coefficients(s->x3);
+  fcontract(mypublic, s->x3);
+
+  memset(s, 0, sizeof(*s));
+  free(s);
+}
+
 #endif // !CURVE25519_64_BIT
 
 
@@ -59,6 +59,10 @@
 
 void curve25519_donna( unsigned char *outKey, const unsigned char *inSecret, const unsigned char *inBasePoint );
 
+// Same result as curve25519_donna( outKey, inSecret, NULL ), using precomputed base point tables (see
+// CURVE25519_BASE_TABLES in curve25519-donna.c). Use it to generate public keys.
+void curve25519_donna_base( unsigned char *outKey, const unsigned char *inSecret );
+
 #ifdef	__cplusplus
 	}
 #endif
@@ -29,6 +29,7 @@ Issue Date: 30/03/2011
    a bug in the fast buffer operations on big endian systems.
 */
 
+#include <stdlib.h>
 #include "gcm.h"
 #include "mode_hdr.h"
 
@@ -94,11 +95,108 @@ extern "C"
 #define inc_ctr(x)  \
     {   int i = BLOCK_SIZE; while(i-- > CTR_POS && !++(UI8_PTR(x)[i])) ; }
 
+#if defined( GF_MODE_LB ) && !defined( GF_REPRESENTATION )
+#  define HAS_CONST_TIME
+#endif
+
+static ghash_mode ghash_default(ghash_mode mode)
+{
+    if(mode != GHASH_DEFAULT)
+        return mode;
+#if defined( TABLES_64K )
+    return GHASH_TABLES_64K;
+#elif defined( TABLES_8K )
+    return GHASH_TABLES_8K;
+#elif defined( TABLES_4K )
+    return GHASH_TABLES_4K;
+#elif defined( TABLES_256 )
+    return GHASH_TABLES_256;
+#else
+    return GHASH_NO_TABLES;
+#endif
+}
+
+unsigned long gcm_table_size(ghash_mode mode)
+{
+    switch(ghash_default(mode))
+    {
+#if defined( TABLES_64K )
+    case GHASH_TABLES_64K:
+        return sizeof(gf_t64k_a);
+#endif
+#if defined( TABLES_8K )
+    case GHASH_TABLES_8K:
+        return sizeof(gf_t8k_a);
+#endif
+#if defined( TABLES_4K )
+    case GHASH_TABLES_4K:
+        return sizeof(gf_t4k_a);
+#endif
+#if defined( TABLES_256 )
+    case GHASH_TABLES_256:
+        return sizeof(gf_t256_a);
+#endif
+    default:
+        return 0;
+    }
+}
+
 ret_type gcm_init_and_key(                  /* initialise mode and set key  */
             const unsigned char key[],      /* the key value                */
             unsigned long key_len,          /* and its length in bytes      */
             gcm_ctx ctx[1])                 /* the mode context             */
+{   void *tab = NULL;
+    unsigned long tab_len = gcm_table_size(GHASH_DEFAULT);
+
+    /* the context owns a GHASH_DEFAULT table that gcm_end() releases */
+    if(tab_len && !(tab = malloc(tab_len)))
+        return RETURN_ERROR;
+    if(gcm_init_and_key_mode(key, key_len, GHASH_DEFAULT, tab, ctx) != RETURN_GOOD)
+    {
+        free(tab);
+        return RETURN_ERROR;
+    }
+    ctx->gf_tab_owned = (tab != NULL);
+    return RETURN_GOOD;
+}
+
+ret_type gcm_init_and_key_mode(             /* as above with a given GHASH  */
+            const unsigned char key[],      /* the key value                */
+            unsigned long key_len,          /* and its length in bytes      */
+            ghash_mode mode,                /* the GHASH multiplier to use  */
+            void *tab,                      /* its table, NULL if none      */
+            gcm_ctx ctx[1])                 /* the mode context             */
 {
+    mode = ghash_default(mode);
+
+    switch(mode)
+    {
+    case GHASH_NO_TABLES:                   /* no tables: use gf_mul()      */
+#if defined( TABLES_64K )
+    case GHASH_TABLES_64K:
+#endif
+#if defined( TABLES_8K )
+    case GHASH_TABLES_8K:
+#endif
+#if defined( TABLES_4K )
+    case GHASH_TABLES_4K:
+#endif
+#if defined( TABLES_256 )
+    case GHASH_TABLES_256:
+#endif
+#if defined( HAS_CONST_TIME )
+    case GHASH_CONST_TIME:
+#endif
+        break;
+    default:
+        return RETURN_ERROR;
+    }
+    if(gcm_table_size(mode) && !tab)
+        return RETURN_ERROR;
+    ctx->gf_mode = mode;
+    ctx->gf_tab = tab;
+    ctx->gf_tab_owned = 0;
+
     memset(ctx->ghash_h, 0, sizeof(ctx->ghash_h));
 
     /* set the AES key                          */
@@ -111,15 +209,31 @@ ret_type gcm_init_and_key(                  /* initialise mode and set key  */
     convert_representation(ctx->ghash_h, ctx->ghash_h, GF_REPRESENTATION);
 #endif
 
+    switch(ctx->gf_mode)
+    {
 #if defined( TABLES_64K )
-    init_64k_table(ctx->ghash_h, ctx->gf_t64k);
-#elif defined( TABLES_8K )
-    init_8k_table(ctx->ghash_h, ctx->gf_t8k);
-#elif defined( TABLES_4K )
-    init_4k_table(ctx->ghash_h, ctx->gf_t4k);
-#elif defined( TABLES_256 )
-    init_256_table(ctx->ghash_h, ctx->gf_t256);
+    case GHASH_TABLES_64K:
+        init_64k_table(ctx->ghash_h, (gf_t64k_t)ctx->gf_tab);
+        break;
 #endif
+#if defined( TABLES_8K )
+    case GHASH_TABLES_8K:
+        init_8k_table(ctx->ghash_h, (gf_t8k_t)ctx->gf_tab);
+        break;
+#endif
+#if defined( TABLES_4K )
+    case GHASH_TABLES_4K:
+        init_4k_table(ctx->ghash_h, (gf_t4k_t)ctx->gf_tab);
+        break;
+#endif
+#if defined( TABLES_256 )
+    case GHASH_TABLES_256:
+        init_256_table(ctx->ghash_h, (gf_t256_t)ctx->gf_tab);
+        break;
+#endif
+    default:
+        break;
+    }
 #if defined(  GF_REPRESENTATION )
     convert_representation(ctx->ghash_h, ctx->ghash_h, GF_REPRESENTATION);
 #endif
@@ -135,22 +249,42 @@ static void gf_mul_hh(gf_t a, gcm_ctx ctx[1])
     convert_representation(a, a, GF_REPRESENTATION);
 #endif
 
+    switch(ctx->gf_mode)
+    {
 #if defined( TABLES_64K )
-    gf_mul_64k(a, ctx->gf_t64k, scr);
-#elif defined( TABLES_8K )
-    gf_mul_8k(a, ctx->gf_t8k, scr);
-#elif defined( TABLES_4K )
-    gf_mul_4k(a, ctx->gf_t4k, scr);
-#elif defined( TABLES_256 )
-    gf_mul_256(a, ctx->gf_t256, scr);
+    case GHASH_TABLES_64K:
+        gf_mul_64k(a, (gf_t64k_t)ctx->gf_tab, scr);
+        break;
+#endif
+#if defined( TABLES_8K )
+    case GHASH_TABLES_8K:
+        gf_mul_8k(a, (gf_t8k_t)ctx->gf_tab, scr);
+        break;
+#endif
+#if defined( TABLES_4K )
+    case GHASH_TABLES_4K:
+        gf_mul_4k(a, (gf_t4k_t)ctx->gf_tab, scr);
+        break;
+#endif
+#if defined( TABLES_256 )
+    case GHASH_TABLES_256:
+        gf_mul_256(a, (gf_t256_t)ctx->gf_tab, scr);
+        break;
+#endif
+#if defined( HAS_CONST_TIME )
+    case GHASH_CONST_TIME:
+        gf_mul_ct(a, ctx->ghash_h);
+        break;
+#endif
+    default:
+#if defined( GF_REPRESENTATION )
+        convert_representation(scr, ctx->ghash_h, GF_REPRESENTATION);
+        gf_mul(a, scr);
 #else
-# if defined( GF_REPRESENTATION )
-    convert_representation(scr, ctx->ghash_h, GF_REPRESENTATION);
-    gf_mul(a, scr);
-# else
-    gf_mul(a, ctx->ghash_h);
-# endif
+        gf_mul(a, ctx->ghash_h);
 #endif
+        break;
+    }
 
 #if defined(  GF_REPRESENTATION )
     convert_representation(a, a, GF_REPRESENTATION);
@@ -481,6 +615,10 @@ ret_type gcm_compute_tag(                   /* compute authentication tag   */
 ret_type gcm_end(                           /* clean up and end operation   */
             gcm_ctx ctx[1])                 /* the mode context             */
 {
+    if(ctx->gf_tab)                         /* the table is key material    */
+        memset(ctx->gf_tab, 0, gcm_table_size(ctx->gf_mode));
+    if(ctx->gf_tab_owned)
+        free(ctx->gf_tab);
     memset(ctx, 0, sizeof(gcm_ctx));
     return RETURN_GOOD;
 }
@@ -94,22 +94,36 @@ BUFR_TYPEDEF(gcm_buf_t, UNIT_BITS, AES_BLOCK_SIZE);
 
 #define GCM_BLOCK_SIZE  AES_BLOCK_SIZE
 
+/*  The GHASH field multiplier used by a context.  The table driven
+    multipliers are available if their table size is enabled in
+    gf128mul.h. Their table is not part of the context: the caller
+    supplies gcm_table_size(mode) bytes of storage, so a context only
+    costs the RAM of the mode it uses. GHASH_CONST_TIME uses no tables
+    and runs in time that does not depend on the key or the data.
+    GHASH_NO_TABLES uses the bitwise gf_mul(). GHASH_DEFAULT selects
+    the largest table enabled, or no tables if none is.
+    gcm_init_and_key() uses GHASH_DEFAULT with a table it allocates
+    itself, which gcm_end() frees.
+*/
+
+typedef enum
+{
+    GHASH_DEFAULT = 0,                      /* largest enabled table        */
+    GHASH_TABLES_64K,                       /* 64K bytes per key            */
+    GHASH_TABLES_8K,                        /* 8K bytes per key             */
+    GHASH_TABLES_4K,                        /* 4K bytes per key (8-bit)     */
+    GHASH_TABLES_256,                       /* 256 bytes per key (4-bit)    */
+    GHASH_CONST_TIME,                       /* no tables, constant time     */
+    GHASH_NO_TABLES                         /* no tables, gf_mul()          */
+} ghash_mode;
+
 /* The GCM-AES  context  */
 
 typedef struct
 {
-#if defined( TABLES_64K )
-    gf_t64k_a       gf_t64k;
-#endif
-#if defined( TABLES_8K )
-    gf_t8k_a        gf_t8k;
-#endif
-#if defined( TABLES_4K )
-    gf_t4k_a        gf_t4k;
-#endif
-#if defined( TABLES_256 )
-    gf_t256_a       gf_t256;
-#endif
+    void            *gf_tab;                /* GHASH table (caller storage) */
+    ghash_mode      gf_mode;                /* GHASH multiplier in use      */
+    int             gf_tab_owned;           /* gf_tab is freed by gcm_end   */
     gcm_buf_t       ctr_val;                /* CTR counter value            */
     gcm_buf_t       enc_ctr;                /* encrypted CTR block          */
     gcm_buf_t       hdr_ghv;                /* ghash buffer (header)        */
@@ -124,9 +138,22 @@ typedef struct
 
 /* The following calls handle mode initialisation, keying and completion    */
 
+                                /* bytes of table storage the GHASH mode    */
+                                /* needs, 0 if it uses no table             */
+unsigned long gcm_table_size(ghash_mode mode);
+
 ret_type gcm_init_and_key(                  /* initialise mode and set key  */
             const unsigned char key[],      /* the key value                */
             unsigned long key_len,          /* and its length in bytes      */
+            gcm_ctx ctx[1]);                /* the mode context             */
+
+                                /* tab must hold gcm_table_size(mode) bytes */
+                                /* aligned for gf_t until gcm_end is called */
+ret_type gcm_init_and_key_mode(             /* as above with a given GHASH  */
+            const unsigned char key[],      /* the key value                */
+            unsigned long key_len,          /* and its length in bytes      */
+            ghash_mode mode,                /* the GHASH multiplier to use  */
+            void *tab,                      /* its table, NULL if none      */
             gcm_ctx ctx[1]);                /* the mode context             */
 
 ret_type gcm_end(                           /* clean up and end operation   */
@@ -87,6 +87,50 @@ void gf_mul(gf_t a, const gf_t b)
     }
 }
 
+#if defined( GF_MODE_LB )
+
+/*  A constant time field multiplier.  The bits of a[] are taken from
+    x^0 up, as in the algorithm in NIST SP 800-38D, with the running
+    multiple of b[] being added under a mask rather than a branch and
+    reduced by the field polynomial under a mask when it overflows. In
+    the LB representation x^0 is the top bit of byte 0 so four 32-bit
+    words loaded in big endian order hold the bits in this order.
+*/
+
+#define load_be32(p)    ((uint_32t)(p)[0] << 24 | (uint_32t)(p)[1] << 16 \
+                       | (uint_32t)(p)[2] << 8 | (uint_32t)(p)[3])
+#define store_be32(p,v) ((p)[0] = (uint_8t)((v) >> 24), (p)[1] = (uint_8t)((v) >> 16), \
+                         (p)[2] = (uint_8t)((v) >> 8), (p)[3] = (uint_8t)(v))
+
+void gf_mul_ct(gf_t a, const gf_t b)
+{   uint_8t *ap = (uint_8t*)a;
+    const uint_8t *bp = (const uint_8t*)b;
+    uint_32t z0 = 0, z1 = 0, z2 = 0, z3 = 0, v0, v1, v2, v3, x, m;
+    int i, j;
+
+    v0 = load_be32(bp); v1 = load_be32(bp + 4);
+    v2 = load_be32(bp + 8); v3 = load_be32(bp + 12);
+    for(i = 0; i < GF_BYTE_LEN; i += 4)
+    {
+        x = load_be32(ap + i);
+        for(j = 0; j < 32; ++j)
+        {
+            m = (uint_32t)0 - (x >> 31);
+            x <<= 1;
+            z0 ^= v0 & m; z1 ^= v1 & m; z2 ^= v2 & m; z3 ^= v3 & m;
+            m = (uint_32t)0 - (v3 & 1);
+            v3 = (v3 >> 1) | (v2 << 31);
+            v2 = (v2 >> 1) | (v1 << 31);
+            v1 = (v1 >> 1) | (v0 << 31);
+            v0 = (v0 >> 1) ^ (0xe1000000 & m);
+        }
+    }
+    store_be32(ap, z0); store_be32(ap + 4, z1);
+    store_be32(ap + 8, z2); store_be32(ap + 12, z3);
+}
+
+#endif
+
 #if defined( TABLES_64K )
 
 /*  This version uses 64k bytes of table space on the stack.
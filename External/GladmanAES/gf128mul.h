@@ -133,8 +133,10 @@ Issue Date: 11/01/2011
 #include "brg_types.h"
 
 /*  Table sizes for GF(128) Multiply.  Normally larger tables give 
-    higher speed but cache loading might change this. Normally only 
-    one table size (or none at all) will be specified here
+    higher speed but cache loading might change this. Each table size 
+    enabled here can be chosen per GCM context (see gcm.h), the table
+    itself is stored outside the context in a buffer of the size the
+    chosen mode needs. Disabling a table size only removes its code
 */
 #if 0
 #  define TABLES_64K
@@ -145,7 +147,7 @@ Issue Date: 11/01/2011
 #if 1
 #  define TABLES_4K
 #endif
-#if 0
+#if 1
 #  define TABLES_256
 #endif
 
@@ -177,13 +179,21 @@ void convert_representation(gf_t dest, const gf_t source, transform rev);
 
 void gf_mul(gf_t a, const gf_t b);      /* slow field multiply  */  
 
+#if defined( GF_MODE_LB )
+/*  A table-less field multiply for the GCM representation in which the
+    sequence of operations and memory accesses does not depend on the
+    values of a[] or b[]  */
+
+void gf_mul_ct(gf_t a, const gf_t b);   /* constant time multiply   */
+#endif
+
 /* types and calls for 64k table driven field multiplier        */
 
 typedef gf_t    gf_t64k_a[16][256]; 
 typedef gf_t    (*gf_t64k_t)[256];
 
 void init_64k_table(const gf_t g, gf_t64k_t t);
-void gf_mul_64k(gf_t a, const gf_t64k_t t, void *r);
+void gf_mul_64k(gf_t a, const gf_t64k_t t, gf_t r);
 
 /* types and calls for 8k table driven field multiplier        */
 
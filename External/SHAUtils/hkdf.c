@@ -59,13 +59,10 @@ int hkdf(SHAversion whichSha,
     const unsigned char *info, int info_len,
     uint8_t okm[ ], int okm_len)
 {
-  int result;
-  uint8_t *prk = malloc(USHAMaxHashSize);
-  result =  hkdfExtract(whichSha, salt, salt_len, ikm, ikm_len, prk) ||
-            hkdfExpand(whichSha, prk, USHAHashSize(whichSha), info,
-                       info_len, okm, okm_len);
-  free(prk);
-  return result;
+  HMACContext prkContext;
+  return hkdfExtractContext(&prkContext, whichSha, salt, salt_len,
+                            ikm, ikm_len) ||
+         hkdfExpandContext(&prkContext, info, info_len, okm, okm_len);
 }
 
 /*
@@ -100,20 +97,56 @@ int hkdfExtract(SHAversion whichSha,
     const unsigned char *ikm, int ikm_len,
     uint8_t prk[USHAMaxHashSize])
 {
-  int result;
-  unsigned char *nullSalt = malloc(USHAMaxHashSize);
-  if(nullSalt == 0) return shaNull; 
+  unsigned char nullSalt[USHAMaxHashSize];
   if (salt == 0) {
     salt = nullSalt;
     salt_len = USHAHashSize(whichSha);
     memset(nullSalt, '\0', salt_len);
   } else if (salt_len < 0) {
-    free(nullSalt);
     return shaBadParam;
   }
-  result = hmac(whichSha, ikm, ikm_len, salt, salt_len, prk);
-  free(nullSalt);
-  return result;
+  return hmac(whichSha, ikm, ikm_len, salt, salt_len, prk);
+}
+
+/*
+ *  hkdfExtractContext
+ *
+ *  Description:
+ *      This function will perform HKDF extraction and key an HMAC
+ *      context with the resulting pseudo-random key, ready for any
+ *      number of calls to hkdfExpandContext().
+ *
+ *  Parameters:
+ *      prkContext: [out]
+ *          The HMAC context keyed with the pseudo-random key.
+ *      whichSha: [in]
+ *          One of SHA1, SHA224, SHA256, SHA384, SHA512
+ *      salt[ ]: [in]
+ *          The optional salt value (a non-secret random value);
+ *          if not provided (salt == NULL), it is set internally
+ *          to a string of HashLen(whichSha) zeros.
+ *      salt_len: [in]
+ *          The length of the salt value.  (Ignored if salt == NULL.)
+ *      ikm[ ]: [in]
+ *          Input keying material.
+ *      ikm_len: [in]
+ *          The length of the input keying material.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int hkdfExtractContext(HMACContext *prkContext, SHAversion whichSha,
+    const unsigned char *salt, int salt_len,
+    const unsigned char *ikm, int ikm_len)
+{
+  uint8_t prk[USHAMaxHashSize];
+  int ret;
+
+  ret = hkdfExtract(whichSha, salt, salt_len, ikm, ikm_len, prk) ||
+        hmacReset(prkContext, whichSha, prk, USHAHashSize(whichSha));
+  memset(prk, 0, sizeof(prk));
+  return ret;
 }
 
 /*
@@ -152,11 +185,52 @@ int hkdfExtract(SHAversion whichSha,
 int hkdfExpand(SHAversion whichSha, const uint8_t prk[ ], int prk_len,
     const unsigned char *info, int info_len,
     uint8_t okm[ ], int okm_len)
+{
+  HMACContext prkContext;
+
+  if (prk_len < USHAHashSize(whichSha)) return shaBadParam;
+  return hmacReset(&prkContext, whichSha, prk, prk_len) ||
+         hkdfExpandContext(&prkContext, info, info_len, okm, okm_len);
+}
+
+/*
+ *  hkdfExpandContext
+ *
+ *  Description:
+ *      This function will perform HKDF expansion with an HMAC
+ *      context that was keyed with the pseudo-random key, either by
+ *      hkdfExtractContext() or by hmacReset().  The context is
+ *      cloned for each HMAC, so it is not modified and can be used
+ *      again to expand other information strings.
+ *
+ *  Parameters:
+ *      prkContext: [in]
+ *          The HMAC context keyed with the pseudo-random key.
+ *      info[ ]: [in]
+ *          The optional context and application specific information.
+ *          If info == NULL or a zero-length string, it is ignored.
+ *      info_len: [in]
+ *          The length of the optional context and application specific
+ *          information.  (Ignored if info == NULL.)
+ *      okm[ ]: [out]
+ *          Where the HKDF is to be stored.
+ *      okm_len: [in]
+ *          The length of the buffer to hold okm.
+ *          okm_len must be <= 255 * USHABlockSize(whichSha)
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int hkdfExpandContext(const HMACContext *prkContext,
+    const unsigned char *info, int info_len,
+    uint8_t okm[ ], int okm_len)
 {
   int hash_len, N;
   unsigned char T[USHAMaxHashSize];
   int Tlen, where, i;
 
+  if (!prkContext) return shaNull;
   if (info == 0) {
     info = (const unsigned char *)"";
     info_len = 0;
@@ -166,8 +240,7 @@ int hkdfExpand(SHAversion whichSha, const uint8_t prk[ ], int prk_len,
   if (okm_len <= 0) return shaBadParam;
   if (!okm) return shaBadParam;
 
-  hash_len = USHAHashSize(whichSha);
-  if (prk_len < hash_len) return shaBadParam;
+  hash_len = prkContext->hashSize;
   N = okm_len / hash_len;
   if ((okm_len % hash_len) != 0) N++;
   if (N > 255) return shaBadParam;
@@ -177,7 +250,7 @@ int hkdfExpand(SHAversion whichSha, const uint8_t prk[ ], int prk_len,
   for (i = 1; i <= N; i++) {
     HMACContext context;
     unsigned char c = i;
-    int ret = hmacReset(&context, whichSha, prk, prk_len) ||
+    int ret = hmacClone(&context, prkContext) ||
               hmacInput(&context, T, Tlen) ||
               hmacInput(&context, info, info_len) ||
               hmacInput(&context, &c, 1) ||
@@ -82,6 +82,9 @@ int hmacReset(HMACContext *context, enum SHAversion whichSha,
   /* inner padding - key XORd with ipad */
   unsigned char k_ipad[USHA_Max_Message_Block_Size];
 
+  /* outer padding - key XORd with opad */
+  unsigned char k_opad[USHA_Max_Message_Block_Size];
+
   /* temporary buffer when keylen > blocksize */
   unsigned char tempkey[USHAMaxHashSize];
 
@@ -122,22 +125,54 @@ int hmacReset(HMACContext *context, enum SHAversion whichSha,
   /* store key into the pads, XOR'd with ipad and opad values */
   for (i = 0; i < key_len; i++) {
     k_ipad[i] = key[i] ^ 0x36;
-    context->k_opad[i] = key[i] ^ 0x5c;
+    k_opad[i] = key[i] ^ 0x5c;
   }
   /* remaining pad bytes are '\0' XOR'd with ipad and opad values */
   for ( ; i < blocksize; i++) {
     k_ipad[i] = 0x36;
-    context->k_opad[i] = 0x5c;
+    k_opad[i] = 0x5c;
   }
 
   /* perform inner hash */
   /* init context for 1st pass */
   ret = USHAReset(&context->shaContext, whichSha) ||
         /* and start with inner pad */
-        USHAInput(&context->shaContext, k_ipad, blocksize);
+        USHAInput(&context->shaContext, k_ipad, blocksize) ||
+        /* hash the outer pad now, so that every clone of this */
+        /* context starts its 2nd pass where the pad left off */
+        USHAReset(&context->outerContext, whichSha) ||
+        USHAInput(&context->outerContext, k_opad, blocksize);
   return context->Corrupted = ret;
 }
 
+/*
+ *  hmacClone
+ *
+ *  Description:
+ *      This function will copy an HMAC context, typically one that
+ *      has just been keyed by hmacReset(), so that several messages
+ *      can be authenticated with the same key without hashing the
+ *      padded key again for each of them.
+ *
+ *  Parameters:
+ *      clone: [out]
+ *          The context to set up.
+ *      context: [in]
+ *          The context to copy.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int hmacClone(HMACContext *clone, const HMACContext *context)
+{
+  if (!clone || !context) return shaNull;
+  if (context->Corrupted) return context->Corrupted;
+  if (context->Computed) return shaStateError;
+  *clone = *context;
+  return shaSuccess;
+}
+
 /*
  *  hmacInput
  *
@@ -231,17 +266,11 @@ int hmacResult(HMACContext *context, uint8_t *digest)
     USHAResult(&context->shaContext, digest) ||
 
          /* perform outer SHA */
-         /* init context for 2nd pass */
-         USHAReset(&context->shaContext, context->whichSha) ||
-
-         /* start with outer pad */
-         USHAInput(&context->shaContext, context->k_opad,
-                   context->blockSize) ||
-
+         /* (the outer pad was hashed by hmacReset()) */
          /* then results of 1st hash */
-         USHAInput(&context->shaContext, digest, context->hashSize) ||
+         USHAInput(&context->outerContext, digest, context->hashSize) ||
          /* finish up 2nd pass */
-         USHAResult(&context->shaContext, digest);
+         USHAResult(&context->outerContext, digest);
 
   context->Computed = 1;
   return context->Corrupted = ret;
@@ -25,5 +25,37 @@
 
 #define SHA_Parity(x, y, z)  ((x) ^ (y) ^ (z))
 
+/*
+ * SHA-224/256 and SHA-384/512 use compression functions with a
+ * rolling 16-word message schedule and rounds unrolled 16 at a time,
+ * and hash whole blocks straight from the input buffer.  Define
+ * USE_REFERENCE_ROUNDS to build the RFC 6234 reference rounds.
+ */
+#ifndef USE_REFERENCE_ROUNDS
+#define USE_UNROLLED_ROUNDS
+#endif /* USE_REFERENCE_ROUNDS */
+
+/*
+ * Big-endian 32-bit load.  Aligned words are loaded in one access
+ * and byte swapped where the compiler provides a byte reverse.
+ */
+#define SHA_LOAD32_BYTES(p)                                    \
+  ((((uint32_t)(p)[0]) << 24) | (((uint32_t)(p)[1]) << 16) |  \
+   (((uint32_t)(p)[2]) << 8) | ((uint32_t)(p)[3]))
+
+#if defined(__ICCARM__) && defined(__LITTLE_ENDIAN__) && __LITTLE_ENDIAN__
+#include <intrinsics.h>
+#define SHA_BSWAP32(x)       __REV(x)
+#elif defined(__CC_ARM) && !defined(__BIG_ENDIAN)
+#define SHA_BSWAP32(x)       __rev(x)
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+      (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SHA_BSWAP32(x)       __builtin_bswap32(x)
+#endif
+
+#ifdef SHA_BSWAP32
+#define SHA_IS_ALIGNED32(p)  ((((uintptr_t)(p)) & 3) == 0)
+#endif /* SHA_BSWAP32 */
+
 #endif /* _SHA_PRIVATE__H */
 
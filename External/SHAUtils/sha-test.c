@@ -0,0 +1,243 @@
+/*
+	File:    sha-test.c
+
+	FIPS 180-4 known-answer tests for the SHA-224/256/384/512 code in sha224-256.c and sha384-512.c, through the USHA
+	API that hmac.c and hkdf.c use. Build it once as is and once with USE_REFERENCE_ROUNDS and USE_32BIT_ONLY to check
+	every compression function against the same vectors.
+*/
+
+#include "Common.h"
+#include "Debug.h"
+#include "MICORTOS.h"
+#include "sha.h"
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+OSStatus	sha2_test( int print );
+
+//===========================================================================================================================
+//	Test Vectors
+//
+//	The FIPS 180-4 examples ("abc", the 448-bit and 896-bit messages and one million 'a'), the empty message and
+//	messages either side of where the length no longer fits in the last block (55/56 and 111/112 bytes) and of a whole
+//	block (63/64, 127/128). Byte i of those is i * 13 + 1. The digests were computed with Python's hashlib.
+//===========================================================================================================================
+
+typedef struct
+{
+	const char *		data;		// NULL for len bytes of i * 13 + 1
+	size_t				len;		// Number of times data is repeated, 0 for once
+	const char *		sha224;
+	const char *		sha256;
+	const char *		sha384;
+	const char *		sha512;
+	
+}	sha2_test_vector;
+
+static const sha2_test_vector		kSHA2TestVectors[] =
+{
+	{
+		"abc", 0,
+		"23097d223405d8228642a477bda255b32aadbce4bda0b3f7e36c9da7",
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		"cb00753f45a35e8bb5a03d699ac65007272c32ab0eded1631a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7",
+		"ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f"
+	},
+	{
+		"", 0,
+		"d14a028c2a3a2bc9476102bb288234c415a2b01f828ea62ac5b3e42f",
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+		"38b060a751ac96384cd9327eb1b1e36a21fdb71114be07434c0cc7bf63f6e1da274edebfe76f65fbd51ad2f14898b95b",
+		"cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce47d0d13c5d85f2b0ff8318d2877eec2f63b931bd47417a81a538327af927da3e"
+	},
+	{
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 0,
+		"75388b16512776cc5dba5da1fd890150b0c6455cb4f58b1952522525",
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		"3391fdddfc8dc7393707a65b1b4709397cf8b1d162af05abfe8f450de5f36bc6b0455a8520bc4e6f5fe95b1fe3c8452b",
+		"204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c33596fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445"
+	},
+	{
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu", 0,
+		"c97ca9a559850ce97a04a96def6d99a9e0e0e2ab14e6b8df265fc0b3",
+		"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1",
+		"09330c33f71147e83d192fc782cd1b4753111b173b3b05d22fa08086e3b0f712fcc7c71a557e2db966c3e9fa91746039",
+		"8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909"
+	},
+	{
+		NULL, 55,
+		"522545d1913f3f77f733bba2cf38f008d4c62f9e4c60f6449f89eb89",
+		"c7480ee93991327abebc1ee6fb551956911da8571f4bd575e780c211300797f2",
+		"409f45dbdba4a63f16ef4ec54a6273af8dc15da0d08f467cff4c7c9c7329eb237b9183b3360dc36fe50f4fd82b5c63da",
+		"b134f87bb1bfafe9cf05f4c44178dbc808d15bd18ae4143454e97894d109f197ebccd612f44d50d7d8ec914f6133ef8058e22aec99766031b01804abcc2955c1"
+	},
+	{
+		NULL, 56,
+		"20b7e1f435749d9f7ec7d7fc6abcf1c255fd0afa46a72d7f25704c7d",
+		"434d6ca8a1c737a8e00ad1558a8c39a8f95d1d62ab39f1418784482cb304afad",
+		"dba599a0b026447193daad272527747d8acf68b417ef5f8fb2606832058982bff21a7b391af9687551fcb9cf574144f4",
+		"9c4a276405d1c768e8d8b70c908a033e3cccf1d94a98a65a4ce335e27c1600bf28c300d23389b446b671ed2abad2dd95121dd1fa8c529b9300753efba8c20169"
+	},
+	{
+		NULL, 63,
+		"56d46545c3a0bee8c7579090df55bda397fe2255923021ce7c106999",
+		"f36b91d14db586e312898467bf17e5f44ebf53a0b1a3a64fa3de90877ba6c4dd",
+		"127587dc110417aebedf433ad9ceddaac201303c9385c32715f12512c5d6767350a57a6322a3052ede9c84236f6ebd55",
+		"5b49a8551703d4e1060af3fb12082cfd91789cfe2750c4ca7fe76697ac1b0f647a9c81bd97bc1af4be14deb131a8a1b0af2687da988fbdb7b99089d99ec58f34"
+	},
+	{
+		NULL, 64,
+		"bc8e6065c2e26014d20feba4505a018ee36a6613ed45e97099def0fd",
+		"5ef2644039fe7976c6cadafb30e28c37fab8bf9c27cb9a3e36e9c74c97d5ac2d",
+		"1798630fff643d8ed3237a65ea71d8fd3c1d85602a963bc78e422e166533f451762f745173327031d877eb50de215ebd",
+		"0706375c26817a8d2704d8a6619a5e0c79d023ac120f3199882c41c894d1e78cbccbcb4760b44da4f9487bf108204cea345a5fcf9da39b28f1c4145de3a761fe"
+	},
+	{
+		NULL, 111,
+		"33b8f870bacaf698eb494bb4c0bb313d5017864370fbf82a6d7a912d",
+		"34f330d6ded96566d807bfdc64cae94b7b1bd376b3a43b3ef332a20fdc69f9f3",
+		"4a3db542ae32f74ddcba5093541311915875794224985be9fe5ff005361eea7e2c534289d0a168bb8a7e91d48a100e94",
+		"ec620bb5ff3b0c4643661282c310c2374dbedb721ba158a876494c4565674f010ff9b0a8c64fe2a5dbf4550e41a791db93619a638ce7f824b01c3241b73e4844"
+	},
+	{
+		NULL, 112,
+		"406651ef4f6336dd37b98f9d1e6247ebb440e9c4a8347115bb17f4e9",
+		"6cf7812858e17fcce63b04259a507dc6b96fa0de077b9e387715eeeff407d8c9",
+		"b3397354802883106097cd7aa2843fa8dcbded802ac0ae92a9d9cb327a444168a11a85d9cafb5f693c15c181497fd02d",
+		"c763f0bfc2cfb32c3b2d59070652694880428fa0ebf0899f5e60816f959a3d3b4b529fd820a47aca30e5406ac837ee81dae025ef2163a4b6684298d266f7c348"
+	},
+	{
+		NULL, 127,
+		"05e00a95e269db3d5b87b48f02a94b6151912ac1df8779701eadf022",
+		"bf0c7825d314208035a05cab50f419a3956889042b8f13847ecd30797769fd8f",
+		"67acb5e8ddca723ba451547d9f4257c96b83515ade3fe550f0d41c7cee029ecfa3fa3c3e061c5b696b2eb850911708c7",
+		"781f0d416a3451f01045d2eb0c305f9a7b706f85826a684189d9b37e2f4cd6b40fde9d879a70365af6e80f2de185e7d302504a7bd86c361af01f4ef8ff224101"
+	},
+	{
+		NULL, 128,
+		"6eed872add002bdd8f3a6c114ec633b04b1e9e9507f328b76745fd6f",
+		"1bd9b72c6f0a1dcefbe20088983ea7cba3cb097d601468d690da693af5573090",
+		"0f150f61964b763160b560572b3c88c6f994f3f45913680cc634fd356a78fbc343a25778a8e12ea190fce77f6a0ab0dd",
+		"595a6b0d27fb964965f136a53311ab8e508011d7da0be47769999fb183998c0eaa8e6ffd733dc1b549d84e2436f5d5fb582eaa419a8acb75d701022da35e329d"
+	},
+	{
+		NULL, 300,
+		"39df025071f0cd5b93c68def592aaf50443497f2c013ab2954e7249c",
+		"7937ccc0d0d68ddc5b1285ddb702971f8beecb043831031e039a7cffb46e4828",
+		"a7cb09d913236fd096a38e0f07729926466af307ea5e97fbcedbb40d130fd3e74d8e4c37f143bc08f6faab728a07f2af",
+		"9425a194d9f77b764c6b47ed50cf8e18e9e64c8438e3022bb93ccf18533e712705e986a15b29fcea6a0ce59f61d5e2dfc012b26f2318ffe3a23c4c0fb91f55a7"
+	},
+	{
+		"a", 1000000,
+		"20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67",
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0",
+		"9d0e1809716474cb086e834e310a4a1ced149e9c00f248527972cec5704c2a5b07b8b3dc38ecc4ebae97ddd87f3d8985",
+		"e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b"
+	}
+};
+
+#define	kSHA2TestMaxLen			300
+
+// Hashes inLen bytes of a vector from inMsg, whole or in chunks of 1, 2, ... 13 bytes, and compares the digest.
+
+static OSStatus	_sha2_test_one( SHAversion inVersion, const uint8_t *inMsg, size_t inLen, size_t inRepeat, int inChunked,
+	const char *inHex )
+{
+	OSStatus			err;
+	USHAContext			ctx;
+	uint8_t				digest[ USHAMaxHashSize ];
+	char				hex[ 2 * USHAMaxHashSize + 1 ];
+	size_t				i, r, n, chunk;
+	int					hashSize;
+	
+	err = USHAReset( &ctx, inVersion );
+	require_noerr( err, exit );
+	for( r = 0; r < inRepeat; ++r )
+	{
+		chunk = 0;
+		for( i = 0; i < inLen; i += n )
+		{
+			n = inChunked ? ( ( chunk++ % 13 ) + 1 ) : inLen;
+			if( n > ( inLen - i ) ) n = inLen - i;
+			err = USHAInput( &ctx, inMsg + i, (unsigned int) n );
+			require_noerr( err, exit );
+		}
+	}
+	err = USHAResult( &ctx, digest );
+	require_noerr( err, exit );
+	
+	hashSize = USHAHashSize( inVersion );
+	for( i = 0; i < (size_t) hashSize; ++i ) snprintf( &hex[ 2 * i ], 3, "%02x", digest[ i ] );
+	err = ( strcmp( hex, inHex ) == 0 ) ? kNoErr : kMismatchErr;
+	
+exit:
+	return( err );
+}
+
+//===========================================================================================================================
+//	sha2_test
+//===========================================================================================================================
+
+OSStatus	sha2_test( int print )
+{
+	static const SHAversion		kVersions[] = { SHA224, SHA256, SHA384, SHA512 };
+	static const char * const	kNames[]	= { "SHA-224", "SHA-256", "SHA-384", "SHA-512" };
+	OSStatus					err = kNoErr;
+	uint8_t *					buf = NULL;
+	const uint8_t *				msg;
+	const char *				hex;
+	size_t						i, j, len, repeat;
+	int							misaligned, chunked;
+	uint32_t					t;
+	
+	t = mico_get_time();
+	buf = (uint8_t *) malloc( 1000 + 1 );
+	require_action( buf, exit, err = kNoMemoryErr );
+	
+	for( i = 0; i < sizeof( kSHA2TestVectors ) / sizeof( kSHA2TestVectors[ 0 ] ); ++i )
+	{
+		const sha2_test_vector * const		tv = &kSHA2TestVectors[ i ];
+		
+		// One million 'a' is hashed from a 1000-byte buffer 1000 times.
+		
+		repeat = 1;
+		if( !tv->data )				len = tv->len;
+		else if( tv->len == 0 )		len = strlen( tv->data );
+		else
+		{
+			len	   = 1000;
+			repeat = tv->len / len;
+		}
+		
+		// Whole blocks are read straight from the caller's buffer, with one word load per message word when it is
+		// aligned: run every vector from an aligned and a misaligned pointer.
+		
+		for( misaligned = 0; misaligned < 2; ++misaligned )
+		{
+			uint8_t * const		dst = buf + misaligned;
+			
+			if( !tv->data )				for( j = 0; j < len; ++j ) dst[ j ] = (uint8_t)( j * 13 + 1 );
+			else if( tv->len == 0 )		memcpy( dst, tv->data, len );
+			else						memset( dst, tv->data[ 0 ], len );
+			msg = dst;
+			
+			for( chunked = 0; chunked < 2; ++chunked )
+			{
+				for( j = 0; j < sizeof( kVersions ) / sizeof( kVersions[ 0 ] ); ++j )
+				{
+					hex = ( j == 0 ) ? tv->sha224 : ( j == 1 ) ? tv->sha256 : ( j == 2 ) ? tv->sha384 : tv->sha512;
+					err = _sha2_test_one( kVersions[ j ], msg, len, repeat, chunked, hex );
+					require_noerr_action( err, exit, if( print ) printf( "%s vector %u failed (%s, %s)\r\n", kNames[ j ],
+						(unsigned int) i, misaligned ? "misaligned" : "aligned", chunked ? "chunked" : "whole" ) );
+				}
+			}
+		}
+	}
+	
+exit:
+	if( buf ) free( buf );
+	printf( "%s: %s (%u ms)\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED", (unsigned int)( mico_get_time() - t ) );
+	return( err );
+}
@@ -214,9 +214,9 @@ typedef struct HMACContext {
     SHAversion whichSha;        /* which SHA is being used */
     int hashSize;               /* hash size of SHA being used */
     int blockSize;              /* block size of SHA being used */
-    USHAContext shaContext;     /* SHA context */
-    unsigned char k_opad[USHA_Max_Message_Block_Size];
-                        /* outer padding - key XORd with opad */
+    USHAContext shaContext;     /* SHA context, inner hash */
+    USHAContext outerContext;   /* SHA context of the outer hash, */
+                        /* with the key XORd with opad already hashed */
     int Computed;               /* Is the MAC computed? */
     int Corrupted;              /* Cumulative corruption code */
 
@@ -327,6 +327,7 @@ extern int hmacFinalBits(HMACContext *context, uint8_t bits,
                          unsigned int bit_count);
 extern int hmacResult(HMACContext *context,
                       uint8_t digest[USHAMaxHashSize]);
+extern int hmacClone(HMACContext *clone, const HMACContext *context);
 
 /*
  * HKDF HMAC-based Extract-and-Expand Key Derivation Function,
@@ -343,6 +344,18 @@ extern int hkdfExpand(SHAversion whichSha, const uint8_t prk[ ],
                       int prk_len, const unsigned char *info,
                       int info_len, uint8_t okm[ ], int okm_len);
 
+/*
+ * HKDF with the PRK kept as a keyed HMAC context, so it is
+ * extracted once and several outputs are expanded from it.
+ */
+extern int hkdfExtractContext(HMACContext *prkContext,
+                              SHAversion whichSha,
+                              const unsigned char *salt, int salt_len,
+                              const unsigned char *ikm, int ikm_len);
+extern int hkdfExpandContext(const HMACContext *prkContext,
+                             const unsigned char *info, int info_len,
+                             uint8_t okm[ ], int okm_len);
+
 /*
  * HKDF HMAC-based Extract-and-Expand Key Derivation Function,
  * RFC 5869, for all SHAs.
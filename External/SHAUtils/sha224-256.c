@@ -42,6 +42,7 @@
 
 #include "sha.h"
 #include "sha-private.h"
+#include <string.h>
 
 /* Define the SHA shift, rotate left, and rotate right macros */
 #define SHA256_SHR(bits,word)      ((word) >> (bits))
@@ -74,6 +75,10 @@ static uint32_t addTemp;
 /* Local Function Prototypes */
 static int SHA224_256Reset(SHA256Context *context, uint32_t *H0);
 static void SHA224_256ProcessMessageBlock(SHA256Context *context);
+#ifdef USE_UNROLLED_ROUNDS
+static void SHA224_256ProcessBlock(uint32_t *Intermediate_Hash,
+  const uint8_t *block);
+#endif /* USE_UNROLLED_ROUNDS */
 static void SHA224_256Finalize(SHA256Context *context,
   uint8_t Pad_Byte);
 static void SHA224_256PadMessage(SHA256Context *context,
@@ -81,6 +86,23 @@ static void SHA224_256PadMessage(SHA256Context *context,
 static int SHA224_256ResultN(SHA256Context *context,
   uint8_t Message_Digest[ ], int HashSize);
 
+/* Constants defined in FIPS 180-3, section 4.2.2 */
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+    0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+    0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+    0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+    0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+    0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
 /* Initial Hash Values: FIPS 180-3 section 5.3.2 */
 static uint32_t SHA224_H0[SHA256HashSize/4] = {
     0xC1059ED8, 0x367CD507, 0x3070DD17, 0xF70E5939,
@@ -235,6 +257,33 @@ int SHA256Input(SHA256Context *context, const uint8_t *message_array,
   if (context->Computed) return context->Corrupted = shaStateError;
   if (context->Corrupted) return context->Corrupted;
 
+#ifdef USE_UNROLLED_ROUNDS
+  while (length) {
+    if ((context->Message_Block_Index == 0) &&
+        (length >= SHA256_Message_Block_Size)) {
+      /* Whole blocks are hashed straight from the caller's buffer */
+      if (SHA224_256AddLength(context, 8 * SHA256_Message_Block_Size)
+          != shaSuccess)
+        break;
+      SHA224_256ProcessBlock(context->Intermediate_Hash, message_array);
+      message_array += SHA256_Message_Block_Size;
+      length -= SHA256_Message_Block_Size;
+    } else {
+      unsigned int count = SHA256_Message_Block_Size -
+                           context->Message_Block_Index;
+      if (count > length) count = length;
+      if (SHA224_256AddLength(context, 8 * count) != shaSuccess)
+        break;
+      memcpy(&context->Message_Block[context->Message_Block_Index],
+             message_array, count);
+      context->Message_Block_Index += count;
+      message_array += count;
+      length -= count;
+      if (context->Message_Block_Index == SHA256_Message_Block_Size)
+        SHA224_256ProcessMessageBlock(context);
+    }
+  }
+#else /* !USE_UNROLLED_ROUNDS */
   while (length--) {
     context->Message_Block[context->Message_Block_Index++] =
             *message_array;
@@ -245,6 +294,7 @@ int SHA256Input(SHA256Context *context, const uint8_t *message_array,
 
     message_array++;
   }
+#endif /* USE_UNROLLED_ROUNDS */
 
   return context->Corrupted;
 
@@ -382,22 +432,10 @@ static int SHA224_256Reset(SHA256Context *context, uint32_t *H0)
  */
 static void SHA224_256ProcessMessageBlock(SHA256Context *context)
 {
-  /* Constants defined in FIPS 180-3, section 4.2.2 */
-  static const uint32_t K[64] = {
-      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
-      0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
-      0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
-      0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
-      0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
-      0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
-      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
-      0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
-      0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
-      0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
-      0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
-      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-  };
+#ifdef USE_UNROLLED_ROUNDS
+  SHA224_256ProcessBlock(context->Intermediate_Hash,
+                         context->Message_Block);
+#else /* !USE_UNROLLED_ROUNDS */
   int        t, t4;                   /* Loop counter */
   uint32_t   temp1, temp2;            /* Temporary word value */
   uint32_t   W[64];                   /* Word sequence */
@@ -445,10 +483,118 @@ static void SHA224_256ProcessMessageBlock(SHA256Context *context)
   context->Intermediate_Hash[5] += F;
   context->Intermediate_Hash[6] += G;
   context->Intermediate_Hash[7] += H;
+#endif /* USE_UNROLLED_ROUNDS */
 
   context->Message_Block_Index = 0;
 }
 
+#ifdef USE_UNROLLED_ROUNDS
+/*
+ * One round with the working variables renamed instead of moved:
+ * after the round the roles of a..h shift by one position.
+ */
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,i)                            \
+  h += SHA256_SIGMA1(e) + SHA_Ch(e,f,g) + K[t + (i)] + W[i];       \
+  d += h;                                                          \
+  h += SHA256_SIGMA0(a) + SHA_Maj(a,b,c)
+
+/*
+ * SHA224_256ProcessBlock
+ *
+ * Description:
+ *   This helper function will process 512 bits of the message
+ *   starting at block, which need not be aligned.
+ *
+ * Parameters:
+ *   Intermediate_Hash: [in/out]
+ *     The intermediate hash of the SHA context to update.
+ *   block: [in]
+ *     The 64 octets to process.
+ *
+ * Returns:
+ *   Nothing.
+ *
+ * Comments:
+ *   Only the last 16 words of the message schedule are kept, W[t]
+ *   overwriting W[t-16], and the rounds are unrolled 16 at a time
+ *   so that every index into W is a constant.
+ */
+static void SHA224_256ProcessBlock(uint32_t *Intermediate_Hash,
+  const uint8_t *block)
+{
+  int        t;                       /* Loop counter */
+  uint32_t   W[16];                   /* Rolling word sequence */
+  uint32_t   A, B, C, D, E, F, G, H;  /* Word buffers */
+
+#ifdef SHA_BSWAP32
+  if (SHA_IS_ALIGNED32(block)) {
+    for (t = 0; t < 16; t++)
+      W[t] = SHA_BSWAP32(((const uint32_t *)block)[t]);
+  } else
+#endif /* SHA_BSWAP32 */
+  for (t = 0; t < 16; t++)
+    W[t] = SHA_LOAD32_BYTES(block + 4 * t);
+
+  A = Intermediate_Hash[0];
+  B = Intermediate_Hash[1];
+  C = Intermediate_Hash[2];
+  D = Intermediate_Hash[3];
+  E = Intermediate_Hash[4];
+  F = Intermediate_Hash[5];
+  G = Intermediate_Hash[6];
+  H = Intermediate_Hash[7];
+
+  for (t = 0; ; t += 16) {
+    SHA256_ROUND(A,B,C,D,E,F,G,H, 0);
+    SHA256_ROUND(H,A,B,C,D,E,F,G, 1);
+    SHA256_ROUND(G,H,A,B,C,D,E,F, 2);
+    SHA256_ROUND(F,G,H,A,B,C,D,E, 3);
+    SHA256_ROUND(E,F,G,H,A,B,C,D, 4);
+    SHA256_ROUND(D,E,F,G,H,A,B,C, 5);
+    SHA256_ROUND(C,D,E,F,G,H,A,B, 6);
+    SHA256_ROUND(B,C,D,E,F,G,H,A, 7);
+    SHA256_ROUND(A,B,C,D,E,F,G,H, 8);
+    SHA256_ROUND(H,A,B,C,D,E,F,G, 9);
+    SHA256_ROUND(G,H,A,B,C,D,E,F,10);
+    SHA256_ROUND(F,G,H,A,B,C,D,E,11);
+    SHA256_ROUND(E,F,G,H,A,B,C,D,12);
+    SHA256_ROUND(D,E,F,G,H,A,B,C,13);
+    SHA256_ROUND(C,D,E,F,G,H,A,B,14);
+    SHA256_ROUND(B,C,D,E,F,G,H,A,15);
+
+    if (t == 48)
+      break;
+
+    /* W[t+16..t+31] in place of W[t..t+15] */
+    W[ 0] += SHA256_sigma1(W[14]) + W[ 9] + SHA256_sigma0(W[ 1]);
+    W[ 1] += SHA256_sigma1(W[15]) + W[10] + SHA256_sigma0(W[ 2]);
+    W[ 2] += SHA256_sigma1(W[ 0]) + W[11] + SHA256_sigma0(W[ 3]);
+    W[ 3] += SHA256_sigma1(W[ 1]) + W[12] + SHA256_sigma0(W[ 4]);
+    W[ 4] += SHA256_sigma1(W[ 2]) + W[13] + SHA256_sigma0(W[ 5]);
+    W[ 5] += SHA256_sigma1(W[ 3]) + W[14] + SHA256_sigma0(W[ 6]);
+    W[ 6] += SHA256_sigma1(W[ 4]) + W[15] + SHA256_sigma0(W[ 7]);
+    W[ 7] += SHA256_sigma1(W[ 5]) + W[ 0] + SHA256_sigma0(W[ 8]);
+    W[ 8] += SHA256_sigma1(W[ 6]) + W[ 1] + SHA256_sigma0(W[ 9]);
+    W[ 9] += SHA256_sigma1(W[ 7]) + W[ 2] + SHA256_sigma0(W[10]);
+    W[10] += SHA256_sigma1(W[ 8]) + W[ 3] + SHA256_sigma0(W[11]);
+    W[11] += SHA256_sigma1(W[ 9]) + W[ 4] + SHA256_sigma0(W[12]);
+    W[12] += SHA256_sigma1(W[10]) + W[ 5] + SHA256_sigma0(W[13]);
+    W[13] += SHA256_sigma1(W[11]) + W[ 6] + SHA256_sigma0(W[14]);
+    W[14] += SHA256_sigma1(W[12]) + W[ 7] + SHA256_sigma0(W[15]);
+    W[15] += SHA256_sigma1(W[13]) + W[ 8] + SHA256_sigma0(W[ 0]);
+  }
+
+  Intermediate_Hash[0] += A;
+  Intermediate_Hash[1] += B;
+  Intermediate_Hash[2] += C;
+  Intermediate_Hash[3] += D;
+  Intermediate_Hash[4] += E;
+  Intermediate_Hash[5] += F;
+  Intermediate_Hash[6] += G;
+  Intermediate_Hash[7] += H;
+}
+#endif /* USE_UNROLLED_ROUNDS */
+
 /*
  * SHA224_256Finalize
  *
@@ -44,6 +44,8 @@
  */
 
 #include "sha.h"
+#include "sha-private.h"
+#include <string.h>
 
 #ifdef USE_32BIT_ONLY
 /*
@@ -191,6 +193,10 @@ static uint32_t sigma1_temp1[2], sigma1_temp2[2],
     SHA512_XOR(sigma1_temp2, sigma1_temp3, sigma1_temp4),      \
     SHA512_XOR(sigma1_temp1, sigma1_temp4, (ret)) )
 
+/* Replace the single word Ch() and Maj() from sha-private.h */
+#undef SHA_Ch
+#undef SHA_Maj
+
 #ifndef USE_MODIFIED_MACROS
 /*
  * These definitions are the ones used in FIPS 180-3, section 4.1.3
@@ -250,6 +256,10 @@ static uint32_t addTemp[4] = { 0, 0, 0, 0 };
 static int SHA384_512Reset(SHA512Context *context,
                            uint32_t H0[SHA512HashSize/4]);
 static void SHA384_512ProcessMessageBlock(SHA512Context *context);
+#ifdef USE_UNROLLED_ROUNDS
+static void SHA384_512ProcessBlock(SHA512Context *context,
+  const uint8_t *block);
+#endif /* USE_UNROLLED_ROUNDS */
 static void SHA384_512Finalize(SHA512Context *context,
   uint8_t Pad_Byte);
 static void SHA384_512PadMessage(SHA512Context *context,
@@ -271,9 +281,43 @@ static uint32_t SHA512_H0[SHA512HashSize/4] = {
     0x137E2179
 };
 
-#else /* !USE_32BIT_ONLY */
+/* Constants defined in FIPS 180-3, section 4.2.3 */
+static const uint32_t K[80*2] = {
+    0x428A2F98, 0xD728AE22, 0x71374491, 0x23EF65CD, 0xB5C0FBCF,
+    0xEC4D3B2F, 0xE9B5DBA5, 0x8189DBBC, 0x3956C25B, 0xF348B538,
+    0x59F111F1, 0xB605D019, 0x923F82A4, 0xAF194F9B, 0xAB1C5ED5,
+    0xDA6D8118, 0xD807AA98, 0xA3030242, 0x12835B01, 0x45706FBE,
+    0x243185BE, 0x4EE4B28C, 0x550C7DC3, 0xD5FFB4E2, 0x72BE5D74,
+    0xF27B896F, 0x80DEB1FE, 0x3B1696B1, 0x9BDC06A7, 0x25C71235,
+    0xC19BF174, 0xCF692694, 0xE49B69C1, 0x9EF14AD2, 0xEFBE4786,
+    0x384F25E3, 0x0FC19DC6, 0x8B8CD5B5, 0x240CA1CC, 0x77AC9C65,
+    0x2DE92C6F, 0x592B0275, 0x4A7484AA, 0x6EA6E483, 0x5CB0A9DC,
+    0xBD41FBD4, 0x76F988DA, 0x831153B5, 0x983E5152, 0xEE66DFAB,
+    0xA831C66D, 0x2DB43210, 0xB00327C8, 0x98FB213F, 0xBF597FC7,
+    0xBEEF0EE4, 0xC6E00BF3, 0x3DA88FC2, 0xD5A79147, 0x930AA725,
+    0x06CA6351, 0xE003826F, 0x14292967, 0x0A0E6E70, 0x27B70A85,
+    0x46D22FFC, 0x2E1B2138, 0x5C26C926, 0x4D2C6DFC, 0x5AC42AED,
+    0x53380D13, 0x9D95B3DF, 0x650A7354, 0x8BAF63DE, 0x766A0ABB,
+    0x3C77B2A8, 0x81C2C92E, 0x47EDAEE6, 0x92722C85, 0x1482353B,
+    0xA2BFE8A1, 0x4CF10364, 0xA81A664B, 0xBC423001, 0xC24B8B70,
+    0xD0F89791, 0xC76C51A3, 0x0654BE30, 0xD192E819, 0xD6EF5218,
+    0xD6990624, 0x5565A910, 0xF40E3585, 0x5771202A, 0x106AA070,
+    0x32BBD1B8, 0x19A4C116, 0xB8D2D0C8, 0x1E376C08, 0x5141AB53,
+    0x2748774C, 0xDF8EEB99, 0x34B0BCB5, 0xE19B48A8, 0x391C0CB3,
+    0xC5C95A63, 0x4ED8AA4A, 0xE3418ACB, 0x5B9CCA4F, 0x7763E373,
+    0x682E6FF3, 0xD6B2B8A3, 0x748F82EE, 0x5DEFB2FC, 0x78A5636F,
+    0x43172F60, 0x84C87814, 0xA1F0AB72, 0x8CC70208, 0x1A6439EC,
+    0x90BEFFFA, 0x23631E28, 0xA4506CEB, 0xDE82BDE9, 0xBEF9A3F7,
+    0xB2C67915, 0xC67178F2, 0xE372532B, 0xCA273ECE, 0xEA26619C,
+    0xD186B8C7, 0x21C0C207, 0xEADA7DD6, 0xCDE0EB1E, 0xF57D4F7F,
+    0xEE6ED178, 0x06F067AA, 0x72176FBA, 0x0A637DC5, 0xA2C898A6,
+    0x113F9804, 0xBEF90DAE, 0x1B710B35, 0x131C471B, 0x28DB77F5,
+    0x23047D84, 0x32CAAB7B, 0x40C72493, 0x3C9EBE0A, 0x15C9BEBC,
+    0x431D67C4, 0x9C100D4C, 0x4CC5D4BE, 0xCB3E42B6, 0x597F299C,
+    0xFC657E2A, 0x5FCB6FAB, 0x3AD6FAEC, 0x6C44198C, 0x4A475817
+};
 
-#include "sha-private.h"
+#else /* !USE_32BIT_ONLY */
 
 /* Define the SHA shift, rotate left and rotate right macros */
 #define SHA512_SHR(bits,word)  (((uint64_t)(word)) >> (bits))
@@ -309,6 +353,10 @@ static uint64_t addTemp;
 static int SHA384_512Reset(SHA512Context *context,
                            uint64_t H0[SHA512HashSize/8]);
 static void SHA384_512ProcessMessageBlock(SHA512Context *context);
+#ifdef USE_UNROLLED_ROUNDS
+static void SHA384_512ProcessBlock(SHA512Context *context,
+  const uint8_t *block);
+#endif /* USE_UNROLLED_ROUNDS */
 static void SHA384_512Finalize(SHA512Context *context,
   uint8_t Pad_Byte);
 static void SHA384_512PadMessage(SHA512Context *context,
@@ -328,6 +376,37 @@ static uint64_t SHA512_H0[ ] = {
     0x1F83D9ABFB41BD6Bll, 0x5BE0CD19137E2179ll
 };
 
+/* Constants defined in FIPS 180-3, section 4.2.3 */
+static const uint64_t K[80] = {
+    0x428A2F98D728AE22ll, 0x7137449123EF65CDll, 0xB5C0FBCFEC4D3B2Fll,
+    0xE9B5DBA58189DBBCll, 0x3956C25BF348B538ll, 0x59F111F1B605D019ll,
+    0x923F82A4AF194F9Bll, 0xAB1C5ED5DA6D8118ll, 0xD807AA98A3030242ll,
+    0x12835B0145706FBEll, 0x243185BE4EE4B28Cll, 0x550C7DC3D5FFB4E2ll,
+    0x72BE5D74F27B896Fll, 0x80DEB1FE3B1696B1ll, 0x9BDC06A725C71235ll,
+    0xC19BF174CF692694ll, 0xE49B69C19EF14AD2ll, 0xEFBE4786384F25E3ll,
+    0x0FC19DC68B8CD5B5ll, 0x240CA1CC77AC9C65ll, 0x2DE92C6F592B0275ll,
+    0x4A7484AA6EA6E483ll, 0x5CB0A9DCBD41FBD4ll, 0x76F988DA831153B5ll,
+    0x983E5152EE66DFABll, 0xA831C66D2DB43210ll, 0xB00327C898FB213Fll,
+    0xBF597FC7BEEF0EE4ll, 0xC6E00BF33DA88FC2ll, 0xD5A79147930AA725ll,
+    0x06CA6351E003826Fll, 0x142929670A0E6E70ll, 0x27B70A8546D22FFCll,
+    0x2E1B21385C26C926ll, 0x4D2C6DFC5AC42AEDll, 0x53380D139D95B3DFll,
+    0x650A73548BAF63DEll, 0x766A0ABB3C77B2A8ll, 0x81C2C92E47EDAEE6ll,
+    0x92722C851482353Bll, 0xA2BFE8A14CF10364ll, 0xA81A664BBC423001ll,
+    0xC24B8B70D0F89791ll, 0xC76C51A30654BE30ll, 0xD192E819D6EF5218ll,
+    0xD69906245565A910ll, 0xF40E35855771202All, 0x106AA07032BBD1B8ll,
+    0x19A4C116B8D2D0C8ll, 0x1E376C085141AB53ll, 0x2748774CDF8EEB99ll,
+    0x34B0BCB5E19B48A8ll, 0x391C0CB3C5C95A63ll, 0x4ED8AA4AE3418ACBll,
+    0x5B9CCA4F7763E373ll, 0x682E6FF3D6B2B8A3ll, 0x748F82EE5DEFB2FCll,
+    0x78A5636F43172F60ll, 0x84C87814A1F0AB72ll, 0x8CC702081A6439ECll,
+    0x90BEFFFA23631E28ll, 0xA4506CEBDE82BDE9ll, 0xBEF9A3F7B2C67915ll,
+    0xC67178F2E372532Bll, 0xCA273ECEEA26619Cll, 0xD186B8C721C0C207ll,
+    0xEADA7DD6CDE0EB1Ell, 0xF57D4F7FEE6ED178ll, 0x06F067AA72176FBAll,
+    0x0A637DC5A2C898A6ll, 0x113F9804BEF90DAEll, 0x1B710B35131C471Bll,
+    0x28DB77F523047D84ll, 0x32CAAB7B40C72493ll, 0x3C9EBE0A15C9BEBCll,
+    0x431D67C49C100D4Cll, 0x4CC5D4BECB3E42B6ll, 0x597F299CFC657E2All,
+    0x5FCB6FAB3AD6FAECll, 0x6C44198C4A475817ll
+};
+
 #endif /* USE_32BIT_ONLY */
 
 /*
@@ -478,6 +557,33 @@ int SHA512Input(SHA512Context *context,
   if (context->Computed) return context->Corrupted = shaStateError;
   if (context->Corrupted) return context->Corrupted;
 
+#ifdef USE_UNROLLED_ROUNDS
+  while (length) {
+    if ((context->Message_Block_Index == 0) &&
+        (length >= SHA512_Message_Block_Size)) {
+      /* Whole blocks are hashed straight from the caller's buffer */
+      if (SHA384_512AddLength(context, 8 * SHA512_Message_Block_Size)
+          != shaSuccess)
+        break;
+      SHA384_512ProcessBlock(context, message_array);
+      message_array += SHA512_Message_Block_Size;
+      length -= SHA512_Message_Block_Size;
+    } else {
+      unsigned int count = SHA512_Message_Block_Size -
+                           context->Message_Block_Index;
+      if (count > length) count = length;
+      if (SHA384_512AddLength(context, 8 * count) != shaSuccess)
+        break;
+      memcpy(&context->Message_Block[context->Message_Block_Index],
+             message_array, count);
+      context->Message_Block_Index += count;
+      message_array += count;
+      length -= count;
+      if (context->Message_Block_Index == SHA512_Message_Block_Size)
+        SHA384_512ProcessMessageBlock(context);
+    }
+  }
+#else /* !USE_UNROLLED_ROUNDS */
   while (length--) {
     context->Message_Block[context->Message_Block_Index++] =
             *message_array;
@@ -488,6 +594,7 @@ int SHA512Input(SHA512Context *context,
 
     message_array++;
   }
+#endif /* USE_UNROLLED_ROUNDS */
 
   return context->Corrupted;
 }
@@ -650,42 +757,9 @@ static int SHA384_512Reset(SHA512Context *context,
  */
 static void SHA384_512ProcessMessageBlock(SHA512Context *context)
 {
-#ifdef USE_32BIT_ONLY
-  /* Constants defined in FIPS 180-3, section 4.2.3 */
-  static const uint32_t K[80*2] = {
-      0x428A2F98, 0xD728AE22, 0x71374491, 0x23EF65CD, 0xB5C0FBCF,
-      0xEC4D3B2F, 0xE9B5DBA5, 0x8189DBBC, 0x3956C25B, 0xF348B538,
-      0x59F111F1, 0xB605D019, 0x923F82A4, 0xAF194F9B, 0xAB1C5ED5,
-      0xDA6D8118, 0xD807AA98, 0xA3030242, 0x12835B01, 0x45706FBE,
-      0x243185BE, 0x4EE4B28C, 0x550C7DC3, 0xD5FFB4E2, 0x72BE5D74,
-      0xF27B896F, 0x80DEB1FE, 0x3B1696B1, 0x9BDC06A7, 0x25C71235,
-      0xC19BF174, 0xCF692694, 0xE49B69C1, 0x9EF14AD2, 0xEFBE4786,
-      0x384F25E3, 0x0FC19DC6, 0x8B8CD5B5, 0x240CA1CC, 0x77AC9C65,
-      0x2DE92C6F, 0x592B0275, 0x4A7484AA, 0x6EA6E483, 0x5CB0A9DC,
-      0xBD41FBD4, 0x76F988DA, 0x831153B5, 0x983E5152, 0xEE66DFAB,
-      0xA831C66D, 0x2DB43210, 0xB00327C8, 0x98FB213F, 0xBF597FC7,
-      0xBEEF0EE4, 0xC6E00BF3, 0x3DA88FC2, 0xD5A79147, 0x930AA725,
-      0x06CA6351, 0xE003826F, 0x14292967, 0x0A0E6E70, 0x27B70A85,
-      0x46D22FFC, 0x2E1B2138, 0x5C26C926, 0x4D2C6DFC, 0x5AC42AED,
-      0x53380D13, 0x9D95B3DF, 0x650A7354, 0x8BAF63DE, 0x766A0ABB,
-      0x3C77B2A8, 0x81C2C92E, 0x47EDAEE6, 0x92722C85, 0x1482353B,
-      0xA2BFE8A1, 0x4CF10364, 0xA81A664B, 0xBC423001, 0xC24B8B70,
-      0xD0F89791, 0xC76C51A3, 0x0654BE30, 0xD192E819, 0xD6EF5218,
-      0xD6990624, 0x5565A910, 0xF40E3585, 0x5771202A, 0x106AA070,
-      0x32BBD1B8, 0x19A4C116, 0xB8D2D0C8, 0x1E376C08, 0x5141AB53,
-      0x2748774C, 0xDF8EEB99, 0x34B0BCB5, 0xE19B48A8, 0x391C0CB3,
-      0xC5C95A63, 0x4ED8AA4A, 0xE3418ACB, 0x5B9CCA4F, 0x7763E373,
-      0x682E6FF3, 0xD6B2B8A3, 0x748F82EE, 0x5DEFB2FC, 0x78A5636F,
-      0x43172F60, 0x84C87814, 0xA1F0AB72, 0x8CC70208, 0x1A6439EC,
-      0x90BEFFFA, 0x23631E28, 0xA4506CEB, 0xDE82BDE9, 0xBEF9A3F7,
-      0xB2C67915, 0xC67178F2, 0xE372532B, 0xCA273ECE, 0xEA26619C,
-      0xD186B8C7, 0x21C0C207, 0xEADA7DD6, 0xCDE0EB1E, 0xF57D4F7F,
-      0xEE6ED178, 0x06F067AA, 0x72176FBA, 0x0A637DC5, 0xA2C898A6,
-      0x113F9804, 0xBEF90DAE, 0x1B710B35, 0x131C471B, 0x28DB77F5,
-      0x23047D84, 0x32CAAB7B, 0x40C72493, 0x3C9EBE0A, 0x15C9BEBC,
-      0x431D67C4, 0x9C100D4C, 0x4CC5D4BE, 0xCB3E42B6, 0x597F299C,
-      0xFC657E2A, 0x5FCB6FAB, 0x3AD6FAEC, 0x6C44198C, 0x4A475817
-  };
+#ifdef USE_UNROLLED_ROUNDS
+  SHA384_512ProcessBlock(context, context->Message_Block);
+#elif defined(USE_32BIT_ONLY)
   int     t, t2, t8;                  /* Loop counter */
   uint32_t  temp1[2], temp2[2],       /* Temporary word values */
         temp3[2], temp4[2], temp5[2];
@@ -772,36 +846,6 @@ static void SHA384_512ProcessMessageBlock(SHA512Context *context)
   SHA512_ADDTO2(&context->Intermediate_Hash[14], H);
 
 #else /* !USE_32BIT_ONLY */
-  /* Constants defined in FIPS 180-3, section 4.2.3 */
-  static const uint64_t K[80] = {
-      0x428A2F98D728AE22ll, 0x7137449123EF65CDll, 0xB5C0FBCFEC4D3B2Fll,
-      0xE9B5DBA58189DBBCll, 0x3956C25BF348B538ll, 0x59F111F1B605D019ll,
-      0x923F82A4AF194F9Bll, 0xAB1C5ED5DA6D8118ll, 0xD807AA98A3030242ll,
-      0x12835B0145706FBEll, 0x243185BE4EE4B28Cll, 0x550C7DC3D5FFB4E2ll,
-      0x72BE5D74F27B896Fll, 0x80DEB1FE3B1696B1ll, 0x9BDC06A725C71235ll,
-      0xC19BF174CF692694ll, 0xE49B69C19EF14AD2ll, 0xEFBE4786384F25E3ll,
-      0x0FC19DC68B8CD5B5ll, 0x240CA1CC77AC9C65ll, 0x2DE92C6F592B0275ll,
-      0x4A7484AA6EA6E483ll, 0x5CB0A9DCBD41FBD4ll, 0x76F988DA831153B5ll,
-      0x983E5152EE66DFABll, 0xA831C66D2DB43210ll, 0xB00327C898FB213Fll,
-      0xBF597FC7BEEF0EE4ll, 0xC6E00BF33DA88FC2ll, 0xD5A79147930AA725ll,
-      0x06CA6351E003826Fll, 0x142929670A0E6E70ll, 0x27B70A8546D22FFCll,
-      0x2E1B21385C26C926ll, 0x4D2C6DFC5AC42AEDll, 0x53380D139D95B3DFll,
-      0x650A73548BAF63DEll, 0x766A0ABB3C77B2A8ll, 0x81C2C92E47EDAEE6ll,
-      0x92722C851482353Bll, 0xA2BFE8A14CF10364ll, 0xA81A664BBC423001ll,
-      0xC24B8B70D0F89791ll, 0xC76C51A30654BE30ll, 0xD192E819D6EF5218ll,
-      0xD69906245565A910ll, 0xF40E35855771202All, 0x106AA07032BBD1B8ll,
-      0x19A4C116B8D2D0C8ll, 0x1E376C085141AB53ll, 0x2748774CDF8EEB99ll,
-      0x34B0BCB5E19B48A8ll, 0x391C0CB3C5C95A63ll, 0x4ED8AA4AE3418ACBll,
-      0x5B9CCA4F7763E373ll, 0x682E6FF3D6B2B8A3ll, 0x748F82EE5DEFB2FCll,
-      0x78A5636F43172F60ll, 0x84C87814A1F0AB72ll, 0x8CC702081A6439ECll,
-      0x90BEFFFA23631E28ll, 0xA4506CEBDE82BDE9ll, 0xBEF9A3F7B2C67915ll,
-      0xC67178F2E372532Bll, 0xCA273ECEEA26619Cll, 0xD186B8C721C0C207ll,
-      0xEADA7DD6CDE0EB1Ell, 0xF57D4F7FEE6ED178ll, 0x06F067AA72176FBAll,
-      0x0A637DC5A2C898A6ll, 0x113F9804BEF90DAEll, 0x1B710B35131C471Bll,
-      0x28DB77F523047D84ll, 0x32CAAB7B40C72493ll, 0x3C9EBE0A15C9BEBCll,
-      0x431D67C49C100D4Cll, 0x4CC5D4BECB3E42B6ll, 0x597F299CFC657E2All,
-      0x5FCB6FAB3AD6FAECll, 0x6C44198C4A475817ll
-  };
   int        t, t8;                   /* Loop counter */
   uint64_t   temp1, temp2;            /* Temporary word value */
   uint64_t   W[80];                   /* Word sequence */
@@ -853,11 +897,258 @@ static void SHA384_512ProcessMessageBlock(SHA512Context *context)
   context->Intermediate_Hash[5] += F;
   context->Intermediate_Hash[6] += G;
   context->Intermediate_Hash[7] += H;
-#endif /* USE_32BIT_ONLY */
+#endif /* USE_UNROLLED_ROUNDS */
 
   context->Message_Block_Index = 0;
 }
 
+#ifdef USE_UNROLLED_ROUNDS
+#ifdef USE_32BIT_ONLY
+/*
+ * Define the SHA SIGMA and sigma functions on the high and low
+ * halves of a 64-bit word, with the rotations and shifts of at
+ * least 32 bits written as swaps of the halves.
+ */
+#define SHA512_SIGMA0_HI(hi, lo)                               \
+  (((hi) >> 28 | (lo) << 4) ^ ((lo) >> 2 | (hi) << 30) ^       \
+   ((lo) >> 7 | (hi) << 25))
+#define SHA512_SIGMA0_LO(hi, lo)                               \
+  (((lo) >> 28 | (hi) << 4) ^ ((hi) >> 2 | (lo) << 30) ^       \
+   ((hi) >> 7 | (lo) << 25))
+#define SHA512_SIGMA1_HI(hi, lo)                               \
+  (((hi) >> 14 | (lo) << 18) ^ ((hi) >> 18 | (lo) << 14) ^     \
+   ((lo) >> 9 | (hi) << 23))
+#define SHA512_SIGMA1_LO(hi, lo)                               \
+  (((lo) >> 14 | (hi) << 18) ^ ((lo) >> 18 | (hi) << 14) ^     \
+   ((hi) >> 9 | (lo) << 23))
+#define SHA512_sigma0_HI(hi, lo)                               \
+  (((hi) >> 1 | (lo) << 31) ^ ((hi) >> 8 | (lo) << 24) ^       \
+   ((hi) >> 7))
+#define SHA512_sigma0_LO(hi, lo)                               \
+  (((lo) >> 1 | (hi) << 31) ^ ((lo) >> 8 | (hi) << 24) ^       \
+   ((lo) >> 7 | (hi) << 25))
+#define SHA512_sigma1_HI(hi, lo)                               \
+  (((hi) >> 19 | (lo) << 13) ^ ((lo) >> 29 | (hi) << 3) ^      \
+   ((hi) >> 6))
+#define SHA512_sigma1_LO(hi, lo)                               \
+  (((lo) >> 19 | (hi) << 13) ^ ((hi) >> 29 | (lo) << 3) ^      \
+   ((lo) >> 6 | (hi) << 26))
+
+/*
+ * Add the 64-bit value (xhi, xlo) to (hi, lo)
+ */
+#define SHA512_ADD32(hi, lo, xhi, xlo) do {                    \
+    uint32_t add_lo = (xlo);                                   \
+    (lo) += add_lo;                                            \
+    (hi) += (xhi) + ((lo) < add_lo);                           \
+  } while (0)
+
+/*
+ * One round on the word buffers S[2*n] (high) and S[2*n + 1] (low),
+ * with the roles of a..h shifting by one position afterwards.
+ */
+#define SHA512_ROUND(a,b,c,d,e,f,g,h,i) do {                             \
+    uint32_t T1_hi, T1_lo;                                               \
+    T1_hi = SHA512_SIGMA1_HI(S[2*(e)], S[2*(e)+1]);                      \
+    T1_lo = SHA512_SIGMA1_LO(S[2*(e)], S[2*(e)+1]);                      \
+    SHA512_ADD32(T1_hi, T1_lo,                                           \
+      (S[2*(e)] & (S[2*(f)] ^ S[2*(g)])) ^ S[2*(g)],                     \
+      (S[2*(e)+1] & (S[2*(f)+1] ^ S[2*(g)+1])) ^ S[2*(g)+1]);            \
+    SHA512_ADD32(T1_hi, T1_lo, K[2*(t+(i))], K[2*(t+(i))+1]);            \
+    SHA512_ADD32(T1_hi, T1_lo, W[2*(i)], W[2*(i)+1]);                    \
+    SHA512_ADD32(T1_hi, T1_lo, S[2*(h)], S[2*(h)+1]);                    \
+    SHA512_ADD32(S[2*(d)], S[2*(d)+1], T1_hi, T1_lo);                    \
+    SHA512_ADD32(T1_hi, T1_lo,                                           \
+      SHA512_SIGMA0_HI(S[2*(a)], S[2*(a)+1]),                            \
+      SHA512_SIGMA0_LO(S[2*(a)], S[2*(a)+1]));                           \
+    SHA512_ADD32(T1_hi, T1_lo,                                           \
+      (S[2*(a)] & (S[2*(b)] | S[2*(c)])) | (S[2*(b)] & S[2*(c)]),        \
+      (S[2*(a)+1] & (S[2*(b)+1] | S[2*(c)+1])) |                         \
+      (S[2*(b)+1] & S[2*(c)+1]));                                        \
+    S[2*(h)] = T1_hi;                                                    \
+    S[2*(h)+1] = T1_lo;                                                  \
+  } while (0)
+
+/*
+ * W[t] = SHA512_sigma1(W[t-2]) + W[t-7] + SHA512_sigma0(W[t-15])
+ *        + W[t-16], stored in place of W[t-16]
+ */
+#define SHA512_SCHEDULE(i) do {                                          \
+    uint32_t *Wt2 = &W[2*(((i)+14)&15)];                                 \
+    uint32_t *Wt15 = &W[2*(((i)+1)&15)];                                 \
+    SHA512_ADD32(W[2*(i)], W[2*(i)+1],                                   \
+      SHA512_sigma1_HI(Wt2[0], Wt2[1]), SHA512_sigma1_LO(Wt2[0], Wt2[1]));\
+    SHA512_ADD32(W[2*(i)], W[2*(i)+1],                                   \
+      W[2*(((i)+9)&15)], W[2*(((i)+9)&15)+1]);                           \
+    SHA512_ADD32(W[2*(i)], W[2*(i)+1],                                   \
+      SHA512_sigma0_HI(Wt15[0], Wt15[1]),                                \
+      SHA512_sigma0_LO(Wt15[0], Wt15[1]));                               \
+  } while (0)
+
+#else /* !USE_32BIT_ONLY */
+/*
+ * One round with the working variables renamed instead of moved:
+ * after the round the roles of a..h shift by one position.
+ */
+#define SHA512_ROUND(a,b,c,d,e,f,g,h,i)                            \
+  h += SHA512_SIGMA1(e) + SHA_Ch(e,f,g) + K[t + (i)] + W[i];       \
+  d += h;                                                          \
+  h += SHA512_SIGMA0(a) + SHA_Maj(a,b,c)
+
+/*
+ * W[t] = SHA512_sigma1(W[t-2]) + W[t-7] + SHA512_sigma0(W[t-15])
+ *        + W[t-16], stored in place of W[t-16]
+ */
+#define SHA512_SCHEDULE(i)                                         \
+  W[i] += SHA512_sigma1(W[((i)+14)&15]) + W[((i)+9)&15] +          \
+          SHA512_sigma0(W[((i)+1)&15])
+#endif /* USE_32BIT_ONLY */
+
+/*
+ * SHA384_512ProcessBlock
+ *
+ * Description:
+ *   This helper function will process 1024 bits of the message
+ *   starting at block, which need not be aligned.
+ *
+ * Parameters:
+ *   context: [in/out]
+ *     The SHA context to update.
+ *   block: [in]
+ *     The 128 octets to process.
+ *
+ * Returns:
+ *   Nothing.
+ *
+ * Comments:
+ *   Only the last 16 words of the message schedule are kept, W[t]
+ *   overwriting W[t-16], and the rounds are unrolled 16 at a time
+ *   so that every index into W is a constant.  With USE_32BIT_ONLY
+ *   each 64-bit word is kept as two 32-bit halves in registers or on
+ *   the stack, without the static temporaries of the macros above.
+ */
+static void SHA384_512ProcessBlock(SHA512Context *context,
+  const uint8_t *block)
+{
+  int        t;                       /* Loop counter */
+#ifdef USE_32BIT_ONLY
+  uint32_t   W[2*16];                 /* Rolling word sequence */
+  uint32_t   S[2*8];                  /* Word buffers A..H */
+  enum { A, B, C, D, E, F, G, H };
+
+#ifdef SHA_BSWAP32
+  if (SHA_IS_ALIGNED32(block)) {
+    for (t = 0; t < 2*16; t++)
+      W[t] = SHA_BSWAP32(((const uint32_t *)block)[t]);
+  } else
+#endif /* SHA_BSWAP32 */
+  for (t = 0; t < 2*16; t++)
+    W[t] = SHA_LOAD32_BYTES(block + 4 * t);
+
+  S[0] = context->Intermediate_Hash[0];
+  S[1] = context->Intermediate_Hash[1];
+  S[2] = context->Intermediate_Hash[2];
+  S[3] = context->Intermediate_Hash[3];
+  S[4] = context->Intermediate_Hash[4];
+  S[5] = context->Intermediate_Hash[5];
+  S[6] = context->Intermediate_Hash[6];
+  S[7] = context->Intermediate_Hash[7];
+  S[8] = context->Intermediate_Hash[8];
+  S[9] = context->Intermediate_Hash[9];
+  S[10] = context->Intermediate_Hash[10];
+  S[11] = context->Intermediate_Hash[11];
+  S[12] = context->Intermediate_Hash[12];
+  S[13] = context->Intermediate_Hash[13];
+  S[14] = context->Intermediate_Hash[14];
+  S[15] = context->Intermediate_Hash[15];
+#else /* !USE_32BIT_ONLY */
+  uint64_t   W[16];                   /* Rolling word sequence */
+  uint64_t   A, B, C, D, E, F, G, H;  /* Word buffers */
+
+#ifdef SHA_BSWAP32
+  if (SHA_IS_ALIGNED32(block)) {
+    const uint32_t *words = (const uint32_t *)block;
+    for (t = 0; t < 16; t++)
+      W[t] = ((uint64_t)SHA_BSWAP32(words[2 * t]) << 32) |
+             SHA_BSWAP32(words[2 * t + 1]);
+  } else
+#endif /* SHA_BSWAP32 */
+  for (t = 0; t < 16; t++)
+    W[t] = ((uint64_t)SHA_LOAD32_BYTES(block + 8 * t) << 32) |
+           SHA_LOAD32_BYTES(block + 8 * t + 4);
+
+  A = context->Intermediate_Hash[0];
+  B = context->Intermediate_Hash[1];
+  C = context->Intermediate_Hash[2];
+  D = context->Intermediate_Hash[3];
+  E = context->Intermediate_Hash[4];
+  F = context->Intermediate_Hash[5];
+  G = context->Intermediate_Hash[6];
+  H = context->Intermediate_Hash[7];
+#endif /* USE_32BIT_ONLY */
+
+  for (t = 0; ; t += 16) {
+    SHA512_ROUND(A,B,C,D,E,F,G,H, 0);
+    SHA512_ROUND(H,A,B,C,D,E,F,G, 1);
+    SHA512_ROUND(G,H,A,B,C,D,E,F, 2);
+    SHA512_ROUND(F,G,H,A,B,C,D,E, 3);
+    SHA512_ROUND(E,F,G,H,A,B,C,D, 4);
+    SHA512_ROUND(D,E,F,G,H,A,B,C, 5);
+    SHA512_ROUND(C,D,E,F,G,H,A,B, 6);
+    SHA512_ROUND(B,C,D,E,F,G,H,A, 7);
+    SHA512_ROUND(A,B,C,D,E,F,G,H, 8);
+    SHA512_ROUND(H,A,B,C,D,E,F,G, 9);
+    SHA512_ROUND(G,H,A,B,C,D,E,F,10);
+    SHA512_ROUND(F,G,H,A,B,C,D,E,11);
+    SHA512_ROUND(E,F,G,H,A,B,C,D,12);
+    SHA512_ROUND(D,E,F,G,H,A,B,C,13);
+    SHA512_ROUND(C,D,E,F,G,H,A,B,14);
+    SHA512_ROUND(B,C,D,E,F,G,H,A,15);
+
+    if (t == 64)
+      break;
+
+    /* W[t+16..t+31] in place of W[t..t+15] */
+    SHA512_SCHEDULE( 0); SHA512_SCHEDULE( 1);
+    SHA512_SCHEDULE( 2); SHA512_SCHEDULE( 3);
+    SHA512_SCHEDULE( 4); SHA512_SCHEDULE( 5);
+    SHA512_SCHEDULE( 6); SHA512_SCHEDULE( 7);
+    SHA512_SCHEDULE( 8); SHA512_SCHEDULE( 9);
+    SHA512_SCHEDULE(10); SHA512_SCHEDULE(11);
+    SHA512_SCHEDULE(12); SHA512_SCHEDULE(13);
+    SHA512_SCHEDULE(14); SHA512_SCHEDULE(15);
+  }
+
+#ifdef USE_32BIT_ONLY
+  SHA512_ADD32(context->Intermediate_Hash[0],
+               context->Intermediate_Hash[1], S[0], S[1]);
+  SHA512_ADD32(context->Intermediate_Hash[2],
+               context->Intermediate_Hash[3], S[2], S[3]);
+  SHA512_ADD32(context->Intermediate_Hash[4],
+               context->Intermediate_Hash[5], S[4], S[5]);
+  SHA512_ADD32(context->Intermediate_Hash[6],
+               context->Intermediate_Hash[7], S[6], S[7]);
+  SHA512_ADD32(context->Intermediate_Hash[8],
+               context->Intermediate_Hash[9], S[8], S[9]);
+  SHA512_ADD32(context->Intermediate_Hash[10],
+               context->Intermediate_Hash[11], S[10], S[11]);
+  SHA512_ADD32(context->Intermediate_Hash[12],
+               context->Intermediate_Hash[13], S[12], S[13]);
+  SHA512_ADD32(context->Intermediate_Hash[14],
+               context->Intermediate_Hash[15], S[14], S[15]);
+#else /* !USE_32BIT_ONLY */
+  context->Intermediate_Hash[0] += A;
+  context->Intermediate_Hash[1] += B;
+  context->Intermediate_Hash[2] += C;
+  context->Intermediate_Hash[3] += D;
+  context->Intermediate_Hash[4] += E;
+  context->Intermediate_Hash[5] += F;
+  context->Intermediate_Hash[6] += G;
+  context->Intermediate_Hash[7] += H;
+#endif /* USE_32BIT_ONLY */
+}
+#endif /* USE_UNROLLED_ROUNDS */
+
 /*
  * SHA384_512Finalize
  *
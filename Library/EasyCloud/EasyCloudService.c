@@ -62,6 +62,17 @@ typedef enum {
 
 #define STACK_SIZE_EASYCLOUD_SERVICE_MAIN_THREAD    0x800
 
+// keep-alive connections shared by all EasyCloud http requests
+#define ECS_CONNECTION_POOL_SIZE                2
+#define ECS_CONNECTION_IDLE_TIMEOUT             30000   // ms, close pooled socket after idle for 30s
+
+typedef struct _ecs_connection_t {
+  int       fd;
+  uint16_t  port;
+  uint32_t  lastUsed;                       // mico_get_time() when returned to pool
+  char      host[MAX_SIZE_DOMAIN_NAME];     // empty string means the slot is free
+} ecs_connection_t;
+
 /*******************************************************************************
  * VARIABLES
  ******************************************************************************/
@@ -69,6 +80,9 @@ typedef enum {
 static mico_thread_t easyCloudServiceThreadHandle = NULL;
 volatile bool bStopbyUser = false;
 
+static ecs_connection_t ecsConnectionPool[ECS_CONNECTION_POOL_SIZE];
+static mico_mutex_t ecsConnectionPoolMutex = NULL;
+
 
 /*******************************************************************************
  * STATIC FUNCTIONS
@@ -88,8 +102,7 @@ static OSStatus get_rom_version(char *host, uint16_t port, char *request_url,
                                 char out_bin_file[MAX_SIZE_FILE_PATH],
                                 char out_bin_md5[MAX_SIZE_FILE_MD5]);
 
-static OSStatus _parseRomVersionResponseMessage(int fd,
-                              ECS_HTTPHeader_t* inHeader, 
+static OSStatus _parseRomVersionResponseMessage(ECS_HTTPHeader_t* inHeader, 
                               char out_version[MAX_SIZE_FW_VERSION],
                               char out_bin_file[MAX_SIZE_FILE_PATH],
                               char out_bin_md5[MAX_SIZE_FILE_MD5]);
@@ -113,7 +126,7 @@ static OSStatus device_activate_authorize(service_request_type_t request_type,
                                           char out_device_id[MAX_SIZE_DEVICE_ID], 
                                           char out_master_device_key[MAX_SIZE_DEVICE_KEY]);
 
-static OSStatus _parseResponseMessage(int fd, ECS_HTTPHeader_t* inHeader, 
+static OSStatus _parseResponseMessage(ECS_HTTPHeader_t* inHeader, 
                                       char out_device_id[MAX_SIZE_DEVICE_ID], 
                                       char out_master_device_key[MAX_SIZE_DEVICE_KEY]);
 
@@ -122,6 +135,18 @@ static OSStatus _configIncommingJsonMessage(const char *input,
                                             char out_device_id[MAX_SIZE_DEVICE_ID], 
                                             char out_master_device_key[MAX_SIZE_DEVICE_KEY]);
 
+static OSStatus _connectToServer(const char* host, uint16_t port, int* fd);
+
+static OSStatus _connectionPoolGet(const char* host, uint16_t port, int* fd, bool* reused);
+static void _connectionPoolPut(const char* host, uint16_t port, int fd, bool keepAlive);
+static void _connectionPoolFlush(void);
+static bool _responseKeepsConnection(ECS_HTTPHeader_t *httpHeader);
+
+static OSStatus _requestToServer(const char* host, uint16_t port,
+                                 const char *method, const char *url,
+                                 const uint8_t *data, size_t dataLen,
+                                 ECS_HTTPHeader_t *httpHeader);
+
 static OSStatus calculate_device_token(char* bssid, 
                                        char* product_key, 
                                        char out_device_token[32]);
@@ -159,12 +184,20 @@ OSStatus EasyCloudServiceInit(easycloud_service_context_t* const context)
   context->service_status.state = EASYCLOUD_STOPPED;
   context->service_status.bin_file_size = 0;
   
+  // init http connection pool
+  if(NULL == ecsConnectionPoolMutex){
+    mico_rtos_init_mutex(&ecsConnectionPoolMutex);
+  }
+  
   return kNoErr;
 }
 
 OSStatus EasyCloudServiceDeInit(easycloud_service_context_t* const context)
 { 
   OSStatus err = kNoErr;
+  
+  // close keep-alive connections left in pool
+  _connectionPoolFlush();
   return err;
 }
 
@@ -460,23 +493,12 @@ OSStatus EasyCloudDeviceReset(easycloud_service_context_t* const context)
     return kParamErr;
   }
   
-  int remoteTcpClient_fd = -1;
-  char ipstr[16];
-  struct sockaddr_t addr;
-  fd_set readfds;
-  
-  struct timeval_t t;
-  t.tv_sec = 5;
-  t.tv_usec = 0;
-  
   /* create device reset http request data */
-  uint8_t *httpRequestData = NULL;
-  size_t httpRequestDataLen = 0;
   ECS_HTTPHeader_t *httpHeader = NULL;
   
   char *json_str = NULL;
   size_t json_str_len = 0;
-  json_object *object;
+  json_object *object = NULL;
   
   //cal device_token = MD5(bssid + product_key)
   err = calculate_device_token(context->service_config_info.bssid,
@@ -504,125 +526,24 @@ OSStatus EasyCloudDeviceReset(easycloud_service_context_t* const context)
   require_action( httpHeader, exit, err = kNoMemoryErr );
   ECS_HTTPHeaderClear( httpHeader );
   
-  //create tcp connect
-  easycloud_service_log("tcp client start to connect...");
-  err = gethostbyname(context->service_config_info.cloudServerDomain, (uint8_t *)ipstr, 16);
-  require_noerr(err, exit);
-  easycloud_service_log("cloud service host:%s, ip: %s", context->service_config_info.cloudServerDomain, ipstr);
-  
-  remoteTcpClient_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  require(remoteTcpClient_fd != -1, exit);
-  
-  addr.s_ip = inet_addr(ipstr); 
-  addr.s_port = context->service_config_info.cloudServerPort;
-  
-  err = connect(remoteTcpClient_fd, &addr, sizeof(addr));
-  require_noerr_quiet(err, exit);
-  
-  easycloud_service_log("EasyCloud server connected at port=%d, fd=%d", 
+  // send request data and read the whole response
+  easycloud_service_log("tcp client send reset request...");
+  easycloud_service_log("send http package: len=%d,\r\n%s", json_str_len, json_str);
+  err = _requestToServer(context->service_config_info.cloudServerDomain,
                          context->service_config_info.cloudServerPort,
-                         remoteTcpClient_fd);
-  
-  // send request data
-  easycloud_service_log("tcp client send activate request...");
-  err = ECS_CreateHTTPMessageEx(ECS_kHTTPPostMethod, 
-                            context->service_config_info.cloudServerDomain,
-                            (char*)DEFAULT_DEVICE_RESET_URL,
-                            ECS_kMIMEType_JSON, 
-                            (uint8_t*)json_str, json_str_len,
-                            &httpRequestData, &httpRequestDataLen);
+                         ECS_kHTTPPostMethod, (char*)DEFAULT_DEVICE_RESET_URL,
+                         (const uint8_t*)json_str, json_str_len,
+                         httpHeader);
   require_noerr( err, exit );
-  easycloud_service_log("send http package: len=%d,\r\n%s", httpRequestDataLen, httpRequestData);
-  
-  err = SocketSend( remoteTcpClient_fd, httpRequestData, httpRequestDataLen );
-  if (httpRequestData != NULL) {
-    free(httpRequestData);
-    httpRequestDataLen = 0;
-  }
-  require_noerr( err, exit );
-  
-  // get http response
-  FD_ZERO(&readfds);
-  FD_SET(remoteTcpClient_fd, &readfds);
-  err = kSelectorErr;
-  err = select(1, &readfds, NULL, NULL, &t);
-  require(err >= 1, exit);
-  //easycloud_service_log("select return ok.");
-  
-  if (FD_ISSET(remoteTcpClient_fd, &readfds)) {
-    err = ECS_SocketReadHTTPHeader( remoteTcpClient_fd, httpHeader );             
-    switch ( err )
-    {
-    case kNoErr:
-      //easycloud_service_log("read httpheader OK!");
-      //easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // statusCode check
-      if(ECS_kStatusOK != httpHeader->statusCode){
-        easycloud_service_log("ERROR: server response statusCode=%d", httpHeader->statusCode);
-        err = kRequestErr;
-        goto exit;
-      }
-      
-      // Read the rest of the HTTP body if necessary
-      err = ECS_SocketReadHTTPBody( remoteTcpClient_fd, httpHeader );
-      require_noerr(err, exit);
-      easycloud_service_log("read httpBody OK!");
-      easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // parse response status
-      if (ECS_kStatusOK != httpHeader->statusCode){
-        err = kResponseErr;
-        goto exit;
-      }
-      
-      goto exit_success;
-      break;
-      
-    case EWOULDBLOCK:
-      easycloud_service_log("ERROR: read blocked!");
-      // NO-OP, keep reading
-      goto exit;
-      break;
-      
-    case kNoSpaceErr:
-      easycloud_service_log("ERROR: Cannot fit HTTPHeader.");
-      goto exit;
-      break;
-      
-    case kConnectionErr:
-      // NOTE: kConnectionErr from SocketReadHTTPHeader means it's closed
-      easycloud_service_log("ERROR: Connection closed.");
-      goto exit;
-      break;
-      
-    default:
-      easycloud_service_log("ERROR: HTTP Header parse internal error: %d", err);
-      goto exit; 
-    }    
-  }
+  easycloud_service_log("read httpBody OK!");
+  easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
 
-exit_success:
-  ECS_HTTPHeaderClear( httpHeader );
-  if(httpHeader) free(httpHeader);
-  if(remoteTcpClient_fd != -1){
-    close(remoteTcpClient_fd);
-    remoteTcpClient_fd = -1;
-  }
-  if(NULL != object){
-    json_object_put(object);
-    object = NULL;
-  }
-  return kNoErr;
-  
 exit:
-  easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  if(kNoErr != err){
+    easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  }
   ECS_HTTPHeaderClear( httpHeader );
   if(httpHeader) free(httpHeader);
-  if(remoteTcpClient_fd != -1){
-    close(remoteTcpClient_fd);
-    remoteTcpClient_fd = -1;
-  }
   if(NULL != object){
     json_object_put(object);
     object = NULL;
@@ -810,18 +731,7 @@ static OSStatus device_activate_authorize(service_request_type_t request_type,
 {
   OSStatus err = kUnknownErr;
   
-  int remoteTcpClient_fd = -1;
-  char ipstr[16];
-  struct sockaddr_t addr;
-  fd_set readfds;
-  
-  struct timeval_t t;
-  t.tv_sec = 5;
-  t.tv_usec = 0;
-  
   /* create activate or authorize http request data */
-  uint8_t *httpRequestData = NULL;
-  size_t httpRequestDataLen = 0;
   ECS_HTTPHeader_t *httpHeader = NULL;
   
   char *json_str = NULL;
@@ -849,123 +759,29 @@ static OSStatus device_activate_authorize(service_request_type_t request_type,
   require_action( httpHeader, exit, err = kNoMemoryErr );
   ECS_HTTPHeaderClear( httpHeader );
   
-  //create tcp connect
-  easycloud_service_log("tcp client start to connect...");
-  err = gethostbyname((char *)host, (uint8_t *)ipstr, 16);
-  require_noerr(err, exit);
-  easycloud_service_log("cloud service host:%s, ip: %s", host, ipstr);
-  
-  remoteTcpClient_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  require(remoteTcpClient_fd != -1, exit);
-  
-  addr.s_ip = inet_addr(ipstr); 
-  addr.s_port = port;
-  
-  err = connect(remoteTcpClient_fd, &addr, sizeof(addr));
-  require_noerr_quiet(err, exit);
-  
-  easycloud_service_log("EasyCloud server connected at port=%d, fd=%d", 
-                         port,
-                         remoteTcpClient_fd);
-  
-  // send request data
-  err = ECS_CreateHTTPMessageEx(ECS_kHTTPPostMethod, 
-                            host, request_url,
-                            ECS_kMIMEType_JSON, 
-                            (uint8_t*)json_str, json_str_len,
-                            &httpRequestData, &httpRequestDataLen);
+  // send request data and read the whole response
+  easycloud_service_log("send http package: len=%d,\r\n%s", json_str_len, json_str);
+  err = _requestToServer(host, port, ECS_kHTTPPostMethod, request_url,
+                         (const uint8_t*)json_str, json_str_len,
+                         httpHeader);
   require_noerr( err, exit );
-  easycloud_service_log("send http package: len=%d,\r\n%s", httpRequestDataLen, httpRequestData);
+  easycloud_service_log("read httpBody OK!");
+  easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
   
-  err = SocketSend( remoteTcpClient_fd, httpRequestData, httpRequestDataLen );
-  if (httpRequestData != NULL) {
-    free(httpRequestData);
-    httpRequestDataLen = 0;
-  }
+  // parse recived extra data to get devicd_id && master_device_key.
+  err = _parseResponseMessage( httpHeader, out_device_id, out_master_device_key );
+  easycloud_service_log("out_device_id=%s", out_device_id);
+  easycloud_service_log("out_master_device_key=%s", out_master_device_key);
   require_noerr( err, exit );
   
-  // get http response
-  FD_ZERO(&readfds);
-  FD_SET(remoteTcpClient_fd, &readfds);
-  err = select(1, &readfds, NULL, NULL, &t);
-  require_action(err >=1, exit, err = kTimeoutErr);
-  
-  if (FD_ISSET(remoteTcpClient_fd, &readfds)) {
-    err = ECS_SocketReadHTTPHeader( remoteTcpClient_fd, httpHeader );             
-    switch ( err )
-    {
-    case kNoErr:
-      //easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // statusCode check
-      if(ECS_kStatusOK != httpHeader->statusCode){
-        easycloud_service_log("ERROR: server response statusCode=%d", 
-                              httpHeader->statusCode);
-        err = kRequestErr;
-        goto exit;
-      }
-      
-      // Read the rest of the HTTP body if necessary
-      err = ECS_SocketReadHTTPBody( remoteTcpClient_fd, httpHeader );
-      require_noerr(err, exit);
-      easycloud_service_log("read httpBody OK!");
-      easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // parse recived extra data to get devicd_id && master_device_key.
-      err = _parseResponseMessage( remoteTcpClient_fd, httpHeader, out_device_id, out_master_device_key );
-      ECS_HTTPHeaderClear(httpHeader);  // Reuse HTTPHeader
-      easycloud_service_log("out_device_id=%s", out_device_id);
-      easycloud_service_log("out_master_device_key=%s", out_master_device_key);
-      require_noerr( err, exit );
-      
-      easycloud_service_log("device (activated=0, authorize=1) [%d] done!", request_type);
-      goto exit_success;
-      break;
-      
-    case EWOULDBLOCK:
-      easycloud_service_log("ERROR: read blocked!");
-      // NO-OP, keep reading
-      goto exit;
-      break;
-      
-    case kNoSpaceErr:
-      easycloud_service_log("ERROR: Cannot fit HTTPHeader.");
-      goto exit;
-      break;
-      
-    case kConnectionErr:
-      // NOTE: kConnectionErr from SocketReadHTTPHeader means it's closed
-      easycloud_service_log("ERROR: Connection closed.");
-      goto exit;
-      break;
-      
-    default:
-      easycloud_service_log("ERROR: HTTP Header parse internal error: %d", err);
-      goto exit; 
-    }    
-  }
+  easycloud_service_log("device (activated=0, authorize=1) [%d] done!", request_type);
 
-exit_success:
-  ECS_HTTPHeaderClear( httpHeader );
-  if(httpHeader) free(httpHeader);
-  if(remoteTcpClient_fd != -1){
-    close(remoteTcpClient_fd);
-    remoteTcpClient_fd = -1;
-  }
-  if(NULL != object){
-    json_object_put(object);
-    object = NULL;
-  }
-  return kNoErr;
-  
 exit:
-  easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  if(kNoErr != err){
+    easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  }
   ECS_HTTPHeaderClear( httpHeader );
   if(httpHeader) free(httpHeader);
-  if(remoteTcpClient_fd != -1){
-    close(remoteTcpClient_fd);
-    remoteTcpClient_fd = -1;
-  }
   if(NULL != object){
     json_object_put(object);
     object = NULL;
@@ -1029,6 +845,186 @@ exit:
   return err;
 }
 
+//////////////////////////////////////////////////////
+// Keep-alive connection pool, one idle socket per host:port is kept after a
+// complete persistent response and checked out again by the next request.
+
+static bool _socketIsStale(int fd)
+{
+  fd_set readfds;
+  struct timeval_t t;
+  t.tv_sec = 0;
+  t.tv_usec = 0;
+  
+  // An idle keep-alive socket has nothing to read, readable means the server
+  // has closed it (FIN/RST) or sent data we never asked for.
+  FD_ZERO(&readfds);
+  FD_SET(fd, &readfds);
+  return (0 != select(fd + 1, &readfds, NULL, NULL, &t));
+}
+
+static OSStatus _connectionPoolGet(const char* host, uint16_t port, int* fd, bool* reused)
+{
+  int i;
+  ecs_connection_t *conn;
+  uint32_t now = mico_get_time();
+  
+  *fd = -1;
+  *reused = false;
+  
+  if(ecsConnectionPoolMutex) mico_rtos_lock_mutex(&ecsConnectionPoolMutex);
+  for(i = 0; i < ECS_CONNECTION_POOL_SIZE; i++){
+    conn = &ecsConnectionPool[i];
+    if('\0' == conn->host[0]) continue;
+    
+    // evict idle or dropped sockets while walking the pool
+    if((now - conn->lastUsed > ECS_CONNECTION_IDLE_TIMEOUT) || _socketIsStale(conn->fd)){
+      close(conn->fd);
+      conn->host[0] = '\0';
+      continue;
+    }
+    
+    if((-1 == *fd) && (port == conn->port) && (0 == strcmp(host, conn->host))){
+      *fd = conn->fd;
+      *reused = true;
+      conn->host[0] = '\0';
+    }
+  }
+  if(ecsConnectionPoolMutex) mico_rtos_unlock_mutex(&ecsConnectionPoolMutex);
+  
+  if(*reused){
+    easycloud_service_log("reuse connection to %s:%d, fd=%d", host, port, *fd);
+    return kNoErr;
+  }
+  return _connectToServer(host, port, fd);
+}
+
+static void _connectionPoolPut(const char* host, uint16_t port, int fd, bool keepAlive)
+{
+  int i;
+  ecs_connection_t *conn = NULL;
+  
+  if(-1 == fd) return;
+  if((false == keepAlive) || (strlen(host) >= MAX_SIZE_DOMAIN_NAME)){
+    close(fd);
+    return;
+  }
+  
+  if(ecsConnectionPoolMutex) mico_rtos_lock_mutex(&ecsConnectionPoolMutex);
+  for(i = 0; i < ECS_CONNECTION_POOL_SIZE; i++){
+    if('\0' == ecsConnectionPool[i].host[0]){
+      conn = &ecsConnectionPool[i];
+      break;
+    }
+    // pool full, replace the least recently used one
+    if((NULL == conn) || (ecsConnectionPool[i].lastUsed < conn->lastUsed)){
+      conn = &ecsConnectionPool[i];
+    }
+  }
+  if('\0' != conn->host[0]){
+    close(conn->fd);
+  }
+  conn->fd = fd;
+  conn->port = port;
+  conn->lastUsed = mico_get_time();
+  strncpy(conn->host, host, MAX_SIZE_DOMAIN_NAME);
+  if(ecsConnectionPoolMutex) mico_rtos_unlock_mutex(&ecsConnectionPoolMutex);
+}
+
+static void _connectionPoolFlush(void)
+{
+  int i;
+  
+  if(ecsConnectionPoolMutex) mico_rtos_lock_mutex(&ecsConnectionPoolMutex);
+  for(i = 0; i < ECS_CONNECTION_POOL_SIZE; i++){
+    if('\0' != ecsConnectionPool[i].host[0]){
+      close(ecsConnectionPool[i].fd);
+      ecsConnectionPool[i].host[0] = '\0';
+    }
+  }
+  if(ecsConnectionPoolMutex) mico_rtos_unlock_mutex(&ecsConnectionPoolMutex);
+}
+
+static bool _responseKeepsConnection(ECS_HTTPHeader_t *httpHeader)
+{
+  if((false == httpHeader->persistent) || (true == httpHeader->dataEndedbyClose)){
+    return false;
+  }
+  // the socket is only reusable when nothing of this response is left unread
+  if(true == httpHeader->chunkedData){
+    return httpHeader->chunkedDataEnded;
+  }
+  return (httpHeader->extraDataLen == httpHeader->contentLength);
+}
+
+// Send one request on a pooled connection and read the whole response into
+// httpHeader. A reused socket the server dropped while idle fails before any
+// response byte arrives, the request is then sent once more on a new connection.
+static OSStatus _requestToServer(const char* host, uint16_t port,
+                                 const char *method, const char *url,
+                                 const uint8_t *data, size_t dataLen,
+                                 ECS_HTTPHeader_t *httpHeader)
+{
+  OSStatus err = kUnknownErr;
+  int fd = -1;
+  bool reused = false;
+  fd_set readfds;
+  struct timeval_t t;
+  
+  for(;;){
+    ECS_HTTPHeaderClear( httpHeader );
+    err = _connectionPoolGet(host, port, &fd, &reused);
+    require_noerr(err, exit);
+    
+    err = ECS_HTTPRequestSend( fd, method, host, url,
+                              ECS_kMIMEType_JSON, data, dataLen );
+    if(kNoErr == err){
+      // get http response
+      t.tv_sec = 5;
+      t.tv_usec = 0;
+      FD_ZERO(&readfds);
+      FD_SET(fd, &readfds);
+      err = select(fd + 1, &readfds, NULL, NULL, &t);
+      if(err >= 1){
+        err = ECS_SocketReadHTTPHeader( fd, httpHeader );
+      }
+      else{
+        err = kTimeoutErr;
+      }
+    }
+    
+    if(reused && (kTimeoutErr != err) && (kNoErr != err) && (0 == httpHeader->len)){
+      easycloud_service_log("pooled connection fd=%d is stale, reconnect.", fd);
+      close(fd);
+      fd = -1;
+      continue;
+    }
+    break;
+  }
+  require_noerr_action( err, exit, 
+                       easycloud_service_log("ERROR: read http header err = %d", err) );
+  
+  // statusCode check
+  if(ECS_kStatusOK != httpHeader->statusCode){
+    easycloud_service_log("ERROR: server response statusCode=%d", httpHeader->statusCode);
+    err = kRequestErr;
+    goto exit;
+  }
+  
+  // Read the rest of the HTTP body if necessary
+  err = ECS_SocketReadHTTPBody( fd, httpHeader );
+  require_noerr(err, exit);
+  
+  _connectionPoolPut(host, port, fd, _responseKeepsConnection(httpHeader));
+  return kNoErr;
+  
+exit:
+  if(-1 != fd){
+    close(fd);
+  }
+  return err;
+}
+
 static OSStatus get_rom_data(char *host, uint16_t port,
                              char bin_file[MAX_SIZE_FILE_PATH],
                              char bin_md5[MAX_SIZE_FILE_MD5],
@@ -1045,6 +1041,8 @@ static OSStatus get_rom_data(char *host, uint16_t port,
   int reTryCount = 0;
   char* request_url = NULL;
   int tcpClient_fd = -1;
+  bool reused = false;
+  bool keepAlive = false;
   fd_set readfds;
   
   // select timeout
@@ -1090,7 +1088,7 @@ static OSStatus get_rom_data(char *host, uint16_t port,
   
   while(1){
     if(-1 == tcpClient_fd){
-      err = _connectToServer(inner_host, inner_port, &tcpClient_fd);
+      err = _connectionPoolGet(inner_host, inner_port, &tcpClient_fd, &reused);
       require_noerr(err, ReTry);
     }
     else{
@@ -1164,6 +1162,7 @@ static OSStatus get_rom_data(char *host, uint16_t port,
           
           easycloud_service_log("read httpBody OK!");
           //easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
+          keepAlive = _responseKeepsConnection(httpHeader);
           ECS_HTTPHeaderClear(httpHeader);  // Reuse HTTPHeader
           
           // check md5
@@ -1216,10 +1215,8 @@ static OSStatus get_rom_data(char *host, uint16_t port,
 exit_success:
   ECS_HTTPHeaderClear( httpHeader );
   if(httpHeader) free(httpHeader);
-  if(tcpClient_fd != -1){
-    close(tcpClient_fd);
-    tcpClient_fd = -1;
-  }
+  _connectionPoolPut(inner_host, inner_port, tcpClient_fd, keepAlive);
+  tcpClient_fd = -1;
   easycloud_service_log("get_rom_data: success!");
   ECS_FlashWriteDone();
   return kNoErr;
@@ -1245,18 +1242,6 @@ static OSStatus get_rom_version(char *host, uint16_t port, char *request_url,
 {
   OSStatus err = kUnknownErr;
   
-  int tcpClient_fd = -1;
-  char ipstr[16];
-  struct sockaddr_t addr;
-  fd_set readfds;
-  
-  struct timeval_t t;
-  t.tv_sec = 5;
-  t.tv_usec = 0;
-  
-  /* create activate or authorize http request data */
-  uint8_t *httpRequestData = NULL;
-  size_t httpRequestDataLen = 0;
   ECS_HTTPHeader_t *httpHeader = NULL;
   
   easycloud_service_log("request: [%s]", request_url);
@@ -1265,128 +1250,34 @@ static OSStatus get_rom_version(char *host, uint16_t port, char *request_url,
   require_action( httpHeader, exit, err = kNoMemoryErr );
   ECS_HTTPHeaderClear( httpHeader );
   
-  //create tcp connect
-  easycloud_service_log("tcp client start to connect...");
-  err = gethostbyname((char *)host, (uint8_t *)ipstr, 16);
-  require_noerr(err, exit);
-  easycloud_service_log("cloud service host:%s, ip: %s", host, ipstr);
-  
-  tcpClient_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-  require_action(tcpClient_fd != -1, exit, err = kOpenErr);
-  
-  addr.s_ip = inet_addr(ipstr); 
-  addr.s_port = port;
-  
-  err = connect(tcpClient_fd, &addr, sizeof(addr));
-  require_noerr(err, exit);
-  
-  easycloud_service_log("EasyCloud server connected at port=%d, fd=%d", 
-                         port,
-                         tcpClient_fd);
-  
-  // send request data
-  easycloud_service_log("tcp client send activate request...");
-  err = ECS_CreateHTTPMessageEx(ECS_kHTTPGetMethod  , 
-                            host, request_url,
-                            ECS_kMIMEType_JSON, 
-                            NULL, 0,
-                            &httpRequestData, &httpRequestDataLen);
+  // send request data and read the whole response
+  easycloud_service_log("tcp client send get rom version request...");
+  err = _requestToServer(host, port, ECS_kHTTPGetMethod, request_url,
+                         NULL, 0, httpHeader);
   require_noerr( err, exit );
-  easycloud_service_log("send http package: len=%d,\r\n%s", httpRequestDataLen, httpRequestData);
+  easycloud_service_log("read httpBody OK!");
+  easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
   
-  err = SocketSend( tcpClient_fd, httpRequestData, httpRequestDataLen );
-  if (httpRequestData != NULL) {
-    free(httpRequestData);
-    httpRequestDataLen = 0;
-  }
+  // parse recived extra data to get rom version, file path and md5.
+  err = _parseRomVersionResponseMessage( httpHeader, 
+                                        out_version, 
+                                        out_bin_file, out_bin_md5 );
   require_noerr( err, exit );
   
-  // get http response
-  FD_ZERO(&readfds);
-  FD_SET(tcpClient_fd, &readfds);
-  err = select(1, &readfds, NULL, NULL, &t);
-  require_action(err >= 1, exit, err = kResponseErr);
-  
-  if (FD_ISSET(tcpClient_fd, &readfds)) {
-    err = ECS_SocketReadHTTPHeader( tcpClient_fd, httpHeader );             
-    switch ( err )
-    {
-    case kNoErr:
-      //easycloud_service_log("read httpheader OK!");
-      //easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // statusCode check
-      if(ECS_kStatusOK != httpHeader->statusCode){
-        easycloud_service_log("ERROR: server response statusCode=%d", 
-                              httpHeader->statusCode);
-        err = kRequestErr;
-        goto exit;
-      }
-      
-      // Read the rest of the HTTP body if necessary
-      err = ECS_SocketReadHTTPBody( tcpClient_fd, httpHeader );
-      require_noerr(err, exit);
-      easycloud_service_log("read httpBody OK!");
-      easycloud_service_log("httpHeader->buf:\r\n%s", httpHeader->buf);
-      
-      // parse recived extra data to get devicd_id && master_device_key.
-      err = _parseRomVersionResponseMessage( tcpClient_fd, httpHeader, 
-                                            out_version, 
-                                            out_bin_file, out_bin_md5 );
-      ECS_HTTPHeaderClear(httpHeader);  // Reuse HTTPHeader
-      require_noerr( err, exit );
-      
-      easycloud_service_log("get rom version done!");
-      goto exit_success;
-      break;
-      
-    case EWOULDBLOCK:
-      easycloud_service_log("ERROR: read blocked!");
-      // NO-OP, keep reading
-      goto exit;
-      break;
-      
-    case kNoSpaceErr:
-      easycloud_service_log("ERROR: Cannot fit HTTPHeader.");
-      goto exit;
-      break;
-      
-    case kConnectionErr:
-      // NOTE: kConnectionErr from SocketReadHTTPHeader means it's closed
-      easycloud_service_log("ERROR: Connection closed.");
-      goto exit;
-      break;
-      
-    default:
-      easycloud_service_log("ERROR: HTTP Header parse internal error: %d", err);
-      goto exit; 
-    }    
-  }
+  easycloud_service_log("get rom version done!");
 
-exit_success:
-  ECS_HTTPHeaderClear( httpHeader );
-  if(httpHeader) free(httpHeader);
-  if(tcpClient_fd != -1){
-    close(tcpClient_fd);
-    tcpClient_fd = -1;
-  }
-  return kNoErr;
-  
 exit:
-  easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  if(kNoErr != err){
+    easycloud_service_log("Exit: EasyCloud tcp client exit with err = %d", err);
+  }
   ECS_HTTPHeaderClear( httpHeader );
   if(httpHeader) free(httpHeader);
-  if(tcpClient_fd != -1){
-    close(tcpClient_fd);
-    tcpClient_fd = -1;
-  }
   
   return err;
 }
 
 
-static OSStatus _parseResponseMessage(int fd,
-                                      ECS_HTTPHeader_t* inHeader, 
+static OSStatus _parseResponseMessage(ECS_HTTPHeader_t* inHeader, 
                                       char out_device_id[MAX_SIZE_DEVICE_ID],
                                       char out_master_device_key[MAX_SIZE_DEVICE_KEY])
 {
@@ -1480,8 +1371,7 @@ exit:
   return err; 
 }
 
-static OSStatus _parseRomVersionResponseMessage(int fd,
-                              ECS_HTTPHeader_t* inHeader, 
+static OSStatus _parseRomVersionResponseMessage(ECS_HTTPHeader_t* inHeader, 
                               char out_version[MAX_SIZE_FW_VERSION],
                               char out_bin_file[MAX_SIZE_FILE_PATH],
                               char out_bin_md5[MAX_SIZE_FILE_MD5])
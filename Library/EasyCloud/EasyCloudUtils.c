@@ -22,6 +22,7 @@
 #include "MICO.h"
 #include "StringUtils.h"
 #include "EasyCloudUtils.h"
+#include "SocketUtils.h"
 
 
 #define ECS_kCRLFNewLine     "\r\n"
@@ -306,6 +307,7 @@ int ECS_SocketReadHTTPHeaderEx( int inSock, ECS_HTTPHeader_t *inHeader )
     require_action(inHeader->chunkedDataBufferPtr, exit, err = kNoMemoryErr);
     memcpy((uint8_t *)inHeader->chunkedDataBufferPtr, end, inHeader->extraDataLen);
     inHeader->extraDataPtr = inHeader->chunkedDataBufferPtr;
+    inHeader->chunkedDataEnded = false;
     return kNoErr;
   }
 
@@ -331,6 +333,128 @@ exit:
   return err;
 }
 
+//===========================================================================================================================
+//  _ECS_SocketReadHTTPChunk
+//
+//  Reads the next chunk of a chunked body and returns it in one piece at extraDataPtr, contentLength bytes long. The
+//  chunk returned by the last call is skipped in place, the buffer is only compacted when the current chunk does not
+//  fit behind it and only grows when a chunk is larger than the whole buffer. Socket reads always fill the free space.
+//  After the last chunk the trailer is skipped up to its empty line, extraDataPtr then points to the next message.
+//===========================================================================================================================
+
+static OSStatus _ECS_ChunkedDataFill( int inSock, ECS_HTTPHeader_t *inHeader, size_t *ioStart, size_t inNeed )
+{
+  OSStatus err = kNoErr;
+  ssize_t readResult;
+  int selectResult;
+  fd_set readSet;
+  char *newBuffer;
+  
+  if( *ioStart + inNeed > inHeader->chunkedDataBufferLen ){
+    /* Drop the consumed chunks, only the unfinished part of the current one is moved */
+    memmove( inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferPtr + *ioStart, inHeader->extraDataLen - *ioStart );
+    inHeader->extraDataLen -= *ioStart;
+    *ioStart = 0;
+    
+    if( inNeed > inHeader->chunkedDataBufferLen ){
+      newBuffer = realloc( inHeader->chunkedDataBufferPtr, inNeed );
+      require_action( newBuffer, exit, err = kNoMemoryErr );
+      inHeader->chunkedDataBufferPtr = newBuffer;
+      inHeader->chunkedDataBufferLen = inNeed;
+    }
+  }
+  
+  while( inHeader->extraDataLen < *ioStart + inNeed ){
+    FD_ZERO( &readSet );
+    FD_SET( inSock, &readSet );
+    selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
+    require_action( selectResult >= 1, exit, err = kNotReadableErr );
+    
+    readResult = read( inSock, inHeader->chunkedDataBufferPtr + inHeader->extraDataLen, 
+                      inHeader->chunkedDataBufferLen - inHeader->extraDataLen );
+    
+    if( readResult  > 0 ) inHeader->extraDataLen += readResult;
+    else { err = kConnectionErr; goto exit; }
+  }
+  
+exit:
+  return err;
+}
+
+static OSStatus _ECS_ChunkedReadLine( int inSock, ECS_HTTPHeader_t *inHeader, size_t *ioStart, size_t *outLineLen )
+{
+  OSStatus err = kNoErr;
+  size_t scanned = 0;
+  char *lf;
+  
+  // Bytes already searched are not searched again after the next read.
+  for( ;; ){
+    lf = memchr( inHeader->chunkedDataBufferPtr + *ioStart + scanned, '\n', inHeader->extraDataLen - *ioStart - scanned );
+    if( lf ) break;
+    scanned = inHeader->extraDataLen - *ioStart;
+    require_action( scanned < inHeader->chunkedDataBufferLen, exit, err = kMalformedErr );
+    err = _ECS_ChunkedDataFill( inSock, inHeader, ioStart, scanned + 1 );
+    require_noerr( err, exit );
+  }
+  *outLineLen = (size_t)( lf - ( inHeader->chunkedDataBufferPtr + *ioStart ) ) + 1;
+  
+exit:
+  return err;
+}
+
+static OSStatus _ECS_SocketReadHTTPChunk( int inSock, ECS_HTTPHeader_t *inHeader )
+{
+  OSStatus err;
+  size_t start, lineLen, i;
+  uint64_t chunkLen = 0;
+  const char *line;
+  int c;
+  
+  /* Skip the chunk returned by the last call and its CRLF tail */
+  start = (size_t)( inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr ) + (size_t) inHeader->contentLength;
+  if( inHeader->contentLength ) start += 2;
+  
+  /* Chunk size line, hex length followed by optional extensions */
+  err = _ECS_ChunkedReadLine( inSock, inHeader, &start, &lineLen );
+  require_noerr( err, exit );
+  line = inHeader->chunkedDataBufferPtr + start;
+  for( i = 0; i < lineLen; ++i ){
+    c = line[ i ];
+    if(      ( c >= '0' ) && ( c <= '9' ) ) c -= '0';
+    else if( ( c >= 'a' ) && ( c <= 'f' ) ) c -= 'a' - 10;
+    else if( ( c >= 'A' ) && ( c <= 'F' ) ) c -= 'A' - 10;
+    else break;
+    require_action( ( chunkLen >> 60 ) == 0, exit, err = kMalformedErr );
+    chunkLen = ( chunkLen << 4 ) | (uint64_t) c;
+  }
+  require_action( i > 0, exit, err = kMalformedErr );
+  start += lineLen;
+  
+  if( chunkLen == 0 ){ //This is the last chunk
+    /* Skip trailer fields up to the empty line, one line is held in the buffer at a time */
+    do{
+      err = _ECS_ChunkedReadLine( inSock, inHeader, &start, &lineLen );
+      require_noerr( err, exit );
+      line = inHeader->chunkedDataBufferPtr + start;
+      start += lineLen;
+    }while( ( lineLen > 2 ) || ( ( lineLen == 2 ) && ( line[ 0 ] != '\r' ) ) );
+    inHeader->chunkedDataEnded = true;
+  }
+  else{
+    require_action( chunkLen < (uint64_t)( (size_t) -1 - 2 ), exit, err = kMalformedErr );
+    err = _ECS_ChunkedDataFill( inSock, inHeader, &start, (size_t) chunkLen + 2 );
+    require_noerr( err, exit );
+    line = inHeader->chunkedDataBufferPtr + start + chunkLen;
+    require_action( line[ 0 ] == '\r' && line[ 1 ] == '\n', exit, err = kMalformedErr );
+  }
+  
+  inHeader->extraDataPtr = inHeader->chunkedDataBufferPtr + start;
+  inHeader->contentLength = chunkLen;
+  
+exit:
+  return err;
+}
+
 OSStatus ECS_SocketReadHTTPBodyEx( int inSock, ECS_HTTPHeader_t *inHeader )
 {
   OSStatus err = kParamErr;
@@ -339,8 +463,6 @@ OSStatus ECS_SocketReadHTTPBodyEx( int inSock, ECS_HTTPHeader_t *inHeader )
   fd_set readSet;
   const char *    value;
   size_t          valueSize;
-  size_t    lastChunkLen, chunckheaderLen; 
-  char *nextPackagePtr;
   
   // select timeout
   struct timeval_t to;
@@ -356,71 +478,8 @@ OSStatus ECS_SocketReadHTTPBodyEx( int inSock, ECS_HTTPHeader_t *inHeader )
 
   /* Chunked data, return after receive one chunk */
   if( inHeader->chunkedData == true ){
-    /* Move next chunk to chunked data buffer header point */
-    lastChunkLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr + inHeader->contentLength;
-    if(inHeader->contentLength) lastChunkLen+=2;  //Last chunck data has a CRLF tail
-    memmove( inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferPtr + lastChunkLen, inHeader->chunkedDataBufferLen - lastChunkLen  );
-    inHeader->extraDataLen -= lastChunkLen;
-
-    while ( ECS_findChunkedDataLength( inHeader->chunkedDataBufferPtr, inHeader->extraDataLen, &inHeader->extraDataPtr ,"%llu", &inHeader->contentLength ) == false){
-      require_action(inHeader->extraDataLen < inHeader->chunkedDataBufferLen, exit, err=kMalformedErr );
-
-      selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-      require( selectResult >= 1, exit ); 
-
-      readResult = read( inSock, inHeader->extraDataPtr, (size_t)( inHeader->chunkedDataBufferLen - inHeader->extraDataLen ) );
-
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }
-    }
-
-    chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
-
-    if(inHeader->contentLength == 0){ //This is the last chunk
-      while( ECS_findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) == false){ //find CRLF
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require( selectResult >= 1, exit ); 
-
-        readResult = read( inSock,
-                          (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen ),
-                          256 - inHeader->extraDataLen ); //Assume chunk trailer length is less than 256 (256 is the min chunk buffer, maybe dangerous
-
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      }
-
-      err = kNoErr;
-      goto exit;
-
-
-    }
-    else{
-      /* Extend chunked data buffer */
-      if( inHeader->chunkedDataBufferLen < inHeader->contentLength + chunckheaderLen + 2){
-        inHeader->chunkedDataBufferLen = inHeader->contentLength + chunckheaderLen + 256;
-        inHeader->chunkedDataBufferPtr = realloc(inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferLen);
-        require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
-      }
-
-      /* Read chunked data */
-      while ( inHeader->extraDataLen < inHeader->contentLength + chunckheaderLen + 2 ){
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require( selectResult >= 1, exit ); 
-
-        readResult = read( inSock,
-                          (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen),
-                          ( inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) + 2 ));
-        
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      } 
-      
-      if( *(inHeader->extraDataPtr + inHeader->contentLength) != '\r' ||
-         *(inHeader->extraDataPtr + inHeader->contentLength +1 ) != '\n'){
-           err = kMalformedErr; 
-           goto exit;
-         }
-    }
+    err = _ECS_SocketReadHTTPChunk( inSock, inHeader );
+    goto exit;
   }
 
   /* We has extra data but total length is not clear, store them to 1500 bytes buffer 
@@ -533,52 +592,32 @@ exit:
 
 char* ECS_DataToHexStringLowercase( const uint8_t *inBuf, size_t inBufLen )
 {
-    char* buf_str = NULL;
-    char* buf_ptr;
-    require_quiet(inBuf, error);
-    require_quiet(inBufLen > 0, error);
-
-    buf_str = (char*) malloc (2*inBufLen + 1);
-    require(buf_str, error);
-    buf_ptr = buf_str;
-    uint32_t i;
-    for (i = 0; i < inBufLen; i++) buf_ptr += sprintf(buf_ptr, "%02x", inBuf[i]);
-    *buf_ptr = '\0';
-    return buf_str;
-
-error:
-    if ( buf_str ) free( buf_str );
-    return NULL;
+    return DataToHexStringLowercase( inBuf, inBufLen );
 }
 
 // dump a new string, must be freed by user
 char* ECS_str_replace(char *dst, const char *src, const unsigned int srcLen, char *old_str, char *new_str)  
 {
-    char *pszPeccancy = strstr(src, old_str);  
-    int length_str = strlen(old_str);  
-    int length_new_str = srcLen - length_str + strlen(new_str)  + 1;
+    size_t length_str = strlen(old_str);
+    size_t length_new_str = strlen(new_str);
+    const char *pszPeccancy = (const char *)memmem((void *)src, srcLen, old_str, length_str);
+    size_t len_before;
+    size_t len_after;
   
     if (pszPeccancy)
     {
-        //easycloud_utils_log("yes, fond it.");
-        
-        char *tmp_str = (char *)malloc(length_new_str);  
-        if (tmp_str)  
-        {   memset(tmp_str, '\0', length_new_str);
-            // ǰβֵַ  
-            int len_before = pszPeccancy - src;  
-            strncpy(tmp_str, src, len_before);  
-            tmp_str[len_before] = '\0';  
-  
-            strcat(tmp_str, new_str);  
-              
-            // Ƕַ  
-            strncat(tmp_str, pszPeccancy + length_str, (srcLen - len_before - length_str));  
-  
-            dst = strdup(tmp_str);  
-  
-            free(tmp_str);  
-        }  
+        // one allocation: part before, new string, part after
+        len_before = pszPeccancy - src;
+        len_after = strnlen(pszPeccancy + length_str, srcLen - len_before - length_str);
+
+        dst = (char *)malloc(len_before + length_new_str + len_after + 1);
+        if (dst)
+        {
+            memcpy(dst, src, len_before);
+            memcpy(dst + len_before, new_str, length_new_str);
+            memcpy(dst + len_before + length_new_str, pszPeccancy + length_str, len_after);
+            dst[len_before + length_new_str + len_after] = '\0';
+        }
     } else  
     {  
         //easycloud_utils_log("no, not fond it.");
@@ -658,6 +697,7 @@ int ECS_SocketReadHTTPHeader( int inSock, ECS_HTTPHeader_t *inHeader )
     require_action(inHeader->chunkedDataBufferPtr, exit, err = kNoMemoryErr);
     memcpy((uint8_t *)inHeader->chunkedDataBufferPtr, end, inHeader->extraDataLen);
     inHeader->extraDataPtr = inHeader->chunkedDataBufferPtr;
+    inHeader->chunkedDataEnded = false;
     return kNoErr;
   }
 
@@ -734,8 +774,6 @@ OSStatus ECS_SocketReadHTTPBody( int inSock, ECS_HTTPHeader_t *inHeader )
   fd_set readSet;
   const char *    value;
   size_t          valueSize;
-  size_t    lastChunkLen, chunckheaderLen; 
-  char *nextPackagePtr;
   struct timeval_t t;
   t.tv_sec = 5;
   t.tv_usec = 0;
@@ -752,69 +790,8 @@ OSStatus ECS_SocketReadHTTPBody( int inSock, ECS_HTTPHeader_t *inHeader )
 
   /* Chunked data, return after receive one chunk */
   if( inHeader->chunkedData == true ){
-    /* Move next chunk to chunked data buffer header point */
-    lastChunkLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr + inHeader->contentLength;
-    if(inHeader->contentLength) lastChunkLen+=2;  //Last chunck data has a CRLF tail
-    memmove( inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferPtr + lastChunkLen, inHeader->chunkedDataBufferLen - lastChunkLen  );
-    inHeader->extraDataLen -= lastChunkLen;
-
-    while ( ECS_findChunkedDataLength( inHeader->chunkedDataBufferPtr, inHeader->extraDataLen, &inHeader->extraDataPtr ,"%llu", &inHeader->contentLength ) == false){
-      require_action(inHeader->extraDataLen < inHeader->chunkedDataBufferLen, exit, err=kMalformedErr );
-
-      selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-      require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-      readResult = read( inSock, inHeader->extraDataPtr, (size_t)( inHeader->chunkedDataBufferLen - inHeader->extraDataLen ) );
-
-      if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-      else { err = kConnectionErr; goto exit; }
-    }
-
-    chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
-
-    if(inHeader->contentLength == 0){ //This is the last chunk
-      while( ECS_findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) == false){ //find CRLF
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-        readResult = read( inSock,
-                          (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen ),
-                          256 - inHeader->extraDataLen ); //Assume chunk trailer length is less than 256 (256 is the min chunk buffer, maybe dangerous
-
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      }
-
-      err = kNoErr;
-      goto exit;
-    }
-    else{
-      /* Extend chunked data buffer */
-      if( inHeader->chunkedDataBufferLen < inHeader->contentLength + chunckheaderLen + 2){
-        inHeader->chunkedDataBufferLen = inHeader->contentLength + chunckheaderLen + 256;
-        inHeader->chunkedDataBufferPtr = realloc(inHeader->chunkedDataBufferPtr, inHeader->chunkedDataBufferLen);
-        require_action(inHeader->extraDataPtr, exit, err = kNoMemoryErr);
-      }
-
-      /* Read chunked data */
-      while ( inHeader->extraDataLen < inHeader->contentLength + chunckheaderLen + 2 ){
-        selectResult = select( inSock + 1, &readSet, NULL, NULL, NULL );
-        require_action( selectResult >= 1, exit, err = kNotReadableErr );
-
-        readResult = read( inSock,
-                          (uint8_t *)( inHeader->extraDataPtr + inHeader->extraDataLen - chunckheaderLen),
-                          ( inHeader->contentLength - (inHeader->extraDataLen - chunckheaderLen) + 2 ));
-        
-        if( readResult  > 0 ) inHeader->extraDataLen += readResult;
-        else { err = kConnectionErr; goto exit; }
-      } 
-      
-      if( *(inHeader->extraDataPtr + inHeader->contentLength) != '\r' ||
-         *(inHeader->extraDataPtr + inHeader->contentLength +1 ) != '\n'){
-           err = kMalformedErr; 
-           goto exit;
-         }
-    }
+    err = _ECS_SocketReadHTTPChunk( inSock, inHeader );
+    goto exit;
   }
 
   /* We has extra data but total length is not clear, store them to 1500 bytes buffer 
@@ -1221,19 +1198,15 @@ ECS_HTTPHeader_t * ECS_HTTPHeaderCreate( void )
 
 void ECS_HTTPHeaderClear( ECS_HTTPHeader_t *inHeader )
 {
-  char *nextPackagePtr;
-  size_t chunckheaderLen = inHeader->extraDataPtr - inHeader->chunkedDataBufferPtr;
   if(inHeader->chunkedData && (uint32_t *)inHeader->chunkedDataBufferPtr){ //chunk data
-    /* Possible to read the header of the next http package */
-    if(ECS_findCRLF( inHeader->extraDataPtr, inHeader->extraDataLen - chunckheaderLen, &nextPackagePtr ) ){
-      if( nextPackagePtr <= inHeader->chunkedDataBufferPtr + inHeader->extraDataLen ){ //We get some data belongs to next http package
-        inHeader->len = inHeader->extraDataLen - (nextPackagePtr - inHeader->chunkedDataBufferPtr);
-        if(inHeader->len > 512)
-          inHeader->len = 0;
-        else
-          memcpy(inHeader->buf, nextPackagePtr, inHeader->len);
-      } else
+    /* Possible to read the header of the next http package, it follows the trailer that ends the chunked body */
+    inHeader->len = 0;
+    if( inHeader->chunkedDataEnded ){
+      inHeader->len = (size_t)( inHeader->chunkedDataBufferPtr + inHeader->extraDataLen - inHeader->extraDataPtr );
+      if(inHeader->len > sizeof(inHeader->buf))
         inHeader->len = 0;
+      else
+        memcpy(inHeader->buf, inHeader->extraDataPtr, inHeader->len);
     }
 
     inHeader->extraDataLen = 0;
@@ -1241,6 +1214,7 @@ void ECS_HTTPHeaderClear( ECS_HTTPHeader_t *inHeader )
     inHeader->chunkedDataBufferPtr = NULL;   
     inHeader->extraDataPtr = NULL;   
     inHeader->chunkedData = false;
+    inHeader->chunkedDataEnded = false;
   }else{
 
     /* We get some data belongs to next http package, this only could happen two or more
@@ -1429,6 +1403,69 @@ exit:
   return err;
 }
 
+/* The header is built on the stack and sent together with the caller's body by a gather send, the body is never
+   copied into a heap buffer. */
+OSStatus ECS_HTTPResponseSend( int fd, int status, const char *contentType, const uint8_t *inData, size_t inDataLen )
+{
+  OSStatus err = kParamErr;
+  char header[ ECS_kHTTPHeaderMax ];
+  SocketIOVec_t vec[ 2 ];
+  int n;
+  
+  require( inDataLen == 0 || ( contentType && inData ), exit );
+  
+  if(inDataLen)
+    n = snprintf( header, sizeof(header), 
+                 "%s %d %s%s%s %s%s%s %d%s",
+                 "HTTP/1.1", status, ECS_getStatusString(status), ECS_kCRLFNewLine, 
+                 "Content-Type:", contentType, ECS_kCRLFNewLine,
+                 "Content-Length:", (int)inDataLen, ECS_kCRLFLineEnding );
+  else
+    n = snprintf( header, sizeof(header), 
+                 "%s %d %s%s%s %d%s",
+                 "HTTP/1.1", status, ECS_getStatusString(status), ECS_kCRLFNewLine,
+                 "Content-Length:", 0, ECS_kCRLFLineEnding );
+  require_action( n > 0 && n < (int)sizeof(header), exit, err = kNoSpaceErr );
+  
+  vec[ 0 ].base = (const uint8_t *)header;
+  vec[ 0 ].len = (size_t)n;
+  vec[ 1 ].base = inData;
+  vec[ 1 ].len = inDataLen;
+  err = SocketSendv( fd, vec, 2 );
+  
+exit:
+  return err;
+}
+
+OSStatus ECS_HTTPRequestSend( int fd, const char *methold, const char * host, 
+                             const char *url, const char *contentType, 
+                             const uint8_t *inData, size_t inDataLen )
+{
+  OSStatus err = kParamErr;
+  char header[ ECS_kHTTPHeaderMax ];
+  SocketIOVec_t vec[ 2 ];
+  int n;
+  
+  require( contentType, exit );
+  
+  n = snprintf( header, sizeof(header), 
+               "%s %s %s %s%s %s%s%s %s%s%s %d%s",
+               methold, url, "HTTP/1.1", ECS_kCRLFNewLine,
+               "Host:", host, ECS_kCRLFNewLine,
+               "Content-Type:", contentType, ECS_kCRLFNewLine,
+               "Content-Length:", (int)inDataLen, ECS_kCRLFLineEnding );
+  require_action( n > 0 && n < (int)sizeof(header), exit, err = kNoSpaceErr );
+  
+  vec[ 0 ].base = (const uint8_t *)header;
+  vec[ 0 ].len = (size_t)n;
+  vec[ 1 ].base = inData;
+  vec[ 1 ].len = inData ? inDataLen : 0;
+  err = SocketSendv( fd, vec, 2 );
+  
+exit:
+  return err;
+}
+
 void ECS_PrintHTTPHeader( ECS_HTTPHeader_t *inHeader )
 {
   (void)inHeader; // Fix warning when debug=0
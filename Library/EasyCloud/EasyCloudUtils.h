@@ -91,6 +91,8 @@
 
 #define ECS_OTA_Data_Length_per_read        1024
 
+#define ECS_kHTTPHeaderMax                  400
+
 
 typedef struct
 {
@@ -121,6 +123,7 @@ typedef struct
     bool                chunkedData;        //! true=Application should read the next chunked data.
     char *              chunkedDataBufferPtr;     //! Ptr for any extra data beyond the header, it is alloced when http header is received.
     size_t              chunkedDataBufferLen; //! Total buffer length that stores the chunkedData, private use only
+    bool                chunkedDataEnded;   //! true=The last chunk and its trailer are received, private use only
 
 
 } ECS_HTTPHeader_t;
@@ -198,6 +201,13 @@ OSStatus ECS_CreateHTTPFailedMessage(const uint8_t *errCode, const uint8_t *errM
 int ECS_SocketReadHTTPHeaderEx( int inSock, ECS_HTTPHeader_t *inHeader );
 OSStatus ECS_SocketReadHTTPBodyEx( int inSock, ECS_HTTPHeader_t *inHeader );
 
+/* Send a whole message without building it in a heap buffer */
+OSStatus ECS_HTTPResponseSend( int fd, int status, const char *contentType, 
+                              const uint8_t *inData, size_t inDataLen );
+OSStatus ECS_HTTPRequestSend( int fd, const char *methold, const char * host, 
+                             const char *url, const char *contentType, 
+                             const uint8_t *inData, size_t inDataLen );
+
 //#ifdef MICO_FLASH_FOR_UPDATE
 
 // OTA flash address
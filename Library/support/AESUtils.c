@@ -91,6 +91,84 @@ static inline void AES_CTR_Increment( uint8_t *inCounter )
     }
 }
 
+//===========================================================================================================================
+//  AES_CTR_GenerateKeystream
+//
+//  Encrypts inCount consecutive counter blocks into outKeystream and advances the counter past them. Batching the
+//  counter blocks lets backends with a multi-block ECB entry point encrypt them in one call.
+//===========================================================================================================================
+
+#define kAES_CTR_BatchBlocks        4 // Keystream blocks generated per backend call on the stack.
+
+static OSStatus AES_CTR_GenerateKeystream( AES_CTR_Context *inContext, uint8_t *outKeystream, size_t inCount )
+{
+    OSStatus        err;
+    size_t          i;
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO || AES_UTILS_USE_GLADMAN_AES )
+    for( i = 0; i < inCount; ++i )
+    {
+        memcpy( &outKeystream[ i * kAES_CTR_Size ], inContext->ctr, kAES_CTR_Size );
+        AES_CTR_Increment( inContext->ctr );
+    }
+    #if( AES_UTILS_USE_COMMON_CRYPTO )
+        err = CCCryptorUpdate( inContext->cryptor, outKeystream, inCount * kAES_CTR_Size, outKeystream, 
+            inCount * kAES_CTR_Size, &i );
+        require_noerr( err, exit );
+        require_action( i == ( inCount * kAES_CTR_Size ), exit, err = kSizeErr );
+    #else
+        aes_ecb_encrypt( outKeystream, outKeystream, (int)( inCount * kAES_CTR_Size ), &inContext->ctx );
+    #endif
+#else
+    for( i = 0; i < inCount; ++i )
+    {
+        #if( AES_UTILS_USE_MICO_AES )
+            AesEncryptDirect( &inContext->ctx, outKeystream, inContext->ctr );
+        #elif( AES_UTILS_USE_USSL )
+            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, outKeystream );
+        #else
+            AES_encrypt( inContext->ctr, outKeystream, &inContext->key );
+        #endif
+        AES_CTR_Increment( inContext->ctr );
+        outKeystream += kAES_CTR_Size;
+    }
+#endif
+    err = kNoErr;
+    
+#if( AES_UTILS_USE_COMMON_CRYPTO )
+exit:
+#endif
+    return( err );
+}
+
+//===========================================================================================================================
+//  AES_CTR_XOR
+//
+//  XORs whole blocks of keystream into the data 32 bits at a time. The words go through memcpy, which compilers turn
+//  into single loads and stores where unaligned access is allowed, so src and dst need no particular alignment.
+//===========================================================================================================================
+
+static inline void AES_CTR_XOR( uint8_t *inDst, const uint8_t *inSrc, const uint8_t *inKeystream, size_t inLen )
+{
+    uint32_t        s[ 4 ];
+    uint32_t        k[ 4 ];
+    
+    check( ( inLen % kAES_CTR_Size ) == 0 );
+    for( ; inLen > 0; inLen -= kAES_CTR_Size )
+    {
+        memcpy( s, inSrc, kAES_CTR_Size );
+        memcpy( k, inKeystream, kAES_CTR_Size );
+        s[ 0 ] ^= k[ 0 ];
+        s[ 1 ] ^= k[ 1 ];
+        s[ 2 ] ^= k[ 2 ];
+        s[ 3 ] ^= k[ 3 ];
+        memcpy( inDst, s, kAES_CTR_Size );
+        inSrc       += kAES_CTR_Size;
+        inDst       += kAES_CTR_Size;
+        inKeystream += kAES_CTR_Size;
+    }
+}
+
 //===========================================================================================================================
 //  AES_CTR_Update
 //===========================================================================================================================
@@ -102,7 +180,11 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     uint8_t *           dst;
     uint8_t *           buf;
     size_t              used;
+    size_t              len;
     size_t              i;
+#if( !AES_UTILS_USE_GLADMAN_AES )
+    uint32_t            keystream[ ( kAES_CTR_BatchBlocks * kAES_CTR_Size ) / 4 ];
+#endif
     
     // inSrc and inDst may be the same, but otherwise, the buffers must not overlap.
     
@@ -125,52 +207,39 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     inContext->used = used;
     
-    // Process whole blocks.
+    // Process whole blocks. Gladman's CTR mode batches the counter blocks itself. Other backends get a few blocks of
+    // keystream generated at a time and XOR'd in words.
     
-    while( inLen >= kAES_CTR_Size )
+    len = inLen & ~( (size_t)( kAES_CTR_Size - 1 ) );
+#if( AES_UTILS_USE_GLADMAN_AES )
+    for( ; len > 0; len -= i )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
-        AES_CTR_Increment( inContext->ctr );
+        i = Min( len, (size_t)( INT_MAX & ~( kAES_CTR_Size - 1 ) ) );
+        aes_ctr_crypt( src, dst, (int) i, inContext->ctr, AES_CTR_Increment, &inContext->ctx );
+        src   += i;
+        dst   += i;
+        inLen -= i;
+    }
+#else
+    for( ; len > 0; len -= i )
+    {
+        i = Min( len, sizeof( keystream ) );
+        err = AES_CTR_GenerateKeystream( inContext, (uint8_t *) keystream, i / kAES_CTR_Size );
+        require_noerr( err, exit );
         
-        for( i = 0; i < kAES_CTR_Size; ++i )
-        {
-            dst[ i ] = src[ i ] ^ buf[ i ];
-        }
-        src   += kAES_CTR_Size;
-        dst   += kAES_CTR_Size;
-        inLen -= kAES_CTR_Size;
+        AES_CTR_XOR( dst, src, (const uint8_t *) keystream, i );
+        src   += i;
+        dst   += i;
+        inLen -= i;
     }
+#endif
     
     // Process any trailing sub-block bytes. Extra key material is buffered for next time.
     
     if( inLen > 0 )
     {
-        #if( AES_UTILS_USE_COMMON_CRYPTO )
-            err = CCCryptorUpdate( inContext->cryptor, inContext->ctr, kAES_CTR_Size, buf, kAES_CTR_Size, &i );
-            require_noerr( err, exit );
-            require_action( i == kAES_CTR_Size, exit, err = kSizeErr );
-        #elif( AES_UTILS_USE_GLADMAN_AES )
-            aes_ecb_encrypt( inContext->ctr, buf, kAES_CTR_Size, &inContext->ctx );
-        #elif( AES_UTILS_USE_MICO_AES )
-            AesEncryptDirect( &inContext->ctx, buf, inContext->ctr );
-        #elif( AES_UTILS_USE_USSL )
-            aes_crypt_ecb( &inContext->ctx, AES_ENCRYPT, inContext->ctr, buf );
-        #else
-            AES_encrypt( inContext->ctr, buf, &inContext->key );
-        #endif
-        AES_CTR_Increment( inContext->ctr );
+        err = AES_CTR_GenerateKeystream( inContext, buf, 1 );
+        require_noerr( err, exit );
         
         for( i = 0; i < inLen; ++i )
         {
@@ -186,9 +255,7 @@ OSStatus    AES_CTR_Update( AES_CTR_Context *inContext, const void *inSrc, size_
     }
     err = kNoErr;
     
-#if( AES_UTILS_USE_COMMON_CRYPTO )
 exit:
-#endif
     return( err );
 }
 
@@ -635,16 +702,48 @@ OSStatus
         AES_GCM_Context *   inContext, 
         const uint8_t       inKey[ kAES_CGM_Size ], 
         const uint8_t       inNonce[ kAES_CGM_Size ] )
+{
+    return( AES_GCM_InitEx( inContext, inKey, inNonce, kAES_GCM_GHashMode_Default ) );
+}
+
+//===========================================================================================================================
+//  AES_GCM_InitEx
+//===========================================================================================================================
+
+OSStatus
+    AES_GCM_InitEx( 
+        AES_GCM_Context *   inContext, 
+        const uint8_t       inKey[ kAES_CGM_Size ], 
+        const uint8_t       inNonce[ kAES_CGM_Size ], 
+        AES_GCM_GHashMode   inGHashMode )
 {
     OSStatus        err;
+#if( AES_UTILS_HAS_GLADMAN_GCM )
+    ghash_mode      mode;
+    void *          table = NULL;
+#endif
     
 #if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
+    (void) inGHashMode;
+    
     err = CCCryptorCreateWithMode( kCCEncrypt, kCCModeGCM, kCCAlgorithmAES128, ccNoPadding, NULL, 
         inKey, kAES_CGM_Size, NULL, 0, 0, 0, &inContext->cryptor );
     require_noerr( err, exit );
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
-    err = gcm_init_and_key( inKey, kAES_CGM_Size, &inContext->ctx );
-    require_noerr( err, exit );
+    if(      inGHashMode == kAES_GCM_GHashMode_Default )        mode = GHASH_DEFAULT;
+    else if( inGHashMode == kAES_GCM_GHashMode_Table8Bit )      mode = GHASH_TABLES_4K;
+    else if( inGHashMode == kAES_GCM_GHashMode_Table4Bit )      mode = GHASH_TABLES_256;
+    else if( inGHashMode == kAES_GCM_GHashMode_ConstantTime )   mode = GHASH_CONST_TIME;
+    else { err = kParamErr; goto exit; }
+    
+    if( gcm_table_size( mode ) > 0 )
+    {
+        table = malloc( gcm_table_size( mode ) );
+        require_action( table, exit, err = kNoMemoryErr );
+    }
+    err = gcm_init_and_key_mode( inKey, kAES_CGM_Size, mode, table, &inContext->ctx );
+    require_action( err == RETURN_GOOD, exit, err = kUnsupportedErr );
+    table = NULL;
 #else
     #error "GCM enabled, but no implementation?"
 #endif
@@ -652,6 +751,9 @@ OSStatus
     if( inNonce ) memcpy( inContext->nonce, inNonce, kAES_CGM_Size );
     
 exit:
+#if( AES_UTILS_HAS_GLADMAN_GCM )
+    if( table ) free( table );
+#endif
     return( err );
 }
 
@@ -664,7 +766,10 @@ void    AES_GCM_Final( AES_GCM_Context *inContext )
 #if( AES_UTILS_HAS_COMMON_CRYPTO_GCM )
     if( inContext->cryptor ) CCCryptorRelease( inContext->cryptor );
 #elif( AES_UTILS_HAS_GLADMAN_GCM )
+    void * const        table = inContext->ctx.gf_tab;
+    
     gcm_end( &inContext->ctx );
+    if( table ) free( table );
 #else
     #error "GCM enabled, but no implementation?"
 #endif
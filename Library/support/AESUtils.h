@@ -309,6 +309,9 @@ void        AES_ECB_Final( AES_ECB_Context *inContext );
         AES_GCM_Decrypt (may repeat as many times as necessary to add each chunk of data to encrypt).
         AES_GCM_VerifyMessage (if this fails, reject the message).
     
+    AES_GCM_InitEx selects the GHASH multiplier per context, trading speed for RAM per key. Table modes need their
+    table size enabled in gf128mul.h; the table is allocated at the size of the selected mode and freed by AES_GCM_Final.
+    
     See <http://en.wikipedia.org/wiki/Galois/Counter_Mode> for more information.
 */
 
@@ -331,12 +334,25 @@ typedef struct
     
 }   AES_GCM_Context;
 
+typedef uint32_t        AES_GCM_GHashMode;
+#define kAES_GCM_GHashMode_Default          0 // Fastest multiplier the build has tables for.
+#define kAES_GCM_GHashMode_Table8Bit        1 // 4 KB table per key.
+#define kAES_GCM_GHashMode_Table4Bit        2 // 256 byte table per key.
+#define kAES_GCM_GHashMode_ConstantTime     3 // No table. Slowest, but timing doesn't depend on the key or data.
+
 OSStatus
     AES_GCM_Init( 
         AES_GCM_Context *   inContext, 
         const uint8_t       inKey[ kAES_CGM_Size ], 
         const uint8_t       inNonce[ kAES_CGM_Size ] ); // May be kAES_CGM_Nonce_None for per-message nonces.
 
+OSStatus
+    AES_GCM_InitEx( 
+        AES_GCM_Context *   inContext, 
+        const uint8_t       inKey[ kAES_CGM_Size ], 
+        const uint8_t       inNonce[ kAES_CGM_Size ],   // May be kAES_CGM_Nonce_None for per-message nonces.
+        AES_GCM_GHashMode   inGHashMode );              // Ignored by CommonCrypto.
+
 void    AES_GCM_Final( AES_GCM_Context *inContext );
 
 OSStatus    AES_GCM_InitMessage( AES_GCM_Context *inContext, const uint8_t *inNonce );
@@ -0,0 +1,980 @@
+/**
+  ******************************************************************************
+  * @file    HTTPUtils-test.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    05-May-2014
+  * @brief   Parser corpus and fuzz tests, keep-alive and pipelining tests
+  *          against a local server thread, and parse and load benchmarks
+  *          for HTTPUtils.c.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "MICO.h"
+#include "HTTPUtils.h"
+#include "SocketUtils.h"
+#include "StringUtils.h"
+
+//===========================================================================================================================
+//  Internals
+//
+//  The server thread serves one connection at a time the way the config server does: read the header and the body,
+//  answer, HTTPHeaderClear and go on with whatever the client pipelined behind the request. Every answer echoes the
+//  request URL, so the client can check that pipelined requests are answered once each and in order.
+//
+//  Latencies are taken with HTTPUtilsTestMicroseconds, which only has the resolution of mico_get_time by default.
+//  Define it to a finer clock when the build has one.
+//===========================================================================================================================
+
+OSStatus    HTTPUtils_Test( int print );
+OSStatus    HTTPUtils_ParseTest( int print );
+OSStatus    HTTPUtils_ParseBench( int print );
+OSStatus    HTTPUtils_LoadBench( int print );
+OSStatus    HTTPUtils_SendBench( int print );
+OSStatus    HTTPUtils_ChunkedBench( int print );
+
+#define kHTTPTestPort               8099
+#define kHTTPTestTimeoutSecs        2
+#define kHTTPTestRequestMax         1200
+#define kHTTPBenchRequests          1000
+#define kHTTPBenchPipelineDepth     8
+#define kHTTPSendBenchMax           4096
+#define kHTTPChunkedBenchBody       65536
+#define kHTTPChunkedBenchRequests   50
+
+#if( !defined( HTTPUtilsTestMicroseconds ) )
+  #define HTTPUtilsTestMicroseconds()   ( (uint64_t) mico_get_time() * 1000 )
+#endif
+
+typedef struct
+{
+  int               listenFd;
+  bool              useCallback;    // Bodies go to onReceivedDataCallback instead of one buffer
+  volatile bool     stop;
+  volatile bool     running;
+  volatile int      lastErr;        // Why the server closed the last connection
+  volatile uint32_t bodyBytes;      // Body bytes passed to onReceivedDataCallback
+  size_t            responseLen;    // Answer with a body of this many bytes instead of echoing the URL
+  bool              legacySend;     // Build that answer with CreateSimpleHTTPMessage instead of HTTPResponseSend
+} HTTPTestServer_t;
+
+static uint8_t          gHTTPSendBenchBody[ kHTTPSendBenchMax ];
+
+static OSStatus _HTTPTestOnBody( HTTPHeader_t *inHeader, uint32_t inPos, uint8_t *inData, size_t inLen, void *inContext )
+{
+  HTTPTestServer_t *server = (HTTPTestServer_t *) inContext;
+
+  UNUSED_PARAMETER( inHeader );
+  UNUSED_PARAMETER( inPos );
+  UNUSED_PARAMETER( inData );
+  server->bodyBytes += inLen;
+  return kNoErr;
+}
+
+// Answers with responseLen bytes of gHTTPSendBenchBody, built the way the server was told to.
+static OSStatus _HTTPTestSendBody( int inFd, HTTPTestServer_t *inServer )
+{
+  OSStatus  err;
+  uint8_t * msg = NULL;
+  size_t    msgLen;
+
+  if( !inServer->legacySend )
+    return HTTPResponseSend( inFd, kStatusOK, kMIMEType_TextPlain, gHTTPSendBenchBody, inServer->responseLen );
+
+  err = CreateSimpleHTTPMessage( kMIMEType_TextPlain, gHTTPSendBenchBody, inServer->responseLen, &msg, &msgLen );
+  require_noerr( err, exit );
+  err = SocketSend( inFd, msg, msgLen );
+
+exit:
+  if( msg ) free( msg );
+  return err;
+}
+
+static void _HTTPTestServerThread( void *inContext )
+{
+  HTTPTestServer_t *    server = (HTTPTestServer_t *) inContext;
+  HTTPHeader_t *        header;
+  struct sockaddr_t     addr;
+  socklen_t             addrLen;
+  int                   fd;
+  OSStatus              err;
+
+  while( !server->stop )
+  {
+    addrLen = sizeof( addr );
+    fd = accept( server->listenFd, &addr, &addrLen );
+    if( !IsValidSocket( fd ) ) continue;
+
+    if( server->useCallback )
+      header = HTTPHeaderCreateWithCallback( _HTTPTestOnBody, NULL, server );
+    else
+      header = HTTPHeaderCreate( );
+    require_action( header, next, err = kNoMemoryErr );
+    HTTPHeaderClear( header );
+
+    for( ;; )
+    {
+      err = SocketReadHTTPHeader( fd, header );
+      if( err != kNoErr ) break;
+      err = SocketReadHTTPBody( fd, header );
+      if( err != kNoErr ) break;
+      if( server->responseLen )
+        err = _HTTPTestSendBody( fd, server );
+      else
+        err = HTTPResponseSend( fd, kStatusOK, kMIMEType_TextPlain, (const uint8_t *) header->urlPtr, header->urlLen );
+      if( ( err != kNoErr ) || ( header->persistent == false ) ) break;
+      HTTPHeaderClear( header );
+    }
+    HTTPHeaderClear( header );
+    free( header );
+
+  next:
+    server->lastErr = err;
+    close( fd );
+  }
+
+  server->running = false;
+  mico_rtos_delete_thread( NULL );
+}
+
+static OSStatus _HTTPTestConnect( int *outFd )
+{
+  OSStatus              err;
+  struct sockaddr_t     addr;
+  int                   fd;
+
+  fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+  require_action( IsValidSocket( fd ), exit, err = kNoResourcesErr );
+
+  addr.s_ip = IPADDR_LOOPBACK;
+  addr.s_port = kHTTPTestPort;
+  err = connect( fd, &addr, sizeof( addr ) );
+  require_noerr_action( err, exit, close( fd ) );
+  *outFd = fd;
+
+exit:
+  return err;
+}
+
+static OSStatus _HTTPTestServerStart( HTTPTestServer_t *inServer, bool inUseCallback )
+{
+  OSStatus              err;
+  struct sockaddr_t     addr;
+  int                   opt = 1;
+
+  memset( inServer, 0, sizeof( *inServer ) );
+  inServer->useCallback = inUseCallback;
+  inServer->listenFd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+  require_action( IsValidSocket( inServer->listenFd ), exit, err = kNoResourcesErr );
+  setsockopt( inServer->listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof( opt ) );
+
+  addr.s_ip = INADDR_ANY;
+  addr.s_port = kHTTPTestPort;
+  err = bind( inServer->listenFd, &addr, sizeof( addr ) );
+  require_noerr( err, exit );
+  err = listen( inServer->listenFd, 0 );
+  require_noerr( err, exit );
+
+  inServer->running = true;
+  err = mico_rtos_create_thread( NULL, MICO_APPLICATION_PRIORITY, "HTTP Test", _HTTPTestServerThread, 0x800, inServer );
+  if( err ) inServer->running = false;
+  require_noerr( err, exit );
+
+exit:
+  if( err && IsValidSocket( inServer->listenFd ) ) close( inServer->listenFd );
+  return err;
+}
+
+static void _HTTPTestServerStop( HTTPTestServer_t *inServer )
+{
+  int       fd;
+  int       i;
+
+  inServer->stop = true;
+  if( _HTTPTestConnect( &fd ) == kNoErr ) close( fd );   // Wake the server up from accept
+  for( i = 0; inServer->running && ( i < 100 ); ++i ) mico_thread_msleep( 10 );
+  close( inServer->listenFd );
+}
+
+//===========================================================================================================================
+//  _HTTPTestAppendRequest
+//
+//  Appends a request for /<inPath> with a body of inBodyLen bytes, sent chunked when inChunked is set, and returns its
+//  length.
+//===========================================================================================================================
+
+static size_t _HTTPTestAppendRequest( char *inBuf, size_t inMaxLen, const char *inPath, bool inClose, size_t inBodyLen,
+                                      bool inChunked, size_t inPadLen )
+{
+  size_t    len, i;
+
+  len = (size_t) snprintf( inBuf, inMaxLen, "%s /%s HTTP/1.1\r\nHost: 127.0.0.1\r\n%s",
+                           inBodyLen ? "POST" : "GET", inPath, inClose ? "Connection: close\r\n" : "" );
+  if( inPadLen )
+  {
+    len += (size_t) snprintf( inBuf + len, inMaxLen - len, "X-Pad: " );
+    for( i = 0; i < inPadLen; ++i ) inBuf[ len++ ] = 'p';
+    len += (size_t) snprintf( inBuf + len, inMaxLen - len, "\r\n" );
+  }
+  if( inChunked )
+    len += (size_t) snprintf( inBuf + len, inMaxLen - len, "Transfer-Encoding: chunked\r\n\r\n%x\r\n", (unsigned int) inBodyLen );
+  else if( inBodyLen )
+    len += (size_t) snprintf( inBuf + len, inMaxLen - len, "Content-Length: %u\r\n\r\n", (unsigned int) inBodyLen );
+  else
+    len += (size_t) snprintf( inBuf + len, inMaxLen - len, "\r\n" );
+  for( i = 0; i < inBodyLen; ++i ) inBuf[ len++ ] = (char)( 'a' + ( i % 26 ) );
+  if( inChunked ) len += (size_t) snprintf( inBuf + len, inMaxLen - len, "\r\n0\r\n\r\n" );
+  return len;
+}
+
+//===========================================================================================================================
+//  _HTTPTestReadResponse
+//
+//  Reads one answer and checks that it echoes inPath. Answers pipelined behind it stay in ioHeader for the next call.
+//===========================================================================================================================
+
+static OSStatus _HTTPTestReadResponse( int inFd, HTTPHeader_t *ioHeader, const char *inPath )
+{
+  OSStatus          err;
+  fd_set            readSet;
+  struct timeval_t  t;
+  size_t            len = strlen( inPath );
+
+  HTTPHeaderClear( ioHeader );
+  if( ioHeader->len == 0 )
+  {
+    FD_ZERO( &readSet );
+    FD_SET( inFd, &readSet );
+    t.tv_sec = kHTTPTestTimeoutSecs;
+    t.tv_usec = 0;
+    require_action( select( inFd + 1, &readSet, NULL, NULL, &t ) == 1, exit, err = kTimeoutErr );
+  }
+  err = SocketReadHTTPHeader( inFd, ioHeader );
+  require_noerr( err, exit );
+  err = SocketReadHTTPBody( inFd, ioHeader );
+  require_noerr( err, exit );
+
+  require_action( ioHeader->statusCode == kStatusOK, exit, err = kMismatchErr );
+  require_action( ioHeader->contentLength == len + 1, exit, err = kMismatchErr );
+  require_action( ioHeader->extraDataPtr[ 0 ] == '/', exit, err = kMismatchErr );
+  require_action( memcmp( ioHeader->extraDataPtr + 1, inPath, len ) == 0, exit, err = kMismatchErr );
+
+exit:
+  return err;
+}
+
+// Waits for the server to close the connection, it must not be left waiting for more data.
+static OSStatus _HTTPTestWaitClosed( int inFd )
+{
+  OSStatus          err;
+  fd_set            readSet;
+  struct timeval_t  t;
+  char              c;
+
+  FD_ZERO( &readSet );
+  FD_SET( inFd, &readSet );
+  t.tv_sec = kHTTPTestTimeoutSecs;
+  t.tv_usec = 0;
+  require_action( select( inFd + 1, &readSet, NULL, NULL, &t ) == 1, exit, err = kTimeoutErr );
+  require_action( read( inFd, &c, 1 ) <= 0, exit, err = kUnexpectedErr );
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+//===========================================================================================================================
+//  HTTPUtils_ParseTest
+//
+//  Runs the parser over a corpus of well-formed, folded, truncated and malformed headers. Every entry and
+//  kHTTPParseFuzzRounds mutations of it are parsed in one call and again resumed after every byte, both must give the
+//  same result and index, and every indexed name and value must lie in the parsed header.
+//===========================================================================================================================
+
+#define kHTTPParseFuzzRounds        300
+#define kHTTPParseBenchRounds       10000
+
+typedef struct
+{
+  const char *      data;
+  OSStatus          err;        // Result once the whole entry is in the buffer
+  const char *      name;       // Field to look up, NULL for none
+  const char *      value;      // Its expected value, NULL when it must not be found
+} HTTPParseCorpus_t;
+
+static const HTTPParseCorpus_t    kHTTPParseCorpus[] =
+{
+  { "GET /index.html HTTP/1.1\r\nHost: 10.0.0.1\r\n\r\n",                        kNoErr,          "Host",           "10.0.0.1" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",                         kNoErr,          "Content-Length", "5" },
+  { "HTTP/1.1 204\r\nServer: x\r\n\r\n",                                         kNoErr,          "Server",         "x" },
+  { "GET / HTTP/1.0\nHost: h\n\n",                                               kNoErr,          "Host",           "h" },
+  { "GET / HTTP/1.1\r\nHost: h\r\n\n",                                           kNoErr,          "host",           "h" },
+  { "PUT /c HTTP/1.1\r\ncontent-length: 7\r\n\r\n",                              kNoErr,          "Content-Length", "7" },
+  { "GET / HTTP/1.1\r\nX-Empty:\r\n\r\n",                                        kNoErr,          "X-Empty",        "" },
+  { "GET / HTTP/1.1\r\nX-Tab:\t \tv\r\n\r\n",                                    kNoErr,          "X-Tab",          "v" },
+  { "GET / HTTP/1.1\r\nX-A: one\r\n two\r\n\tthree\r\n\r\n",                     kNoErr,          "X-A",            "one\r\n two\r\n\tthree" },
+  { "GET / HTTP/1.1\r\nX-A: one\r\nNoColon\r\n two\r\n\r\n",                     kNoErr,          "X-A",            "one" },
+  { "GET / HTTP/1.1\r\n folded\r\nHost: h\r\n\r\n",                              kNoErr,          "Host",           "h" },
+  { "GET / HTTP/1.1\r\n folded: x\r\n\r\n",                                      kNoErr,          "folded",         NULL },
+  { "GET / HTTP/1.1\r\nHost: h\r\n",                                             kInProgressErr,  NULL,             NULL },
+  { "GET / HTTP/1.1\r\nHo",                                                      kInProgressErr,  NULL,             NULL },
+  { "$\x01\x00\x05",                                                             kNoErr,          "Host",           NULL },
+  { "\r\n\r\n",                                                                  kMalformedErr,   NULL,             NULL },
+  { "GET\r\n\r\n",                                                               kMalformedErr,   NULL,             NULL },
+  { "GET /a\r\n\r\n",                                                            kMalformedErr,   NULL,             NULL },
+  { "HTTP/1.1 20 OK\r\n\r\n",                                                    kMalformedErr,   NULL,             NULL },
+  { "HTTP/1.1 2000 OK\r\n\r\n",                                                  kMalformedErr,   NULL,             NULL },
+  { "HTTP/1.1\r\n\r\n",                                                          kMalformedErr,   NULL,             NULL },
+  { "GET / HTTP/1.1\r\nHost: h\r\n\r\r",                                         kMalformedErr,   NULL,             NULL },
+};
+
+static uint32_t _HTTPParseRandom( uint32_t *ioState )
+{
+  uint32_t x = *ioState;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *ioState = x;
+  return x;
+}
+
+// Parses the inLen bytes in ioHeader->buf, in one call or resumed after every byte.
+static OSStatus _HTTPParseTestRun( HTTPHeader_t *ioHeader, size_t inLen, bool inByteByByte )
+{
+  OSStatus          err;
+  char *            end;
+  size_t            i;
+
+  HTTPHeaderClear( ioHeader );
+  if( !inByteByByte )
+  {
+    ioHeader->len = inLen;
+    return HTTPHeaderParseIncremental( ioHeader, &end );
+  }
+  err = kInProgressErr;
+  for( i = 1; ( i <= inLen ) && ( err == kInProgressErr ); ++i )
+  {
+    ioHeader->len = i;
+    err = HTTPHeaderParseIncremental( ioHeader, &end );
+  }
+  return err;
+}
+
+// Parses one input both ways and checks that the results agree and that the index stays inside the parsed header.
+static OSStatus _HTTPParseTestCheck( HTTPHeader_t *ioHeader, HTTPHeaderField_t *ioFields, const char *inData,
+                                     size_t inLen, OSStatus *outErr )
+{
+  OSStatus          err, wholeErr;
+  uint8_t           fieldCount;
+  size_t            parsedLen, i;
+
+  memcpy( ioHeader->buf, inData, inLen );
+  wholeErr = _HTTPParseTestRun( ioHeader, inLen, false );
+  fieldCount = ioHeader->fieldCount;
+  parsedLen = ioHeader->parsedLen;
+  memcpy( ioFields, ioHeader->fields, fieldCount * sizeof( HTTPHeaderField_t ) );
+
+  err = _HTTPParseTestRun( ioHeader, inLen, true );
+  require_action( err == wholeErr, exit, err = kMismatchErr );
+  require_action( ioHeader->fieldCount == fieldCount, exit, err = kMismatchErr );
+  require_action( memcmp( ioHeader->fields, ioFields, fieldCount * sizeof( HTTPHeaderField_t ) ) == 0, exit,
+                  err = kMismatchErr );
+  if( wholeErr == kNoErr )
+  {
+    require_action( ioHeader->parsedLen == parsedLen && parsedLen <= inLen, exit, err = kMismatchErr );
+    for( i = 0; i < fieldCount; ++i )
+    {
+      require_action( ioFields[ i ].nameLen > 0, exit, err = kMismatchErr );
+      require_action( ioFields[ i ].nameOffset + ioFields[ i ].nameLen <= parsedLen, exit, err = kRangeErr );
+      require_action( ioFields[ i ].valueOffset + ioFields[ i ].valueLen <= parsedLen, exit, err = kRangeErr );
+    }
+  }
+  *outErr = wholeErr;
+  err = kNoErr;
+
+exit:
+  return err;
+}
+
+OSStatus HTTPUtils_ParseTest( int print )
+{
+  static const char     kFuzzBytes[] = " :\r\n\t$/0H";
+  OSStatus              err, parseErr;
+  HTTPHeader_t *        header = NULL;
+  HTTPHeaderField_t *   fields = NULL;
+  char *                data = NULL;
+  const char *          value;
+  size_t                valueLen, len, n, i, j;
+  uint32_t              seed = 0x4D49434F;
+  unsigned int          fuzzCount = 0;
+
+  header = HTTPHeaderCreate( );
+  fields = (HTTPHeaderField_t *) malloc( kHTTPHeaderFieldMax * sizeof( HTTPHeaderField_t ) );
+  data = (char *) malloc( sizeof( header->buf ) );
+  require_action( header && fields && data, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+
+  for( i = 0; i < sizeof( kHTTPParseCorpus ) / sizeof( kHTTPParseCorpus[ 0 ] ); ++i )
+  {
+    len = strlen( kHTTPParseCorpus[ i ].data );
+    if( kHTTPParseCorpus[ i ].data[ 0 ] == '$' ) len = 4;
+    err = _HTTPParseTestCheck( header, fields, kHTTPParseCorpus[ i ].data, len, &parseErr );
+    require_noerr_action( err, exit, if( print ) printf( "corpus %u: incremental parse differs\r\n", (unsigned int) i ) );
+    require_action( parseErr == kHTTPParseCorpus[ i ].err, exit, err = kResponseErr;
+                    if( print ) printf( "corpus %u: got %d, expected %d\r\n", (unsigned int) i, (int) parseErr,
+                                        (int) kHTTPParseCorpus[ i ].err ) );
+    if( kHTTPParseCorpus[ i ].name )
+    {
+      err = HTTPHeaderGetField( header, kHTTPParseCorpus[ i ].name, &value, &valueLen );
+      if( kHTTPParseCorpus[ i ].value )
+      {
+        require_noerr_action( err, exit, if( print ) printf( "corpus %u: %s not found\r\n", (unsigned int) i,
+                                                             kHTTPParseCorpus[ i ].name ) );
+        require_action( strnicmpx( value, valueLen, kHTTPParseCorpus[ i ].value ) == 0 &&
+                        valueLen == strlen( kHTTPParseCorpus[ i ].value ), exit, err = kMismatchErr;
+                        if( print ) printf( "corpus %u: %s is \"%.*s\"\r\n", (unsigned int) i,
+                                            kHTTPParseCorpus[ i ].name, (int) valueLen, value ) );
+      }
+      else
+        require_action( err == kNotFoundErr, exit, err = kMismatchErr );
+    }
+
+    // Mutations: overwrite, insert or cut a few bytes, mostly with the bytes the parser switches on.
+    for( n = 0; n < kHTTPParseFuzzRounds; ++n )
+    {
+      size_t fuzzLen = len;
+
+      memcpy( data, kHTTPParseCorpus[ i ].data, len );
+      for( j = 1 + ( _HTTPParseRandom( &seed ) % 4 ); j > 0; --j )
+      {
+        size_t  pos  = fuzzLen ? _HTTPParseRandom( &seed ) % fuzzLen : 0;
+        uint32_t r   = _HTTPParseRandom( &seed );
+        char    c    = ( r & 0x100 ) ? kFuzzBytes[ r % ( sizeof( kFuzzBytes ) - 1 ) ] : (char)( r >> 24 );
+
+        switch( r % 3 )
+        {
+          case 0:   if( fuzzLen ) data[ pos ] = c; break;
+          case 1:   if( fuzzLen < sizeof( header->buf ) ) { memmove( data + pos + 1, data + pos, fuzzLen - pos ); data[ pos ] = c; ++fuzzLen; } break;
+          default:  fuzzLen = pos; break;
+        }
+      }
+      if( fuzzLen == 0 ) continue;
+      err = _HTTPParseTestCheck( header, fields, data, fuzzLen, &parseErr );
+      require_noerr_action( err, exit, if( print ) printf( "corpus %u mutation %u: incremental parse differs\r\n",
+                                                           (unsigned int) i, (unsigned int) n ) );
+      ++fuzzCount;
+    }
+  }
+
+  // A folded line after a field name too long to index must not extend the field before it.
+  len = (size_t) snprintf( data, sizeof( header->buf ), "GET / HTTP/1.1\r\nX-A: one\r\n" );
+  for( i = 0; i < 300; ++i ) data[ len++ ] = 'n';
+  len += (size_t) snprintf( data + len, sizeof( header->buf ) - len, ": v\r\n two\r\n\r\n" );
+  err = _HTTPParseTestCheck( header, fields, data, len, &parseErr );
+  require_noerr( err, exit );
+  require_noerr_action( parseErr, exit, err = parseErr );
+  err = HTTPHeaderGetField( header, "X-A", &value, &valueLen );
+  require_noerr( err, exit );
+  require_action( valueLen == 3, exit, err = kMismatchErr );
+
+  if( print ) printf( "parser corpus: %u entries, %u mutations: ok\r\n",
+                      (unsigned int)( sizeof( kHTTPParseCorpus ) / sizeof( kHTTPParseCorpus[ 0 ] ) ), fuzzCount );
+
+exit:
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  if( fields ) free( fields );
+  if( data ) free( data );
+  return( err );
+}
+
+//===========================================================================================================================
+//  HTTPUtils_Test
+//===========================================================================================================================
+
+static const size_t     kHTTPTestBodyLens[] = { 10, 0, 100, 300, 0, 40 };
+
+OSStatus HTTPUtils_Test( int print )
+{
+  OSStatus              err;
+  HTTPTestServer_t      server;
+  HTTPHeader_t *        header = NULL;
+  char *                req = NULL;
+  char                  path[ 16 ];
+  size_t                reqLen, bodyBytes, i;
+  int                   fd = -1;
+  int                   mode;
+
+  server.listenFd = -1;
+  req = (char *) malloc( 2 * kHTTPTestRequestMax );
+  require_action( req, exit, err = kNoMemoryErr );
+  header = HTTPHeaderCreate( );
+  require_action( header, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+
+  err = HTTPUtils_ParseTest( print );
+  require_noerr( err, exit );
+
+  // Pipelined requests with and without bodies in one write, with bodies read into one buffer and through the
+  // callback. The callback path used to drop whatever followed the body in the header buffer.
+
+  for( mode = 0; mode < 2; ++mode )
+  {
+    err = _HTTPTestServerStart( &server, mode == 1 );
+    require_noerr( err, exit );
+    err = _HTTPTestConnect( &fd );
+    require_noerr( err, exit );
+
+    reqLen = 0;
+    bodyBytes = 0;
+    for( i = 0; i < sizeof( kHTTPTestBodyLens ) / sizeof( kHTTPTestBodyLens[ 0 ] ); ++i )
+    {
+      snprintf( path, sizeof( path ), "r/%u", (unsigned int) i );
+      reqLen += _HTTPTestAppendRequest( req + reqLen, kHTTPTestRequestMax, path, false, kHTTPTestBodyLens[ i ], false, 0 );
+      bodyBytes += kHTTPTestBodyLens[ i ];
+    }
+    err = SocketSend( fd, (const uint8_t *) req, reqLen );
+    require_noerr( err, exit );
+    for( i = 0; i < sizeof( kHTTPTestBodyLens ) / sizeof( kHTTPTestBodyLens[ 0 ] ); ++i )
+    {
+      snprintf( path, sizeof( path ), "r/%u", (unsigned int) i );
+      err = _HTTPTestReadResponse( fd, header, path );
+      require_noerr( err, exit );
+    }
+
+    // Then a plain keep-alive request, and one that closes.
+    reqLen = _HTTPTestAppendRequest( req, kHTTPTestRequestMax, "k", false, 20, false, 0 );
+    err = SocketSend( fd, (const uint8_t *) req, reqLen );
+    require_noerr( err, exit );
+    err = _HTTPTestReadResponse( fd, header, "k" );
+    require_noerr( err, exit );
+    reqLen = _HTTPTestAppendRequest( req, kHTTPTestRequestMax, "c", true, 0, false, 0 );
+    err = SocketSend( fd, (const uint8_t *) req, reqLen );
+    require_noerr( err, exit );
+    err = _HTTPTestReadResponse( fd, header, "c" );
+    require_noerr( err, exit );
+    err = _HTTPTestWaitClosed( fd );
+    require_noerr( err, exit );
+    close( fd );
+    fd = -1;
+
+    require_action( server.lastErr == kNoErr, exit, err = kResponseErr );
+    if( server.useCallback ) require_action( server.bodyBytes == bodyBytes + 20, exit, err = kMismatchErr );
+    _HTTPTestServerStop( &server );
+    server.listenFd = -1;
+    if( print ) printf( "pipelined %s bodies: ok\r\n", mode ? "callback" : "buffered" );
+  }
+
+  // A chunked body read in one go with more pipelined data behind it than the header buffer holds. The server must
+  // fail with kNoSpaceErr and close instead of dropping the data and waiting for a request that already came.
+
+  err = _HTTPTestServerStart( &server, false );
+  require_noerr( err, exit );
+  err = _HTTPTestConnect( &fd );
+  require_noerr( err, exit );
+
+  reqLen  = _HTTPTestAppendRequest( req, kHTTPTestRequestMax, "big", false, 1000, true, 0 );
+  reqLen += _HTTPTestAppendRequest( req + reqLen, kHTTPTestRequestMax, "next", false, 0, false, sizeof( header->buf ) + 100 );
+  err = SocketSend( fd, (const uint8_t *) req, reqLen );
+  require_noerr( err, exit );
+  err = _HTTPTestReadResponse( fd, header, "big" );
+  require_noerr( err, exit );
+  err = _HTTPTestWaitClosed( fd );
+  require_noerr( err, exit );
+  require_action( server.lastErr == kNoSpaceErr, exit, err = kResponseErr );
+  if( print ) printf( "pipelined data beyond the header buffer: closed with %d\r\n", server.lastErr );
+  close( fd );
+  fd = -1;
+  _HTTPTestServerStop( &server );
+  server.listenFd = -1;
+
+  err = HTTPUtils_ParseBench( print );
+  require_noerr( err, exit );
+  err = HTTPUtils_LoadBench( print );
+  require_noerr( err, exit );
+  err = HTTPUtils_SendBench( print );
+  require_noerr( err, exit );
+  err = HTTPUtils_ChunkedBench( print );
+  require_noerr( err, exit );
+
+exit:
+  if( IsValidSocket( fd ) ) close( fd );
+  if( IsValidSocket( server.listenFd ) ) _HTTPTestServerStop( &server );
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  if( req ) free( req );
+  printf( "%s: %s\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED" );
+  return( err );
+}
+
+//===========================================================================================================================
+//  HTTPUtils_LoadBench
+//
+//  kHTTPBenchRequests small GETs against the local server on a new connection each, on one keep-alive connection and
+//  pipelined kHTTPBenchPipelineDepth deep on one connection. Prints requests per second and the median and p99 time
+//  from sending a request to having its answer. Each pipelined answer is its own write, so on a stack with Nagle's
+//  algorithm on, the answers after the first in a batch wait for the client's delayed ACK.
+//===========================================================================================================================
+
+static int _HTTPBenchCompare( const void *inA, const void *inB )
+{
+  uint32_t a = *( (const uint32_t *) inA );
+  uint32_t b = *( (const uint32_t *) inB );
+
+  return( ( a > b ) - ( a < b ) );
+}
+
+static void _HTTPBenchReport( int print, const char *inLabel, uint32_t *inLatencies, size_t inCount, uint64_t inTotalUs )
+{
+  qsort( inLatencies, inCount, sizeof( inLatencies[ 0 ] ), _HTTPBenchCompare );
+  if( print ) printf( "%-12s %7u req/s  p50 %6u us  p99 %6u us\r\n", inLabel,
+                      (unsigned int)( inTotalUs ? ( (uint64_t) inCount * 1000000 ) / inTotalUs : 0 ),
+                      (unsigned int) inLatencies[ inCount / 2 ], (unsigned int) inLatencies[ ( inCount * 99 ) / 100 ] );
+}
+
+OSStatus HTTPUtils_LoadBench( int print )
+{
+  OSStatus              err;
+  HTTPTestServer_t      server;
+  HTTPHeader_t *        header = NULL;
+  uint32_t *            latencies = NULL;
+  char                  req[ 128 ];
+  char *                batch = NULL;
+  size_t                reqLen, batchLen, i, j;
+  uint64_t              start, sent, now;
+  int                   fd = -1;
+
+  server.listenFd = -1;
+  latencies = (uint32_t *) malloc( kHTTPBenchRequests * sizeof( uint32_t ) );
+  batch = (char *) malloc( kHTTPBenchPipelineDepth * sizeof( req ) );
+  header = HTTPHeaderCreate( );
+  require_action( latencies && batch && header, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+
+  err = _HTTPTestServerStart( &server, false );
+  require_noerr( err, exit );
+
+  // New connection per request
+
+  reqLen = _HTTPTestAppendRequest( req, sizeof( req ), "b", true, 0, false, 0 );
+  start = HTTPUtilsTestMicroseconds( );
+  for( i = 0; i < kHTTPBenchRequests; ++i )
+  {
+    sent = HTTPUtilsTestMicroseconds( );
+    err = _HTTPTestConnect( &fd );
+    require_noerr( err, exit );
+    err = SocketSend( fd, (const uint8_t *) req, reqLen );
+    require_noerr( err, exit );
+    err = _HTTPTestReadResponse( fd, header, "b" );
+    require_noerr( err, exit );
+    latencies[ i ] = (uint32_t)( HTTPUtilsTestMicroseconds( ) - sent );
+    close( fd );
+    fd = -1;
+  }
+  _HTTPBenchReport( print, "close", latencies, kHTTPBenchRequests, HTTPUtilsTestMicroseconds( ) - start );
+
+  // One keep-alive connection
+
+  reqLen = _HTTPTestAppendRequest( req, sizeof( req ), "b", false, 0, false, 0 );
+  err = _HTTPTestConnect( &fd );
+  require_noerr( err, exit );
+  start = HTTPUtilsTestMicroseconds( );
+  for( i = 0; i < kHTTPBenchRequests; ++i )
+  {
+    sent = HTTPUtilsTestMicroseconds( );
+    err = SocketSend( fd, (const uint8_t *) req, reqLen );
+    require_noerr( err, exit );
+    err = _HTTPTestReadResponse( fd, header, "b" );
+    require_noerr( err, exit );
+    latencies[ i ] = (uint32_t)( HTTPUtilsTestMicroseconds( ) - sent );
+  }
+  _HTTPBenchReport( print, "keep-alive", latencies, kHTTPBenchRequests, HTTPUtilsTestMicroseconds( ) - start );
+
+  // Pipelined on the same connection
+
+  batchLen = 0;
+  for( j = 0; j < kHTTPBenchPipelineDepth; ++j )
+  {
+    memcpy( batch + batchLen, req, reqLen );
+    batchLen += reqLen;
+  }
+  start = HTTPUtilsTestMicroseconds( );
+  for( i = 0; i < kHTTPBenchRequests; i += kHTTPBenchPipelineDepth )
+  {
+    sent = HTTPUtilsTestMicroseconds( );
+    err = SocketSend( fd, (const uint8_t *) batch, batchLen );
+    require_noerr( err, exit );
+    for( j = 0; ( j < kHTTPBenchPipelineDepth ) && ( i + j < kHTTPBenchRequests ); ++j )
+    {
+      err = _HTTPTestReadResponse( fd, header, "b" );
+      require_noerr( err, exit );
+      now = HTTPUtilsTestMicroseconds( );
+      latencies[ i + j ] = (uint32_t)( now - sent );
+    }
+  }
+  _HTTPBenchReport( print, "pipelined", latencies, kHTTPBenchRequests, HTTPUtilsTestMicroseconds( ) - start );
+
+exit:
+  if( IsValidSocket( fd ) ) close( fd );
+  if( IsValidSocket( server.listenFd ) ) _HTTPTestServerStop( &server );
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  if( batch ) free( batch );
+  if( latencies ) free( latencies );
+  return( err );
+}
+
+//===========================================================================================================================
+//  HTTPUtils_ParseBench
+//
+//  Parses a HomeKit-sized request kHTTPParseBenchRounds times in one call and then resumed after every byte, as it is
+//  when it trickles in, and looks four fields up in each. Both rates should be close: every byte is only read once.
+//===========================================================================================================================
+
+static const char       kHTTPParseBenchRequest[] =
+  "PUT /characteristics HTTP/1.1\r\n"
+  "Host: MiCOKit-3288._hap._tcp.local\r\n"
+  "User-Agent: HomeKit/1 CFNetwork/711.1.16 Darwin/14.0.0\r\n"
+  "Accept: */*\r\n"
+  "Accept-Language: en-us\r\n"
+  "Accept-Encoding: gzip, deflate\r\n"
+  "Content-Type: application/hap+json\r\n"
+  "Content-Length: 49\r\n"
+  "Connection: keep-alive\r\n"
+  "\r\n";
+
+static unsigned int _HTTPBenchPerSecond( uint64_t inCount, uint64_t inUs )
+{
+  return( inUs ? (unsigned int)( ( inCount * 1000000 ) / inUs ) : 0 );
+}
+
+OSStatus HTTPUtils_ParseBench( int print )
+{
+  static const char * const kNames[] = { "Content-Length", "Content-Type", "Connection", "X-Missing" };
+  OSStatus              err;
+  HTTPHeader_t *        header = NULL;
+  const char *          value;
+  size_t                valueLen, i, j;
+  uint64_t              start, wholeUs, byteUs;
+  int                   mode;
+
+  header = HTTPHeaderCreate( );
+  require_action( header, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+  memcpy( header->buf, kHTTPParseBenchRequest, sizeof( kHTTPParseBenchRequest ) - 1 );
+
+  wholeUs = byteUs = 0;
+  for( mode = 0; mode < 2; ++mode )
+  {
+    start = HTTPUtilsTestMicroseconds( );
+    for( i = 0; i < kHTTPParseBenchRounds; ++i )
+    {
+      err = _HTTPParseTestRun( header, sizeof( kHTTPParseBenchRequest ) - 1, mode == 1 );
+      require_noerr( err, exit );
+      for( j = 0; j < sizeof( kNames ) / sizeof( kNames[ 0 ] ); ++j )
+        HTTPHeaderGetField( header, kNames[ j ], &value, &valueLen );
+    }
+    if( mode ) byteUs  = HTTPUtilsTestMicroseconds( ) - start;
+    else       wholeUs = HTTPUtilsTestMicroseconds( ) - start;
+  }
+  require_action( header->contentLength == 49 && header->persistent, exit, err = kMismatchErr );
+
+  if( print ) printf( "parse %u bytes, %u fields: whole %u headers/s %u KB/s, byte by byte %u headers/s %u KB/s\r\n",
+                      (unsigned int)( sizeof( kHTTPParseBenchRequest ) - 1 ), (unsigned int) header->fieldCount,
+                      _HTTPBenchPerSecond( kHTTPParseBenchRounds, wholeUs ),
+                      _HTTPBenchPerSecond( kHTTPParseBenchRounds * ( sizeof( kHTTPParseBenchRequest ) - 1 ), wholeUs ) / 1024,
+                      _HTTPBenchPerSecond( kHTTPParseBenchRounds, byteUs ),
+                      _HTTPBenchPerSecond( kHTTPParseBenchRounds * ( sizeof( kHTTPParseBenchRequest ) - 1 ), byteUs ) / 1024 );
+  err = kNoErr;
+
+exit:
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  return( err );
+}
+
+//===========================================================================================================================
+//  HTTPUtils_SendBench
+//
+//  kHTTPBenchRequests keep-alive GETs over loopback for each body size, answered with CreateSimpleHTTPMessage and
+//  SocketSend and then with HTTPResponseSend. With Nagle's algorithm on, an answer that leaves in two writes waits for
+//  the client's delayed ACK of the first one, which shows as ~40 ms or more per request here.
+//===========================================================================================================================
+
+static const size_t     kHTTPSendBenchLens[] = { 64, 1024, 4096 };
+
+// Reads one answer of inLen body bytes.
+static OSStatus _HTTPSendBenchRead( int inFd, HTTPHeader_t *ioHeader, size_t inLen )
+{
+  OSStatus  err;
+
+  HTTPHeaderClear( ioHeader );
+  err = SocketReadHTTPHeader( inFd, ioHeader );
+  require_noerr( err, exit );
+  err = SocketReadHTTPBody( inFd, ioHeader );
+  require_noerr( err, exit );
+  require_action( ioHeader->statusCode == kStatusOK && ioHeader->contentLength == inLen, exit, err = kMismatchErr );
+  require_action( memcmp( ioHeader->extraDataPtr, gHTTPSendBenchBody, inLen ) == 0, exit, err = kMismatchErr );
+
+exit:
+  return err;
+}
+
+OSStatus HTTPUtils_SendBench( int print )
+{
+  OSStatus              err;
+  HTTPTestServer_t      server;
+  HTTPHeader_t *        header = NULL;
+  uint32_t *            latencies = NULL;
+  char                  req[ 128 ];
+  char                  label[ 24 ];
+  size_t                reqLen, i, l;
+  uint64_t              start, sent;
+  int                   legacy, fd = -1;
+
+  server.listenFd = -1;
+  for( i = 0; i < sizeof( gHTTPSendBenchBody ); ++i ) gHTTPSendBenchBody[ i ] = (uint8_t)( '0' + ( i % 64 ) );
+  latencies = (uint32_t *) malloc( kHTTPBenchRequests * sizeof( uint32_t ) );
+  header = HTTPHeaderCreate( );
+  require_action( latencies && header, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+
+  reqLen = _HTTPTestAppendRequest( req, sizeof( req ), "s", false, 0, false, 0 );
+  for( l = 0; l < sizeof( kHTTPSendBenchLens ) / sizeof( kHTTPSendBenchLens[ 0 ] ); ++l )
+  {
+    for( legacy = 1; legacy >= 0; --legacy )
+    {
+      err = _HTTPTestServerStart( &server, false );
+      require_noerr( err, exit );
+      server.responseLen = kHTTPSendBenchLens[ l ];
+      server.legacySend = ( legacy != 0 );
+      err = _HTTPTestConnect( &fd );
+      require_noerr( err, exit );
+
+      start = HTTPUtilsTestMicroseconds( );
+      for( i = 0; i < kHTTPBenchRequests; ++i )
+      {
+        sent = HTTPUtilsTestMicroseconds( );
+        err = SocketSend( fd, (const uint8_t *) req, reqLen );
+        require_noerr( err, exit );
+        err = _HTTPSendBenchRead( fd, header, kHTTPSendBenchLens[ l ] );
+        require_noerr( err, exit );
+        latencies[ i ] = (uint32_t)( HTTPUtilsTestMicroseconds( ) - sent );
+      }
+      snprintf( label, sizeof( label ), "%s %u", legacy ? "legacy" : "writer", (unsigned int) kHTTPSendBenchLens[ l ] );
+      _HTTPBenchReport( print, label, latencies, kHTTPBenchRequests, HTTPUtilsTestMicroseconds( ) - start );
+
+      close( fd );
+      fd = -1;
+      _HTTPTestServerStop( &server );
+      server.listenFd = -1;
+    }
+  }
+
+exit:
+  if( IsValidSocket( fd ) ) close( fd );
+  if( IsValidSocket( server.listenFd ) ) _HTTPTestServerStop( &server );
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  if( latencies ) free( latencies );
+  return( err );
+}
+
+//===========================================================================================================================
+//  HTTPUtils_ChunkedBench
+//
+//  kHTTPChunkedBenchRequests POSTs of a kHTTPChunkedBenchBody byte body sent chunked, in chunks of 1 byte up to 4 KB,
+//  to the server reading bodies through onReceivedDataCallback, on one keep-alive connection. Each request is sent in
+//  one write, so the server reads whole buffers and the time goes to the chunked decoder and the callbacks. The last
+//  row adds a chunk extension to every size line and a trailer. Prints body MB/s and checks every body byte arrived.
+//===========================================================================================================================
+
+static const size_t     kHTTPChunkedBenchSizes[] = { 1, 16, 256, 4096, 4096 };
+
+// Builds the request in a malloc'd buffer, chunks of inChunkLen bytes, with extensions and a trailer if inExtras.
+static char * _HTTPChunkedBenchRequest( size_t inChunkLen, bool inExtras, size_t *outLen )
+{
+  size_t    maxLen, len, done, n, i;
+  char *    req;
+
+  maxLen = 256 + kHTTPChunkedBenchBody + ( ( kHTTPChunkedBenchBody / inChunkLen ) + 1 ) * 32;
+  req = (char *) malloc( maxLen );
+  require( req, exit );
+
+  len = (size_t) snprintf( req, maxLen, "POST /c HTTP/1.1\r\nHost: 127.0.0.1\r\nTransfer-Encoding: chunked\r\n\r\n" );
+  for( done = 0; done < kHTTPChunkedBenchBody; done += n )
+  {
+    n = Min( inChunkLen, kHTTPChunkedBenchBody - done );
+    len += (size_t) snprintf( req + len, maxLen - len, "%X%s\r\n", (unsigned int) n, inExtras ? ";name=value" : "" );
+    for( i = 0; i < n; ++i ) req[ len++ ] = (char)( 'a' + ( ( done + i ) % 26 ) );
+    req[ len++ ] = '\r';
+    req[ len++ ] = '\n';
+  }
+  len += (size_t) snprintf( req + len, maxLen - len, "0\r\n%s\r\n", inExtras ? "X-Checksum: 0\r\n" : "" );
+  *outLen = len;
+
+exit:
+  return req;
+}
+
+OSStatus HTTPUtils_ChunkedBench( int print )
+{
+  OSStatus              err;
+  HTTPTestServer_t      server;
+  HTTPHeader_t *        header = NULL;
+  char *                req = NULL;
+  size_t                reqLen, i, s;
+  uint64_t              start, us;
+  int                   fd = -1;
+
+  server.listenFd = -1;
+  header = HTTPHeaderCreate( );
+  require_action( header, exit, err = kNoMemoryErr );
+  HTTPHeaderClear( header );
+
+  err = _HTTPTestServerStart( &server, true );
+  require_noerr( err, exit );
+  err = _HTTPTestConnect( &fd );
+  require_noerr( err, exit );
+
+  for( s = 0; s < sizeof( kHTTPChunkedBenchSizes ) / sizeof( kHTTPChunkedBenchSizes[ 0 ] ); ++s )
+  {
+    bool extras = ( s == sizeof( kHTTPChunkedBenchSizes ) / sizeof( kHTTPChunkedBenchSizes[ 0 ] ) - 1 );
+
+    req = _HTTPChunkedBenchRequest( kHTTPChunkedBenchSizes[ s ], extras, &reqLen );
+    require_action( req, exit, err = kNoMemoryErr );
+
+    server.bodyBytes = 0;
+    start = HTTPUtilsTestMicroseconds( );
+    for( i = 0; i < kHTTPChunkedBenchRequests; ++i )
+    {
+      err = SocketSend( fd, (const uint8_t *) req, reqLen );
+      require_noerr( err, exit );
+      err = _HTTPTestReadResponse( fd, header, "c" );
+      require_noerr( err, exit );
+    }
+    us = HTTPUtilsTestMicroseconds( ) - start;
+    require_action( server.bodyBytes == kHTTPChunkedBenchRequests * kHTTPChunkedBenchBody, exit, err = kMismatchErr );
+
+    if( print ) printf( "chunked %4u byte chunks%s: %u requests/s, body %u KB/s\r\n",
+                        (unsigned int) kHTTPChunkedBenchSizes[ s ], extras ? " + extensions, trailer" : "",
+                        _HTTPBenchPerSecond( kHTTPChunkedBenchRequests, us ),
+                        _HTTPBenchPerSecond( (uint64_t) kHTTPChunkedBenchRequests * kHTTPChunkedBenchBody, us ) / 1024 );
+    free( req );
+    req = NULL;
+  }
+
+exit:
+  if( IsValidSocket( fd ) ) close( fd );
+  if( IsValidSocket( server.listenFd ) ) _HTTPTestServerStop( &server );
+  if( header ) { HTTPHeaderClear( header ); free( header ); }
+  if( req ) free( req );
+  return( err );
+}
@@ -27,6 +27,7 @@
 #include "Common.h"
 
 #include "URLUtils.h"
+#include "SocketUtils.h"
 #include "stdbool.h"
 
 #define kHTTPPostMethod     "POST"
@@ -85,6 +86,19 @@
 
 #define OTA_Data_Length_per_read        1024
 
+#define kHTTPHeaderFieldMax             16
+
+struct json_object;
+struct json_tokener;
+
+typedef struct
+{
+    uint16_t            nameOffset;         //! Offset of the field name in HTTPHeader_t.buf.
+    uint16_t            valueOffset;        //! Offset of the field value, leading whitespace skipped.
+    uint16_t            valueLen;           //! Number of bytes in value, including continuation lines.
+    uint8_t             nameLen;            //! Number of bytes in name.
+    uint8_t             nameHash;           //! Case-insensitive hash of the name, checked before comparing.
+} HTTPHeaderField_t;
 
 typedef struct _HTTPHeader_t
 {
@@ -115,16 +129,40 @@ typedef struct _HTTPHeader_t
     bool                chunkedData;        //! true=Application should read the next chunked data.
     char *              chunkedDataBufferPtr;     //! Ptr for any extra data beyond the header, it is alloced when http header is received.
     size_t              chunkedDataBufferLen; //! Total buffer length that stores the chunkedData, private use only
+    uint8_t             chunkState;         //! Chunked decoder state, private use only.
+    uint64_t            chunkRemaining;     //! Size of the chunk being decoded, then bytes of it still to come, private use only.
 
     void *              userContext;
     bool                isCallbackSupported;
     OSStatus            (*onReceivedDataCallback) ( struct _HTTPHeader_t * , uint32_t, uint8_t *, size_t, void * ); 
     void                (*onClearCallback) ( struct _HTTPHeader_t * httpHeader, void * userContext );
 
+    size_t              parsedLen;          //! Number of bytes in buf already consumed by HTTPHeaderParseIncremental.
+    uint8_t             parseState;         //! Incremental parser state, private use only.
+    uint8_t             fieldCount;         //! Number of header fields recorded in fields.
+    bool                lineRecorded;       //! true=The last header line was recorded in fields, private use only.
+    HTTPHeaderField_t   fields[ kHTTPHeaderFieldMax ]; //! Index of the header fields found while parsing.
 
+    struct json_tokener * jsonTokener;      //! Tokener of the JSON body being received, private use only.
+    struct json_object *  jsonBody;         //! JSON body parsed by HTTPHeaderJsonBodyInput, released by HTTPHeaderClear.
 
 } HTTPHeader_t;
 
+#define kHTTPWriterHeaderMax            200
+#define kHTTPBodyLengthChunked          ( (size_t) -1 ) //! Body length is unknown, send it with Transfer-Encoding: chunked.
+
+typedef OSStatus (*HTTPWriterSendv) ( int fd, const SocketIOVec_t *inVec, int inVecCount, void *inContext );
+
+typedef struct
+{
+    int                 fd;                 //! Socket the message is sent to.
+    bool                chunked;            //! true=Body segments are sent as chunks.
+    size_t              headerLen;          //! Bytes in header still to send, they go out with the first body segment.
+    char                header[ kHTTPWriterHeaderMax ]; //! Start line and header fields.
+    HTTPWriterSendv     sendv;              //! Gather send function, SocketSendv unless replaced after begin.
+    void *              sendContext;        //! Context passed to sendv.
+} HTTPWriter_t;
+
 typedef OSStatus (*onReceivedDataCallback) ( struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext );
 
 typedef void (*onClearCallback) ( struct _HTTPHeader_t * httpHeader, void * userContext );
@@ -145,6 +183,18 @@ int SocketReadHTTPBody( int inSock, HTTPHeader_t *inHeader );
 
 int HTTPHeaderParse( HTTPHeader_t *ioHeader );
 
+int HTTPHeaderParseIncremental( HTTPHeader_t *ioHeader, char **outHeaderEnd );
+
+int HTTPHeaderGetField( HTTPHeader_t *inHeader, const char *inName, const char **outValuePtr, size_t *outValueLen );
+
+bool HTTPHeaderIsJsonBody( HTTPHeader_t *inHeader );
+
+OSStatus HTTPHeaderJsonBodyInput( HTTPHeader_t *inHeader, uint32_t inPos, const uint8_t *inData, size_t inLen );
+
+struct json_object * HTTPHeaderTakeJsonBody( HTTPHeader_t *inHeader );
+
+int HTTPHeaderScanFValue( HTTPHeader_t *inHeader, const char *inName, const char *inFormat, ... );
+
 int HTTPHeaderMatchMethod( HTTPHeader_t *inHeader, const char *method );
 
 int HTTPHeaderMatchURL( HTTPHeader_t *inHeader, const char *url );
@@ -183,5 +233,20 @@ OSStatus CreateHTTPMessageWithHost( const char *methold, const char *url,
                            uint8_t *inData, size_t inDataLen, 
                            uint8_t **outMessage, size_t *outMessageSize );
 
+/* Streaming message writer, the start line and header fields are built in the writer (normally on the caller's
+   stack) and go out with the first body segment in one write. SocketSendv only allocates a send buffer when they
+   don't fit in its 256 byte staging buffer. Pass kHTTPBodyLengthChunked as inDataLen when the body length is
+   unknown. */
+OSStatus HTTPWriterBeginResponse( HTTPWriter_t *inWriter, int fd, int status, const char *contentType, size_t inDataLen );
+
+OSStatus HTTPWriterBeginRequest( HTTPWriter_t *inWriter, int fd, const char *method, const char *url,
+                                 const char* host, uint16_t port, const char *contentType, size_t inDataLen );
+
+OSStatus HTTPWriterWrite( HTTPWriter_t *inWriter, const uint8_t *inData, size_t inDataLen );
+
+OSStatus HTTPWriterEnd( HTTPWriter_t *inWriter );
+
+OSStatus HTTPResponseSend( int fd, int status, const char *contentType, const uint8_t *inData, size_t inDataLen );
+
 #endif // __HTTPUtils_h__
 
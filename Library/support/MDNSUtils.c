@@ -21,9 +21,46 @@
 */ 
 
 #include "MDNSUtils.h"
+#include "StringUtils.h"
 
 static int mDNS_fd = -1;
 
+#define MDNS_RESPONSE_RECORD_GROWTH        8     // Record table of a response grows by this many entries
+#define MDNS_RESPONSE_SIZE                 512
+#define MDNS_PACKET_SIZE                   1440  // Announcements are packed up to this size, fits an Ethernet MTU
+#define MDNS_ANNOUNCE_PACKET_MAX           4
+#define MDNS_RATE_LIMIT_INTERVAL           1000  // RFC 6762 section 6: a record is multicast at most once per second
+#define MDNS_NAME_POINTER_MAX              16    // Compression pointers followed in one name before it is rejected
+
+typedef struct
+{
+  uint16_t offset;        // Start of the record (owner name) in the packet
+  uint16_t length;        // Bytes from the owner name to the end of rdata
+  uint16_t rdata_offset;
+  uint16_t rd_length;
+  uint16_t type;
+  uint32_t ttl;
+  uint32_t last_sent;     // mico_get_time() of the last multicast, 0 if never sent
+  uint8_t  selected;      // Set while a response is filtered, the record goes into the packet sent
+} dns_cached_record_t;
+
+typedef struct
+{
+  uint8_t* packet;        // Pre-serialized response, NULL until it is built
+  uint16_t length;
+  uint16_t record_count;
+  uint16_t record_max;    // Entries allocated in records, a packet holds as many records as fit in its size
+  dns_cached_record_t* records;
+} dns_cached_response_t;
+
+typedef struct
+{
+  const char* name;
+  uint16_t record_class;
+  uint16_t record_type;
+  uint8_t* rdata;
+} dns_record_spec_t;
+
 typedef struct
 {
   char* hostname;
@@ -32,6 +69,7 @@ typedef struct
   char* txt_att;
   uint16_t	port;
   char	instance_name_suffix[4]; // This variable should only be modified by the DNS-SD library
+  dns_cached_response_t response; // PTR, TXT, SRV and A records of this service
 } dns_sd_service_record_t;
 
 static WiFi_Interface _interface;
@@ -66,6 +104,13 @@ static int _bonjour_announce = 0;
 static dns_sd_service_record_t*   available_services	= NULL;
 static uint8_t	available_service_count;
 
+/* Answers only change with the TXT record or the IP address, they are serialized once and sent as they are */
+static dns_cached_response_t services_response; // PTR records of all services, for _services._dns-sd._udp queries
+static dns_cached_response_t host_response;     // A record of the host name
+static dns_cached_response_t announce_responses[MDNS_ANNOUNCE_PACKET_MAX]; // All records of all services, packed
+static uint8_t announce_count;
+static uint32_t cached_ip;
+
 static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name );
 static int dns_compare_name_to_string( dns_name_t* name, const char* string, const char* fun, const int line );
 static int dns_create_message( dns_message_iterator_t* message, uint16_t size );
@@ -81,34 +126,24 @@ static void dns_write_bytes( dns_message_iterator_t* iter, uint8_t* data, uint16
 static uint16_t dns_read_uint16( dns_message_iterator_t* iter );
 static void dns_skip_name( dns_message_iterator_t* iter );
 static void dns_write_name( dns_message_iterator_t* iter, const char* src );
+static const uint8_t* dns_skip_name_checked( const uint8_t* name, const uint8_t* end );
+static int dns_compare_names( const uint8_t* packet_a, const uint8_t* name_a, const uint8_t* end_a,
+                              const uint8_t* packet_b, const uint8_t* name_b, const uint8_t* end_b );
+static void mdns_update_responses( uint32_t myip );
+static void mdns_invalidate_responses( void );
+static void mdns_send_response( int fd, dns_cached_response_t* response, dns_message_iterator_t* source, bool rate_limit );
+static void dns_write_string( dns_message_iterator_t* iter, const char* src );
+static void dns_copy_record( dns_message_iterator_t* iter, const uint8_t* packet, const dns_cached_record_t* record, const uint8_t* end );
 
 static mico_mutex_t bonjour_mutex = NULL;
 static mico_thread_t mfi_bonjour_thread_handler;
 static void _bonjour_thread(void *arg);
 
-static char *__strdup(char *src)
-{
-  int len;
-  char *dst;
-  
-  if (src == NULL)
-    return NULL;
-  
-  if (src[0] == 0)
-    return NULL;
-  
-  len = strlen(src) + 1;
-  dst = (char*)malloc(len);
-  if (dst) 
-    memcpy(dst, src, len);
-  return dst;
-}
-
 void process_dns_questions(int fd, dns_message_iterator_t* iter )
 {
   dns_name_t name;
   dns_question_t question;
-  dns_message_iterator_t response;
+  dns_message_iterator_t known_answers;
   IPStatusTypedef para;
   int a = 0;
   int question_processed;
@@ -120,8 +155,17 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
     _debug_out("UDP multicast test: IP error.\r\n");
     return;
   }
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
+
+  mdns_update_responses( myip );
+
+  /* Known answers follow the questions, find them before any answer is sent */
+  known_answers = *iter;
+  for ( a = 0; a < htons(iter->header->question_count) && known_answers.iter; ++a ){
+    known_answers.iter = (uint8_t*) dns_skip_name_checked( known_answers.iter, known_answers.end );
+    if ( known_answers.iter ) known_answers.iter += 4;
+  }
+  if ( known_answers.iter == NULL || known_answers.iter > known_answers.end )
+    known_answers.iter = known_answers.end;
   
   for ( a = 0; a < htons(iter->header->question_count); ++a )
   {
@@ -135,17 +179,9 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
       if ( available_services != NULL ){
         // Check if its a query for all available services  
         if ( dns_compare_name_to_string( &name, MFi_SERVICE_QUERY_NAME, __FUNCTION__, __LINE__ ) ){
-          int b = 0;
           _debug_out("UDP multicast test: Recv a SERVICE QUERY request.\r\n");
-          if(dns_create_message( &response, 512 )) {
-            dns_write_header(&response, iter->header->id, 0x8400, 0, available_service_count, 0 );          
-            for ( b = 0; b < available_service_count; ++b ){
-              dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-            }
-            mdns_send_message(fd, &response );
-            dns_free_message( &response );
-            question_processed = 1;
-          }
+          mdns_send_response( fd, &services_response, &known_answers, true );
+          question_processed = 1;
         }
         // else check if its one of our records
         else {
@@ -154,20 +190,8 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
             //printf("UDP multicast test: Recv a SERVICE Detail request: %s.\r\n", name);
             if ( dns_compare_name_to_string( &name, available_services[b].service_name, __FUNCTION__, __LINE__ )){
               // Send the PTR, TXT, SRV and A records
-              if(dns_create_message( &response, 512 )){
-                dns_write_header( &response, iter->header->id, 0x8400, 0, 4, 0 );
-                //dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (u8*) available_services[b].service_name );
-                dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-                dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-                dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-                mdns_send_message(fd, &response );
-                dns_free_message( &response );
-                question_processed = 1;
-              }
-              else{
-                _debug_out("UDP multicast test: Send error.\r\n");
-              }
+              mdns_send_response( fd, &available_services[b].response, &known_answers, true );
+              question_processed = 1;
             }
           }
         }
@@ -176,7 +200,7 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
     }
     if (!question_processed ){
       _debug_out("UDP multicast test: Recv a mDNS request.\r\n");
-      mdns_process_query(fd, &name, &question, iter);
+      mdns_process_query(fd, &name, &question, &known_answers);
     }
   }
 }
@@ -184,34 +208,360 @@ void process_dns_questions(int fd, dns_message_iterator_t* iter )
 static void mdns_process_query(int fd, dns_name_t* name, 
                                dns_question_t* question, dns_message_iterator_t* source )
 {
-  dns_message_iterator_t response;
-  IPStatusTypedef para;
-  uint32_t myip;
-  
-  micoWlanGetIPStatus(&para, _interface);
-  myip = htonl(inet_addr(para.ip));
-  
-  memset( &response, 0, sizeof(dns_message_iterator_t) );
-  
+  if ( available_services == NULL )
+    return;
+
   switch ( question->question_type )
   {
   case RR_QTYPE_ANY:
   case RR_TYPE_A:
     if ( dns_compare_name_to_string( name, available_services->hostname, __FUNCTION__, __LINE__) ){				
       _debug_out("UDP multicast test: Recv RR_TYPE_A.\r\n");
-      if(dns_create_message( &response, 256 )){
-        dns_write_header( &response, source->header->id, 0x8400, 0, 1, 0 );
-        dns_write_record( &response, available_services->hostname, RR_CLASS_IN | RR_CACHE_FLUSH, RR_TYPE_A, 300, (uint8_t *)&myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-        return;
-      }
+      mdns_send_response( fd, &host_response, source, true );
+      return;
     }    
   default:
     _debug_out("UDP multicast test: Request not support type: %d.---------------------\r\n", question->question_type);
   }
 }
 
+//===========================================================================================================================
+//  Pre-serialized responses
+//
+//  Every answer set is written once into a packet with a zero ID, as RFC 6762 section 18.1 asks of multicast responses,
+//  and the offset, type and TTL of each record are kept beside it. A query is answered by sending that packet as it is.
+//  Records the querier lists as known answers with at least half of our TTL left (RFC 6762 section 7.1) and records
+//  multicast less than a second ago are left out, only then a packet with the remaining records is copied together.
+//  The packets are rebuilt after the TXT record or the IP address changes.
+//===========================================================================================================================
+
+static void mdns_free_response( dns_cached_response_t* response )
+{
+  if ( response->packet ) free( response->packet );
+  if ( response->records ) free( response->records );
+  memset( response, 0, sizeof(dns_cached_response_t) );
+}
+
+static void mdns_invalidate_responses( void )
+{
+  int b = 0;
+
+  mdns_free_response( &services_response );
+  mdns_free_response( &host_response );
+  for ( b = 0; b < announce_count; ++b )
+    mdns_free_response( &announce_responses[b] );
+  announce_count = 0;
+  for ( b = 0; b < available_service_count && available_services; ++b )
+    mdns_free_response( &available_services[b].response );
+}
+
+/* Record n of all services: the _services._dns-sd._udp PTR of every service, then PTR, TXT, SRV and A of each one */
+static int mdns_service_record( int n, dns_record_spec_t* spec )
+{
+  dns_sd_service_record_t* service;
+
+  if ( available_services == NULL )
+    return 0;
+
+  if ( n < available_service_count ){
+    spec->name         = MFi_SERVICE_QUERY_NAME;
+    spec->record_class = RR_CLASS_IN;
+    spec->record_type  = RR_TYPE_PTR;
+    spec->rdata        = (uint8_t*) available_services[n].service_name;
+    return 1;
+  }
+
+  n -= available_service_count;
+  if ( n >= available_service_count * 4 )
+    return 0;
+
+  service = &available_services[n / 4];
+  spec->record_class = RR_CACHE_FLUSH|RR_CLASS_IN;
+  switch ( n % 4 )
+  {
+  case 0:
+    spec->name         = service->service_name;
+    spec->record_class = RR_CLASS_IN;
+    spec->record_type  = RR_TYPE_PTR;
+    spec->rdata        = (uint8_t*) service->instance_name;
+    break;
+  case 1:
+    spec->name         = service->instance_name;
+    spec->record_type  = RR_TYPE_TXT;
+    spec->rdata        = (uint8_t*) service->txt_att;
+    break;
+  case 2:
+    spec->name         = service->instance_name;
+    spec->record_type  = RR_TYPE_SRV;
+    spec->rdata        = (uint8_t*) service;
+    break;
+  default:
+    spec->name         = service->hostname;
+    spec->record_type  = RR_TYPE_A;
+    spec->rdata        = (uint8_t*) &cached_ip;
+    break;
+  }
+  return 1;
+}
+
+/* Size of the record without name compression, a record that may not fit is not written */
+static uint16_t dns_record_size_max( const dns_record_spec_t* spec )
+{
+  uint16_t size = strlen( spec->name ) + 2 + 10;
+
+  switch ( spec->record_type )
+  {
+  case RR_TYPE_A:
+    size += 4;
+    break;
+  case RR_TYPE_PTR:
+  case RR_TYPE_TXT:
+    size += ( spec->rdata ? strlen( (const char*) spec->rdata ) : 0 ) + 2;
+    break;
+  case RR_TYPE_SRV:
+    size += 6 + strlen( ( (dns_sd_service_record_t*) spec->rdata )->hostname ) + 2;
+    break;
+  default:
+    break;
+  }
+  return size;
+}
+
+static int mdns_response_begin( dns_cached_response_t* response, dns_message_iterator_t* message, uint16_t size )
+{
+  mdns_free_response( response );
+  return dns_create_message( message, size );
+}
+
+static int mdns_response_add_record( dns_cached_response_t* response, dns_message_iterator_t* message, const dns_record_spec_t* spec, uint32_t ttl )
+{
+  dns_cached_record_t* record;
+  uint8_t* start = message->iter;
+
+  if ( message->iter + dns_record_size_max( spec ) > message->end )
+    return 0;
+
+  if ( response->record_count == response->record_max ){
+    record = (dns_cached_record_t*) realloc( response->records, ( response->record_max + MDNS_RESPONSE_RECORD_GROWTH ) * sizeof(dns_cached_record_t) );
+    if ( record == NULL )
+      return 0;
+    response->records     = record;
+    response->record_max += MDNS_RESPONSE_RECORD_GROWTH;
+  }
+
+  dns_write_record( message, spec->name, spec->record_class, spec->record_type, ttl, spec->rdata );
+
+  record = &response->records[response->record_count++];
+  record->offset       = start - (uint8_t*) message->header;
+  record->length       = message->iter - start;
+  record->rdata_offset = dns_skip_name_checked( start, message->iter ) + 10 - (uint8_t*) message->header;
+  record->rd_length    = message->iter - (uint8_t*) message->header - record->rdata_offset;
+  record->type         = spec->record_type;
+  record->ttl          = ttl;
+  record->last_sent    = 0;
+  record->selected     = 0;
+  return 1;
+}
+
+static void mdns_response_end( dns_cached_response_t* response, dns_message_iterator_t* message )
+{
+  dns_write_header( message, 0x0, 0x8400, 0, response->record_count, 0 );
+  response->packet = (uint8_t*) message->header;
+  response->length = message->iter - response->packet;
+}
+
+/* Writes records first to first + count - 1 of all services into one response of at most size bytes */
+static void mdns_build_response( dns_cached_response_t* response, int first, int count, uint16_t size, uint32_t ttl )
+{
+  dns_message_iterator_t message;
+  dns_record_spec_t spec;
+  int n = 0;
+
+  if ( !mdns_response_begin( response, &message, size ) )
+    return;
+  for ( n = first; n < first + count && mdns_service_record( n, &spec ); ++n ){
+    if ( !mdns_response_add_record( response, &message, &spec, ttl ) ){
+      mdns_utils_log( "mDNS record %d does not fit in the response", n );
+    }
+  }
+  mdns_response_end( response, &message );
+}
+
+/* Packs all records of all services into as few packets of MDNS_PACKET_SIZE as possible, returns the packet count.
+   A packet is filled until the next record no longer fits, that record starts the next packet. */
+static uint8_t mdns_pack_service_records( dns_cached_response_t* responses, uint8_t max, uint32_t ttl )
+{
+  dns_message_iterator_t message;
+  dns_record_spec_t spec;
+  uint8_t count = 0;
+  int n = 0;
+
+  for ( n = 0; mdns_service_record( n, &spec ); ++n ){
+    if ( count > 0 && mdns_response_add_record( &responses[count - 1], &message, &spec, ttl ) )
+      continue;
+
+    /* No packet yet or the current one is full */
+    if ( count > 0 )
+      mdns_response_end( &responses[count - 1], &message );
+    if ( count >= max || !mdns_response_begin( &responses[count], &message, MDNS_PACKET_SIZE ) ){
+      mdns_utils_log( "mDNS records from %d on are not sent", n );
+      return count;
+    }
+    if ( !mdns_response_add_record( &responses[count++], &message, &spec, ttl ) ){
+      mdns_utils_log( "mDNS record %d does not fit in a packet", n );
+    }
+  }
+  if ( count > 0 )
+    mdns_response_end( &responses[count - 1], &message );
+  return count;
+}
+
+/* Marks the selected records of the response as multicast at now, or every record if all is set */
+static void mdns_mark_sent( dns_cached_response_t* response, bool all, uint32_t now )
+{
+  int r = 0;
+
+  for ( r = 0; r < response->record_count; ++r ){
+    if ( all || response->records[r].selected )
+      response->records[r].last_sent = ( now != 0 ) ? now : 1;
+  }
+}
+
+static void mdns_update_responses( uint32_t myip )
+{
+  int b = 0;
+
+  if ( myip != cached_ip ){
+    mdns_invalidate_responses( );
+    cached_ip = myip;
+  }
+
+  if ( available_services == NULL )
+    return;
+
+  if ( services_response.packet == NULL )
+    mdns_build_response( &services_response, 0, available_service_count, MDNS_PACKET_SIZE, 1500 );
+
+  for ( b = 0; b < available_service_count; ++b ){
+    if ( available_services[b].response.packet == NULL )
+      mdns_build_response( &available_services[b].response, available_service_count + b * 4, 4, MDNS_RESPONSE_SIZE, 1500 );
+  }
+
+  /* The A record of the first service, with a shorter TTL */
+  if ( host_response.packet == NULL )
+    mdns_build_response( &host_response, available_service_count + 3, 1, MDNS_RESPONSE_SIZE, 300 );
+
+  if ( announce_count == 0 )
+    announce_count = mdns_pack_service_records( announce_responses, MDNS_ANNOUNCE_PACKET_MAX, 1500 );
+}
+
+static int mdns_compare_rdata( uint16_t type, const uint8_t* packet_a, const uint8_t* rdata_a, uint16_t length_a, const uint8_t* end_a,
+                               const uint8_t* packet_b, const uint8_t* rdata_b, uint16_t length_b, const uint8_t* end_b )
+{
+  switch ( type )
+  {
+  case RR_TYPE_PTR:
+    return dns_compare_names( packet_a, rdata_a, end_a, packet_b, rdata_b, end_b );
+  case RR_TYPE_SRV:
+    /* Priority, weight and port, then the target host name */
+    if ( length_a < 7 || length_b < 7 || memcmp( rdata_a, rdata_b, 6 ) )
+      return 0;
+    return dns_compare_names( packet_a, rdata_a + 6, end_a, packet_b, rdata_b + 6, end_b );
+  default:
+    return ( length_a == length_b ) && ( memcmp( rdata_a, rdata_b, length_a ) == 0 );
+  }
+}
+
+/* Deselects the records listed as known answers in source, returns the number of records still selected */
+static int mdns_suppress_known_answers( dns_message_iterator_t* source, dns_cached_response_t* response, int selected )
+{
+  const uint8_t* packet = (const uint8_t*) source->header;
+  const uint8_t* iter = source->iter;
+  const uint8_t* name;
+  const uint8_t* rdata;
+  const uint8_t* response_end = response->packet + response->length;
+  dns_cached_record_t* record;
+  uint16_t type, rd_length;
+  uint32_t ttl;
+  int a = 0, r = 0;
+
+  for ( a = 0; a < htons(source->header->answer_count) && selected; ++a ){
+    name = iter;
+    iter = dns_skip_name_checked( iter, source->end );
+    if ( iter == NULL || iter + 10 > source->end )
+      break;
+    type      = ( iter[0] << 8 ) | iter[1];
+    ttl       = ( (uint32_t) iter[4] << 24 ) | ( (uint32_t) iter[5] << 16 ) | ( iter[6] << 8 ) | iter[7];
+    rd_length = ( iter[8] << 8 ) | iter[9];
+    rdata     = iter + 10;
+    iter      = rdata + rd_length;
+    if ( iter > source->end )
+      break;
+
+    for ( r = 0; r < response->record_count; ++r ){
+      record = &response->records[r];
+      if ( !record->selected || record->type != type || ttl < record->ttl / 2 )
+        continue;
+      if ( dns_compare_names( packet, name, source->end, response->packet, response->packet + record->offset, response_end ) &&
+           mdns_compare_rdata( type, packet, rdata, rd_length, source->end,
+                               response->packet, response->packet + record->rdata_offset, record->rd_length, response_end ) ){
+        _debug_out("UDP multicast test: Known answer, type %d.\r\n", type);
+        record->selected = 0;
+        --selected;
+      }
+    }
+  }
+  return selected;
+}
+
+static void mdns_send_response( int fd, dns_cached_response_t* response, dns_message_iterator_t* source, bool rate_limit )
+{
+  dns_message_iterator_t message;
+  dns_cached_record_t* record;
+  uint32_t now = mico_get_time();
+  int selected = response->record_count;
+  uint16_t count = 0;
+  int r = 0;
+
+  if ( response->packet == NULL || response->record_count == 0 )
+    return;
+
+  for ( r = 0; r < response->record_count; ++r )
+    response->records[r].selected = 1;
+  if ( source != NULL )
+    selected = mdns_suppress_known_answers( source, response, selected );
+
+  for ( r = 0; r < response->record_count && rate_limit; ++r ){
+    record = &response->records[r];
+    if ( record->selected && record->last_sent != 0 && now - record->last_sent < MDNS_RATE_LIMIT_INTERVAL ){
+      record->selected = 0;
+      --selected;
+    }
+  }
+  if ( selected == 0 )
+    return;
+
+  if ( selected == response->record_count ){
+    message.header = (dns_message_header_t*) response->packet;
+    message.iter   = response->packet + response->length;
+    mdns_send_message( fd, &message );
+  }
+  else if ( dns_create_message( &message, MDNS_PACKET_SIZE ) ){
+    /* Names may point into records left out, so every record is copied and compressed again */
+    for ( r = 0; r < response->record_count; ++r ){
+      record = &response->records[r];
+      if ( record->selected ){
+        dns_copy_record( &message, response->packet, record, response->packet + response->length );
+        ++count;
+      }
+    }
+    dns_write_header( &message, 0x0, 0x8400, 0, count, 0 );
+    mdns_send_message( fd, &message );
+    dns_free_message( &message );
+  }
+
+  mdns_mark_sent( response, false, now );
+}
 
 static int dns_get_next_question( dns_message_iterator_t* iter, dns_question_t* q, dns_name_t* name )
 {
@@ -256,7 +606,7 @@ static int dns_compare_name_to_string( dns_name_t* name, const char* string, con
     memcpy(temp, buffer, section_length );
     _debug_out("UDP multicast test: Recv a name: %s.\r\n", temp);
     free(temp);
-    if ( strncmp( (char*) buffer, string, section_length ) )
+    if ( strnicmp( (char*) buffer, string, section_length ) )
     {
       result	 = 0;
       finished = 1;
@@ -288,6 +638,8 @@ static int dns_create_message( dns_message_iterator_t* message, uint16_t size )
   }
   
   message->iter = (uint8_t *) message->header + sizeof(dns_message_header_t);
+  message->end  = (uint8_t *) message->header + size;
+  message->name_offset_count = 0;
   return 1;
 }
 
@@ -373,9 +725,13 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     break;
     
   case RR_TYPE_PTR:
-  case RR_TYPE_TXT:
     dns_write_name( iter, (const char*) rdata );
     break;
+
+  case RR_TYPE_TXT:
+    /* Character strings, not a name, never compressed */
+    dns_write_string( iter, rdata ? (const char*) rdata : "" );
+    break;
     
   case RR_TYPE_SRV:
     /* Set priority and weight to 0*/
@@ -385,8 +741,8 @@ static void dns_write_record( dns_message_iterator_t* iter, const char* name, ui
     /* Write the port*/
     dns_write_uint16( iter, ( (dns_sd_service_record_t*) rdata )->port );
     
-    /* Write the hostname*/
-    dns_write_string( iter, ( (dns_sd_service_record_t*) rdata )->hostname );
+    /* Write the hostname, RFC 6762 section 18.14 allows it to be compressed */
+    dns_write_name( iter, ( (dns_sd_service_record_t*) rdata )->hostname );
     break;
   default:
     break;
@@ -467,9 +823,141 @@ static void dns_skip_name( dns_message_iterator_t* iter )
   ++iter->iter;
 }
 
+/* Returns the byte after the name, or NULL if the name runs past end */
+static const uint8_t* dns_skip_name_checked( const uint8_t* name, const uint8_t* end )
+{
+  while ( name < end )
+  {
+    if ( *name == 0 )
+      return name + 1;
+    if ( ( *name & 0xC0 ) == 0xC0 )
+      return ( name + 2 <= end ) ? name + 2 : NULL;
+    name += (uint32_t) *name + 1;
+  }
+  return NULL;
+}
+
+/* Follows compression pointers to the next label, NULL on a pointer loop or a label past end */
+static const uint8_t* dns_resolve_label( const uint8_t* packet, const uint8_t* label, const uint8_t* end, int* pointers )
+{
+  while ( label < end && ( *label & 0xC0 ) == 0xC0 )
+  {
+    if ( label + 2 > end || ++( *pointers ) > MDNS_NAME_POINTER_MAX )
+      return NULL;
+    label = packet + ( ( ( label[0] & 0x3F ) << 8 ) | label[1] );
+  }
+  if ( label >= end || label + *label + 1 > end )
+    return NULL;
+  return label;
+}
+
+/* Compares two names in wire format, either may be compressed. Labels are compared case-insensitively */
+static int dns_compare_names( const uint8_t* packet_a, const uint8_t* name_a, const uint8_t* end_a,
+                              const uint8_t* packet_b, const uint8_t* name_b, const uint8_t* end_b )
+{
+  int pointers_a = 0, pointers_b = 0;
+
+  while ( 1 )
+  {
+    name_a = dns_resolve_label( packet_a, name_a, end_a, &pointers_a );
+    name_b = dns_resolve_label( packet_b, name_b, end_b, &pointers_b );
+    if ( name_a == NULL || name_b == NULL || *name_a != *name_b )
+      return 0;
+    if ( *name_a == 0 )
+      return 1;
+    if ( strnicmp( (const char*) name_a + 1, (const char*) name_b + 1, *name_a ) )
+      return 0;
+    name_a += *name_a + 1;
+    name_b += *name_b + 1;
+  }
+}
+
+
+//===========================================================================================================================
+//  Name compression
+//
+//  Every label written uncompressed is remembered in name_offsets. A new name is first written in full, then its
+//  longest suffix that is already in the packet is replaced by a pointer (RFC 1035 section 4.1.4).
+//===========================================================================================================================
+
+static void dns_compress_name( dns_message_iterator_t* iter, uint8_t* name )
+{
+  uint8_t* packet = (uint8_t*) iter->header;
+  uint8_t* label = name;
+  uint16_t offset;
+  int i = 0;
+
+  while ( *label != 0 && ( *label & 0xC0 ) != 0xC0 )
+  {
+    for ( i = 0; i < iter->name_offset_count; ++i )
+    {
+      offset = iter->name_offsets[i];
+      if ( dns_compare_names( packet, packet + offset, iter->iter, packet, label, iter->iter ) )
+      {
+        label[0] = 0xC0 | ( offset >> 8 );
+        label[1] = offset & 0xFF;
+        iter->iter = label + 2;
+        return;
+      }
+    }
+    if ( iter->name_offset_count < DNS_NAME_OFFSET_MAX && label - packet < 0x3FFF )
+      iter->name_offsets[iter->name_offset_count++] = label - packet;
+    label += *label + 1;
+  }
+}
+
 static void dns_write_name( dns_message_iterator_t* iter, const char* src )
 {
+  uint8_t* name = iter->iter;
+
   dns_write_string( iter, src );
+  dns_compress_name( iter, name );
+}
+
+/* Writes a name of another packet, pointers in it are resolved and the name is compressed against this packet */
+static void dns_copy_name( dns_message_iterator_t* iter, const uint8_t* packet, const uint8_t* src, const uint8_t* end )
+{
+  uint8_t* name = iter->iter;
+  int pointers = 0;
+
+  while ( ( src = dns_resolve_label( packet, src, end, &pointers ) ) != NULL && *src != 0 )
+  {
+    dns_write_bytes( iter, (uint8_t*) src, *src + 1 );
+    src += *src + 1;
+  }
+  *iter->iter++ = 0;
+  dns_compress_name( iter, name );
+}
+
+static void dns_copy_record( dns_message_iterator_t* iter, const uint8_t* packet, const dns_cached_record_t* record, const uint8_t* end )
+{
+  const uint8_t* rdata = packet + record->rdata_offset;
+  uint8_t* rd_length;
+  uint8_t* temp_ptr;
+
+  /* Name, then type, class and TTL as they are */
+  dns_copy_name( iter, packet, packet + record->offset, end );
+  dns_write_bytes( iter, (uint8_t*) rdata - 10, 8 );
+
+  rd_length	= iter->iter;
+  iter->iter += 2;
+  temp_ptr	= iter->iter;
+
+  switch ( record->type )
+  {
+  case RR_TYPE_PTR:
+    dns_copy_name( iter, packet, rdata, end );
+    break;
+  case RR_TYPE_SRV:
+    dns_write_bytes( iter, (uint8_t*) rdata, 6 );
+    dns_copy_name( iter, packet, rdata + 6, end );
+    break;
+  default:
+    dns_write_bytes( iter, (uint8_t*) rdata, record->rd_length );
+    break;
+  }
+  rd_length[0] = ( iter->iter - temp_ptr ) >> 8;
+  rd_length[1] = ( iter->iter - temp_ptr ) & 0xFF;
 }
 
 
@@ -485,6 +973,7 @@ void bonjour_service_init(bonjour_init_t init)
 
 
   mico_rtos_lock_mutex( &bonjour_mutex );
+  mdns_invalidate_responses( );
   if(available_services) {
     //suspend_bonjour_service(ENABLE);
     if(available_services->service_name)  free(available_services->service_name);
@@ -504,12 +993,12 @@ void bonjour_service_init(bonjour_init_t init)
 
   available_services->hostname = (char*)__strdup(init.host_name);
 
+  /* Full name, records are copied out of the cached packets one by one so they must not point to each other */
   len = strlen(init.instance_name);
-  available_services->instance_name = (char*)malloc(len+3);//// 0xc00c+\0
+  available_services->instance_name = (char*)malloc(len+strlen(init.service_name)+2);// .+\0
   memcpy(available_services->instance_name, init.instance_name, len);
-  available_services->instance_name[len]= 0xc0;
-  available_services->instance_name[len+1]= 0x0c;
-  available_services->instance_name[len+2]= 0;
+  available_services->instance_name[len]= '.';
+  strcpy(available_services->instance_name+len+1, init.service_name);
   
   available_services->txt_att = (char*)__strdup(init.txt_record);
 
@@ -524,6 +1013,7 @@ void bonjour_update_txt_record(char *txt_record)
   if(available_services->txt_att)  free(available_services->txt_att);
   
   available_services->txt_att = (char*)__strdup(txt_record);
+  mdns_invalidate_responses( );
 
   _bonjour_announce = 1;
   mico_rtos_unlock_mutex( &bonjour_mutex );
@@ -551,58 +1041,50 @@ void mfi_mdns_handler(int fd, uint8_t* pkt, int pkt_len)
 
 void mfi_bonjour_send(int fd)
 {
-  dns_message_iterator_t response;
   uint32_t myip;
+  uint32_t now = mico_get_time();
   IPStatusTypedef para;
   micoWlanGetIPStatus(&para, _interface);
   myip = htonl(inet_addr(para.ip));
   if(myip == 0) return;
   int b = 0;
-    
-  if(dns_create_message( &response, 512 )) {
-    dns_write_header(&response, 0x0, 0x8400, 0, available_service_count, 0 );          
-    for ( b = 0; b < available_service_count; ++b ){
-      dns_write_record( &response, MFi_SERVICE_QUERY_NAME, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].service_name );
-    }
-    mdns_send_message(fd, &response );
-    dns_free_message( &response );
-  }
 
+  mdns_update_responses( myip );
+
+  /* Announcements are paced by the bonjour thread, the same records are not sent again for a query within a second */
+  for ( b = 0; b < announce_count; ++b ){
+    mdns_send_response( fd, &announce_responses[b], NULL, false );
+  }
+  mdns_mark_sent( &services_response, true, now );
   for ( b = 0; b < available_service_count; ++b ){
-      if(dns_create_message( &response, 512 )){
-        dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-        dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 1500, (uint8_t*) available_services[b].instance_name );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 1500, (uint8_t*) available_services[b].txt_att );
-        dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 1500, (uint8_t*) &available_services[b]);
-        dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 1500, (uint8_t*) &myip);
-        mdns_send_message(fd, &response );
-        dns_free_message( &response );
-      }
+    mdns_mark_sent( &available_services[b].response, true, now );
   }
 }
 
 
 void mfi_bonjour_remove_record(int fd)
 {
+  dns_cached_response_t goodbye[MDNS_ANNOUNCE_PACKET_MAX];
   dns_message_iterator_t response;
   uint32_t myip;
+  uint8_t count;
   IPStatusTypedef para;
   micoWlanGetIPStatus(&para, _interface);
   myip = htonl(inet_addr(para.ip));
   int b = 0;
 
-  for ( b = 0; b < available_service_count; ++b ){
-    if(dns_create_message( &response, 512 )){
-      dns_write_header( &response, 0x0, 0x8400, 0, 4, 0 );
-      dns_write_record( &response, available_services[b].service_name, RR_CLASS_IN, RR_TYPE_PTR, 0, (uint8_t*) available_services[b].instance_name );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_TXT, 0, (uint8_t*) available_services[b].txt_att );
-      dns_write_record( &response, available_services[b].instance_name, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_SRV, 0, (uint8_t*) &available_services[b]);
-      dns_write_record( &response, available_services[b].hostname, RR_CACHE_FLUSH|RR_CLASS_IN, RR_TYPE_A, 0, (uint8_t*) &myip);
-      mdns_send_message(fd, &response );
-      mico_thread_msleep(20);
-      mdns_send_message(fd, &response );
-      dns_free_message( &response );
-    }
+  mdns_update_responses( myip );
+
+  /* Same records as the announcement with TTL 0 */
+  memset( goodbye, 0, sizeof(goodbye) );
+  count = mdns_pack_service_records( goodbye, MDNS_ANNOUNCE_PACKET_MAX, 0 );
+  for ( b = 0; b < count; ++b ){
+    response.header = (dns_message_header_t*) goodbye[b].packet;
+    response.iter   = goodbye[b].packet + goodbye[b].length;
+    mdns_send_message(fd, &response );
+    mico_thread_msleep(20);
+    mdns_send_message(fd, &response );
+    mdns_free_response( &goodbye[b] );
   }
 }
 
@@ -105,11 +105,15 @@ typedef struct
   uint16_t additional_record_count;
 } dns_message_header_t;
 
+#define DNS_NAME_OFFSET_MAX   32
+
 typedef struct
 {
     dns_message_header_t* header; // Also used as start of packet for compressed names
     uint8_t* iter;
     uint8_t* end;
+    uint16_t name_offsets[DNS_NAME_OFFSET_MAX]; // Labels written so far, later names are compressed against them
+    uint8_t  name_offset_count;
 } dns_message_iterator_t;
 
 typedef struct
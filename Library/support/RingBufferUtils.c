@@ -26,12 +26,26 @@
 #define ring_buffer_utils_log(M, ...) custom_log("RingBufferUtils", M, ##__VA_ARGS__)
 #define ring_buffer_utils_log_trace() custom_log_trace("RingBufferUtils")
 
+/* head is owned by the consumer and tail by the producer, the other side may
+ * change it at any time (ISR/DMA), so always read it through a volatile access */
+#define ring_buffer_load(x)   (*(volatile uint32_t *)&(x))
+
+/* Indexes passed in are always less than 2 * size, so a single subtraction is
+ * enough when size is not a power of two */
+static inline uint32_t ring_buffer_wrap( const ring_buffer_t* ring_buffer, uint32_t index )
+{
+  if ( ring_buffer->mask != 0 )
+    return index & ring_buffer->mask;
+  return ( index >= ring_buffer->size ) ? index - ring_buffer->size : index;
+}
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size )
 {
     ring_buffer->buffer     = (uint8_t*)buffer;
     ring_buffer->size       = size;
     ring_buffer->head       = 0;
     ring_buffer->tail       = 0;
+    ring_buffer->mask       = ( size != 0 && ( size & ( size - 1 ) ) == 0 ) ? size - 1 : 0;
     return kNoErr;
 }
 
@@ -43,50 +57,124 @@ OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer )
 
 uint32_t ring_buffer_free_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
-  return ((tail_to_end + ring_buffer->head) % ring_buffer->size);
+  /* One byte is kept unused so that head == tail always means empty */
+  return ring_buffer->size - 1 - ring_buffer_used_space( ring_buffer );
 }
 
 uint32_t ring_buffer_used_space( ring_buffer_t* ring_buffer )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
-  return ((head_to_end + ring_buffer->tail) % ring_buffer->size);
+  uint32_t head = ring_buffer_load( ring_buffer->head );
+  uint32_t tail = ring_buffer_load( ring_buffer->tail );
+  return ring_buffer_wrap( ring_buffer, ring_buffer->size + tail - head );
 }
 
 uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes )
 {
-  uint32_t head_to_end = ring_buffer->size - ring_buffer->head;
+  uint32_t head = ring_buffer_load( ring_buffer->head );
+  uint32_t tail = ring_buffer_load( ring_buffer->tail );
   
-  *data = &(ring_buffer->buffer[ring_buffer->head]);
+  /* Acquire: data written before tail was published must be visible now */
+  RING_BUFFER_BARRIER();
   
-  *contiguous_bytes = MIN(head_to_end, (head_to_end + ring_buffer->tail) % ring_buffer->size);
+  *data = &(ring_buffer->buffer[head]);
+  *contiguous_bytes = ( tail >= head ) ? tail - head : ring_buffer->size - head;
   return 0;
 }
 
+uint32_t ring_buffer_get_segments( ring_buffer_t* ring_buffer, ring_buffer_segment_t segments[2] )
+{
+  uint32_t head = ring_buffer_load( ring_buffer->head );
+  uint32_t tail = ring_buffer_load( ring_buffer->tail );
+  
+  RING_BUFFER_BARRIER();
+  
+  segments[0].data = &(ring_buffer->buffer[head]);
+  segments[1].data = ring_buffer->buffer;
+  if ( tail >= head )
+  {
+    segments[0].length = tail - head;
+    segments[1].length = 0;
+  }
+  else
+  {
+    segments[0].length = ring_buffer->size - head;
+    segments[1].length = tail;
+  }
+  return segments[0].length + segments[1].length;
+}
+
 uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed )
 {
-  ring_buffer->head = (ring_buffer->head + bytes_consumed) % ring_buffer->size;
+  uint32_t head = ring_buffer_wrap( ring_buffer, ring_buffer->head + bytes_consumed );
+  
+  /* Release: finish reading the data before the producer may overwrite it */
+  RING_BUFFER_BARRIER();
+  
+  ring_buffer_load( ring_buffer->head ) = head;
   return 0;
 }
 
-uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length )
 {
-  uint32_t tail_to_end = ring_buffer->size - ring_buffer->tail;
+  ring_buffer_segment_t segments[2];
+  uint32_t amount_to_copy;
+  uint32_t first_copy;
   
-  /* Calculate the maximum amount we can copy */
-  uint32_t amount_to_copy = MIN(data_length, (ring_buffer->tail == ring_buffer->head) ? ring_buffer->size : (tail_to_end + ring_buffer->head) % ring_buffer->size);
+  amount_to_copy = MIN( data_length, ring_buffer_get_segments( ring_buffer, segments ) );
+  if ( amount_to_copy == 0 )
+    return 0;
   
-  /* Copy as much as we can until we fall off the end of the buffer */
-  memcpy(&ring_buffer->buffer[ring_buffer->tail], data, MIN(amount_to_copy, tail_to_end));
+  first_copy = MIN( amount_to_copy, segments[0].length );
+  memcpy( data, segments[0].data, first_copy );
+  if ( amount_to_copy > first_copy )
+    memcpy( data + first_copy, segments[1].data, amount_to_copy - first_copy );
   
-  /* Check if we have more to copy to the front of the buffer */
-  if (tail_to_end < amount_to_copy)
+  ring_buffer_consume( ring_buffer, amount_to_copy );
+  return amount_to_copy;
+}
+
+uint32_t ring_buffer_reserve( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t data_length )
+{
+  uint32_t head = ring_buffer_load( ring_buffer->head );
+  uint32_t tail = ring_buffer->tail;
+  uint32_t contiguous_bytes;
+  
+  if ( head > tail )
+    contiguous_bytes = head - tail - 1;
+  else
+    contiguous_bytes = ring_buffer->size - tail - ( ( head == 0 ) ? 1 : 0 );
+  
+  *data = &(ring_buffer->buffer[tail]);
+  return MIN( data_length, contiguous_bytes );
+}
+
+uint8_t ring_buffer_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written )
+{
+  uint32_t tail = ring_buffer_wrap( ring_buffer, ring_buffer->tail + bytes_written );
+  
+  /* Release: the data must be in memory before the consumer can see the new tail */
+  RING_BUFFER_BARRIER();
+  
+  ring_buffer_load( ring_buffer->tail ) = tail;
+  return 0;
+}
+
+uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length )
+{
+  uint8_t* space;
+  uint32_t amount_to_copy;
+  uint32_t copied = 0;
+  
+  /* At most two passes: up to the end of the buffer, then from the front */
+  while ( copied < data_length )
   {
-    memcpy(ring_buffer->buffer, data + tail_to_end, amount_to_copy - tail_to_end);
+    amount_to_copy = ring_buffer_reserve( ring_buffer, &space, data_length - copied );
+    if ( amount_to_copy == 0 )
+      break;
+    memcpy( space, data + copied, amount_to_copy );
+    ring_buffer_commit( ring_buffer, amount_to_copy );
+    copied += amount_to_copy;
   }
   
-  /* Update the tail */
-  ring_buffer->tail = (ring_buffer->tail + amount_to_copy) % ring_buffer->size;
-  
-  return amount_to_copy;
+  return copied;
 }
@@ -25,18 +25,43 @@
 
 #include "Common.h"
 
+/* The ring buffer is a single-producer/single-consumer queue: one context
+ * (ISR, DMA or thread) only moves tail, the other only moves head. Index
+ * updates are ordered with a memory barrier so no lock is required. */
 typedef struct
 {
   uint32_t  size;
   uint32_t  head;
   uint32_t  tail;
   uint8_t*  buffer;
+  uint32_t  mask;     /* size - 1 when size is a power of two, otherwise 0 */
 } ring_buffer_t;
 
+typedef struct
+{
+  uint8_t*  data;
+  uint32_t  length;
+} ring_buffer_segment_t;
+
 #ifndef MIN
 #define MIN(x,y)  ((x) < (y) ? (x) : (y))
 #endif /* ifndef MIN */
 
+#if defined ( __GNUC__ )
+  #if defined ( __arm__ )
+    #define RING_BUFFER_BARRIER()   __asm volatile ("dmb" ::: "memory")
+  #else
+    /* Acquire and release only: a full barrier (mfence on x86) would cost
+     * more than the copy for short reads and writes */
+    #define RING_BUFFER_BARRIER()   __atomic_thread_fence( __ATOMIC_ACQ_REL )
+  #endif
+#elif defined ( __ICCARM__ )
+  #include <intrinsics.h>
+  #define RING_BUFFER_BARRIER()     __DMB()
+#elif defined ( __CC_ARM ) //KEIL
+  #define RING_BUFFER_BARRIER()     __dmb(0xF)
+#endif
+
 OSStatus ring_buffer_init( ring_buffer_t* ring_buffer, uint8_t* buffer, uint32_t size );
 
 OSStatus ring_buffer_deinit( ring_buffer_t* ring_buffer );
@@ -47,10 +72,21 @@ uint32_t ring_buffer_used_space( ring_buffer_t* ring_buffer );
 
 uint8_t ring_buffer_get_data( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t* contiguous_bytes );
 
+/* Fill segments[0..1] with the readable data, return the total readable length */
+uint32_t ring_buffer_get_segments( ring_buffer_t* ring_buffer, ring_buffer_segment_t segments[2] );
+
 uint8_t ring_buffer_consume( ring_buffer_t* ring_buffer, uint32_t bytes_consumed );
 
+/* Copy up to data_length bytes out of the buffer and consume them in one step */
+uint32_t ring_buffer_read( ring_buffer_t* ring_buffer, uint8_t* data, uint32_t data_length );
+
 uint32_t ring_buffer_write( ring_buffer_t* ring_buffer, const uint8_t* data, uint32_t data_length );
 
-#endif // __RingBufferUtils_h__
+/* Zero-copy write: get up to data_length contiguous free bytes at *data, fill
+ * them in place, then publish them to the consumer with ring_buffer_commit */
+uint32_t ring_buffer_reserve( ring_buffer_t* ring_buffer, uint8_t** data, uint32_t data_length );
 
+uint8_t ring_buffer_commit( ring_buffer_t* ring_buffer, uint32_t bytes_written );
+
+#endif // __RingBufferUtils_h__
 
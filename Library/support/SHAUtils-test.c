@@ -0,0 +1,251 @@
+/**
+  ******************************************************************************
+  * @file    SHAUtils-test.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    05-May-2014
+  * @brief   FIPS 202 known-answer tests for the SHA-3 and SHAKE functions in
+  *          SHAUtils.c.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "Common.h"
+#include "Debug.h"
+#include "MICORTOS.h"
+#include "SHAUtils.h"
+#include "StringUtils.h"
+
+//===========================================================================================================================
+//  Internals
+//===========================================================================================================================
+
+OSStatus    SHA3_Test( int print );
+
+//===========================================================================================================================
+//  Test Vectors
+//
+//  The FIPS 202 examples ("", "abc", the 448-bit message and 1600 bits of 0xA3), plus 0xA3 messages one byte either
+//  side of the SHA3-512 (72), SHA3-256/SHAKE256 (136) and SHAKE128 (168) rates. SHAKE128 is read for 32 bytes and
+//  SHAKE256 for 64.
+//===========================================================================================================================
+
+typedef struct
+{
+    const char *        data;       // NULL for len bytes of 0xA3
+    size_t              len;
+    const char *        sha3_256;
+    const char *        sha3_512;
+    const char *        shake128;
+    const char *        shake256;
+    
+}   sha3_test_vector;
+
+static const sha3_test_vector       kSHA3TestVectors[] =
+{
+    {
+        "", 0,
+        "a7ffc6f8bf1ed76651c14756a061d662f580ff4de43b49fa82d80a4b80f8434a",
+        "a69f73cca23a9ac5c8b567dc185a756e97c982164fe25859e0d1dcc1475c80a615b2123af1f5f94c11e3e9402c3ac558f500199d95b6d3e301758586281dcd26",
+        "7f9c2ba4e88f827d616045507605853ed73b8093f6efbc88eb1a6eacfa66ef26",
+        "46b9dd2b0ba88d13233b3feb743eeb243fcd52ea62b81b82b50c27646ed5762fd75dc4ddd8c0f200cb05019d67b592f6fc821c49479ab48640292eacb3b7c4be"
+    },
+    {
+        "abc", 0,
+        "3a985da74fe225b2045c172d6bd390bd855f086e3e9d525b46bfe24511431532",
+        "b751850b1a57168a5693cd924b6b096e08f621827444f70d884f5d0240d2712e10e116e9192af3c91a7ec57647e3934057340b4cf408d5a56592f8274eec53f0",
+        "5881092dd818bf5cf8a3ddb793fbcba74097d5c526a6d35f97b83351940f2cc8",
+        "483366601360a8771c6863080cc4114d8db44530f8f1e1ee4f94ea37e78b5739d5a15bef186a5386c75744c0527e1faa9f8726e462a12a4feb06bd8801e751e4"
+    },
+    {
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 0,
+        "41c0dba2a9d6240849100376a8235e2c82e1b9998a999e21db32dd97496d3376",
+        "04a371e84ecfb5b8b77cb48610fca8182dd457ce6f326a0fd3d7ec2f1e91636dee691fbe0c985302ba1b0d8dc78c086346b533b49c030d99a27daf1139d6e75e",
+        "1a96182b50fb8c7e74e0a707788f55e98209b8d91fade8f32f8dd5cff7bf21f5",
+        "4d8c2dd2435a0128eefbb8c36f6f87133a7911e18d979ee1ae6be5d4fd2e332940d8688a4e6a59aa8060f1f9bc996c05aca3c696a8b66279dc672c740bb224ec"
+    },
+    {
+        NULL, 71,
+        "ab4c6ad92ea1c2d9aefe57d6b98191b0bb3b56b92cb669695d5177a65334ca41",
+        "3179c85b18c790518b1ddb02e6953b01b2d01ff72409b1ce0b38828c710ab7c0bd98f0a5c5861692c3954d8ce4fb02da42560be129c4dd5b3eadcb02908676e0",
+        "063b9a09d22771cea70699481c0acc53d1193a176ed85a0fb115103aa5f6cbfc",
+        "44f85b0b5b8811c08e2271d37b338dcb194bc361c68104ce88d4719577e2dfd76cfe2ffccd0ba1c4011a111a4c77f1d633739ce1d0b7ea2f7be69befc4d732af"
+    },
+    {
+        NULL, 72,
+        "5d97e2aec78ff4f88f78b624080602205efb4a3e29c3d6da478812680e2b8f9f",
+        "d24ce75b87c7be36e3fedbaa285f563d3efcc13663f5eb2fdd0c60033dab04e894d343b3971bc0c9ba30e0dde18106cbaaa955c8c3c0bf1ec3490aafcae15788",
+        "469d8c95815ca88b57f643f0056d897332ebf89f2a3f62a4a9ccefdfbc1e62b3",
+        "3daf9eb161be315b97881c15c025cf9fe3a866da8d34001f83b3fda9cb52b6fb4bb45fe1e52f4987f69ec09e98a530015576002452850df61863fdb7b89fdfee"
+    },
+    {
+        NULL, 73,
+        "38aa55d1b143a8a7f6501ed48392b722a84e2c2aa4d7b22a7613bb5ff0b3989d",
+        "b5d2e4263c9ee9c66993a29db88c04a479df53ad69fb6742dffb0789a14e35fe46bc0f3a8bac7a2b83335b9b4ebb05b07fce2960a790e628a1dde08eb6bb22e0",
+        "2a1294f0bfe7c3b5af8054e881de914e2d018d1b781327a6f5cbef94b9418918",
+        "e77ce33ebbba49702adb3258cd0fda073f3f1af97fa7cdecf3b9eadb597b17b36c8a7b0f218c146d9dc63e409be929b3f8897943461c944f96879bd962555fb5"
+    },
+    {
+        NULL, 135,
+        "d51927265ca4bf0cc8b4453387700918c03f8894e395ad437d4573f3be4d2c34",
+        "f22492517cd747d9d0a4f84053df812575ec3dd25a5bbf641da573ed481f25f70d0fb37549e4b2a7cdb985488926fcc884b719fc7cd836c65af73a890637aea6",
+        "69977a5a40fa7dcce568b9685627647aa87e8153190335a44ecda6e55370e1d9",
+        "36acdc8ec09dad14523122174245fb10f297998ec08d524d65c90fe57ac0d0066259f116f9d104a4f53eaee2f5916b920fac7ab13816d59de6d52e6b00ff194d"
+    },
+    {
+        NULL, 136,
+        "0adf6bfb359ae40019b67d8c49c361574b70242a6b752de6f9e0d426ca177f7a",
+        "6cc1423fe516548bd7311ec35e9c47ef08034d2d61c80d7f6118da48ed0ca6a449ab2002ab0d895914c772407dfe020cfe240c13ccf44046eb20c6db376ae9a8",
+        "eb6a1e71acd32714bee7408ae036747fefddd55359391d98849b136fda823b67",
+        "ed6a19aeeec3d80f588cc95d705e6c3244a0586d2b15fb0f27070f3002e864e0a27342e8672c6f900ca24c26718c189078e5d6d5e360b1ca58572084e57f9204"
+    },
+    {
+        NULL, 137,
+        "e2fa06eaa22fe60106af67d5f6ea093fe58f07d2dcfb06d51057953f114849a7",
+        "843678193223883fdf90cd83083542eb6b49b9084c9b0b2bf48540b187697e0ba52cb9b20f8bb90a6c6542e66b4b94781cab54b557e63b46282d4bc5302b36e9",
+        "e369c032b54b62fab0f9a43f0cb208cb6b8924c2ccabc6e996d38c826f1a9225",
+        "fb3cb4ff0b116bbe00040673d4767ef51798acaf30c24f66c73a79421954d698d1384f4f53525aec5b6586215a1f9f32e49fe6bb2947298ea2e1f598b9cb73df"
+    },
+    {
+        NULL, 167,
+        "782151e8ab9f2d8118a166e20097c0b096bcc4939f1884dd7a0a67c273912e20",
+        "c15a3fcac84da70d4d8ec7772a31209be88ad8c8b0d6d88b7827a26358ee530793071c7c155ec9057e62db66727505e91550c6827d9a06c876645ea13b488759",
+        "e783d770f81839ef4c1584c25275d85110fae5d7cb94ae5dbeebefb328c8034d",
+        "b9509d6c2a23f4ec4f68ae779ca9dd3338e74183a8e471cd81654c4647ca5583e579db9764c258a89da7ee8c57fe1e25514317cab3f8464500aa3bbc652b10fc"
+    },
+    {
+        NULL, 168,
+        "922063d55c0b80ca625a19b8835e7db24f2d4d0e8dda0e8d536bbdacdcc95251",
+        "9ab94664303124aea7f8d7afc29a9618619475f93b8ad136d787c62eadb42ad0048cb7f4aa94711d3b62417c915f367077ab54dcd20455253a9555599ece4db6",
+        "4d24ec06f7d2b3a71ca0a1b0f3ac5ce970beebd83008e7497dd72cfc34c967aa",
+        "15c485c7c3a991e4681dbb6042e223740801e81e7ff930a0b23facf15d21fd0b598441d4e591fe8662686efb11e274bc4ac4d22d0cdedf6252c98329e9653996"
+    },
+    {
+        NULL, 200,
+        "79f38adec5c20307a98ef76e8324afbfd46cfd81b22e3973c65fa1bd9de31787",
+        "e76dfad22084a8b1467fcf2ffa58361bec7628edf5f3fdc0e4805dc48caeeca81b7c13c30adf52a3659584739a2df46be589c51ca1a4a8416df6545a1ce8ba00",
+        "131ab8d2b594946b9c81333f9bb6e0ce75c3b93104fa3469d3917457385da037",
+        "cd8a920ed141aa0407a22d59288652e9d9f1a7ee0c1e7c1ca699424da84a904d2d700caae7396ece96604440577da4f3aa22aeb8857f961c4cd8e06f0ae6610b"
+    }
+};
+
+// Keccak-512 of "" with the original padding, as SHA3_compat computes it.
+
+static const char       kKeccak512Empty[] =
+    "0eab42de4c3ceb9235fc91acffe746b29c29a8c366b7c60e4e67c466f36a4304c00fa9caf9d87976ba469bcbe06713b435f091ef2769fb160cdab33d3670680e";
+
+// Bytes 168..199 of SHAKE128 and SHAKE256 over 1600 bits of 0xA3: the second squeezed block of SHAKE128.
+
+static const char       kSHAKE128A3Tail[] = "09ba9e94f7266122ed7ac24e5e266c42a82fa1bbefb7b8db0066e16a85e0493f";
+static const char       kSHAKE256A3Tail[] = "213e470618178001c9fb56c54fefa5fee67d2da524bb3b0b61ef0e9114a92cdb";
+
+static OSStatus _SHA3TestCompare( const uint8_t *inDigest, size_t inLen, const char *inHex )
+{
+    OSStatus        err;
+    char *          hex;
+
+    hex = DataToHexStringLowercase( inDigest, inLen );
+    require_action( hex, exit, err = kNoMemoryErr );
+    err = ( strcmp( hex, inHex ) == 0 ) ? kNoErr : kMismatchErr;
+    free( hex );
+    
+exit:
+    return( err );
+}
+
+//===========================================================================================================================
+//  SHA3_Test
+//===========================================================================================================================
+
+OSStatus    SHA3_Test( int print )
+{
+    OSStatus                err;
+    SHAKE_CTX_compat        shake;
+    SHA3_CTX_compat         sha3;
+    uint8_t *               msg = NULL;
+    uint8_t                 digest[ 64 ], digest2[ 64 ];
+    uint8_t                 out[ 200 ], out2[ 200 ];
+    size_t                  i, j, len;
+    uint32_t                t;
+    
+    t = mico_get_time();
+    msg = (uint8_t *) malloc( 200 );
+    require_action( msg, exit, err = kNoMemoryErr );
+    
+    for( i = 0; i < sizeof( kSHA3TestVectors ) / sizeof( kSHA3TestVectors[ 0 ] ); ++i )
+    {
+        const sha3_test_vector * const      tv = &kSHA3TestVectors[ i ];
+        
+        if( tv->data )
+        {
+            len = strlen( tv->data );
+            memcpy( msg, tv->data, len );
+        }
+        else
+        {
+            len = tv->len;
+            memset( msg, 0xA3, len );
+        }
+        
+        err = _SHA3TestCompare( SHA3_256_compat( msg, len, digest ), 32, tv->sha3_256 );
+        require_noerr_action( err, exit, if( print ) printf( "SHA3-256 vector %u failed\r\n", (unsigned int) i ) );
+        err = _SHA3TestCompare( SHA3_512_compat( msg, len, digest ), 64, tv->sha3_512 );
+        require_noerr_action( err, exit, if( print ) printf( "SHA3-512 vector %u failed\r\n", (unsigned int) i ) );
+        err = _SHA3TestCompare( SHAKE128_compat( msg, len, digest, 32 ), 32, tv->shake128 );
+        require_noerr_action( err, exit, if( print ) printf( "SHAKE128 vector %u failed\r\n", (unsigned int) i ) );
+        err = _SHA3TestCompare( SHAKE256_compat( msg, len, digest, 64 ), 64, tv->shake256 );
+        require_noerr_action( err, exit, if( print ) printf( "SHAKE256 vector %u failed\r\n", (unsigned int) i ) );
+        
+        // The same SHAKE256 output, absorbed a byte at a time and squeezed in two pieces.
+        
+        SHAKE256_Init_compat( &shake );
+        for( j = 0; j < len; ++j ) SHAKE_Update_compat( &shake, msg + j, 1 );
+        SHAKE_Squeeze_compat( &shake, digest2, 1 );
+        SHAKE_Squeeze_compat( &shake, digest2 + 1, 63 );
+        require_action( memcmp( digest, digest2, 64 ) == 0, exit, err = kMismatchErr );
+    }
+    
+    // Output longer than a block, read whole and in pieces that straddle the block boundary.
+    
+    memset( msg, 0xA3, 200 );
+    SHAKE128_compat( msg, 200, out, sizeof( out ) );
+    err = _SHA3TestCompare( out + 168, 32, kSHAKE128A3Tail );
+    require_noerr( err, exit );
+    SHAKE128_Init_compat( &shake );
+    SHAKE_Update_compat( &shake, msg, 100 );
+    SHAKE_Update_compat( &shake, msg + 100, 100 );
+    SHAKE_Squeeze_compat( &shake, out2, 7 );
+    SHAKE_Squeeze_compat( &shake, out2 + 7, 160 );
+    SHAKE_Squeeze_compat( &shake, out2 + 167, 33 );
+    require_action( memcmp( out, out2, sizeof( out ) ) == 0, exit, err = kMismatchErr );
+    require_action( SHAKE_Update_compat( &shake, msg, 1 ) == kStateErr, exit, err = kStateErr );
+    
+    SHAKE256_compat( msg, 200, out, sizeof( out ) );
+    err = _SHA3TestCompare( out + 168, 32, kSHAKE256A3Tail );
+    require_noerr( err, exit );
+    
+    // Keccak-512 keeps its original padding, fed whole or a byte at a time.
+    
+    err = _SHA3TestCompare( SHA3_compat( "", 0, digest ), 64, kKeccak512Empty );
+    require_noerr( err, exit );
+    SHA3_compat( msg, 200, digest );
+    SHA3_Init_compat( &sha3 );
+    for( j = 0; j < 200; ++j ) SHA3_Update_compat( &sha3, msg + j, 1 );
+    SHA3_Final_compat( digest2, &sha3 );
+    require_action( memcmp( digest, digest2, 64 ) == 0, exit, err = kMismatchErr );
+    
+exit:
+    if( msg ) free( msg );
+    printf( "%s: %s (%u ms)\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED", (unsigned int)( mico_get_time() - t ) );
+    return( err );
+}
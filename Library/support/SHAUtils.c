@@ -426,25 +426,37 @@ static void _SHA512_Compress( SHA512_CTX_compat *ctx, const uint8_t *inPtr )
 //  SHA-3 internals
 //
 //  Based on code from <https://github.com/floodyberry>.
+//
+//  The state is kept bit-interleaved so the permutation only needs 32-bit operations: each 64-bit lane is stored as
+//  two words, the even-numbered bits followed by the odd-numbered bits. A 64-bit rotate by an even count is then two
+//  32-bit rotates by half the count and a rotate by an odd count also swaps the two halves. Input and output are
+//  converted a whole lane at a time.
 //===========================================================================================================================
 
-static const uint64_t       kSHA3RoundConstants[24] = 
+// Round constants, bit-interleaved (even word, odd word).
+
+static const uint32_t       kSHA3RoundConstants[48] =
 {
-    UINT64_C( 0x0000000000000001 ), UINT64_C( 0x0000000000008082 ),
-    UINT64_C( 0x800000000000808a ), UINT64_C( 0x8000000080008000 ),
-    UINT64_C( 0x000000000000808b ), UINT64_C( 0x0000000080000001 ),
-    UINT64_C( 0x8000000080008081 ), UINT64_C( 0x8000000000008009 ),
-    UINT64_C( 0x000000000000008a ), UINT64_C( 0x0000000000000088 ),
-    UINT64_C( 0x0000000080008009 ), UINT64_C( 0x000000008000000a ),
-    UINT64_C( 0x000000008000808b ), UINT64_C( 0x800000000000008b ),
-    UINT64_C( 0x8000000000008089 ), UINT64_C( 0x8000000000008003 ),
-    UINT64_C( 0x8000000000008002 ), UINT64_C( 0x8000000000000080 ),
-    UINT64_C( 0x000000000000800a ), UINT64_C( 0x800000008000000a ),
-    UINT64_C( 0x8000000080008081 ), UINT64_C( 0x8000000000008080 ),
-    UINT64_C( 0x0000000080000001 ), UINT64_C( 0x8000000080008008 )
+    UINT32_C( 0x00000001 ), UINT32_C( 0x00000000 ), UINT32_C( 0x00000000 ), UINT32_C( 0x00000089 ),
+    UINT32_C( 0x00000000 ), UINT32_C( 0x8000008B ), UINT32_C( 0x00000000 ), UINT32_C( 0x80008080 ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x0000008B ), UINT32_C( 0x00000001 ), UINT32_C( 0x00008000 ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x80008088 ), UINT32_C( 0x00000001 ), UINT32_C( 0x80000082 ),
+    UINT32_C( 0x00000000 ), UINT32_C( 0x0000000B ), UINT32_C( 0x00000000 ), UINT32_C( 0x0000000A ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x00008082 ), UINT32_C( 0x00000000 ), UINT32_C( 0x00008003 ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x0000808B ), UINT32_C( 0x00000001 ), UINT32_C( 0x8000000B ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x8000008A ), UINT32_C( 0x00000001 ), UINT32_C( 0x80000081 ),
+    UINT32_C( 0x00000000 ), UINT32_C( 0x80000081 ), UINT32_C( 0x00000000 ), UINT32_C( 0x80000008 ),
+    UINT32_C( 0x00000000 ), UINT32_C( 0x00000083 ), UINT32_C( 0x00000000 ), UINT32_C( 0x80008003 ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x80008088 ), UINT32_C( 0x00000000 ), UINT32_C( 0x80000088 ),
+    UINT32_C( 0x00000001 ), UINT32_C( 0x00008000 ), UINT32_C( 0x00000000 ), UINT32_C( 0x80008082 )
 };
 
-static void _SHA3_Block( SHA3_CTX_compat *ctx, const uint8_t *in );
+static void _KeccakUpdate( uint32_t *inState, size_t inRate, uint8_t *inBuffer, size_t *ioLeftover,
+                           const uint8_t *inData, size_t inLen );
+static void _KeccakPad( uint32_t *inState, size_t inRate, uint8_t *inBuffer, size_t inLeftover, uint8_t inSuffix );
+static void _KeccakAbsorb( uint32_t *inState, const uint8_t *inData, size_t inLaneCount );
+static void _KeccakExtract( const uint32_t *inState, uint8_t *outData, size_t inLaneCount );
+static void _KeccakF1600( uint32_t *inState );
 
 //===========================================================================================================================
 //  SHA3_Init_compat
@@ -462,66 +474,30 @@ int SHA3_Init_compat( SHA3_CTX_compat *ctx )
 
 int SHA3_Update_compat( SHA3_CTX_compat *ctx, const void *inData, size_t inLen )
 {
-    const uint8_t *     in = (const uint8_t *) inData;
-    size_t              want;
-    
-    // Handle the previous data.
-    if( ctx->leftover > 0 )
-    {
-        want = SHA3_BLOCK_SIZE - ctx->leftover;
-        want = ( want < inLen ) ? want : inLen;
-        memcpy( ctx->buffer + ctx->leftover, in, want );
-        ctx->leftover += want;
-        if( ctx->leftover < SHA3_BLOCK_SIZE ) goto exit;
-        in    += want;
-        inLen -= want;
-        _SHA3_Block( ctx, ctx->buffer );
-    }
-    
-    // Handle the current data.
-    while( inLen >= SHA3_BLOCK_SIZE )
-    {
-        _SHA3_Block( ctx, in );
-        in    += SHA3_BLOCK_SIZE;
-        inLen -= SHA3_BLOCK_SIZE;
-    }
-    
-    // Handle leftover data.
-    ctx->leftover = inLen;
-    if( inLen > 0 ) memcpy( ctx->buffer, in, inLen );
-    
-exit:
+    _KeccakUpdate( ctx->state, SHA3_BLOCK_SIZE, ctx->buffer, &ctx->leftover, (const uint8_t *) inData, inLen );
     return( 0 );
 }
 
 //===========================================================================================================================
-//  SHA3_Update_compat
+//  SHA3_Final_compat
 //===========================================================================================================================
 
 int SHA3_Final_compat( uint8_t *outDigest, SHA3_CTX_compat *ctx )
 {
-    size_t      i;
-    
-    ctx->buffer[ctx->leftover] = 0x01;
-    memset( ctx->buffer + ( ctx->leftover + 1 ), 0, SHA3_BLOCK_SIZE - ( ctx->leftover + 1 ) );
-    ctx->buffer[SHA3_BLOCK_SIZE - 1] |= 0x80;
-    _SHA3_Block( ctx, ctx->buffer );
-
-    for( i = 0; i < SHA3_DIGEST_LENGTH; i += 8 )
-    {
-        WriteLittle64( &outDigest[i], ctx->state[i / 8] );
-    }
+    _KeccakPad( ctx->state, SHA3_BLOCK_SIZE, ctx->buffer, ctx->leftover, 0x01 );
+    _KeccakF1600( ctx->state );
+    _KeccakExtract( ctx->state, outDigest, SHA3_DIGEST_LENGTH / 8 );
     return( 0 );
 }
 
 //===========================================================================================================================
-//  SHA3_Update_compat
+//  SHA3_compat
 //===========================================================================================================================
 
 uint8_t *   SHA3_compat( const void *inData, size_t inLen, uint8_t outDigest[64] )
 {
     SHA3_CTX_compat     ctx;
-    
+
     SHA3_Init_compat( &ctx );
     SHA3_Update_compat( &ctx, inData, inLen );
     SHA3_Final_compat( outDigest, &ctx );
@@ -529,159 +505,347 @@ uint8_t *   SHA3_compat( const void *inData, size_t inLen, uint8_t outDigest[64]
 }
 
 //===========================================================================================================================
-//  _SHA3_Block
+//  SHA3_256_compat / SHA3_512_compat
+//
+//  FIPS 202 SHA3-256 and SHA3-512: the 01 domain bits before the pad give the 0x06 suffix.
 //===========================================================================================================================
 
-static void _SHA3_Block( SHA3_CTX_compat *ctx, const uint8_t *in )
+static uint8_t *    _SHA3FIPS( size_t inRate, const void *inData, size_t inLen, uint8_t *outDigest, size_t inDigestLen )
 {
-    uint64_t        s0, s1, s2, s3, s4, s5, s6, s7, s8, s9, s10;
-    uint64_t        s11, s12, s13, s14, s15, s16, s17, s18, s19, s20;
-    uint64_t        s21, s22, s23, s24;
-    uint64_t        t0, t1, t2, t3, t4, u0, u1, u2, u3, u4, v, w;
-    size_t          i;
-    
-    s0  = ctx->state[ 0] ^ ReadLittle64( &in[0] );
-    s1  = ctx->state[ 1] ^ ReadLittle64( &in[8] );
-    s2  = ctx->state[ 2] ^ ReadLittle64( &in[16] );
-    s3  = ctx->state[ 3] ^ ReadLittle64( &in[24] );
-    s4  = ctx->state[ 4] ^ ReadLittle64( &in[32] );
-    s5  = ctx->state[ 5] ^ ReadLittle64( &in[40] );
-    s6  = ctx->state[ 6] ^ ReadLittle64( &in[48] );
-    s7  = ctx->state[ 7] ^ ReadLittle64( &in[56] );
-    s8  = ctx->state[ 8] ^ ReadLittle64( &in[64] );
-    s9  = ctx->state[ 9];
-    s10 = ctx->state[10];
-    s11 = ctx->state[11];
-    s12 = ctx->state[12];
-    s13 = ctx->state[13];
-    s14 = ctx->state[14];
-    s15 = ctx->state[15];
-    s16 = ctx->state[16];
-    s17 = ctx->state[17];
-    s18 = ctx->state[18];
-    s19 = ctx->state[19];
-    s20 = ctx->state[20];
-    s21 = ctx->state[21];
-    s22 = ctx->state[22];
-    s23 = ctx->state[23];
-    s24 = ctx->state[24];
-    
-    for( i = 0; i < 24; ++i )
+    SHAKE_CTX_compat        ctx;
+
+    memset( &ctx, 0, sizeof( ctx ) );
+    _KeccakUpdate( ctx.state, inRate, ctx.buffer, &ctx.leftover, (const uint8_t *) inData, inLen );
+    _KeccakPad( ctx.state, inRate, ctx.buffer, ctx.leftover, 0x06 );
+    _KeccakF1600( ctx.state );
+    _KeccakExtract( ctx.state, outDigest, inDigestLen / 8 );
+    memset( &ctx, 0, sizeof( ctx ) ); // Zero sensitive info.
+    return( outDigest );
+}
+
+uint8_t *   SHA3_256_compat( const void *inData, size_t inLen, uint8_t outDigest[32] )
+{
+    return( _SHA3FIPS( SHA3_256_BLOCK_SIZE, inData, inLen, outDigest, SHA3_256_DIGEST_LENGTH ) );
+}
+
+uint8_t *   SHA3_512_compat( const void *inData, size_t inLen, uint8_t outDigest[64] )
+{
+    return( _SHA3FIPS( SHA3_BLOCK_SIZE, inData, inLen, outDigest, SHA3_512_DIGEST_LENGTH ) );
+}
+
+//===========================================================================================================================
+//  SHAKE128_Init_compat
+//===========================================================================================================================
+
+int SHAKE128_Init_compat( SHAKE_CTX_compat *ctx )
+{
+    memset( ctx, 0, sizeof( *ctx ) );
+    ctx->rate = SHAKE128_BLOCK_SIZE;
+    return( 0 );
+}
+
+//===========================================================================================================================
+//  SHAKE256_Init_compat
+//===========================================================================================================================
+
+int SHAKE256_Init_compat( SHAKE_CTX_compat *ctx )
+{
+    memset( ctx, 0, sizeof( *ctx ) );
+    ctx->rate = SHAKE256_BLOCK_SIZE;
+    return( 0 );
+}
+
+//===========================================================================================================================
+//  SHAKE_Update_compat
+//===========================================================================================================================
+
+int SHAKE_Update_compat( SHAKE_CTX_compat *ctx, const void *inData, size_t inLen )
+{
+    if( ctx->squeezing ) return( kStateErr );
+    _KeccakUpdate( ctx->state, ctx->rate, ctx->buffer, &ctx->leftover, (const uint8_t *) inData, inLen );
+    return( 0 );
+}
+
+//===========================================================================================================================
+//  SHAKE_Squeeze_compat
+//===========================================================================================================================
+
+int SHAKE_Squeeze_compat( SHAKE_CTX_compat *ctx, void *outData, size_t outLen )
+{
+    uint8_t *       dst = (uint8_t *) outData;
+    size_t          n;
+
+    // The first squeeze ends the input. The buffer then holds the unread output of the current block.
+    if( !ctx->squeezing )
     {
-        // theta: c = a[0,i] ^ a[1,i] ^ .. a[4,i]
-        t0 = s0 ^ s5 ^ s10 ^ s15 ^ s20;
-        t1 = s1 ^ s6 ^ s11 ^ s16 ^ s21;
-        t2 = s2 ^ s7 ^ s12 ^ s17 ^ s22;
-        t3 = s3 ^ s8 ^ s13 ^ s18 ^ s23;
-        t4 = s4 ^ s9 ^ s14 ^ s19 ^ s24;
-
-        // theta: d[i] = c[i+4] ^ rotl(c[i+1],1)
-        u0 = t4 ^ ROTL64(t1, 1);
-        u1 = t0 ^ ROTL64(t2, 1);
-        u2 = t1 ^ ROTL64(t3, 1);
-        u3 = t2 ^ ROTL64(t4, 1);
-        u4 = t3 ^ ROTL64(t0, 1);
-
-        // theta: a[0,i], a[1,i], .. a[4,i] ^= d[i]
-        s0 ^= u0; s5 ^= u0; s10 ^= u0; s15 ^= u0; s20 ^= u0;
-        s1 ^= u1; s6 ^= u1; s11 ^= u1; s16 ^= u1; s21 ^= u1;
-        s2 ^= u2; s7 ^= u2; s12 ^= u2; s17 ^= u2; s22 ^= u2;
-        s3 ^= u3; s8 ^= u3; s13 ^= u3; s18 ^= u3; s23 ^= u3;
-        s4 ^= u4; s9 ^= u4; s14 ^= u4; s19 ^= u4; s24 ^= u4;
-
-        // rho pi: b[..] = rotl(a[..], ..)
-        v   = s1;
-        s1  = ROTL64(s6,  44);
-        s6  = ROTL64(s9,  20);
-        s9  = ROTL64(s22, 61);
-        s22 = ROTL64(s14, 39);
-        s14 = ROTL64(s20, 18);
-        s20 = ROTL64(s2,  62);
-        s2  = ROTL64(s12, 43);
-        s12 = ROTL64(s13, 25);
-        s13 = ROTL64(s19,  8);
-        s19 = ROTL64(s23, 56);
-        s23 = ROTL64(s15, 41);
-        s15 = ROTL64(s4,  27);
-        s4  = ROTL64(s24, 14);
-        s24 = ROTL64(s21,  2);
-        s21 = ROTL64(s8,  55);
-        s8  = ROTL64(s16, 45);
-        s16 = ROTL64(s5,  36);
-        s5  = ROTL64(s3,  28);
-        s3  = ROTL64(s18, 21);
-        s18 = ROTL64(s17, 15);
-        s17 = ROTL64(s11, 10);
-        s11 = ROTL64(s7,   6);
-        s7  = ROTL64(s10,  3);
-        s10 = ROTL64(v,    1);
-        
-        // chi: a[i,j] ^= ~b[i,j+1] & b[i,j+2]
-        v = s0;
-        w = s1;
-        s0 ^= (~w)  & s2;
-        s1 ^= (~s2) & s3;
-        s2 ^= (~s3) & s4;
-        s3 ^= (~s4) & v;
-        s4 ^= (~v)  & w;
-        v = s5;
-        w = s6;
-        s5 ^= (~w)  & s7;
-        s6 ^= (~s7) & s8;
-        s7 ^= (~s8) & s9;
-        s8 ^= (~s9) & v;
-        s9 ^= (~v)  & w;
-        v = s10;
-        w = s11;
-        s10 ^= (~w)   & s12;
-        s11 ^= (~s12) & s13;
-        s12 ^= (~s13) & s14;
-        s13 ^= (~s14) & v;
-        s14 ^= (~v)  & w;
-        v = s15;
-        w = s16;
-        s15 ^= (~w)   & s17;
-        s16 ^= (~s17) & s18;
-        s17 ^= (~s18) & s19;
-        s18 ^= (~s19) & v;
-        s19 ^= (~v)   & w;
-        v = s20;
-        w = s21;
-        s20 ^= (~w)   & s22;
-        s21 ^= (~s22) & s23;
-        s22 ^= (~s23) & s24;
-        s23 ^= (~s24) & v;
-        s24 ^= (~v)   & w;
-        
-        // iota: a[0,0] ^= round constant
-        s0 ^= kSHA3RoundConstants[i];
+        _KeccakPad( ctx->state, ctx->rate, ctx->buffer, ctx->leftover, 0x1F );
+        ctx->leftover  = ctx->rate;
+        ctx->squeezing = 1;
     }
-    
-    ctx->state[ 0] = s0;
-    ctx->state[ 1] = s1;
-    ctx->state[ 2] = s2;
-    ctx->state[ 3] = s3;
-    ctx->state[ 4] = s4;
-    ctx->state[ 5] = s5;
-    ctx->state[ 6] = s6;
-    ctx->state[ 7] = s7;
-    ctx->state[ 8] = s8;
-    ctx->state[ 9] = s9;
-    ctx->state[10] = s10;
-    ctx->state[11] = s11;
-    ctx->state[12] = s12;
-    ctx->state[13] = s13;
-    ctx->state[14] = s14;
-    ctx->state[15] = s15;
-    ctx->state[16] = s16;
-    ctx->state[17] = s17;
-    ctx->state[18] = s18;
-    ctx->state[19] = s19;
-    ctx->state[20] = s20;
-    ctx->state[21] = s21;
-    ctx->state[22] = s22;
-    ctx->state[23] = s23;
-    ctx->state[24] = s24;
+
+    while( outLen > 0 )
+    {
+        if( ctx->leftover == ctx->rate )
+        {
+            _KeccakF1600( ctx->state );
+            if( outLen >= ctx->rate )
+            {
+                // Whole blocks go straight to the caller's buffer.
+                _KeccakExtract( ctx->state, dst, ctx->rate / 8 );
+                dst    += ctx->rate;
+                outLen -= ctx->rate;
+                continue;
+            }
+            _KeccakExtract( ctx->state, ctx->buffer, ctx->rate / 8 );
+            ctx->leftover = 0;
+        }
+        n = Min( outLen, ctx->rate - ctx->leftover );
+        memcpy( dst, ctx->buffer + ctx->leftover, n );
+        ctx->leftover += n;
+        dst           += n;
+        outLen        -= n;
+    }
+    return( 0 );
+}
+
+//===========================================================================================================================
+//  SHAKE128_compat
+//===========================================================================================================================
+
+uint8_t *   SHAKE128_compat( const void *inData, size_t inLen, void *outData, size_t outLen )
+{
+    SHAKE_CTX_compat        ctx;
+
+    SHAKE128_Init_compat( &ctx );
+    SHAKE_Update_compat( &ctx, inData, inLen );
+    SHAKE_Squeeze_compat( &ctx, outData, outLen );
+    memset( &ctx, 0, sizeof( ctx ) ); // Zero sensitive info.
+    return( (uint8_t *) outData );
+}
+
+//===========================================================================================================================
+//  SHAKE256_compat
+//===========================================================================================================================
+
+uint8_t *   SHAKE256_compat( const void *inData, size_t inLen, void *outData, size_t outLen )
+{
+    SHAKE_CTX_compat        ctx;
+
+    SHAKE256_Init_compat( &ctx );
+    SHAKE_Update_compat( &ctx, inData, inLen );
+    SHAKE_Squeeze_compat( &ctx, outData, outLen );
+    memset( &ctx, 0, sizeof( ctx ) ); // Zero sensitive info.
+    return( (uint8_t *) outData );
+}
+
+//===========================================================================================================================
+//  _KeccakUpdate
+//===========================================================================================================================
+
+static void
+    _KeccakUpdate(
+        uint32_t *      inState,
+        size_t          inRate,
+        uint8_t *       inBuffer,
+        size_t *        ioLeftover,
+        const uint8_t * inData,
+        size_t          inLen )
+{
+    size_t      want;
+
+    // Handle the previous data.
+    if( *ioLeftover > 0 )
+    {
+        want = inRate - *ioLeftover;
+        want = ( want < inLen ) ? want : inLen;
+        memcpy( inBuffer + *ioLeftover, inData, want );
+        *ioLeftover += want;
+        if( *ioLeftover < inRate ) return;
+        inData += want;
+        inLen  -= want;
+        _KeccakAbsorb( inState, inBuffer, inRate / 8 );
+        _KeccakF1600( inState );
+    }
+
+    // Handle the current data.
+    while( inLen >= inRate )
+    {
+        _KeccakAbsorb( inState, inData, inRate / 8 );
+        _KeccakF1600( inState );
+        inData += inRate;
+        inLen  -= inRate;
+    }
+
+    // Handle leftover data.
+    *ioLeftover = inLen;
+    if( inLen > 0 ) memcpy( inBuffer, inData, inLen );
 }
 
+//===========================================================================================================================
+//  _KeccakPad
+//
+//  Pads the buffered data with the domain suffix and the final bit and absorbs it, without the last permutation.
+//===========================================================================================================================
+
+static void _KeccakPad( uint32_t *inState, size_t inRate, uint8_t *inBuffer, size_t inLeftover, uint8_t inSuffix )
+{
+    inBuffer[ inLeftover ] = inSuffix;
+    memset( inBuffer + ( inLeftover + 1 ), 0, inRate - ( inLeftover + 1 ) );
+    inBuffer[ inRate - 1 ] |= 0x80;
+    _KeccakAbsorb( inState, inBuffer, inRate / 8 );
+}
+
+//===========================================================================================================================
+//  _KeccakAbsorb
+//
+//  XORs whole little endian lanes into the bit-interleaved state. Each 32-bit half of a lane has its even bits gathered
+//  into the low 16 bits and its odd bits into the high 16 bits with a sequence of delta swaps.
+//===========================================================================================================================
+
+#define KeccakUnshuffle32( X, T ) \
+    do \
+    { \
+        (T) = ( (X) ^ ( (X) >> 1 ) ) & UINT32_C( 0x22222222 ); (X) ^= (T) ^ ( (T) << 1 ); \
+        (T) = ( (X) ^ ( (X) >> 2 ) ) & UINT32_C( 0x0C0C0C0C ); (X) ^= (T) ^ ( (T) << 2 ); \
+        (T) = ( (X) ^ ( (X) >> 4 ) ) & UINT32_C( 0x00F000F0 ); (X) ^= (T) ^ ( (T) << 4 ); \
+        (T) = ( (X) ^ ( (X) >> 8 ) ) & UINT32_C( 0x0000FF00 ); (X) ^= (T) ^ ( (T) << 8 ); \
+        \
+    }   while( 0 )
+
+#define KeccakShuffle32( X, T ) \
+    do \
+    { \
+        (T) = ( (X) ^ ( (X) >> 8 ) ) & UINT32_C( 0x0000FF00 ); (X) ^= (T) ^ ( (T) << 8 ); \
+        (T) = ( (X) ^ ( (X) >> 4 ) ) & UINT32_C( 0x00F000F0 ); (X) ^= (T) ^ ( (T) << 4 ); \
+        (T) = ( (X) ^ ( (X) >> 2 ) ) & UINT32_C( 0x0C0C0C0C ); (X) ^= (T) ^ ( (T) << 2 ); \
+        (T) = ( (X) ^ ( (X) >> 1 ) ) & UINT32_C( 0x22222222 ); (X) ^= (T) ^ ( (T) << 1 ); \
+        \
+    }   while( 0 )
+
+static void _KeccakAbsorb( uint32_t *inState, const uint8_t *inData, size_t inLaneCount )
+{
+    uint32_t        lo, hi, t;
+
+    for( ; inLaneCount > 0; --inLaneCount )
+    {
+        lo = ReadLittle32( inData );
+        hi = ReadLittle32( inData + 4 );
+        KeccakUnshuffle32( lo, t );
+        KeccakUnshuffle32( hi, t );
+        inState[ 0 ] ^= ( lo & UINT32_C( 0x0000FFFF ) ) | ( hi << 16 );
+        inState[ 1 ] ^= ( lo >> 16 ) | ( hi & UINT32_C( 0xFFFF0000 ) );
+        inState += 2;
+        inData  += 8;
+    }
+}
 
+//===========================================================================================================================
+//  _KeccakExtract
+//===========================================================================================================================
+
+static void _KeccakExtract( const uint32_t *inState, uint8_t *outData, size_t inLaneCount )
+{
+    uint32_t        lo, hi, t;
+
+    for( ; inLaneCount > 0; --inLaneCount )
+    {
+        lo = ( inState[ 0 ] & UINT32_C( 0x0000FFFF ) ) | ( inState[ 1 ] << 16 );
+        hi = ( inState[ 0 ] >> 16 ) | ( inState[ 1 ] & UINT32_C( 0xFFFF0000 ) );
+        KeccakShuffle32( lo, t );
+        KeccakShuffle32( hi, t );
+        WriteLittle32( outData, lo );
+        WriteLittle32( outData + 4, hi );
+        inState += 2;
+        outData += 8;
+    }
+}
+
+//===========================================================================================================================
+//  _KeccakF1600
+//
+//  Each round reads one copy of the state and writes the other so the rho and pi steps need no moves. Lanes are
+//  numbered x + 5y and a row of the output takes 5 lanes of the input, each XORed with its theta column parity and
+//  rotated by its rho offset, through chi.
+//===========================================================================================================================
+
+// Rotate by 0..31. A count of 0 must not shift by 32.
+#define KeccakROTL32( X, N )    ( ( (X) << (N) ) | ( (X) >> ( ( 32 - (N) ) & 31 ) ) )
+
+// Half H (0 = even bits, 1 = odd bits) of input lane L after theta and a 64-bit rotate left by R.
+#define KeccakB( A, D, L, R, H ) \
+    ( ( (R) & 1 ) ? \
+        ( ( (H) == 0 ) ? \
+            KeccakROTL32( (A)[ 2 * (L) + 1 ] ^ (D)[ 2 * ( (L) % 5 ) + 1 ], ( (R) + 1 ) / 2 ) : \
+            KeccakROTL32( (A)[ 2 * (L) ] ^ (D)[ 2 * ( (L) % 5 ) ], (R) / 2 ) ) : \
+        KeccakROTL32( (A)[ 2 * (L) + (H) ] ^ (D)[ 2 * ( (L) % 5 ) + (H) ], (R) / 2 ) )
+
+// Half H of output row Y from input lanes L0..L4 with rho offsets R0..R4.
+#define KeccakRow( A, E, D, Y, H, L0, R0, L1, R1, L2, R2, L3, R3, L4, R4 ) \
+    do \
+    { \
+        b0 = KeccakB( A, D, L0, R0, H ); \
+        b1 = KeccakB( A, D, L1, R1, H ); \
+        b2 = KeccakB( A, D, L2, R2, H ); \
+        b3 = KeccakB( A, D, L3, R3, H ); \
+        b4 = KeccakB( A, D, L4, R4, H ); \
+        (E)[ 10 * (Y) + 0 + (H) ] = b0 ^ ( ~b1 & b2 ); \
+        (E)[ 10 * (Y) + 2 + (H) ] = b1 ^ ( ~b2 & b3 ); \
+        (E)[ 10 * (Y) + 4 + (H) ] = b2 ^ ( ~b3 & b4 ); \
+        (E)[ 10 * (Y) + 6 + (H) ] = b3 ^ ( ~b4 & b0 ); \
+        (E)[ 10 * (Y) + 8 + (H) ] = b4 ^ ( ~b0 & b1 ); \
+        \
+    }   while( 0 )
+
+#define KeccakRound( A, E, RC ) \
+    do \
+    { \
+        /* theta: c[x] = a[x,0] ^ a[x,1] ^ .. a[x,4] */ \
+        c0 = (A)[ 0] ^ (A)[10] ^ (A)[20] ^ (A)[30] ^ (A)[40]; \
+        c1 = (A)[ 1] ^ (A)[11] ^ (A)[21] ^ (A)[31] ^ (A)[41]; \
+        c2 = (A)[ 2] ^ (A)[12] ^ (A)[22] ^ (A)[32] ^ (A)[42]; \
+        c3 = (A)[ 3] ^ (A)[13] ^ (A)[23] ^ (A)[33] ^ (A)[43]; \
+        c4 = (A)[ 4] ^ (A)[14] ^ (A)[24] ^ (A)[34] ^ (A)[44]; \
+        c5 = (A)[ 5] ^ (A)[15] ^ (A)[25] ^ (A)[35] ^ (A)[45]; \
+        c6 = (A)[ 6] ^ (A)[16] ^ (A)[26] ^ (A)[36] ^ (A)[46]; \
+        c7 = (A)[ 7] ^ (A)[17] ^ (A)[27] ^ (A)[37] ^ (A)[47]; \
+        c8 = (A)[ 8] ^ (A)[18] ^ (A)[28] ^ (A)[38] ^ (A)[48]; \
+        c9 = (A)[ 9] ^ (A)[19] ^ (A)[29] ^ (A)[39] ^ (A)[49]; \
+        \
+        /* theta: d[x] = c[x-1] ^ rotl(c[x+1], 1) */ \
+        d[0] = c8 ^ KeccakROTL32( c3, 1 ); d[1] = c9 ^ c2; \
+        d[2] = c0 ^ KeccakROTL32( c5, 1 ); d[3] = c1 ^ c4; \
+        d[4] = c2 ^ KeccakROTL32( c7, 1 ); d[5] = c3 ^ c6; \
+        d[6] = c4 ^ KeccakROTL32( c9, 1 ); d[7] = c5 ^ c8; \
+        d[8] = c6 ^ KeccakROTL32( c1, 1 ); d[9] = c7 ^ c0; \
+        \
+        /* theta, rho, pi, chi */ \
+        KeccakRow( A, E, d, 0, 0,  0,  0,  6, 44, 12, 43, 18, 21, 24, 14 ); \
+        KeccakRow( A, E, d, 0, 1,  0,  0,  6, 44, 12, 43, 18, 21, 24, 14 ); \
+        KeccakRow( A, E, d, 1, 0,  3, 28,  9, 20, 10,  3, 16, 45, 22, 61 ); \
+        KeccakRow( A, E, d, 1, 1,  3, 28,  9, 20, 10,  3, 16, 45, 22, 61 ); \
+        KeccakRow( A, E, d, 2, 0,  1,  1,  7,  6, 13, 25, 19,  8, 20, 18 ); \
+        KeccakRow( A, E, d, 2, 1,  1,  1,  7,  6, 13, 25, 19,  8, 20, 18 ); \
+        KeccakRow( A, E, d, 3, 0,  4, 27,  5, 36, 11, 10, 17, 15, 23, 56 ); \
+        KeccakRow( A, E, d, 3, 1,  4, 27,  5, 36, 11, 10, 17, 15, 23, 56 ); \
+        KeccakRow( A, E, d, 4, 0,  2, 62,  8, 55, 14, 39, 15, 41, 21,  2 ); \
+        KeccakRow( A, E, d, 4, 1,  2, 62,  8, 55, 14, 39, 15, 41, 21,  2 ); \
+        \
+        /* iota: a[0,0] ^= round constant */ \
+        (E)[ 0 ] ^= (RC)[ 0 ]; \
+        (E)[ 1 ] ^= (RC)[ 1 ]; \
+        \
+    }   while( 0 )
+
+static void _KeccakF1600( uint32_t *inState )
+{
+    uint32_t            e[ 50 ], d[ 10 ];
+    uint32_t            c0, c1, c2, c3, c4, c5, c6, c7, c8, c9;
+    uint32_t            b0, b1, b2, b3, b4;
+    const uint32_t *    rc;
+
+    for( rc = kSHA3RoundConstants; rc < &kSHA3RoundConstants[ 48 ]; rc += 4 )
+    {
+        KeccakRound( inState, e, rc );
+        KeccakRound( e, inState, rc + 2 );
+    }
+}
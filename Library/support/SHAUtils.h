@@ -64,6 +64,9 @@ unsigned char * SHA512_compat( const void *inData, size_t inLen, unsigned char *
 
 //===========================================================================================================================
 //  SHA-3 (Keccak)
+//
+//  SHA3_*_compat is Keccak-512 as it was before FIPS 202 changed the padding, kept for the data already hashed with it.
+//  SHA3_256_compat and SHA3_512_compat are the FIPS 202 functions.
 //===========================================================================================================================
 
 #define SHA3_DIGEST_LENGTH      64
@@ -74,7 +77,7 @@ unsigned char * SHA512_compat( const void *inData, size_t inLen, unsigned char *
 
 typedef struct
 {
-    uint64_t        state[ SHA3_F / 64 ];
+    uint32_t        state[ SHA3_F / 32 ];   // Bit-interleaved: even bits then odd bits of each lane.
     size_t          leftover;
     uint8_t         buffer[ SHA3_BLOCK_SIZE ];
     
@@ -85,6 +88,40 @@ int SHA3_Update_compat( SHA3_CTX_compat *ctx, const void *inData, size_t inLen )
 int SHA3_Final_compat( unsigned char *outDigest, SHA3_CTX_compat *ctx );
 uint8_t *   SHA3_compat( const void *inData, size_t inLen, uint8_t outDigest[ 64 ] );
 
+#define SHA3_256_DIGEST_LENGTH  32
+#define SHA3_256_BLOCK_SIZE     136
+#define SHA3_512_DIGEST_LENGTH  64
+
+uint8_t *   SHA3_256_compat( const void *inData, size_t inLen, uint8_t outDigest[ 32 ] );
+uint8_t *   SHA3_512_compat( const void *inData, size_t inLen, uint8_t outDigest[ 64 ] );
+
+//===========================================================================================================================
+//  SHAKE128 / SHAKE256 (FIPS 202 extendable output)
+//
+//  Absorb with SHAKE_Update_compat, then call SHAKE_Squeeze_compat as many times as needed to read output of any length.
+//  Update fails with kStateErr once squeezing has started.
+//===========================================================================================================================
+
+#define SHAKE128_BLOCK_SIZE     168
+#define SHAKE256_BLOCK_SIZE     136
+
+typedef struct
+{
+    uint32_t        state[ SHA3_F / 32 ];   // Bit-interleaved: even bits then odd bits of each lane.
+    size_t          rate;
+    size_t          leftover;               // Absorbing: bytes buffered. Squeezing: bytes of the block already read.
+    int             squeezing;
+    uint8_t         buffer[ SHAKE128_BLOCK_SIZE ];
+    
+}   SHAKE_CTX_compat;
+
+int SHAKE128_Init_compat( SHAKE_CTX_compat *ctx );
+int SHAKE256_Init_compat( SHAKE_CTX_compat *ctx );
+int SHAKE_Update_compat( SHAKE_CTX_compat *ctx, const void *inData, size_t inLen );
+int SHAKE_Squeeze_compat( SHAKE_CTX_compat *ctx, void *outData, size_t outLen );
+uint8_t *   SHAKE128_compat( const void *inData, size_t inLen, void *outData, size_t outLen );
+uint8_t *   SHAKE256_compat( const void *inData, size_t inLen, void *outData, size_t outLen );
+
 #endif // __SHAUtils_h_
 
 
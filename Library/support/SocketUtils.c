@@ -72,6 +72,75 @@ exit:
     return err;
 }
 
+/* Gather send. The segments always go out in one write: with Nagle's algorithm on, a short write behind another one
+   is held until the peer ACKs the first, and the peer may delay that ACK by up to 200 ms. When they don't fit in the
+   staging buffer on the stack they are copied into one buffer of their total length for the write. Only if that
+   can't be allocated segments shorter than the staging buffer are collected on the stack and longer ones are written
+   straight from the caller's memory. */
+#define kSocketSendvStagingSize   256
+
+OSStatus SocketSendv( int fd, const SocketIOVec_t *inVec, int inVecCount )
+{
+    OSStatus err = kParamErr;
+    uint8_t staging[ kSocketSendvStagingSize ];
+    uint8_t *buf;
+    size_t stagingLen = 0;
+    size_t totalLen = 0;
+    int i;
+
+    require( fd>=0, exit );
+    require( inVec, exit );
+
+    for( i = 0; i < inVecCount; i++ )
+        totalLen += inVec[ i ].len;
+
+    err = kNoErr;
+    if( totalLen == 0 ) goto exit;
+
+    buf = ( totalLen <= sizeof( staging ) ) ? staging : malloc( totalLen );
+    if( buf )
+    {
+        for( i = 0; i < inVecCount; i++ )
+        {
+            memcpy( buf + stagingLen, inVec[ i ].base, inVec[ i ].len );
+            stagingLen += inVec[ i ].len;
+        }
+        err = SocketSend( fd, buf, totalLen );
+        if( buf != staging ) free( buf );
+        goto exit;
+    }
+
+    err = kNoErr;
+    for( i = 0; i < inVecCount; i++ )
+    {
+        if( inVec[ i ].len == 0 ) continue;
+
+        if( stagingLen + inVec[ i ].len > sizeof( staging ) && stagingLen )
+        {
+            err = SocketSend( fd, staging, stagingLen );
+            require_noerr( err, exit );
+            stagingLen = 0;
+        }
+
+        if( inVec[ i ].len < sizeof( staging ) )
+        {
+            memcpy( staging + stagingLen, inVec[ i ].base, inVec[ i ].len );
+            stagingLen += inVec[ i ].len;
+        }
+        else
+        {
+            err = SocketSend( fd, inVec[ i ].base, inVec[ i ].len );
+            require_noerr( err, exit );
+        }
+    }
+
+    if( stagingLen )
+        err = SocketSend( fd, staging, stagingLen );
+
+exit:
+    return err;
+}
+
 void SocketClose(int* fd)
 {
     int tempFd = *fd;
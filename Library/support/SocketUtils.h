@@ -24,8 +24,16 @@
 
 #include "Common.h"
 
+typedef struct
+{
+    const uint8_t *     base;               //! Start of the segment.
+    size_t              len;                //! Number of bytes in the segment, may be 0.
+} SocketIOVec_t;
+
 OSStatus SocketSend( int fd, const uint8_t *inBuf, size_t inBufLen );
 
+OSStatus SocketSendv( int fd, const SocketIOVec_t *inVec, int inVecCount );
+
 void SocketClose(int* fd);
 
 void SocketAccept(int *plocalTcpClientsPool, int maxClientsNum, int newFd);
@@ -0,0 +1,322 @@
+/**
+  ******************************************************************************
+  * @file    StringUtils-test.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    05-May-2014
+  * @brief   Tests and a per-size benchmark for the word-at-a-time kernels in
+  *          StringUtils.c.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "Common.h"
+#include "Debug.h"
+#include "MICORTOS.h"
+#include "StringUtils.h"
+
+//===========================================================================================================================
+//  Internals
+//
+//  Every kernel is checked against a plain byte loop on strings of every length up to kStrTestMaxLen, at every offset
+//  within a word, in buffers allocated to the exact size so a read past the terminator or the given length shows up
+//  under a memory checker. The benchmark runs the same byte loops next to the kernels for comparison.
+//===========================================================================================================================
+
+OSStatus    StringUtils_Test( int print );
+OSStatus    StringUtils_Bench( int print );
+
+#define kStrTestMaxLen          40
+#define kStrBenchMs             200
+
+static const size_t             kStrBenchSizes[] = { 8, 32, 128, 512 };
+
+static int _RefStrnicmp( const char *inS1, const char *inS2, size_t inMax )
+{
+    int     c1, c2;
+
+    for( ; inMax > 0; --inMax, ++inS1, ++inS2 )
+    {
+        c1 = tolower( *( (const unsigned char *) inS1 ) );
+        c2 = tolower( *( (const unsigned char *) inS2 ) );
+        if( c1 != c2 )  return( ( c1 < c2 ) ? -1 : 1 );
+        if( c1 == '\0' ) break;
+    }
+    return( 0 );
+}
+
+static int _RefStrnicmpx( const void *inS1, size_t inN, const char *inS2 )
+{
+    const unsigned char *   s1 = (const unsigned char *) inS1;
+    const unsigned char *   s2 = (const unsigned char *) inS2;
+    int                     c1, c2;
+
+    for( ; inN > 0; --inN, ++s1, ++s2 )
+    {
+        c1 = tolower( *s1 );
+        c2 = tolower( *s2 );
+        if( c1 != c2 ) return( ( c1 < c2 ) ? -1 : 1 );
+        if( c2 == 0 )  return( 0 );
+    }
+    return( ( *s2 != 0 ) ? -1 : 0 );
+}
+
+static const char * _RefStrnstrSuffix( const char *inStr, size_t inMaxLen, const char *inSuffix )
+{
+    size_t      len, suffixLen, i;
+
+    for( len = 0; ( len < inMaxLen ) && inStr[ len ]; ++len ) {}
+    suffixLen = strlen( inSuffix );
+    for( i = 0; i + suffixLen <= len; ++i )
+    {
+        if( _RefStrnicmpx( inStr + i, suffixLen, inSuffix ) == 0 ) return( inStr + i );
+    }
+    return( NULL );
+}
+
+static const void * _RefMemmem( const void *inSrc, size_t inLen, const void *inFind, size_t inFindLen )
+{
+    const uint8_t *     src = (const uint8_t *) inSrc;
+    size_t              i;
+
+    for( i = 0; i + inFindLen <= inLen; ++i )
+    {
+        if( memcmp( src + i, inFind, inFindLen ) == 0 ) return( src + i );
+    }
+    return( NULL );
+}
+
+static void _RefDataToHex( char *inDst, const uint8_t *inSrc, size_t inLen )
+{
+    size_t      i;
+
+    for( i = 0; i < inLen; ++i ) sprintf( inDst + ( i * 2 ), "%02X", inSrc[ i ] );
+    inDst[ inLen * 2 ] = '\0';
+}
+
+static int _Sign( int inValue )
+{
+    return( ( inValue > 0 ) - ( inValue < 0 ) );
+}
+
+// Copies inLen bytes (plus a terminator if inTerminate) into a heap block of exactly that size.
+static char * _StrTestDup( const char *inSrc, size_t inLen, int inTerminate )
+{
+    char *      s;
+
+    s = (char *) malloc( inLen + ( inTerminate ? 1 : 0 ) );
+    if( s )
+    {
+        memcpy( s, inSrc, inLen );
+        if( inTerminate ) s[ inLen ] = '\0';
+    }
+    return( s );
+}
+
+//===========================================================================================================================
+//  StringUtils_Test
+//===========================================================================================================================
+
+OSStatus StringUtils_Test( int print )
+{
+    static const char   kMixed[]   = "Content-Type: Application/JSON; charset=UTF-8 @[`{";
+    static const char   kFolded[]  = "content-type: application/json; charset=utf-8 @[`{";
+    OSStatus            err;
+    char                base[ kStrTestMaxLen + 8 ];
+    char *              s1 = NULL;
+    char *              s2 = NULL;
+    char *              hex = NULL;
+    uint8_t             data[ kStrTestMaxLen ];
+    uint8_t             mac[ 6 ];
+    size_t              len1, len2, n, i;
+
+    // strnicmp/strnicmpx against the byte loop: both strings in exact-size heap blocks, every pair of lengths, the
+    // first differing byte at every position and every limit. A shorter inS1 must not be read past its terminator.
+
+    for( i = 0; i < sizeof( base ); ++i ) base[ i ] = (char)( 'A' + ( i % 26 ) );
+    for( len1 = 0; len1 <= kStrTestMaxLen; ++len1 )
+    {
+        for( len2 = 0; len2 <= kStrTestMaxLen; ++len2 )
+        {
+            s1 = _StrTestDup( base, len1, 1 );
+            s2 = _StrTestDup( kFolded, Min( len2, sizeof( kFolded ) - 1 ), 1 );
+            require_action( s1 && s2, exit, err = kNoMemoryErr );
+            for( i = 0; i < len1; ++i ) s1[ i ] = ( i < len2 ) ? kMixed[ i % ( sizeof( kMixed ) - 1 ) ] : 'x';
+            if( ( len1 > 0 ) && ( len1 == len2 ) && ( len1 % 3 == 0 ) ) s1[ len1 / 2 ] ^= 0x01;
+
+            for( n = 0; n <= kStrTestMaxLen + 1; ++n )
+            {
+                require_action( _Sign( strnicmp( s1, s2, n ) ) == _Sign( _RefStrnicmp( s1, s2, n ) ), exit, err = kMismatchErr );
+                require_action( _Sign( strnicmp( s2, s1, n ) ) == _Sign( _RefStrnicmp( s2, s1, n ) ), exit, err = kMismatchErr );
+                if( n <= len1 )
+                {
+                    require_action( strnicmpx( s1, n, s2 ) == _RefStrnicmpx( s1, n, s2 ), exit, err = kMismatchErr );
+                }
+            }
+            free( s1 ); s1 = NULL;
+            free( s2 ); s2 = NULL;
+        }
+    }
+    require_action( strnicmp( "ABC[", "abc{", 4 ) != 0, exit, err = kMismatchErr );
+    require_action( strnicmp( "abc@", "ABC`", 4 ) != 0, exit, err = kMismatchErr );
+    require_action( strnicmpx( "Keep-Alive", 10, "keep-alive" ) == 0, exit, err = kMismatchErr );
+    require_action( strnicmpx( "Keep-Alive", 4, "keep-alive" ) != 0, exit, err = kMismatchErr );
+
+    // strnstr_suffix and strnicmp_suffix at every offset, with and without a match.
+
+    for( len1 = 0; len1 <= kStrTestMaxLen; ++len1 )
+    {
+        s1 = _StrTestDup( kMixed, Min( len1, sizeof( kMixed ) - 1 ), 1 );
+        require_action( s1, exit, err = kNoMemoryErr );
+        for( i = 0; i + 4 <= sizeof( kFolded ) - 1; i += 3 )
+        {
+            memcpy( base, kFolded + i, 4 );
+            base[ 4 ] = '\0';
+            require_action( strnstr_suffix( s1, len1, base ) == _RefStrnstrSuffix( s1, len1, base ), exit, err = kMismatchErr );
+        }
+        require_action( strnstr_suffix( s1, len1, "json;x" ) == NULL, exit, err = kMismatchErr );
+        if( len1 >= 4 )
+        {
+            require_action( strnicmp_suffix( s1, len1, s1 + len1 - 4 ) == 0, exit, err = kMismatchErr );
+        }
+        free( s1 ); s1 = NULL;
+    }
+
+    // memmem: short and long patterns (the memchr and the Horspool paths), matches at every offset and none.
+
+    s1 = _StrTestDup( kMixed, sizeof( kMixed ) - 1, 0 );
+    require_action( s1, exit, err = kNoMemoryErr );
+    for( n = 1; n <= 12; ++n )
+    {
+        for( i = 0; i + n <= sizeof( kMixed ) - 1; ++i )
+        {
+            require_action( memmem( s1, sizeof( kMixed ) - 1, s1 + i, (unsigned int) n ) ==
+                _RefMemmem( s1, sizeof( kMixed ) - 1, s1 + i, n ), exit, err = kMismatchErr );
+        }
+    }
+    require_action( memmem( s1, sizeof( kMixed ) - 1, "JSONx", 5 ) == NULL, exit, err = kMismatchErr );
+    require_action( memmem( s1, 3, "Content", 7 ) == NULL, exit, err = kMismatchErr );
+    free( s1 ); s1 = NULL;
+
+    // Hex encoders and the hardware address parser.
+
+    for( n = 1; n <= kStrTestMaxLen; ++n )
+    {
+        for( i = 0; i < n; ++i ) data[ i ] = (uint8_t)( i * 37 + n );
+        hex = DataToHexString( data, n );
+        require_action( hex, exit, err = kNoMemoryErr );
+        _RefDataToHex( base, data, Min( n, ( sizeof( base ) - 1 ) / 2 ) );
+        require_action( strncmp( hex, base, strlen( base ) ) == 0, exit, err = kMismatchErr );
+        require_action( strlen( hex ) == n * 2, exit, err = kSizeErr );
+        free( hex ); hex = NULL;
+    }
+    data[ 0 ] = 0xAB; data[ 1 ] = 0x01; data[ 2 ] = 0xF0;
+    hex = DataToHexStringWithColons( data, 3 );
+    require_action( hex && ( strcmp( hex, "AB:01:F0" ) == 0 ), exit, err = kMismatchErr );
+    free( hex ); hex = NULL;
+    hex = DataToHexStringWithSpaces( data, 3 );
+    require_action( hex && ( strcmp( hex, "AB 01 F0 " ) == 0 ), exit, err = kMismatchErr );
+    free( hex ); hex = NULL;
+    hex = DataToHexStringLowercase( data, 3 );
+    require_action( hex && ( strcmp( hex, "ab01f0" ) == 0 ), exit, err = kMismatchErr );
+    free( hex ); hex = NULL;
+
+    err = TextToHardwareAddress( "C8:93:46:0a:B1:2", kSizeCString, 6, mac );
+    require_noerr( err, exit );
+    require_action( ( mac[ 0 ] == 0xC8 ) && ( mac[ 3 ] == 0x0A ) && ( mac[ 5 ] == 0x02 ), exit, err = kMismatchErr );
+    require_action( TextToHardwareAddress( "C8:93:46:0a:B1", kSizeCString, 6, mac ) != kNoErr, exit, err = kMismatchErr );
+
+    err = StringUtils_Bench( print );
+    require_noerr( err, exit );
+
+exit:
+    if( s1 )  free( s1 );
+    if( s2 )  free( s2 );
+    if( hex ) free( hex );
+    printf( "%s: %s\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED" );
+    return( err );
+}
+
+//===========================================================================================================================
+//  StringUtils_Bench
+//
+//  Time per call of each kernel and of the byte loop it replaced, for inputs of kStrBenchSizes bytes. The compares
+//  run over equal strings and the searches find their pattern at the end, so both walk the whole input.
+//===========================================================================================================================
+
+#define _StrBenchRun( LABEL, CALL )                                                                     \
+    do                                                                                                  \
+    {                                                                                                   \
+        count = 0;                                                                                      \
+        start = mico_get_time();                                                                        \
+        do                                                                                              \
+        {                                                                                               \
+            for( i = 0; i < 64; ++i ) { sink += (uintptr_t)( CALL ); }                                  \
+            count += 64;                                                                                \
+            ms = mico_get_time() - start;                                                               \
+                                                                                                        \
+        }   while( ms < kStrBenchMs );                                                                  \
+        if( print ) printf( "%-22s %4u bytes: %6u ns/call\r\n", LABEL, (unsigned int) size,             \
+            (unsigned int)( ( (uint64_t) ms * 1000000 ) / count ) );                                    \
+                                                                                                        \
+    }   while( 0 )
+
+OSStatus StringUtils_Bench( int print )
+{
+    OSStatus            err;
+    char * volatile     s1 = NULL;      // volatile: the byte loops are static and would be hoisted out of the loop.
+    char * volatile     s2 = NULL;
+    char * volatile     hex = NULL;
+    char * volatile     text;
+    char *              out;
+    uint32_t            start, ms, count;
+    uintptr_t           sink = 0;
+    size_t              size, i, k;
+
+    s1  = (char *) malloc( 512 + 1 );
+    s2  = (char *) malloc( 512 + 1 );
+    hex = (char *) malloc( ( 512 * 2 ) + 1 );
+    require_action( s1 && s2 && hex, exit, err = kNoMemoryErr );
+
+    for( k = 0; k < sizeof( kStrBenchSizes ) / sizeof( kStrBenchSizes[ 0 ] ); ++k )
+    {
+        size = kStrBenchSizes[ k ];
+        for( i = 0; i < size; ++i )
+        {
+            s1[ i ] = (char)( 'a' + ( i % 23 ) );
+            s2[ i ] = (char) toupper( s1[ i ] );
+        }
+        s1[ size ] = '\0';
+        s2[ size ] = '\0';
+        text = s1 + size - Min( size, 8 );
+
+        _StrBenchRun( "strnicmp",           strnicmp( s1, s2, size ) );
+        _StrBenchRun( "strnicmp bytewise",  _RefStrnicmp( s1, s2, size ) );
+        _StrBenchRun( "strnicmpx",          strnicmpx( s1, size, s2 ) );
+        _StrBenchRun( "strnicmpx bytewise", _RefStrnicmpx( s1, size, s2 ) );
+        _StrBenchRun( "strnstr_suffix",     strnstr_suffix( s2, size, text ) );
+        _StrBenchRun( "strnstr bytewise",   _RefStrnstrSuffix( s2, size, text ) );
+        _StrBenchRun( "memmem",             memmem( s1, (unsigned int) size, text, (unsigned int) Min( size, 8 ) ) );
+        _StrBenchRun( "memmem bytewise",    _RefMemmem( s1, size, text, Min( size, 8 ) ) );
+        _StrBenchRun( "DataToHexString",    ( free( out = DataToHexString( (const uint8_t *) s1, size ) ), 0 ) );
+        _StrBenchRun( "hex bytewise",       ( _RefDataToHex( hex, (const uint8_t *) s1, size ), hex ) );
+    }
+    if( print && ( sink == 0 ) ) printf( "\r\n" );
+    err = kNoErr;
+
+exit:
+    if( s1 )  free( s1 );
+    if( s2 )  free( s2 );
+    if( hex ) free( hex );
+    return( err );
+}
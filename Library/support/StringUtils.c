@@ -32,6 +32,127 @@
 #define CONVERTHEX_alpha(c)  (IS_AF(c) ? (c - 'A'+10) : (c - 'a'+10))
 #define CONVERTHEX(c)   (IS_09(c) ? (c - '0') : CONVERTHEX_alpha(c))
 
+//===========================================================================================================================
+//  Word-at-a-time helpers
+//
+//  Strings are processed one machine word (4 bytes on Cortex-M3) at a time. Words are loaded through memcpy, which the
+//  compilers turn into a single unaligned-safe LDR, and only from bytes known to be readable: either inside a length
+//  given by the caller, or in an aligned word that holds at least one byte of a string that has not ended yet.
+//===========================================================================================================================
+
+typedef size_t          str_word_t;
+
+#define kStrWordSize            sizeof( str_word_t )
+#define kStrWordOnes            ( ( (str_word_t) -1 ) / 0xFF )     // 0x01 in every byte
+#define kStrWordHighs           ( kStrWordOnes * 0x80 )            // 0x80 in every byte
+#define StrWordHasZero( W )     ( ( ( W ) - kStrWordOnes ) & ~( W ) & kStrWordHighs )
+#define StrIsWordAligned( P )   ( ( ( (uintptr_t)( P ) ) & ( kStrWordSize - 1 ) ) == 0 )
+
+// The aligned word holding a terminator may extend past the end of the allocation, which is safe on the target (it
+// can't cross a page or MPU region) but is reported by AddressSanitizer in host builds of the tests.
+#if( defined( __SANITIZE_ADDRESS__ ) )
+    #define StrNoSanitizeAddress    __attribute__( ( no_sanitize_address ) )
+#elif( defined( __has_feature ) )
+    #if( __has_feature( address_sanitizer ) )
+        #define StrNoSanitizeAddress    __attribute__( ( no_sanitize_address ) )
+    #endif
+#endif
+#if( !defined( StrNoSanitizeAddress ) )
+    #define StrNoSanitizeAddress
+#endif
+
+static const char kHexDigitsUpper[] = "0123456789ABCDEF";
+static const char kHexDigitsLower[] = "0123456789abcdef";
+
+// Value of a hex digit character, 0xFF for any other character.
+static const uint8_t kHexDigitValue[ 256 ] =
+{
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static str_word_t _StrLoadWord( const void *inPtr )
+{
+    str_word_t          w;
+    
+    memcpy( &w, inPtr, sizeof( w ) );
+    return( w );
+}
+
+// Lower cases the ASCII letters in every byte of the word, other bytes are left untouched like tolower does.
+static str_word_t _StrFoldWord( str_word_t inWord )
+{
+    str_word_t          low7;
+    str_word_t          upper;
+    
+    low7  = inWord & ~kStrWordHighs;
+    upper = ( low7 + ( kStrWordOnes * ( 0x80 - 'A' ) ) ) ^ ( low7 + ( kStrWordOnes * ( 0x7F - 'Z' ) ) );
+    upper &= ~inWord & kStrWordHighs;
+    return( inWord | ( upper >> 2 ) );
+}
+
+// strnlen that reads aligned words once the string is known to reach them.
+StrNoSanitizeAddress static size_t _StrLenMax( const char *inStr, size_t inMax )
+{
+    const char *        ptr = inStr;
+    const char *        end = inStr + inMax;
+    
+    while( ( ptr < end ) && !StrIsWordAligned( ptr ) )
+    {
+        if( *ptr == '\0' ) return( (size_t)( ptr - inStr ) );
+        ++ptr;
+    }
+    while( ( (size_t)( end - ptr ) >= kStrWordSize ) && !StrWordHasZero( *( (const str_word_t *) ptr ) ) )
+    {
+        ptr += kStrWordSize;
+    }
+    while( ( ptr < end ) && ( *ptr != '\0' ) ) ++ptr;
+    return( (size_t)( ptr - inStr ) );
+}
+
+// Case-insensitive compare of inLen readable bytes, returns the offset of the first mismatch or inLen.
+static size_t _StrCaseMatchLen( const unsigned char *inS1, const unsigned char *inS2, size_t inLen )
+{
+    size_t              i = 0;
+    
+    while( ( inLen - i ) >= kStrWordSize )
+    {
+        if( _StrFoldWord( _StrLoadWord( inS1 + i ) ) != _StrFoldWord( _StrLoadWord( inS2 + i ) ) ) break;
+        i += kStrWordSize;
+    }
+    while( ( i < inLen ) && ( tolower( inS1[ i ] ) == tolower( inS2[ i ] ) ) ) ++i;
+    return( i );
+}
+
+// Writes two digits per byte from inDigits, with inSeparator between the bytes if it is not '\0'.
+static char * _DataToHex( char *inDst, const uint8_t *inSrc, size_t inLen, const char *inDigits, char inSeparator )
+{
+    const uint8_t *     end = inSrc + inLen;
+    
+    while( inSrc < end )
+    {
+        *inDst++ = inDigits[ *inSrc >> 4 ];
+        *inDst++ = inDigits[ *inSrc & 0x0F ];
+        if( ++inSrc < end && inSeparator ) *inDst++ = inSeparator;
+    }
+    *inDst = '\0';
+    return( inDst );
+}
+
 //===========================================================================================================================
 //  formatMACAddr
 //
@@ -126,16 +247,10 @@ char *__strdup_trans_dot(char *src)
 #if defined (__CC_ARM)
 size_t strnlen(const char *str, size_t maxsize)  
 {  
-  size_t n;  
-  
   /* Note that we do not check if s == NULL, because we do not  
   * return errno_t...  
   */  
-  
-  for (n = 0; n < maxsize && *str; n++, str++)  
-  ;  
-  
-  return n;  
+  return _StrLenMax( str, maxsize );
 }  
 #endif
 
@@ -274,8 +389,7 @@ OSStatus TextToHardwareAddress( const void *inText, size_t inTextSize, size_t in
         while( ( i < 2 ) && ( src < end ) )
         {
             c = *src++;
-            if(      isdigit_safe(  c ) ) { x = ( x * 16 )      +               ( c   - '0' ); ++i; }
-            else if( isxdigit_safe( c ) ) { x = ( x * 16 ) + 10 + ( tolower_safe( c ) - 'a' ); ++i; }
+            if( kHexDigitValue[ (uint8_t) c ] != 0xFF ) { x = ( x * 16 ) + kHexDigitValue[ (uint8_t) c ]; ++i; }
             else if( ( i != 0 ) || ( ( c != ':' ) && ( c != '-' ) && ( c != ' ' ) ) ) break;
         }
         if( i == 0 )
@@ -302,9 +416,7 @@ char* DataToHexString( const uint8_t *inBuf, size_t inBufLen )
     buf_str = (char*) malloc (2*inBufLen + 1);
     require(buf_str, error);
     buf_ptr = buf_str;
-    uint32_t i;
-    for (i = 0; i < inBufLen; i++) buf_ptr += sprintf(buf_ptr, "%02X", inBuf[i]);
-    *buf_ptr = '\0';
+    _DataToHex( buf_ptr, inBuf, inBufLen, kHexDigitsUpper, '\0' );
     return buf_str;
 
 error:
@@ -321,9 +433,8 @@ char* DataToHexStringWithSpaces( const uint8_t *inBuf, size_t inBufLen )
 
     buf_str = (char*) malloc (3*inBufLen + 1);
     require(buf_str, error);
-    buf_ptr = buf_str;
-    uint32_t i;
-    for (i = 0; i < inBufLen; i++) buf_ptr += sprintf(buf_ptr, "%02X ", inBuf[i]);
+    buf_ptr = _DataToHex( buf_str, inBuf, inBufLen, kHexDigitsUpper, ' ' );
+    *buf_ptr++ = ' ';
     *buf_ptr = '\0';
     return buf_str;
 
@@ -342,15 +453,7 @@ char* DataToHexStringWithColons( const uint8_t *inBuf, size_t inBufLen )
     buf_str = (char*) malloc (3*inBufLen + 1);
     require(buf_str, error);
     buf_ptr = buf_str;
-    uint32_t i;
-    for (i = 0; i < inBufLen; i++)
-    {
-        if ( i == inBufLen - 1 )
-            buf_ptr += sprintf(buf_ptr, "%02X", inBuf[i]);
-        else
-            buf_ptr += sprintf(buf_ptr, "%02X:", inBuf[i]);
-    }
-    *buf_ptr = '\0';
+    _DataToHex( buf_ptr, inBuf, inBufLen, kHexDigitsUpper, ':' );
     return buf_str;
 
 error:
@@ -358,6 +461,21 @@ error:
     return NULL;
 }
 
+char* DataToHexStringLowercase( const uint8_t *inBuf, size_t inBufLen )
+{
+    char* buf_str = NULL;
+    require_quiet(inBuf, error);
+    require_quiet(inBufLen > 0, error);
+
+    buf_str = (char*) malloc (2*inBufLen + 1);
+    require(buf_str, error);
+    _DataToHex( buf_str, inBuf, inBufLen, kHexDigitsLower, '\0' );
+    return buf_str;
+
+error:
+    return NULL;
+}
+
 char* DataToCString( const uint8_t *inBuf, size_t inBufLen )
 {
     char* cString = NULL;
@@ -386,6 +504,14 @@ int strnicmp( const char *inS1, const char *inS2, size_t inMax )
     const char *        end;
     int                 c1;
     int                 c2;
+    size_t              len;
+
+    // Skip the matching head a word at a time, no further than the terminator of either string.
+    len   = _StrLenMax( inS1, _StrLenMax( inS2, inMax ) );
+    len   = _StrCaseMatchLen( (const unsigned char *) inS1, (const unsigned char *) inS2, len );
+    inS1 += len;
+    inS2 += len;
+    inMax -= len;
 
     end = inS1 + inMax;
     while( inS1 < end )
@@ -414,9 +540,17 @@ int strnicmpx( const void *inS1, size_t inN, const char *inS2 )
     const unsigned char *       s2;
     int                         c1;
     int                         c2;
+    size_t                      len;
 
     s1 = (const unsigned char *) inS1;
     s2 = (const unsigned char *) inS2;
+
+    // All inN bytes of inS1 are readable, inS2 is only read up to its terminator.
+    len = _StrCaseMatchLen( s1, s2, _StrLenMax( inS2, inN ) );
+    s1  += len;
+    s2  += len;
+    inN -= len;
+
     while( inN-- > 0 )
     {
         c1 = tolower( *s1 );
@@ -873,7 +1007,7 @@ int strnicmp_suffix( const void *inStr, size_t inMaxLen, const char *inSuffix )
     size_t              suffixLen;
 
     stringPtr = (const char *) inStr;
-    stringLen = strnlen( stringPtr, inMaxLen );
+    stringLen = _StrLenMax( stringPtr, inMaxLen );
     suffixLen = strlen( inSuffix );
     if( suffixLen <= stringLen )
     {
@@ -891,57 +1025,78 @@ int strnicmp_suffix( const void *inStr, size_t inMaxLen, const char *inSuffix )
 
 char * strnstr_suffix( const char *inStr, size_t inMaxLen, const char *inSuffix)
 {
-    size_t              stringLen;
-    size_t              suffixLen;
-    char *              instr_tmp;
-    char *              inSuffix_tmp;
-    size_t              i;
-    char *              ret;
+    const unsigned char *   str = (const unsigned char *) inStr;
+    const unsigned char *   suffix = (const unsigned char *) inSuffix;
+    size_t                  stringLen;
+    size_t                  suffixLen;
+    size_t                  i;
+    uint8_t                 shift[ 256 ];
+    int                     c;
 
     suffixLen = strlen( inSuffix );
-    stringLen = strnlen( inStr, inMaxLen );
-    instr_tmp = calloc(stringLen+1, 1);
-    inSuffix_tmp = calloc(suffixLen+1, 1);
-
-    for(i=0; i<stringLen; i++)
-        instr_tmp[i] = tolower(inStr[i]);
-    for(i=0; i<suffixLen; i++)
-        inSuffix_tmp[i] = tolower(inSuffix[i]);
-
-    if( suffixLen <= stringLen ){
-        ret = strstr( instr_tmp, inSuffix_tmp );
-        if(ret != NULL)
-            ret = (char *)(inStr+(ret-instr_tmp));
-    }
-    else
-        ret = NULL;
+    stringLen = _StrLenMax( inStr, inMaxLen );
+    if( suffixLen > stringLen ) return( NULL );
+    if( suffixLen == 0 )        return( (char *) inStr );
 
-    free(instr_tmp);
-    free(inSuffix_tmp);
+    // Horspool: the shift for each character is taken from its last position in the suffix, both cases share it.
+    memset( shift, (int) Min( suffixLen, 0xFF ), sizeof( shift ) );
+    for( i = 0; i < suffixLen - 1; i++ )
+    {
+        c = tolower( suffix[ i ] );
+        shift[ c ] = shift[ toupper( c ) ] = (uint8_t) Min( suffixLen - 1 - i, 0xFF );
+    }
 
-    return ret;
+    for( i = 0; i <= stringLen - suffixLen; i += shift[ str[ i + suffixLen - 1 ] ] )
+    {
+        if( ( tolower( str[ i + suffixLen - 1 ] ) == tolower( suffix[ suffixLen - 1 ] ) ) &&
+            ( _StrCaseMatchLen( str + i, suffix, suffixLen - 1 ) == suffixLen - 1 ) )
+        {
+            return( (char *)( str + i ) );
+        }
+    }
+    return( NULL );
 }
 
 
+//===========================================================================================================================
+//  memmem
+//
+//  Finds the first occurrence of find in start, Horspool search for longer inputs.
+//===========================================================================================================================
+
 void *memmem(void *start, unsigned int s_len, void *find, unsigned int f_len)
 {
-    char                *p, *q;
-    unsigned int        len;
-
-    p = start, q = find;
-    len = 0;
-    while((p - (char *)start + f_len) <= s_len){
-        while(*p++ == *q++){
-            len++;
-            if(len == f_len)
-                return(p - f_len);
-        };
-        q = find;
-        len = 0;
-    };
-
-    return(NULL);
-}
+    const uint8_t *     src = (const uint8_t *) start;
+    const uint8_t *     pat = (const uint8_t *) find;
+    const uint8_t *     ptr;
+    const uint8_t *     end;
+    unsigned int        i;
+    uint8_t             shift[ 256 ];
+    uint8_t             last;
+
+    if( f_len == 0 )    return( start );
+    if( f_len > s_len ) return( NULL );
+    end = src + ( s_len - f_len ) + 1;
+
+    // A short pattern or buffer does not pay for the shift table: let memchr find the candidates.
+    if( ( f_len < 4 ) || ( s_len < 64 ) )
+    {
+        for( ptr = src; ( ptr = (const uint8_t *) memchr( ptr, pat[ 0 ], (size_t)( end - ptr ) ) ) != NULL; ++ptr )
+        {
+            if( memcmp( ptr + 1, pat + 1, f_len - 1 ) == 0 ) return( (void *) ptr );
+        }
+        return( NULL );
+    }
 
+    memset( shift, (int) Min( f_len, 0xFF ), sizeof( shift ) );
+    for( i = 0; i < f_len - 1; i++ )
+        shift[ pat[ i ] ] = (uint8_t) Min( f_len - 1 - i, 0xFF );
 
+    last = pat[ f_len - 1 ];
+    for( ptr = src; ptr < end; ptr += shift[ ptr[ f_len - 1 ] ] )
+    {
+        if( ( ptr[ f_len - 1 ] == last ) && ( memcmp( ptr, pat, f_len - 1 ) == 0 ) ) return( (void *) ptr );
+    }
+    return( NULL );
+}
 
@@ -88,6 +88,8 @@ char* DataToHexStringWithSpaces( const uint8_t *inBuf, size_t inBufLen );
 
 char* DataToHexStringWithColons( const uint8_t *inBuf, size_t inBufLen );
 
+char* DataToHexStringLowercase( const uint8_t *inBuf, size_t inBufLen );
+
 // ==== STRING COMPARE UTILS ====
 int strnicmp_suffix( const void *inStr, size_t inMaxLen, const char *inSuffix );
 
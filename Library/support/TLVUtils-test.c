@@ -0,0 +1,190 @@
+/**
+  ******************************************************************************
+  * @file    TLVUtils-test.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    05-May-2014
+  * @brief   Round-trip tests for the TLV8 reader and writer in TLVUtils.c.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "Common.h"
+#include "Debug.h"
+#include "TLVUtils.h"
+
+//===========================================================================================================================
+//  Internals
+//
+//  Every value length around the fragment boundaries is written with TLVWriterAppend and with TLVWriterReserve and
+//  TLVWriterCommit, followed by a one-byte item of another type. Both encodings must be the same and TLVGetNextItem must
+//  read the value back whole, through the gather list, copied out and defragmented in place the way pair setup does,
+//  and then find the item behind it. Writers one byte short and encodings cut one byte short must fail.
+//===========================================================================================================================
+
+OSStatus    TLVUtils_Test( int print );
+
+#define kTLVTestType            0x06
+#define kTLVTestNextType        0x07
+#define kTLVTestMaxLen          766
+
+static const size_t             kTLVTestLens[] = { 0, 1, 254, 255, 256, 509, 510, 511, 765, 766 };
+
+static OSStatus _TLVTestOne( size_t inLen, const uint8_t *inValue, uint8_t *inBuf, uint8_t *inBuf2, uint8_t *inCopy )
+{
+    OSStatus            err;
+    TLVWriter_t         writer;
+    TLVItem_t           item;
+    const uint8_t *     src;
+    const uint8_t *     next;
+    const uint8_t *     ptr;
+    uint8_t *           value;
+    size_t              size, len, offset, i;
+
+    size = TLVSizeOf( inLen ) + TLVSizeOf( 1 );
+
+    // Append, then check every fragment header: all fragments but the last carry kTLVFragmentMaxLen bytes.
+
+    TLVWriterInit( &writer, inBuf, size );
+    err = TLVWriterAppend( &writer, kTLVTestType, inValue, inLen );
+    require_noerr( err, exit );
+    err = TLVWriterAppendUInt8( &writer, kTLVTestNextType, 0x5A );
+    require_noerr( err, exit );
+    require_action( writer.len == size, exit, err = kSizeErr );
+
+    for( offset = 0, i = 0; ( offset < inLen ) || ( i == 0 ); ++i )
+    {
+        len = Min( inLen - offset, kTLVFragmentMaxLen );
+        src = inBuf + i * ( kTLVHeaderLen + kTLVFragmentMaxLen );
+        require_action( src[ 0 ] == kTLVTestType && src[ 1 ] == len, exit, err = kMalformedErr );
+        require_action( memcmp( src + kTLVHeaderLen, inValue + offset, len ) == 0, exit, err = kMismatchErr );
+        offset += len;
+    }
+
+    // Reserve and commit must give the same bytes.
+
+    memset( inBuf2, 0xEE, size );
+    TLVWriterInit( &writer, inBuf2, size );
+    value = TLVWriterReserve( &writer, inLen );
+    require_action( value, exit, err = kSizeErr );
+    memcpy( value, inValue, inLen );
+    err = TLVWriterCommit( &writer, kTLVTestType, inLen );
+    require_noerr( err, exit );
+    err = TLVWriterAppendUInt8( &writer, kTLVTestNextType, 0x5A );
+    require_noerr( err, exit );
+    require_action( writer.len == size && memcmp( inBuf, inBuf2, size ) == 0, exit, err = kMismatchErr );
+
+    // Read it back: whole, through the gather list and copied out.
+
+    err = TLVGetNextItem( inBuf, inBuf + size, &item, &next );
+    require_noerr( err, exit );
+    require_action( item.type == kTLVTestType && item.len == inLen, exit, err = kSizeErr );
+    require_action( item.fragmentCount == ( inLen ? ( inLen + kTLVFragmentMaxLen - 1 ) / kTLVFragmentMaxLen : 1 ), exit,
+                    err = kCountErr );
+    for( offset = 0, i = 0; i < item.fragmentCount; ++i )
+    {
+        len = TLVItemGetFragment( &item, i, &ptr );
+        require_action( memcmp( ptr, inValue + offset, len ) == 0, exit, err = kMismatchErr );
+        offset += len;
+    }
+    require_action( offset == inLen && TLVItemGetFragment( &item, i, &ptr ) == 0, exit, err = kSizeErr );
+
+    if( inLen > 0 ) require_action( TLVItemCopyData( &item, inCopy, inLen - 1 ) == kSizeErr, exit, err = kSizeErr );
+    err = TLVItemCopyData( &item, inCopy, inLen );
+    require_noerr( err, exit );
+    require_action( memcmp( inCopy, inValue, inLen ) == 0, exit, err = kMismatchErr );
+
+    // The item behind it, then the end.
+
+    err = TLVGetNextItem( next, inBuf + size, &item, &next );
+    require_noerr( err, exit );
+    require_action( item.type == kTLVTestNextType && item.len == 1 && item.data[ 0 ] == 0x5A, exit, err = kMismatchErr );
+    require_action( next == inBuf + size, exit, err = kSizeErr );
+    require_action( TLVGetNextItem( next, inBuf + size, &item, &next ) == kNotFoundErr, exit, err = kUnexpectedErr );
+
+    // Defragment in place over the item's own headers, as the pair setup handlers do with encrypted data.
+
+    err = TLVGetNextItem( inBuf2, inBuf2 + size, &item, NULL );
+    require_noerr( err, exit );
+    value = (uint8_t *) item.data - kTLVHeaderLen;
+    err = TLVItemCopyData( &item, value, item.len );
+    require_noerr( err, exit );
+    require_action( memcmp( value, inValue, inLen ) == 0, exit, err = kMismatchErr );
+
+    // One byte short: the writers must refuse without writing, the reader must not run past the end.
+
+    TLVWriterInit( &writer, inBuf2, TLVSizeOf( inLen ) - 1 );
+    require_action( TLVWriterAppend( &writer, kTLVTestType, inValue, inLen ) == kSizeErr && writer.len == 0, exit,
+                    err = kUnexpectedErr );
+    require_action( TLVWriterReserve( &writer, inLen ) == NULL, exit, err = kUnexpectedErr );
+    require_action( TLVWriterCommit( &writer, kTLVTestType, inLen ) == kSizeErr, exit, err = kUnexpectedErr );
+
+    err = TLVGetNextItem( inBuf, inBuf + TLVSizeOf( inLen ) - 1, &item, &next );
+    require_action( err == ( inLen ? kUnderrunErr : kNotFoundErr ), exit, err = kUnexpectedErr );
+    err = kNoErr;
+
+exit:
+    return( err );
+}
+
+//===========================================================================================================================
+//  TLVUtils_Test
+//===========================================================================================================================
+
+OSStatus TLVUtils_Test( int print )
+{
+    OSStatus            err = kNoErr;
+    uint8_t *           value = NULL;
+    uint8_t *           buf = NULL;
+    uint8_t *           buf2 = NULL;
+    uint8_t *           copy = NULL;
+    TLVItem_t           item;
+    const uint8_t *     next;
+    size_t              size, i;
+    uint8_t             pair[ 2 * kTLVHeaderLen ];
+
+    size  = TLVSizeOf( kTLVTestMaxLen ) + TLVSizeOf( 1 );
+    value = (uint8_t *) malloc( kTLVTestMaxLen );
+    buf   = (uint8_t *) malloc( size );
+    buf2  = (uint8_t *) malloc( size );
+    copy  = (uint8_t *) malloc( kTLVTestMaxLen );
+    require_action( value && buf && buf2 && copy, exit, err = kNoMemoryErr );
+    for( i = 0; i < kTLVTestMaxLen; ++i ) value[ i ] = (uint8_t)( i * 7 + 3 );
+
+    for( i = 0; i < sizeof( kTLVTestLens ) / sizeof( kTLVTestLens[ 0 ] ); ++i )
+    {
+        err = _TLVTestOne( kTLVTestLens[ i ], value, buf, buf2, copy );
+        require_noerr_action( err, exit, if( print ) printf( "%u-byte value: %d\r\n", (unsigned int) kTLVTestLens[ i ], (int) err ) );
+        if( print ) printf( "%u-byte value: %u bytes encoded, ok\r\n", (unsigned int) kTLVTestLens[ i ],
+                            (unsigned int) TLVSizeOf( kTLVTestLens[ i ] ) );
+    }
+
+    // Two zero-length items in a row are two items.
+
+    pair[ 0 ] = kTLVTestType;     pair[ 1 ] = 0;
+    pair[ 2 ] = kTLVTestNextType; pair[ 3 ] = 0;
+    err = TLVGetNextItem( pair, pair + sizeof( pair ), &item, &next );
+    require_noerr( err, exit );
+    require_action( item.type == kTLVTestType && item.len == 0 && next == pair + kTLVHeaderLen, exit, err = kMismatchErr );
+    err = TLVGetNextItem( next, pair + sizeof( pair ), &item, &next );
+    require_noerr( err, exit );
+    require_action( item.type == kTLVTestNextType && item.len == 0 && next == pair + sizeof( pair ), exit, err = kMismatchErr );
+
+exit:
+    if( value ) free( value );
+    if( buf ) free( buf );
+    if( buf2 ) free( buf2 );
+    if( copy ) free( copy );
+    printf( "%s: %s\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED" );
+    return( err );
+}
@@ -55,3 +55,166 @@ OSStatus TLVGetNext( const uint8_t *    inSrc,
     return( kNoErr );
 }
 
+OSStatus TLVGetNextItem( const uint8_t *    inSrc, 
+                         const uint8_t *    inEnd, 
+                         TLVItem_t *        outItem, 
+                         const uint8_t **   outNext )
+{
+    OSStatus            err;
+    uint8_t             eid;
+    const uint8_t *     ptr;
+    size_t              len;
+    const uint8_t *     next;
+
+    err = TLVGetNext( inSrc, inEnd, &eid, &ptr, &len, &next );
+    if( err != kNoErr )
+        return( err );
+
+    outItem->type          = eid;
+    outItem->data          = ptr;
+    outItem->len           = len;
+    outItem->fragmentCount = 1;
+
+    /* A full fragment is continued by the next item if it has the same type */
+    while( len == kTLVFragmentMaxLen && ( next + 1 ) < inEnd && next[ 0 ] == outItem->type )
+    {
+        err = TLVGetNext( next, inEnd, &eid, &ptr, &len, &next );
+        if( err != kNoErr )
+            return( err );
+        outItem->len += len;
+        outItem->fragmentCount++;
+    }
+
+    if( outNext )
+        *outNext = next;
+
+    return( kNoErr );
+}
+
+size_t TLVItemGetFragment( const TLVItem_t *inItem, size_t inIndex, const uint8_t **outData )
+{
+    size_t              offset;
+
+    if( inIndex >= inItem->fragmentCount )
+        return( 0 );
+
+    offset   = inIndex * kTLVFragmentMaxLen;
+    *outData = inItem->data + inIndex * ( kTLVFragmentMaxLen + kTLVHeaderLen );
+    return( Min( inItem->len - offset, kTLVFragmentMaxLen ) );
+}
+
+OSStatus TLVItemCopyData( const TLVItem_t *inItem, uint8_t *inBuf, size_t inMaxLen )
+{
+    const uint8_t *     ptr;
+    size_t              len;
+    size_t              i;
+
+    if( inItem->len > inMaxLen )
+        return( kSizeErr );
+
+    if( inItem->fragmentCount == 1 )
+    {
+        memmove( inBuf, inItem->data, inItem->len );
+        return( kNoErr );
+    }
+
+    /* Fragments are moved front to back, so inBuf may overlap the encoding as
+       long as it does not start behind the first fragment. */
+    for( i = 0; i < inItem->fragmentCount; i++ )
+    {
+        len = TLVItemGetFragment( inItem, i, &ptr );
+        memmove( inBuf, ptr, len );
+        inBuf += len;
+    }
+
+    return( kNoErr );
+}
+
+size_t TLVSizeOf( size_t inLen )
+{
+    size_t              count;
+
+    count = ( inLen + kTLVFragmentMaxLen - 1 ) / kTLVFragmentMaxLen;
+    if( count == 0 )
+        count = 1;
+
+    return( inLen + count * kTLVHeaderLen );
+}
+
+void TLVWriterInit( TLVWriter_t *inWriter, uint8_t *inBuf, size_t inMaxLen )
+{
+    inWriter->buf    = inBuf;
+    inWriter->maxLen = inMaxLen;
+    inWriter->len    = 0;
+}
+
+OSStatus TLVWriterAppend( TLVWriter_t *inWriter, uint8_t inType, const void *inData, size_t inLen )
+{
+    const uint8_t *     src = (const uint8_t *) inData;
+    uint8_t *           dst;
+    size_t              len;
+
+    if( inWriter->len + TLVSizeOf( inLen ) > inWriter->maxLen )
+        return( kSizeErr );
+
+    dst = inWriter->buf + inWriter->len;
+    do
+    {
+        len = Min( inLen, kTLVFragmentMaxLen );
+        *dst++ = inType;
+        *dst++ = (uint8_t) len;
+        memcpy( dst, src, len );
+        dst   += len;
+        src   += len;
+        inLen -= len;
+    } while( inLen > 0 );
+
+    inWriter->len = (size_t)( dst - inWriter->buf );
+    return( kNoErr );
+}
+
+OSStatus TLVWriterAppendUInt8( TLVWriter_t *inWriter, uint8_t inType, uint8_t inValue )
+{
+    return( TLVWriterAppend( inWriter, inType, &inValue, sizeof( inValue ) ) );
+}
+
+uint8_t * TLVWriterReserve( TLVWriter_t *inWriter, size_t inLen )
+{
+    size_t              size = TLVSizeOf( inLen );
+
+    if( inWriter->len + size > inWriter->maxLen )
+        return( NULL );
+
+    /* Leave room for every fragment header in front of the value */
+    return( inWriter->buf + inWriter->len + ( size - inLen ) );
+}
+
+OSStatus TLVWriterCommit( TLVWriter_t *inWriter, uint8_t inType, size_t inLen )
+{
+    size_t              size = TLVSizeOf( inLen );
+    uint8_t *           dst;
+    const uint8_t *     src;
+    size_t              len;
+
+    if( inWriter->len + size > inWriter->maxLen )
+        return( kSizeErr );
+
+    dst = inWriter->buf + inWriter->len;
+    src = dst + ( size - inLen );
+
+    /* Each fragment moves towards the front by the headers still to insert
+       before it, so it never overwrites the fragments that follow. */
+    do
+    {
+        len = Min( inLen, kTLVFragmentMaxLen );
+        memmove( dst + kTLVHeaderLen, src, len );
+        dst[ 0 ] = inType;
+        dst[ 1 ] = (uint8_t) len;
+        dst   += kTLVHeaderLen + len;
+        src   += len;
+        inLen -= len;
+    } while( inLen > 0 );
+
+    inWriter->len += size;
+    return( kNoErr );
+}
@@ -26,6 +26,27 @@
 #define __TLVUtils_h__
 #include "Common.h"
 
+#define kTLVFragmentMaxLen              255     //! Longest value a single TLV8 item can carry.
+#define kTLVHeaderLen                   2       //! Type and length bytes in front of every fragment.
+
+/* A value longer than kTLVFragmentMaxLen is sent as consecutive items of the
+   same type, every one but the last carrying exactly kTLVFragmentMaxLen bytes.
+   TLVGetNextItem joins these fragments into one item without copying them. */
+typedef struct
+{
+    uint8_t             type;               //! Type of the item.
+    size_t              len;                //! Length of the value, summed over all fragments.
+    const uint8_t *     data;               //! Value of the first fragment.
+    size_t              fragmentCount;      //! Number of fragments the value was split into.
+} TLVItem_t;
+
+typedef struct
+{
+    uint8_t *           buf;                //! Output buffer, sized by the caller with TLVSizeOf.
+    size_t              maxLen;             //! Size of buf.
+    size_t              len;                //! Number of bytes written to buf.
+} TLVWriter_t;
+
 
 OSStatus TLVGetNext( 
         const uint8_t *     inSrc, 
@@ -35,5 +56,33 @@ OSStatus TLVGetNext(
         size_t *            outLen, 
         const uint8_t **    outNext );
 
+OSStatus TLVGetNextItem( 
+        const uint8_t *     inSrc, 
+        const uint8_t *     inEnd, 
+        TLVItem_t *         outItem, 
+        const uint8_t **    outNext );
+
+// Gather access: returns the length of fragment inIndex and points outData at it.
+size_t TLVItemGetFragment( const TLVItem_t *inItem, size_t inIndex, const uint8_t **outData );
+
+// Concatenates the fragments into inBuf, which may point into the item's own
+// encoding to defragment it in place.
+OSStatus TLVItemCopyData( const TLVItem_t *inItem, uint8_t *inBuf, size_t inMaxLen );
+
+// Encoded size of a value of inLen bytes, including the headers of all its fragments.
+size_t TLVSizeOf( size_t inLen );
+
+void TLVWriterInit( TLVWriter_t *inWriter, uint8_t *inBuf, size_t inMaxLen );
+
+OSStatus TLVWriterAppend( TLVWriter_t *inWriter, uint8_t inType, const void *inData, size_t inLen );
+
+OSStatus TLVWriterAppendUInt8( TLVWriter_t *inWriter, uint8_t inType, uint8_t inValue );
+
+// Returns where the caller has to place a contiguous value of inLen bytes,
+// TLVWriterCommit then splits it into fragments in place.
+uint8_t * TLVWriterReserve( TLVWriter_t *inWriter, size_t inLen );
+
+OSStatus TLVWriterCommit( TLVWriter_t *inWriter, uint8_t inType, size_t inLen );
+
 #endif // __TLVUtils_h__
 
@@ -0,0 +1,329 @@
+/**
+  ******************************************************************************
+  * @file    URLUtils-test.c
+  * @author  William Xu
+  * @version V1.0.0
+  * @date    05-May-2014
+  * @brief   Tests and a micro-benchmark for the URL router in URLUtils.c.
+  ******************************************************************************
+  * @attention
+  *
+  * THE PRESENT FIRMWARE WHICH IS FOR GUIDANCE ONLY AIMS AT PROVIDING CUSTOMERS
+  * WITH CODING INFORMATION REGARDING THEIR PRODUCTS IN ORDER FOR THEM TO SAVE
+  * TIME. AS A RESULT, MXCHIP Inc. SHALL NOT BE HELD LIABLE FOR ANY
+  * DIRECT, INDIRECT OR CONSEQUENTIAL DAMAGES WITH RESPECT TO ANY CLAIMS ARISING
+  * FROM THE CONTENT OF SUCH FIRMWARE AND/OR THE USE MADE BY CUSTOMERS OF THE
+  * CODING INFORMATION CONTAINED HEREIN IN CONNECTION WITH THEIR PRODUCTS.
+  *
+  * <h2><center>&copy; COPYRIGHT 2014 MXCHIP Inc.</center></h2>
+  ******************************************************************************
+  */
+
+#include "Common.h"
+#include "Debug.h"
+#include "MICORTOS.h"
+#include "StringUtils.h"
+#include "URLUtils.h"
+
+//===========================================================================================================================
+//  Internals
+//
+//  kURLTestRoutes has 30 routes: the resources of the config, HomeKit and MVD config servers and a few wildcard routes.
+//  The tests resolve every route by its own method and path and check the 404, 405, case, suffix and wildcard rules.
+//  The benchmark times the router against the chain it replaced: one strnicmp_suffix per route in table order, as
+//  HTTPHeaderMatchURL did, followed by a method compare.
+//===========================================================================================================================
+
+OSStatus    URLUtils_Test( int print );
+OSStatus    URLUtils_Bench( int print );
+
+#define kURLBenchMs             200
+#define kURLTestWildcardTag     100     // Tags from here on belong to wildcard routes, which the old chain can't express.
+
+static const URLRoute_t         kURLTestRoutes[] =
+{
+    { "GET",  "/config-read",               NULL, 1 },
+    { "POST", "/config-write",              NULL, 2 },
+    { "POST", "/config-write-uap",          NULL, 3 },
+    { "POST", "/OTA",                       NULL, 4 },
+    { "POST", "/identify",                  NULL, 5 },
+    { "POST", "/pair-setup",                NULL, 6 },
+    { "POST", "/pair-verify",               NULL, 7 },
+    { "POST", "/pairings",                  NULL, 8 },
+    { "GET",  "/accessories",               NULL, 9 },
+    { "GET",  "/characteristics",           NULL, 10 },
+    { "PUT",  "/characteristics",           NULL, 11 },
+    { "POST", "/dev-activate",              NULL, 12 },
+    { "POST", "/dev-authorize",             NULL, 13 },
+    { "POST", "/dev-reset",                 NULL, 14 },
+    { "POST", "/dev-fw-update",             NULL, 15 },
+    { "GET",  "/dev-state",                 NULL, 16 },
+    { "GET",  "/dev-info",                  NULL, 17 },
+    { "GET",  "/wifi-scan",                 NULL, 18 },
+    { "POST", "/wifi-connect",              NULL, 19 },
+    { "GET",  "/wifi-status",               NULL, 20 },
+    { "GET",  "/time",                      NULL, 21 },
+    { "POST", "/time",                      NULL, 22 },
+    { NULL,   "/log",                       NULL, 23 },
+    { "GET",  "/",                          NULL, 24 },
+    { "GET",  "/led/all",                   NULL, 25 },
+    { "GET",  "/led/*",                     NULL, kURLTestWildcardTag + 0 },
+    { "PUT",  "/led/*/color",               NULL, kURLTestWildcardTag + 1 },
+    { "GET",  "/files/special",             NULL, 26 },
+    { "GET",  "/files/**",                  NULL, kURLTestWildcardTag + 2 },
+    { "DELETE", "/pairings/*",              NULL, kURLTestWildcardTag + 3 },
+};
+
+#define kURLTestRouteCount      ( (int)( sizeof( kURLTestRoutes ) / sizeof( kURLTestRoutes[ 0 ] ) ) )
+
+// Resolves a request, returns the route tag or -404/-405, and copies the first wildcard text into outWildcard.
+static int _URLTestMatch( const URLRouter_t *inRouter, const char *inMethod, const char *inURL, char *outWildcard, size_t inMaxLen )
+{
+    OSStatus            err;
+    URLComponents       url;
+    URLRouteMatch_t     match;
+
+    err = URLParseComponents( inURL, NULL, &url, NULL );
+    if( err ) return( -400 );
+
+    err = URLRouterMatch( inRouter, inMethod, strlen( inMethod ), &url, &match );
+    if( err == kUnsupportedErr ) return( -405 );
+    if( err ) return( -404 );
+
+    if( outWildcard )
+    {
+        if( match.wildcardPtr && ( match.wildcardLen < inMaxLen ) )
+        {
+            memcpy( outWildcard, match.wildcardPtr, match.wildcardLen );
+            outWildcard[ match.wildcardLen ] = '\0';
+        }
+        else
+        {
+            strcpy( outWildcard, "-" );
+        }
+    }
+    return( match.route->tag );
+}
+
+static OSStatus _URLTestHandler( const URLRouteMatch_t *inMatch, void *inContext )
+{
+    *( (int *) inContext ) = inMatch->route->tag;
+    return( kNoErr );
+}
+
+// The dispatch the router replaced: first route whose pattern ends the path and whose method equals the request's.
+static int _URLTestChain( const URLComponents *inURL, const char *inMethod, size_t inMethodLen )
+{
+    int     i;
+
+    for( i = 0; i < kURLTestRouteCount; ++i )
+    {
+        if( kURLTestRoutes[ i ].tag >= kURLTestWildcardTag ) continue;
+        if( strnicmp_suffix( inURL->pathPtr, inURL->pathLen, kURLTestRoutes[ i ].pattern ) != 0 ) continue;
+        if( kURLTestRoutes[ i ].method && ( strnicmpx( inMethod, inMethodLen, kURLTestRoutes[ i ].method ) != 0 ) ) continue;
+        return( kURLTestRoutes[ i ].tag );
+    }
+    return( -404 );
+}
+
+//===========================================================================================================================
+//  URLUtils_Test
+//===========================================================================================================================
+
+OSStatus URLUtils_Test( int print )
+{
+    static const URLRoute_t     kDuplicates[] = { { "GET", "/a", NULL, 1 }, { "get", "/A", NULL, 2 } };
+    static const URLRoute_t     kNoHandler[]  = { { "GET", "/a", NULL, 1 } };
+    OSStatus                    err;
+    URLRouter_t *               router = NULL;
+    URLRouter_t *               other = NULL;
+    URLComponents               url;
+    char                        wildcard[ 64 ];
+    char                        path[ 64 ];
+    int                         i, tag;
+
+    err = URLRouterCreate( kURLTestRoutes, kURLTestRouteCount, &router );
+    require_noerr( err, exit );
+
+    // Every literal route by its own method and path, and with the path as the end of a longer one.
+
+    for( i = 0; i < kURLTestRouteCount; ++i )
+    {
+        if( kURLTestRoutes[ i ].tag >= kURLTestWildcardTag ) continue;
+        tag = _URLTestMatch( router, kURLTestRoutes[ i ].method ? kURLTestRoutes[ i ].method : "PATCH",
+                             kURLTestRoutes[ i ].pattern, wildcard, sizeof( wildcard ) );
+        require_action( tag == kURLTestRoutes[ i ].tag, exit, err = kMismatchErr );
+        require_action( strcmp( wildcard, "-" ) == 0, exit, err = kMismatchErr );
+        require_action( _URLTestChain( ( URLParseComponents( kURLTestRoutes[ i ].pattern, NULL, &url, NULL ), &url ),
+            kURLTestRoutes[ i ].method ? kURLTestRoutes[ i ].method : "PATCH", kURLTestRoutes[ i ].method ? strlen( kURLTestRoutes[ i ].method ) : 5 )
+            == tag, exit, err = kMismatchErr );
+
+        if( strcmp( kURLTestRoutes[ i ].pattern, "/" ) == 0 ) continue;
+        snprintf( path, sizeof( path ), "/prefix%s?q=1", kURLTestRoutes[ i ].pattern );
+        tag = _URLTestMatch( router, kURLTestRoutes[ i ].method ? kURLTestRoutes[ i ].method : "GET", path, NULL, 0 );
+        require_action( tag == kURLTestRoutes[ i ].tag, exit, err = kMismatchErr );
+    }
+
+    // Methods: 405 for a known path, a NULL method takes any, two methods on one path, methods compare without case.
+
+    require_action( _URLTestMatch( router, "POST", "/config-read", NULL, 0 ) == -405, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "DELETE", "/log", NULL, 0 ) == 23, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "PUT", "/characteristics", NULL, 0 ) == 11, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "get", "/characteristics", NULL, 0 ) == 10, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GE", "/characteristics", NULL, 0 ) == -405, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GETX", "/characteristics", NULL, 0 ) == -405, exit, err = kMismatchErr );
+
+    // Paths: case, neighbours one byte shorter or longer, query and fragment ignored.
+
+    require_action( _URLTestMatch( router, "GET", "/CONFIG-Read", NULL, 0 ) == 1, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "POST", "/config-writ", NULL, 0 ) == -404, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "POST", "/config-write-uapx", NULL, 0 ) == -404, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "POST", "/pair", NULL, 0 ) == -404, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/dev-state?x=1#top", NULL, 0 ) == 16, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/nothing-here", NULL, 0 ) == -404, exit, err = kMismatchErr );
+
+    // Wildcards: "*" takes one non-empty segment and loses to a literal, "**" takes the rest.
+
+    require_action( _URLTestMatch( router, "GET", "/led/3", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 0, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "3" ) == 0, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/led/all", wildcard, sizeof( wildcard ) ) == 25, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/led/alx", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 0, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "alx" ) == 0, exit, err = kMismatchErr );
+    // "/led/" has an empty segment, so it falls back to the suffix "/", as it did with HTTPHeaderMatchURL.
+    require_action( _URLTestMatch( router, "GET", "/led/", NULL, 0 ) == 24, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "PUT", "/led/", NULL, 0 ) == -405, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "PUT", "/led/7/color", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 1, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "7" ) == 0, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/led/7/color", NULL, 0 ) == -405, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/files/special", NULL, 0 ) == 26, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/files/a/b/c.txt", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 2, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "a/b/c.txt" ) == 0, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "GET", "/files/special/x", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 2, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "special/x" ) == 0, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "DELETE", "/pairings/ABCD", wildcard, sizeof( wildcard ) ) == kURLTestWildcardTag + 3, exit, err = kMismatchErr );
+    require_action( strcmp( wildcard, "ABCD" ) == 0, exit, err = kMismatchErr );
+    require_action( _URLTestMatch( router, "DELETE", "/pairings", NULL, 0 ) == -405, exit, err = kMismatchErr );
+
+    // Dispatch calls the handler of the route, or fails when it has none. Duplicates are refused.
+
+    err = URLParseComponents( "/a", NULL, &url, NULL );
+    require_noerr( err, exit );
+    {
+        const URLRoute_t    withHandler[] = { { "GET", "/a", _URLTestHandler, 7 } };
+
+        err = URLRouterCreate( withHandler, 1, &other );
+        require_noerr( err, exit );
+        tag = 0;
+        err = URLRouterDispatch( other, "GET", 3, &url, &tag );
+        require_noerr( err, exit );
+        require_action( tag == 7, exit, err = kMismatchErr );
+        URLRouterFree( other );
+        other = NULL;
+    }
+    err = URLRouterCreate( kNoHandler, 1, &other );
+    require_noerr( err, exit );
+    require_action( URLRouterDispatch( other, "GET", 3, &url, NULL ) == kNotHandledErr, exit, err = kMismatchErr );
+    URLRouterFree( other );
+    other = NULL;
+
+    require_action( URLRouterCreate( kDuplicates, 2, &other ) == kDuplicateErr, exit, err = kMismatchErr );
+    require_action( other == NULL, exit, err = kMismatchErr );
+    err = kNoErr;
+
+exit:
+    if( router ) URLRouterFree( router );
+    if( other )  URLRouterFree( other );
+    if( print ) printf( "%s: %s\r\n", __FUNCTION__, !err ? "PASSED" : "FAILED" );
+    return( err );
+}
+
+//===========================================================================================================================
+//  URLUtils_Bench
+//
+//  Time per lookup through the 30-route table, by the router and by the strnicmp_suffix chain: the first route in the
+//  table, the last literal one, a path that matches nothing and the average over all literal routes. The URLs are
+//  parsed once up front, both servers parse the request line before they dispatch.
+//===========================================================================================================================
+
+#define _URLBenchRun( LABEL, CALL )                                                                     \
+    do                                                                                                  \
+    {                                                                                                   \
+        count = 0;                                                                                      \
+        start = mico_get_time();                                                                        \
+        do                                                                                              \
+        {                                                                                               \
+            for( i = 0; i < 64; ++i ) { sink += (uintptr_t)( CALL ); }                                  \
+            count += 64;                                                                                \
+            ms = mico_get_time() - start;                                                               \
+                                                                                                        \
+        }   while( ms < kURLBenchMs );                                                                  \
+        if( print ) printf( "%-8s %-20s %6u ns/lookup\r\n", LABEL, name,                                \
+            (unsigned int)( ( (uint64_t) ms * 1000000 ) / count ) );                                    \
+                                                                                                        \
+    }   while( 0 )
+
+static int _URLBenchRouter( const URLRouter_t *inRouter, const URLComponents *inURL, const char *inMethod, size_t inMethodLen )
+{
+    URLRouteMatch_t     match;
+
+    if( URLRouterMatch( inRouter, inMethod, inMethodLen, inURL, &match ) != kNoErr ) return( -404 );
+    return( match.route->tag );
+}
+
+OSStatus URLUtils_Bench( int print )
+{
+    static const char * const   kMissPath = "/config-erase";
+    OSStatus                    err;
+    URLRouter_t *               router = NULL;
+    URLComponents               urls[ kURLTestRouteCount + 1 ];
+    const char *                methods[ kURLTestRouteCount + 1 ];
+    size_t                      methodLens[ kURLTestRouteCount + 1 ];
+    int                         lookups[ 3 ];
+    const char *                names[ 3 ];
+    const char *                name;
+    uint32_t                    start, ms, count;
+    uintptr_t                   sink = 0;
+    int                         literal = 0;
+    int                         i, k, n;
+
+    err = URLRouterCreate( kURLTestRoutes, kURLTestRouteCount, &router );
+    require_noerr( err, exit );
+
+    for( i = 0; i < kURLTestRouteCount; ++i )
+    {
+        if( kURLTestRoutes[ i ].tag >= kURLTestWildcardTag ) continue;
+        URLParseComponents( kURLTestRoutes[ i ].pattern, NULL, &urls[ literal ], NULL );
+        methods[ literal ]    = kURLTestRoutes[ i ].method ? kURLTestRoutes[ i ].method : "GET";
+        methodLens[ literal ] = strlen( methods[ literal ] );
+        ++literal;
+    }
+    URLParseComponents( kMissPath, NULL, &urls[ literal ], NULL );
+    methods[ literal ]    = "POST";
+    methodLens[ literal ] = 4;
+
+    lookups[ 0 ] = 0;
+    lookups[ 1 ] = literal - 1;
+    lookups[ 2 ] = literal;
+    names[ 0 ]   = urls[ 0 ].pathPtr;
+    names[ 1 ]   = urls[ literal - 1 ].pathPtr;
+    names[ 2 ]   = "miss";
+    for( k = 0; k < 3; ++k )
+    {
+        n = lookups[ k ];
+        name = names[ k ];
+        _URLBenchRun( "router", _URLBenchRouter( router, &urls[ n ], methods[ n ], methodLens[ n ] ) );
+        _URLBenchRun( "chain",  _URLTestChain( &urls[ n ], methods[ n ], methodLens[ n ] ) );
+    }
+
+    // The average walks every literal route once per 64 lookups, so the index comes from the inner loop counter.
+
+    name = "all literal routes";
+    _URLBenchRun( "router", _URLBenchRouter( router, &urls[ i % literal ], methods[ i % literal ], methodLens[ i % literal ] ) );
+    _URLBenchRun( "chain",  _URLTestChain( &urls[ i % literal ], methods[ i % literal ], methodLens[ i % literal ] ) );
+
+    if( print && ( sink == 0 ) ) printf( "\r\n" );
+
+exit:
+    if( router ) URLRouterFree( router );
+    return( err );
+}
@@ -218,3 +218,342 @@ void PrintURL( URLComponents *inURL )
 }
 
 
+
+//===========================================================================================================================
+//  URLRouter
+//
+//  Every route is stored as the key "<path> <method>" in a byte trie. The method goes last, so a request whose path
+//  exists but whose method does not can be answered with 405 instead of 404. Wildcard segments are stored as marker
+//  bytes that never appear in a request line. Children are kept in priority order (literal bytes, then "*", then "**"),
+//  so the first complete match found while walking the trie is also the most specific one.
+//===========================================================================================================================
+
+#define kURLRouteSeparator      ' '     // Between path and method in a key, never part of a request path.
+#define kURLRouteWildcard       0x01    // "*" segment: one or more bytes up to the next '/'.
+#define kURLRoutePrefix         0x02    // Trailing "**" segment: the rest of the path.
+#define kURLRouterMaxBacktrack  8       // Pending alternatives while matching, one per "*"/"**" branch passed.
+
+#define _URLRouteRank( BYTE )   ( ( (BYTE) > kURLRoutePrefix ) ? 0 : (BYTE) )
+
+typedef struct
+{
+    uint8_t             byte;           // Literal byte (lower case) or one of the markers above.
+    int16_t             child;          // First child node, -1 if none.
+    int16_t             sibling;        // Next sibling node, -1 if none.
+    int16_t             route;          // Index of the route that ends here, -1 if none.
+} URLRouterNode_t;
+
+struct _URLRouter_t
+{
+    const URLRoute_t *  routes;
+    int                 routeCount;
+    int                 nodeCount;
+    URLRouterNode_t     nodes[ 1 ];     // Node 0 is the root, the rest are allocated with the router.
+};
+
+typedef struct
+{
+    int16_t             node;
+    uint16_t            pos;
+    const char *        wildcardPtr;
+    size_t              wildcardLen;
+} URLRouterFrame_t;
+
+static size_t _URLRouteKeyLen( const URLRoute_t *inRoute )
+{
+    return( strlen( inRoute->pattern ) + 1 + ( inRoute->method ? strlen( inRoute->method ) : 1 ) );
+}
+
+static int _URLRouterAddByte( URLRouter_t *inRouter, int inParent, uint8_t inByte )
+{
+    URLRouterNode_t * const nodes = inRouter->nodes;
+    int16_t *               link;
+    int                     i;
+    int                     n;
+    
+    for( i = nodes[ inParent ].child; i >= 0; i = nodes[ i ].sibling )
+    {
+        if( nodes[ i ].byte == inByte ) return( i );
+    }
+    
+    // Insert behind the siblings of the same or a higher priority.
+    
+    link = &nodes[ inParent ].child;
+    while( ( *link >= 0 ) && ( _URLRouteRank( nodes[ *link ].byte ) <= _URLRouteRank( inByte ) ) )
+    {
+        link = &nodes[ *link ].sibling;
+    }
+    
+    n = inRouter->nodeCount++;
+    nodes[ n ].byte    = inByte;
+    nodes[ n ].child   = -1;
+    nodes[ n ].sibling = *link;
+    nodes[ n ].route   = -1;
+    *link = (int16_t) n;
+    return( n );
+}
+
+static OSStatus _URLRouterAddRoute( URLRouter_t *inRouter, int inIndex )
+{
+    const URLRoute_t * const    route = &inRouter->routes[ inIndex ];
+    const char *                src   = route->pattern;
+    const char *                seg;
+    int                         node  = 0;
+    
+    while( *src != '\0' )
+    {
+        // A "*" or "**" segment sits between two slashes or after the last one.
+        
+        seg = src;
+        if( ( src[ 0 ] == '*' ) && ( ( seg == route->pattern ) || ( seg[ -1 ] == '/' ) ) )
+        {
+            if( ( src[ 1 ] == '/' ) || ( src[ 1 ] == '\0' ) )
+            {
+                node = _URLRouterAddByte( inRouter, node, kURLRouteWildcard );
+                src += 1;
+                continue;
+            }
+            if( ( src[ 1 ] == '*' ) && ( src[ 2 ] == '\0' ) )
+            {
+                node = _URLRouterAddByte( inRouter, node, kURLRoutePrefix );
+                src += 2;
+                continue;
+            }
+        }
+        node = _URLRouterAddByte( inRouter, node, (uint8_t) tolower_safe( *src ) );
+        ++src;
+    }
+    
+    node = _URLRouterAddByte( inRouter, node, kURLRouteSeparator );
+    if( route->method )
+    {
+        for( src = route->method; *src != '\0'; ++src )
+            node = _URLRouterAddByte( inRouter, node, (uint8_t) tolower_safe( *src ) );
+    }
+    else
+    {
+        node = _URLRouterAddByte( inRouter, node, kURLRouteWildcard );
+    }
+    
+    if( inRouter->nodes[ node ].route >= 0 ) return( kDuplicateErr );
+    inRouter->nodes[ node ].route = (int16_t) inIndex;
+    return( kNoErr );
+}
+
+//===========================================================================================================================
+//  URLRouterCreate
+//===========================================================================================================================
+
+OSStatus URLRouterCreate( const URLRoute_t *inRoutes, int inRouteCount, URLRouter_t **outRouter )
+{
+    OSStatus        err = kParamErr;
+    URLRouter_t *   router = NULL;
+    size_t          nodeMax = 1;
+    int             i;
+    
+    require( inRoutes && ( inRouteCount > 0 ) && outRouter, exit );
+    
+    for( i = 0; i < inRouteCount; ++i )
+    {
+        require( inRoutes[ i ].pattern, exit );
+        nodeMax += _URLRouteKeyLen( &inRoutes[ i ] );
+    }
+    require_action( nodeMax < INT16_MAX, exit, err = kSizeErr );
+    
+    router = (URLRouter_t *) calloc( 1, sizeof( URLRouter_t ) + ( nodeMax - 1 ) * sizeof( URLRouterNode_t ) );
+    require_action( router, exit, err = kNoMemoryErr );
+    
+    router->routes     = inRoutes;
+    router->routeCount = inRouteCount;
+    router->nodeCount  = 1;
+    router->nodes[ 0 ].child   = -1;
+    router->nodes[ 0 ].sibling = -1;
+    router->nodes[ 0 ].route   = -1;
+    
+    for( i = 0; i < inRouteCount; ++i )
+    {
+        err = _URLRouterAddRoute( router, i );
+        require_noerr_action( err, exit, url_utils_log( "Duplicate route %s %s", 
+                                                        inRoutes[ i ].method ? inRoutes[ i ].method : "*",
+                                                        inRoutes[ i ].pattern ) );
+    }
+    
+    *outRouter = router;
+    router = NULL;
+    err = kNoErr;
+    
+exit:
+    if( router ) free( router );
+    return( err );
+}
+
+void URLRouterFree( URLRouter_t *inRouter )
+{
+    if( inRouter ) free( inRouter );
+}
+
+//===========================================================================================================================
+//  URLRouterMatch
+//===========================================================================================================================
+
+// Matches the key "<path> <method>" against the trie.
+static OSStatus _URLRouterMatchKey( const URLRouter_t *inRouter, const char *path, size_t pathLen,
+                                    const char *inMethodPtr, size_t inMethodLen, URLRouteMatch_t *outMatch )
+{
+    const URLRouterNode_t * const   nodes = inRouter->nodes;
+    size_t                          keyLen;
+    URLRouterFrame_t                stack[ kURLRouterMaxBacktrack ];
+    int                             depth;
+    URLRouterFrame_t                f;
+    bool                            pathFound = false;
+    int                             i;
+    int                             literal;
+    int                             wildcard;
+    int                             prefix;
+    size_t                          end;
+    uint8_t                         c;
+    
+    keyLen = pathLen + 1 + inMethodLen;
+    
+    // Byte of the request key "<path> <method>" at a position.
+    #define _URLRouterKeyByte( POS ) \
+        ( ( (POS) < pathLen ) ? (uint8_t) tolower_safe( path[ (POS) ] ) : \
+          ( (POS) == pathLen ) ? (uint8_t) kURLRouteSeparator : (uint8_t) tolower_safe( inMethodPtr[ (POS) - pathLen - 1 ] ) )
+    
+    // Save an alternative: continue at NODE with the key consumed up to END. Only path bytes are captured.
+    #define _URLRouterPush( NODE, END ) \
+        do { \
+            stack[ depth ].node        = (int16_t)( NODE ); \
+            stack[ depth ].pos         = (uint16_t)( END ); \
+            stack[ depth ].wildcardPtr = f.wildcardPtr; \
+            stack[ depth ].wildcardLen = f.wildcardLen; \
+            if( ( f.wildcardPtr == NULL ) && ( f.pos < pathLen ) ) \
+            { \
+                stack[ depth ].wildcardPtr = &path[ f.pos ]; \
+                stack[ depth ].wildcardLen = ( ( (END) < pathLen ) ? (END) : pathLen ) - f.pos; \
+            } \
+            ++depth; \
+        } while( 0 )
+    
+    f.node        = 0;
+    f.pos         = 0;
+    f.wildcardPtr = NULL;
+    f.wildcardLen = 0;
+    depth = 0;
+    
+    for( ;; )
+    {
+        if( ( f.pos == keyLen ) && ( nodes[ f.node ].route >= 0 ) )
+        {
+            outMatch->route       = &inRouter->routes[ nodes[ f.node ].route ];
+            outMatch->wildcardPtr = f.wildcardPtr;
+            outMatch->wildcardLen = f.wildcardLen;
+            return( kNoErr );
+        }
+        
+        // Find the literal child for the next byte and remember where "*" and "**" could take over instead. "**" is
+        // pushed first so that "*" is tried first.
+        
+        c = ( f.pos < keyLen ) ? _URLRouterKeyByte( f.pos ) : 0;
+        literal  = -1;
+        wildcard = -1;
+        prefix   = -1;
+        for( i = nodes[ f.node ].child; i >= 0; i = nodes[ i ].sibling )
+        {
+            if(      nodes[ i ].byte == kURLRouteWildcard ) wildcard = i;
+            else if( nodes[ i ].byte == kURLRoutePrefix )   prefix   = i;
+            else if( ( nodes[ i ].byte == c ) && ( f.pos < keyLen ) ) literal = i;
+        }
+        if( ( prefix >= 0 ) && ( f.pos <= pathLen ) )
+        {
+            require_quiet( depth < kURLRouterMaxBacktrack, overflow );
+            _URLRouterPush( prefix, pathLen );
+        }
+        if( ( wildcard >= 0 ) && ( f.pos < keyLen ) && ( c != '/' ) && ( c != kURLRouteSeparator ) )
+        {
+            require_quiet( depth < kURLRouterMaxBacktrack, overflow );
+            end = f.pos + 1;
+            while( ( end < keyLen ) && ( _URLRouterKeyByte( end ) != '/' ) && ( _URLRouterKeyByte( end ) != kURLRouteSeparator ) ) ++end;
+            _URLRouterPush( wildcard, end );
+        }
+        if( literal >= 0 )
+        {
+            if( c == kURLRouteSeparator ) pathFound = true;
+            f.node = (int16_t) literal;
+            f.pos += 1;
+            continue;
+        }
+        
+        // Dead end, resume at the most recent "*" or "**" alternative.
+        
+        if( depth == 0 ) break;
+        f = stack[ --depth ];
+    }
+    
+    #undef _URLRouterPush
+    #undef _URLRouterKeyByte
+    return( pathFound ? kUnsupportedErr : kNotFoundErr );
+    
+overflow:
+    // Dropping an alternative could pick a less specific route, so give up instead.
+    url_utils_log( "Route match gave up on %.*s, more than %d wildcard alternatives", (int) pathLen, path, kURLRouterMaxBacktrack );
+    return( kNoResourcesErr );
+}
+
+OSStatus URLRouterMatch( const URLRouter_t *inRouter, const char *inMethodPtr, size_t inMethodLen,
+                         const URLComponents *inURL, URLRouteMatch_t *outMatch )
+{
+    OSStatus        err;
+    OSStatus        result = kNotFoundErr;
+    const char *    path;
+    size_t          pathLen;
+    size_t          start;
+    
+    path    = inURL->pathPtr;
+    pathLen = inURL->pathLen;
+    if( pathLen == 0 )
+    {
+        path    = "/";
+        pathLen = 1;
+    }
+    
+    // The whole path first, then ever shorter trailing parts starting at a '/', so "/a/config-read" still reaches
+    // "/config-read" like the suffix compare of HTTPHeaderMatchURL did.
+    
+    for( start = 0; start < pathLen; ++start )
+    {
+        if( path[ start ] != '/' ) continue;
+        
+        err = _URLRouterMatchKey( inRouter, path + start, pathLen - start, inMethodPtr, inMethodLen, outMatch );
+        if( err == kNoErr )
+        {
+            outMatch->url = inURL;
+            return( kNoErr );
+        }
+        require_action_quiet( err != kNoResourcesErr, exit, result = err );
+        if( err == kUnsupportedErr ) result = kUnsupportedErr;
+    }
+    
+exit:
+    return( result );
+}
+
+//===========================================================================================================================
+//  URLRouterDispatch
+//===========================================================================================================================
+
+OSStatus URLRouterDispatch( const URLRouter_t *inRouter, const char *inMethodPtr, size_t inMethodLen,
+                            const URLComponents *inURL, void *inContext )
+{
+    OSStatus            err;
+    URLRouteMatch_t     match;
+    
+    err = URLRouterMatch( inRouter, inMethodPtr, inMethodLen, inURL, &match );
+    require_noerr_quiet( err, exit );
+    require_action( match.route->handler, exit, err = kNotHandledErr );
+    
+    err = match.route->handler( &match, inContext );
+    
+exit:
+    return( err );
+}
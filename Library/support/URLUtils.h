@@ -56,5 +56,63 @@ int URLParseComponents( const char *inSrc, const char *inEnd, URLComponents *out
 
 void PrintURL( URLComponents *inURL );
 
+//---------------------------------------------------------------------------------------------------------------------------
+/*! @group      URLRouter
+    @abstract   Dispatches HTTP requests by method and path.
+    @discussion A route table is compiled once into a byte trie, a request is then resolved by one pass over its
+                path and method. Paths compare case-insensitively. A "*" segment matches one non-empty path segment,
+                a trailing "**" segment matches the rest of the path (including nothing). A NULL method matches any
+                method. Literal bytes win over "*", and "*" wins over "**". Like HTTPHeaderMatchURL, a route also
+                matches the end of a longer path ("/config-read" matches "/a/config-read"), the whole path is
+                tried first.
+*/
+
+struct _URLRoute_t;
+typedef struct _URLRouter_t URLRouter_t;
+
+typedef struct _URLRouteMatch_t
+{
+    const struct _URLRoute_t *  route;          //! Matched route entry.
+    const URLComponents *       url;            //! Parsed URL of the request.
+    const char *                wildcardPtr;    //! Path text matched by the first "*" or "**" segment, NULL if none.
+    size_t                      wildcardLen;    //! Number of bytes in wildcardPtr.
+} URLRouteMatch_t;
+
+typedef OSStatus (*URLRouteHandler)( const URLRouteMatch_t *inMatch, void *inContext );
+
+typedef struct _URLRoute_t
+{
+    const char *        method;     //! Request method, e.g. "GET", or NULL for any method.
+    const char *        pattern;    //! Path pattern, e.g. "/config-read", "/a/*/b" or "/ota/**".
+    URLRouteHandler     handler;    //! Called by URLRouterDispatch, may be NULL if only URLRouterMatch is used.
+    int                 tag;        //! Free for the caller, e.g. to switch on after URLRouterMatch.
+} URLRoute_t;
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*! @function   URLRouterCreate
+    @abstract   Compiles a route table into a router. The table must stay valid while the router is used.
+    @result     kDuplicateErr if two routes have the same method and pattern.
+*/
+OSStatus URLRouterCreate( const URLRoute_t *inRoutes, int inRouteCount, URLRouter_t **outRouter );
+
+void URLRouterFree( URLRouter_t *inRouter );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*! @function   URLRouterMatch
+    @abstract   Finds the route for a request method and parsed URL.
+    @result     kNoErr if a route matched, kUnsupportedErr if the path matched but not with this method (405),
+                kNotFoundErr if no route has this path (404), or kNoResourcesErr if the path needed more pending
+                wildcard alternatives than the router keeps (8).
+*/
+OSStatus URLRouterMatch( const URLRouter_t *inRouter, const char *inMethodPtr, size_t inMethodLen,
+                         const URLComponents *inURL, URLRouteMatch_t *outMatch );
+
+//---------------------------------------------------------------------------------------------------------------------------
+/*! @function   URLRouterDispatch
+    @abstract   URLRouterMatch, then calls the handler of the matched route and returns its result.
+*/
+OSStatus URLRouterDispatch( const URLRouter_t *inRouter, const char *inMethodPtr, size_t inMethodLen,
+                            const URLComponents *inURL, void *inContext );
+
 #endif // __URLUtils_h__
 
@@ -55,7 +55,6 @@ static void easylink_thread(void *inContext);
 
 static OSStatus _FTCRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext);
 
-static uint8_t *httpResponse = NULL;
 static HTTPHeader_t *httpHeader = NULL;
 
 
@@ -324,8 +323,7 @@ OSStatus _connectFTCServer( mico_Context_t * const inContext, int *fd)
   json_object *easylink_report = NULL;
   const char  *json_str;
   char host[16] = {0};
-  
-  size_t      httpResponseLen = 0;
+  HTTPWriter_t writer;
 
   *fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   addr.s_ip = inContext->flashContentInRam.micoSystemConfig.easylinkServerIP; 
@@ -343,14 +341,12 @@ OSStatus _connectFTCServer( mico_Context_t * const inContext, int *fd)
 
   inet_ntoa( host, inContext->flashContentInRam.micoSystemConfig.easylinkServerIP);
   easylink_log("Send config object=%s", json_str);
-  err =  CreateHTTPMessageWithHost( "POST", kEasyLinkURLAuth, host, addr.s_port, kMIMEType_JSON, (uint8_t *)json_str, strlen(json_str), &httpResponse, &httpResponseLen );
+  err = HTTPWriterBeginRequest( &writer, *fd, "POST", kEasyLinkURLAuth, host, addr.s_port, kMIMEType_JSON, strlen(json_str) );
   require_noerr( err, exit );
-  require( httpResponse, exit );
+  err = HTTPWriterWrite( &writer, (const uint8_t *)json_str, strlen(json_str) );
+  if( err == kNoErr ) err = HTTPWriterEnd( &writer );
 
   json_object_put(easylink_report);
-
-  err = SocketSend( *fd, httpResponse, httpResponseLen );
-  free(httpResponse);
   require_noerr( err, exit );
   easylink_log("Current configuration sent");
 
@@ -536,7 +532,7 @@ OSStatus _FTCRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context
 
       case kStatusOK:
         easylink_log("Easylink server respond status OK!");
-        err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+        err = HTTPHeaderGetField( inHeader, "Content-Type", &value, &valueSize );
         require_noerr(err, exit);
         if( strnicmpx( value, strlen(kMIMEType_JSON), kMIMEType_JSON ) == 0 ){
           easylink_log("Receive JSON config data!");
@@ -53,8 +53,14 @@ typedef struct _configContext_t{
   bool     isFlashLocked;
 } configContext_t;
 
-extern OSStatus     ConfigIncommingJsonMessage( const char *input, mico_Context_t * const inContext );
-extern OSStatus     ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * const inContext );
+typedef struct _configRequest_t{
+  int             fd;
+  HTTPHeader_t    *header;
+  mico_Context_t  *context;
+} configRequest_t;
+
+extern OSStatus     ConfigIncommingJsonObject( json_object *new_obj, mico_Context_t * const inContext );
+extern OSStatus     ConfigIncommingJsonObjectUAP( json_object *new_obj, mico_Context_t * const inContext );
 extern json_object* ConfigCreateReportJsonMessage( mico_Context_t * const inContext );
 
 static void localConfiglistener_thread(void *inContext);
@@ -65,6 +71,23 @@ static void _easylinkConnectWiFi( mico_Context_t * const inContext);
 static OSStatus onReceivedData(struct _HTTPHeader_t * httpHeader, uint32_t pos, uint8_t * data, size_t len, void * userContext );
 static void onClearHTTPHeader(struct _HTTPHeader_t * httpHeader, void * userContext );
 
+static OSStatus _configReadHandler( const URLRouteMatch_t *inMatch, void *inRequest );
+static OSStatus _configWriteHandler( const URLRouteMatch_t *inMatch, void *inRequest );
+static OSStatus _configWriteByUAPHandler( const URLRouteMatch_t *inMatch, void *inRequest );
+#ifdef MICO_FLASH_FOR_UPDATE
+static OSStatus _configOTAHandler( const URLRouteMatch_t *inMatch, void *inRequest );
+#endif
+
+static const URLRoute_t configRoutes[] = {
+  { NULL, kCONFIGURLRead,       _configReadHandler,       0 },
+  { NULL, kCONFIGURLWrite,      _configWriteHandler,      0 },
+  { NULL, kCONFIGURLWriteByUAP, _configWriteByUAPHandler, 0 },
+#ifdef MICO_FLASH_FOR_UPDATE
+  { NULL, kCONFIGURLOTA,        _configOTAHandler,        0 },
+#endif
+};
+static URLRouter_t *configRouter = NULL;
+
 OSStatus MICOStartConfigServer ( mico_Context_t * const inContext )
 {
   return mico_rtos_create_thread(NULL, MICO_APPLICATION_PRIORITY, "Config Server", localConfiglistener_thread, STACK_SIZE_LOCAL_CONFIG_SERVER_THREAD, (void*)inContext );
@@ -83,6 +106,11 @@ void localConfiglistener_thread(void *inContext)
   
   int localConfiglistener_fd = -1;
 
+  if(configRouter == NULL){
+    err = URLRouterCreate( configRoutes, sizeof(configRoutes)/sizeof(URLRoute_t), &configRouter );
+    require_noerr( err, exit );
+  }
+
   /*Establish a TCP server fd that accept the tcp clients connections*/ 
   localConfiglistener_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
   require_action(IsValidSocket( localConfiglistener_fd ), exit, err = kNoResourcesErr );
@@ -124,6 +152,7 @@ void localConfig_thread(void *inFd)
   OSStatus err;
   int clientFd = *(int *)inFd;
   int clientFdIsSet;
+  int requestCount = 0;
   fd_set readfds;
   struct timeval_t t;
   HTTPHeader_t *httpHeader = NULL;
@@ -134,8 +163,6 @@ void localConfig_thread(void *inFd)
   require_action( httpHeader, exit, err = kNoMemoryErr );
   HTTPHeaderClear( httpHeader );
 
-  t.tv_sec = 60;
-  t.tv_usec = 0;
   config_log("Free memory %d bytes", MicoGetMemoryInfo()->free_memory) ; 
 
   while(1){
@@ -143,12 +170,21 @@ void localConfig_thread(void *inFd)
     FD_SET(clientFd, &readfds);
     clientFdIsSet = 0;
 
-    if(httpHeader->len == 0){
-      require(select(1, &readfds, NULL, NULL, &t) >= 0, exit);
+    /* Pipelined requests already in httpHeader->buf are served without waiting on the socket, a pipelined
+       request that HTTPHeaderClear could not keep is reported by SocketReadHTTPHeader right away */
+    if(httpHeader->len == 0 && httpHeader->firstErr == kNoErr){
+      t.tv_sec = CONFIG_SERVICE_IDLE_TIMEOUT;
+      t.tv_usec = 0;
+      require(select(clientFd + 1, &readfds, NULL, NULL, &t) >= 0, exit);
       clientFdIsSet = FD_ISSET(clientFd, &readfds);
+      if(!clientFdIsSet){
+        config_log("Connection idle for %d seconds, close it.", CONFIG_SERVICE_IDLE_TIMEOUT);
+        err = kTimeoutErr;
+        goto exit;
+      }
     }
   
-    if(clientFdIsSet||httpHeader->len){
+    if(clientFdIsSet||httpHeader->len||httpHeader->firstErr){
       err = SocketReadHTTPHeader( clientFd, httpHeader );
 
       switch ( err )
@@ -180,6 +216,13 @@ void localConfig_thread(void *inFd)
           //
           //Exit if connection is closed
           //require_noerr(err, exit); 
+
+          // Keep the connection for the next request unless the client or the limit says otherwise
+          if( httpHeader->persistent == false || ++requestCount >= CONFIG_SERVICE_MAX_REQUESTS ){
+            config_log("Close connection after %d requests.", requestCount);
+            err = kNoErr;
+            goto exit;
+          }
       
           // Reuse HTTPHeader
           HTTPHeaderClear( httpHeader );
@@ -223,7 +266,7 @@ static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos,
   size_t          valueSize;
   configContext_t *context = (configContext_t *)inUserContext;
 
-  err = HTTPGetHeaderField( inHeader->buf, inHeader->len, "Content-Type", NULL, NULL, &value, &valueSize, NULL );
+  err = HTTPHeaderGetField( inHeader, "Content-Type", &value, &valueSize );
   if(err == kNoErr && strnicmpx( value, valueSize, kMIMEType_MXCHIP_OTA ) == 0){
     config_log("OTA data %d, %d to: %x", inPos, inLen, context->flashStorageAddress);
 #ifdef MICO_FLASH_FOR_UPDATE  
@@ -246,6 +289,10 @@ static OSStatus onReceivedData(struct _HTTPHeader_t * inHeader, uint32_t inPos,
     return kUnsupportedErr;
 #endif
   }
+  else if(HTTPHeaderIsJsonBody(inHeader)){
+    /* Parse the JSON body as it arrives, it is never stored as a whole */
+    err = HTTPHeaderJsonBodyInput(inHeader, inPos, inData, inLen);
+  }
   else if(inHeader->chunkedData == true){
     config_log("ChunkedData: %d, %d:", inPos, inLen);
     for(uint32_t i = 0; i<inLen; i++)
@@ -280,103 +327,129 @@ static void onClearHTTPHeader(struct _HTTPHeader_t * inHeader, void * inUserCont
 
 
 
-OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext)
+static OSStatus _configReadHandler( const URLRouteMatch_t *inMatch, void *inRequest )
 {
   OSStatus err = kUnknownErr;
+  configRequest_t *request = (configRequest_t *)inRequest;
   const char *  json_str;
-  uint8_t *httpResponse = NULL;
-  size_t httpResponseLen = 0;
   json_object* report = NULL;
-  config_log_trace();
+  UNUSED_PARAMETER(inMatch);
+
+  report = ConfigCreateReportJsonMessage( request->context );
+  require( report, exit );
+  json_str = json_object_to_json_string(report);
+  require_action( json_str, exit, err = kNoMemoryErr );
+  config_log("Send config object=%s", json_str);
+  err = HTTPResponseSend( request->fd, kStatusOK, kMIMEType_JSON, (const uint8_t *)json_str, strlen(json_str) );
+  require_noerr( err, exit );
+  config_log("Current configuration sent");
 
-  if(HTTPHeaderMatchURL( inHeader, kCONFIGURLRead ) == kNoErr){    
-    report = ConfigCreateReportJsonMessage( inContext );
-    require( report, exit );
-    json_str = json_object_to_json_string(report);
-    require_action( json_str, exit, err = kNoMemoryErr );
-    config_log("Send config object=%s", json_str);
-    err =  CreateSimpleHTTPMessageNoCopy( kMIMEType_JSON, strlen(json_str), &httpResponse, &httpResponseLen );
-    require_noerr( err, exit );
-    require( httpResponse, exit );
-    err = SocketSend( fd, httpResponse, httpResponseLen );
-    require_noerr( err, exit );
-    err = SocketSend( fd, (uint8_t *)json_str, strlen(json_str) );
+exit:
+  if(report)        json_object_put(report);
+  return err;
+}
+
+static OSStatus _configWriteHandler( const URLRouteMatch_t *inMatch, void *inRequest )
+{
+  OSStatus err = kUnknownErr;
+  configRequest_t *request = (configRequest_t *)inRequest;
+  mico_Context_t *inContext = request->context;
+  json_object *body = NULL;
+  UNUSED_PARAMETER(inMatch);
+
+  if(request->header->contentLength > 0){
+    config_log("Recv new configuration, apply and reset");
+    body = HTTPHeaderTakeJsonBody( request->header );
+    err = ConfigIncommingJsonObject( body, inContext);
+    if(body) json_object_put(body);
     require_noerr( err, exit );
-    config_log("Current configuration sent");
-    goto exit;
-  }
-  else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWrite ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Recv new configuration, apply and reset");
-      err = ConfigIncommingJsonMessage( inHeader->extraDataPtr, inContext);
-      require_noerr( err, exit );
-      inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
-      MICOUpdateConfiguration(inContext);
-
-      err =  CreateSimpleHTTPOKMessage( &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
-      err = SocketSend( fd, httpResponse, httpResponseLen );
-      SocketClose(&fd);
-      inContext->micoStatus.sys_state = eState_Software_Reset;
-      if(inContext->micoStatus.sys_state_change_sem != NULL );
-        mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
-      mico_thread_sleep(MICO_WAIT_FOREVER);
-    }
-    goto exit;
+    inContext->flashContentInRam.micoSystemConfig.configured = allConfigured;
+    MICOUpdateConfiguration(inContext);
+
+    err = HTTPResponseSend( request->fd, kStatusOK, NULL, NULL, 0 );
+    SocketClose(&request->fd);
+    inContext->micoStatus.sys_state = eState_Software_Reset;
+    if(inContext->micoStatus.sys_state_change_sem != NULL );
+      mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
+    mico_thread_sleep(MICO_WAIT_FOREVER);
   }
-else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLWriteByUAP ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Recv new configuration from uAP, apply and connect to AP");
-      err = ConfigIncommingJsonMessageUAP( inHeader->extraDataPtr, inContext);
-      require_noerr( err, exit );
-      MICOUpdateConfiguration(inContext);
 
-      err =  CreateSimpleHTTPOKMessage( &httpResponse, &httpResponseLen );
-      require_noerr( err, exit );
-      require( httpResponse, exit );
+exit:
+  return err;
+}
+
+static OSStatus _configWriteByUAPHandler( const URLRouteMatch_t *inMatch, void *inRequest )
+{
+  OSStatus err = kUnknownErr;
+  configRequest_t *request = (configRequest_t *)inRequest;
+  mico_Context_t *inContext = request->context;
+  json_object *body = NULL;
+  UNUSED_PARAMETER(inMatch);
+
+  if(request->header->contentLength > 0){
+    config_log("Recv new configuration from uAP, apply and connect to AP");
+    body = HTTPHeaderTakeJsonBody( request->header );
+    err = ConfigIncommingJsonObjectUAP( body, inContext);
+    if(body) json_object_put(body);
+    require_noerr( err, exit );
+    MICOUpdateConfiguration(inContext);
 
-      err = SocketSend( fd, httpResponse, httpResponseLen );
-      require_noerr( err, exit );
-      sleep(1);
+    err = HTTPResponseSend( request->fd, kStatusOK, NULL, NULL, 0 );
+    require_noerr( err, exit );
+    sleep(1);
 
-      micoWlanSuspendSoftAP();
-      _easylinkConnectWiFi( inContext );
+    micoWlanSuspendSoftAP();
+    _easylinkConnectWiFi( inContext );
 
-      err = kConnectionErr; //Return an err to close socket and exit the current thread
-    }
-    goto exit;
+    err = kConnectionErr; //Return an err to close socket and exit the current thread
   }
+
+exit:
+  return err;
+}
+
 #ifdef MICO_FLASH_FOR_UPDATE
-  else if(HTTPHeaderMatchURL( inHeader, kCONFIGURLOTA ) == kNoErr){
-    if(inHeader->contentLength > 0){
-      config_log("Receive OTA data!");
-      memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
-      inContext->flashContentInRam.bootTable.length = inHeader->contentLength;
-      inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
-      inContext->flashContentInRam.bootTable.type = 'A';
-      inContext->flashContentInRam.bootTable.upgrade_type = 'U';
-      if(inContext->flashContentInRam.micoSystemConfig.configured != allConfigured)
-        inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_SOFT_AP_BYPASS;
-      MICOUpdateConfiguration(inContext);
-      SocketClose(&fd);
-      inContext->micoStatus.sys_state = eState_Software_Reset;
-      if(inContext->micoStatus.sys_state_change_sem != NULL );
-        mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
-      mico_thread_sleep(MICO_WAIT_FOREVER);
-    }
-    goto exit;
+static OSStatus _configOTAHandler( const URLRouteMatch_t *inMatch, void *inRequest )
+{
+  OSStatus err = kUnknownErr;
+  configRequest_t *request = (configRequest_t *)inRequest;
+  mico_Context_t *inContext = request->context;
+  UNUSED_PARAMETER(inMatch);
+
+  if(request->header->contentLength > 0){
+    config_log("Receive OTA data!");
+    memset(&inContext->flashContentInRam.bootTable, 0, sizeof(boot_table_t));
+    inContext->flashContentInRam.bootTable.length = request->header->contentLength;
+    inContext->flashContentInRam.bootTable.start_address = UPDATE_START_ADDRESS;
+    inContext->flashContentInRam.bootTable.type = 'A';
+    inContext->flashContentInRam.bootTable.upgrade_type = 'U';
+    if(inContext->flashContentInRam.micoSystemConfig.configured != allConfigured)
+      inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_SOFT_AP_BYPASS;
+    MICOUpdateConfiguration(inContext);
+    SocketClose(&request->fd);
+    inContext->micoStatus.sys_state = eState_Software_Reset;
+    if(inContext->micoStatus.sys_state_change_sem != NULL );
+      mico_rtos_set_semaphore(&inContext->micoStatus.sys_state_change_sem);
+    mico_thread_sleep(MICO_WAIT_FOREVER);
   }
+
+  return err;
+}
 #endif
-  else{
-    return kNotFoundErr;
-  };
+
+OSStatus _LocalConfigRespondInComingMessage(int fd, HTTPHeader_t* inHeader, mico_Context_t * const inContext)
+{
+  OSStatus err = kUnknownErr;
+  configRequest_t request = { fd, inHeader, inContext };
+  config_log_trace();
+
+  /* One pass over method and path picks the handler, kNotFoundErr if no route matches */
+  err = URLRouterDispatch( configRouter, inHeader->methodPtr, inHeader->methodLen, &inHeader->url, &request );
+  require_noerr_quiet( err, exit );
 
  exit:
   if(inHeader->persistent == false)  //Return an err to close socket and exit the current thread
     err = kConnectionErr;
-  if(httpResponse)  free(httpResponse);
-  if(report)        json_object_put(report);
 
   return err;
 
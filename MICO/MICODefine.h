@@ -68,6 +68,8 @@
 #endif
 
 #define CONFIG_SERVICE_PORT     8000
+#define CONFIG_SERVICE_IDLE_TIMEOUT     60  /**< Seconds a persistent config connection may stay idle. */
+#define CONFIG_SERVICE_MAX_REQUESTS     32  /**< Requests served on one config connection before it is closed. */
 
 #define APPLICATION_WATCHDOG_TIMEOUT_SECONDS  5 /**< Watch-dog enabled by MICO's main thread:
                                                      5 seconds to reload. */
@@ -292,14 +292,12 @@ void _easylinkConnectWiFi( mico_Context_t * const inContext)
 }
 
 
-OSStatus ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * const inContext )
+OSStatus ConfigIncommingJsonObjectUAP( json_object *new_obj, mico_Context_t * const inContext )
 {
   OSStatus err = kNoErr;
-  json_object *new_obj;
   easylink_uap_log_trace();
   inContext->flashContentInRam.micoSystemConfig.easyLinkByPass = EASYLINK_BYPASS_NO;
 
-  new_obj = json_tokener_parse(input);
   require_action(new_obj, exit, err = kUnknownErr);
   easylink_uap_log("Recv config object=%s", json_object_to_json_string(new_obj));
   json_object_object_foreach(new_obj, key, val) {
@@ -330,6 +328,20 @@ OSStatus ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * cons
       strncpy(inContext->flashContentInRam.micoSystemConfig.dnsServer, json_object_get_string(val), maxIpLen);
     }
   }
+
+exit:
+  return err; 
+}
+
+OSStatus ConfigIncommingJsonMessageUAP( const char *input, mico_Context_t * const inContext )
+{
+  OSStatus err = kNoErr;
+  json_object *new_obj;
+  easylink_uap_log_trace();
+
+  new_obj = json_tokener_parse(input);
+  require_action(new_obj, exit, err = kUnknownErr);
+  err = ConfigIncommingJsonObjectUAP(new_obj, inContext);
   json_object_put(new_obj);
 
 exit:
@@ -279,19 +279,8 @@ OSStatus FUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t timeou
       
       size -= transfer_size;
       
-      // Grab data from the buffer
-      do
-      {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( uart_interfaces[uart].rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data = ( (uint8_t*) data + bytes_available );
-        ring_buffer_consume( uart_interfaces[uart].rx_buffer, bytes_available );
-      } while ( transfer_size != 0 );
+      // Grab data from the buffer, both wrapped segments in one pass
+      data = ( (uint8_t*) data + ring_buffer_read( uart_interfaces[uart].rx_buffer, (uint8_t*) data, transfer_size ) );
     }
     
     if ( size != 0 )
@@ -417,6 +406,7 @@ void FuartInterrupt(void)
 {
   int status;
   uint8_t rxData;
+  uint8_t* rxSpace;
   status = FuartIOctl(UART_IOCTL_RXSTAT_GET,0);
 
   if(status & 0x1E){
@@ -433,8 +423,14 @@ void FuartInterrupt(void)
   if(status & 0x01)
   { 
     //or,you can receive them in the interrupt directly
-    while(FuartRecvByte(&rxData) > 0){
-      ring_buffer_write( uart_interfaces[ AP80xx_FUART ].rx_buffer, &rxData,1 );
+    //receive in place into the ring buffer, drop the byte if it is full
+    while(1){
+      if( ring_buffer_reserve( uart_interfaces[ AP80xx_FUART ].rx_buffer, &rxSpace, 1 ) == 0 )
+        rxSpace = &rxData;
+      if( FuartRecvByte(rxSpace) <= 0 )
+        break;
+      if( rxSpace != &rxData )
+        ring_buffer_commit( uart_interfaces[ AP80xx_FUART ].rx_buffer, 1 );
     }
 
     FuartIOctl(UART_IOCTL_RXINT_CLR,0);
@@ -501,19 +501,8 @@ OSStatus MicoUartRecv( mico_uart_t uart, void* data, uint32_t size, uint32_t tim
       
       size -= transfer_size;
       
-      // Grab data from the buffer
-      do
-      {
-        uint8_t* available_data;
-        uint32_t bytes_available;
-        
-        ring_buffer_get_data( uart_interfaces[uart].rx_buffer, &available_data, &bytes_available );
-        bytes_available = MIN( bytes_available, transfer_size );
-        memcpy( data, available_data, bytes_available );
-        transfer_size -= bytes_available;
-        data = ( (uint8_t*) data + bytes_available );
-        ring_buffer_consume( uart_interfaces[uart].rx_buffer, bytes_available );
-      } while ( transfer_size != 0 );
+      // Grab data from the buffer, both wrapped segments in one pass
+      data = ( (uint8_t*) data + ring_buffer_read( uart_interfaces[uart].rx_buffer, (uint8_t*) data, transfer_size ) );
     }
     
     if ( size != 0 )
@@ -0,0 +1,65 @@
+/*
+	File:    MicoAES-host.c
+
+	Host stand-in for the block functions of include/MicoAES.h that AESUtils.c calls, built on External/GladmanAES.
+	On the target these come from Library/MicoCrypto.a, which is ARM only. This lets crypto_bench run AESUtils.c with
+	its default backend, AES_UTILS_USE_MICO_AES, so the per-block call pattern of that backend is what gets timed.
+
+	The Gladman key schedule is kept in the key and rounds fields of Aes, which it fills exactly. reg holds the CBC IV
+	as it does in the library.
+*/
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../include/MicoAES.h"
+#include "aes.h"
+
+typedef char	MicoAESHostCheck[ ( ( offsetof( Aes, key ) == 0 ) && ( sizeof( aes_encrypt_ctx ) <= offsetof( Aes, reg ) ) ) ? 1 : -1 ];
+
+#define	_EncryptCtx( AES )		( (aes_encrypt_ctx *)(void *)( AES ) )
+#define	_DecryptCtx( AES )		( (aes_decrypt_ctx *)(void *)( AES ) )
+
+int	AesSetKey( Aes *aes, const byte *userKey, word32 keylen, const byte *iv, int dir )
+{
+	int		err;
+
+	aes_init();
+	if( dir == AES_DECRYPTION )	err = aes_decrypt_key( userKey, (int) keylen, _DecryptCtx( aes ) );
+	else						err = aes_encrypt_key( userKey, (int) keylen, _EncryptCtx( aes ) );
+	if( err != EXIT_SUCCESS ) return( -1 );
+	return( AesSetIV( aes, iv ) );
+}
+
+int	AesSetKeyDirect( Aes *aes, const byte *userKey, word32 keylen, const byte *iv, int dir )
+{
+	return( AesSetKey( aes, userKey, keylen, iv, dir ) );
+}
+
+int	AesSetIV( Aes *aes, const byte *iv )
+{
+	if( iv )	memcpy( aes->reg, iv, AES_BLOCK_SIZE );
+	else		memset( aes->reg, 0, AES_BLOCK_SIZE );
+	return( 0 );
+}
+
+void	AesEncryptDirect( Aes *aes, byte *out, const byte *in )
+{
+	aes_encrypt( in, out, _EncryptCtx( aes ) );
+}
+
+void	AesDecryptDirect( Aes *aes, byte *out, const byte *in )
+{
+	aes_decrypt( in, out, _DecryptCtx( aes ) );
+}
+
+int	AesCbcEncrypt( Aes *aes, byte *out, const byte *in, word32 sz )
+{
+	return( ( aes_cbc_encrypt( in, out, (int) sz, (unsigned char *) aes->reg, _EncryptCtx( aes ) ) == EXIT_SUCCESS ) ? 0 : -1 );
+}
+
+int	AesCbcDecrypt( Aes *aes, byte *out, const byte *in, word32 sz )
+{
+	return( ( aes_cbc_decrypt( in, out, (int) sz, (unsigned char *) aes->reg, _DecryptCtx( aes ) ) == EXIT_SUCCESS ) ? 0 : -1 );
+}
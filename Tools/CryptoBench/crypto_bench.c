@@ -0,0 +1,644 @@
+/*
+	File:    crypto_bench.c
+
+	Host benchmark for the crypto used on the HomeKit pairing and session paths: External/SHAUtils (SHA, HMAC, HKDF),
+	External/GladmanAES (ECB, CBC, CTR, GCM), optionally Library/support/AESUtils.c, both Curve25519 builds and the
+	ChaCha20-Poly1305 AEAD. Each primitive is run across message sizes after a warm-up and reported as median and p99
+	ns per operation and cycles per byte, as a table or as JSON for regression tracking. GCM is also run with every
+	GHASH multiplier compiled in, next to the RAM each one costs per key. It finishes with an estimate of the
+	accessory's share of a HAP pair-verify, added up from the operations it performs.
+
+	Ed25519 only exists as the ARM build in Library/MicoCrypto.a, so it can't be run here. Pass the target's numbers
+	with --ed25519 <sign ns>,<verify ns> to include it in the pair-verify estimate.
+
+	Build from the top of the tree (Linux, gcc or clang):
+
+		R=.
+		cc -O2 -DCURVE25519_64_BIT=0 -Dcurve25519_donna=curve25519_donna_32 -Dcurve25519_donna_base=curve25519_donna_base_32 \
+			-c $R/External/Curve25519/curve25519-donna.c -o /tmp/donna32.o
+		cc -O2 -DCURVE25519_64_BIT=1 -Dcurve25519_donna=curve25519_donna_64 -Dcurve25519_donna_base=curve25519_donna_base_64 \
+			-c $R/External/Curve25519/curve25519-donna.c -o /tmp/donna64.o
+		cc -O2 -DSODIUM_STATIC -I$R/include -I$R/External/SHAUtils -I$R/External/GladmanAES \
+			$R/Tools/CryptoBench/crypto_bench.c \
+			$R/External/SHAUtils/{sha1,sha224-256,sha384-512,usha,hmac,hkdf}.c \
+			$R/External/GladmanAES/{aescrypt,aeskey,aestab,aes_modes,gcm,gf128mul}.c \
+			$R/External/ChaCha20Poly1305/chacha20poly1305.c /tmp/donna32.o /tmp/donna64.o -o crypto_bench
+
+	To include the AESUtils.c wrappers, add
+
+		-DCRYPTO_BENCH_AESUTILS=1 -DAES_UTILS_HAS_GLADMAN_GCM=1 -I$R -I$R/Library/support -I$R/Board/MiCOKit-3288 \
+			-I$R/Platform/Cortex-M4 -I$R/Demos/COM.Apple.HomeKit -I$R/Tools/CryptoBench/host \
+			$R/Library/support/{AESUtils,SecurityUtils}.c $R/Tools/CryptoBench/MicoAES-host.c
+
+	This builds AESUtils.c with its default backend, AES_UTILS_USE_MICO_AES, on MicoAES-host.c, which stands in for
+	the AES in Library/MicoCrypto.a with Gladman's block functions. Add -DAES_UTILS_USE_GLADMAN_AES=1 for the Gladman
+	backend instead. The rows are named after the backend. Before they run, AES_CTR_Update must reproduce the SP 800-38A
+	F.5.1 vector fed in uneven pieces and Gladman's CTR output over kBenchMaxSize bytes. To compare against another
+	revision of AESUtils.c, build it the same way and compare the aesutils-*-ctr rows; sizes of 64 bytes and up show
+	the per-block overhead. On a case-sensitive file system the Debug.h includes also need a MicoRTOS.h that includes
+	MICORTOS.h, as below.
+
+	Add -DCRYPTO_BENCH_SHAUTILS=1 $R/Library/support/SHAUtils.c for the SHA3-256, SHA3-512, Keccak-512 and SHAKE128/256
+	rows. SHAUtils.c includes Library/support/Debug.h, which also needs -I$R/Library/support -I$R/Board/MiCOKit-3288
+	-I$R/Platform/Cortex-M4 -I$R/Demos/COM.Apple.HomeKit and, on a case-sensitive file system, a MicoRTOS.h that
+	includes MICORTOS.h.
+
+	Usage: crypto_bench [--json] [--quick] [--ed25519 <sign ns>,<verify ns>]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if( defined( __x86_64__ ) || defined( __i386__ ) )
+	#include <x86intrin.h>
+	#define	CRYPTO_BENCH_HAS_TSC		1
+#else
+	#define	CRYPTO_BENCH_HAS_TSC		0
+#endif
+
+#include "sha.h"
+#include "aes.h"
+#include "gcm.h"
+#include "MICOCrypto/crypto_aead_chacha20poly1305.h"
+
+#if( !defined( CRYPTO_BENCH_AESUTILS ) )
+	#define	CRYPTO_BENCH_AESUTILS		0
+#endif
+
+#if( CRYPTO_BENCH_AESUTILS )
+	#include "AESUtils.h"
+
+	#if( AES_UTILS_USE_GLADMAN_AES )
+		#define	kAESUtilsRowPrefix		"aesutils-gladman-"
+	#else
+		#define	kAESUtilsRowPrefix		"aesutils-mico-"
+	#endif
+#endif
+
+#if( !defined( CRYPTO_BENCH_SHAUTILS ) )
+	#define	CRYPTO_BENCH_SHAUTILS		0
+#endif
+
+#if( CRYPTO_BENCH_SHAUTILS )
+	#include "SHAUtils.h"
+#endif
+
+void	curve25519_donna_32( unsigned char *outKey, const unsigned char *inSecret, const unsigned char *inBasePoint );
+void	curve25519_donna_base_32( unsigned char *outKey, const unsigned char *inSecret );
+void	curve25519_donna_64( unsigned char *outKey, const unsigned char *inSecret, const unsigned char *inBasePoint );
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+#define	kBenchMaxSize			8192
+#define	kBenchMaxResults		128
+#define	kBenchMaxSamples		201
+
+typedef void ( *BenchFunc )( size_t inSize );
+
+typedef struct
+{
+	const char *		name;
+	size_t				size;			// Bytes per operation, 0 for fixed-size operations.
+	double				medianNs;
+	double				p99Ns;
+	double				cyclesPerByte;	// Median, 0 if there is no cycle counter or size is 0.
+
+}	BenchResult;
+
+static const size_t		kBenchSizes[] = { 16, 64, 256, 1024, 8192 };
+
+static uint8_t			gIn[ kBenchMaxSize + 64 ];
+static uint8_t			gOut[ kBenchMaxSize + 64 ];
+static uint8_t			gSealed[ kBenchMaxSize + 64 ];
+static size_t			gSealedSize		= SIZE_MAX;
+static uint8_t			gKey[ 64 ];
+static uint8_t			gIV[ 16 ];
+static BenchResult		gResults[ kBenchMaxResults ];
+static size_t			gResultCount;
+static int				gSampleCount	= kBenchMaxSamples;
+static double			gSampleNs		= 50000;	// Minimum time per sample.
+
+static aes_encrypt_ctx	gAESEncrypt[ 1 ];
+static gcm_ctx			gGCM[ 1 ];
+static void *			gGCMTable;
+
+// GHASH multipliers for the throughput vs RAM matrix, each on its own context and table.
+
+typedef struct
+{
+	ghash_mode				mode;
+	const char *			name;
+	gcm_ctx					ctx[ 1 ];
+	unsigned long			tableSize;		// Bytes of table per key, 0 for the table-less multipliers.
+	int						available;		// Compiled in, see the TABLES_* switches in gf128mul.h.
+	const BenchResult *		results[ 2 ];	// One per kGHashSizes entry.
+
+}	GHashModeRow;
+
+static const size_t		kGHashSizes[] = { 64, 1024 };
+
+static GHashModeRow		gGHashModes[] =
+{
+	{ GHASH_TABLES_64K,	"gcm-ghash-64k" },
+	{ GHASH_TABLES_8K,	"gcm-ghash-8k" },
+	{ GHASH_TABLES_4K,	"gcm-ghash-4k" },
+	{ GHASH_TABLES_256,	"gcm-ghash-256" },
+	{ GHASH_CONST_TIME,	"gcm-ghash-const-time" },
+	{ GHASH_NO_TABLES,	"gcm-ghash-no-tables" },
+};
+static GHashModeRow *	gGHashRow;
+
+#if( CRYPTO_BENCH_AESUTILS )
+static AES_CTR_Context		gAESUtilsCTR;
+static AES_CBCFrame_Context	gAESUtilsCBC;
+static AES_GCM_Context		gAESUtilsGCM;
+#endif
+
+//===========================================================================================================================
+//	Timing
+//===========================================================================================================================
+
+static uint64_t	_NowNs( void )
+{
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ( (uint64_t) ts.tv_sec * 1000000000 ) + (uint64_t) ts.tv_nsec );
+}
+
+static uint64_t	_NowCycles( void )
+{
+#if( CRYPTO_BENCH_HAS_TSC )
+	return( __rdtsc() );
+#else
+	return( 0 );
+#endif
+}
+
+static int	_CompareDoubles( const void *inLeft, const void *inRight )
+{
+	double const		a = *( (const double *) inLeft );
+	double const		b = *( (const double *) inRight );
+
+	return( ( a > b ) - ( a < b ) );
+}
+
+//===========================================================================================================================
+//	_BenchRun
+//
+//	Warms up for ~20 ms, picks a batch size so each sample takes at least gSampleNs, then takes gSampleCount samples.
+//===========================================================================================================================
+
+static const BenchResult *	_BenchRun( const char *inName, BenchFunc inFunc, size_t inSize )
+{
+	double			ns[ kBenchMaxSamples ];
+	double			cycles[ kBenchMaxSamples ];
+	BenchResult *	result;
+	uint64_t		start, startCycles;
+	uint32_t		batch, i;
+	int				s;
+
+	if( gResultCount >= kBenchMaxResults ) return( NULL );
+	result = &gResults[ gResultCount++ ];
+
+	start = _NowNs();
+	batch = 0;
+	do { inFunc( inSize ); ++batch; } while( ( _NowNs() - start ) < 20000000 );
+	batch = (uint32_t)( ( batch * gSampleNs ) / 20000000.0 );
+	if( batch < 1 ) batch = 1;
+
+	for( s = 0; s < gSampleCount; ++s )
+	{
+		startCycles = _NowCycles();
+		start		= _NowNs();
+		for( i = 0; i < batch; ++i ) inFunc( inSize );
+		ns[ s ]		= (double)( _NowNs() - start ) / batch;
+		cycles[ s ]	= (double)( _NowCycles() - startCycles ) / batch;
+	}
+	qsort( ns, (size_t) gSampleCount, sizeof( ns[ 0 ] ), _CompareDoubles );
+	qsort( cycles, (size_t) gSampleCount, sizeof( cycles[ 0 ] ), _CompareDoubles );
+
+	result->name			= inName;
+	result->size			= inSize;
+	result->medianNs		= ns[ gSampleCount / 2 ];
+	result->p99Ns			= ns[ ( ( gSampleCount - 1 ) * 99 ) / 100 ];
+	result->cyclesPerByte	= ( inSize > 0 ) ? ( cycles[ gSampleCount / 2 ] / inSize ) : 0;
+	return( result );
+}
+
+static void	_BenchSizes( const char *inName, BenchFunc inFunc )
+{
+	size_t		i;
+
+	for( i = 0; i < sizeof( kBenchSizes ) / sizeof( kBenchSizes[ 0 ] ); ++i ) _BenchRun( inName, inFunc, kBenchSizes[ i ] );
+}
+
+//===========================================================================================================================
+//	Primitives
+//===========================================================================================================================
+
+static void	_USHA( SHAversion inVersion, size_t inSize )
+{
+	USHAContext		ctx;
+
+	USHAReset( &ctx, inVersion );
+	USHAInput( &ctx, gIn, (unsigned int) inSize );
+	USHAResult( &ctx, gOut );
+}
+
+static void	_SHA1( size_t inSize )			{ _USHA( SHA1, inSize ); }
+static void	_SHA256( size_t inSize )		{ _USHA( SHA256, inSize ); }
+static void	_SHA512( size_t inSize )		{ _USHA( SHA512, inSize ); }
+static void	_HMAC_SHA512( size_t inSize )	{ hmac( SHA512, gIn, (int) inSize, gKey, 32, gOut ); }
+
+#if( CRYPTO_BENCH_SHAUTILS )
+// SHAKE is read for the output a key derivation would take: 32 bytes from SHAKE128, 64 from SHAKE256.
+
+static void	_SHA3_256( size_t inSize )		{ SHA3_256_compat( gIn, inSize, gOut ); }
+static void	_SHA3_512( size_t inSize )		{ SHA3_512_compat( gIn, inSize, gOut ); }
+static void	_Keccak512( size_t inSize )		{ SHA3_compat( gIn, inSize, gOut ); }
+static void	_SHAKE128( size_t inSize )		{ SHAKE128_compat( gIn, inSize, gOut, 32 ); }
+static void	_SHAKE256( size_t inSize )		{ SHAKE256_compat( gIn, inSize, gOut, 64 ); }
+#endif
+
+// The HomeKit session and pair-verify keys: 32-byte shared secret in, 32-byte key out.
+
+static void	_HKDF_SHA512( size_t inSize )
+{
+	(void) inSize;
+	hkdf( SHA512, (const unsigned char *) "Control-Salt", 12, gKey, 32,
+		(const unsigned char *) "Control-Read-Encryption-Key", 27, gOut, 32 );
+}
+
+static void	_AES_ECB( size_t inSize )		{ aes_ecb_encrypt( gIn, gOut, (int) inSize, gAESEncrypt ); }
+static void	_AES_CBC( size_t inSize )		{ aes_cbc_encrypt( gIn, gOut, (int) inSize, gIV, gAESEncrypt ); }
+
+static void	_AES_CTRIncrement( unsigned char *ioCounter )
+{
+	int		i;
+
+	for( i = 15; ( i >= 0 ) && ( ++ioCounter[ i ] == 0 ); --i ) {}
+}
+
+static void	_AES_CTR( size_t inSize )
+{
+	aes_ctr_crypt( gIn, gOut, (int) inSize, gIV, _AES_CTRIncrement, gAESEncrypt );
+}
+
+static void	_AES_GCM( size_t inSize )
+{
+	gcm_encrypt_message( gIV, 12, gKey, 16, gOut, (unsigned long) inSize, gOut + inSize, 16, gGCM );
+}
+
+static void	_AES_GCMMode( size_t inSize )
+{
+	gcm_encrypt_message( gIV, 12, gKey, 16, gOut, (unsigned long) inSize, gOut + inSize, 16, gGHashRow->ctx );
+}
+
+// Sets up every GHASH mode on its own key and runs GCM on it. Modes that are not compiled in are listed as such.
+
+static int	_BenchGHashModes( void )
+{
+	GHashModeRow *		row;
+	void *				table;
+	size_t				i, j;
+
+	for( i = 0; i < sizeof( gGHashModes ) / sizeof( gGHashModes[ 0 ] ); ++i )
+	{
+		row = &gGHashModes[ i ];
+		row->tableSize = gcm_table_size( row->mode );
+		table = row->tableSize ? malloc( row->tableSize ) : NULL;
+		if( row->tableSize && !table ) return( -1 );
+
+		row->available = ( gcm_init_and_key_mode( gKey, 16, row->mode, table, row->ctx ) == RETURN_GOOD );
+		if( row->available )
+		{
+			gGHashRow = row;
+			for( j = 0; j < sizeof( kGHashSizes ) / sizeof( kGHashSizes[ 0 ] ); ++j )
+			{
+				row->results[ j ] = _BenchRun( row->name, _AES_GCMMode, kGHashSizes[ j ] );
+			}
+			gcm_end( row->ctx );
+		}
+		free( table );
+	}
+	return( 0 );
+}
+
+#if( CRYPTO_BENCH_AESUTILS )
+static void	_AESUtils_CTR( size_t inSize )	{ AES_CTR_Update( &gAESUtilsCTR, gIn, inSize, gOut ); }
+
+// AES_CTR_Update against SP 800-38A F.5.1, in pieces that start and end inside blocks, and against Gladman's CTR over
+// kBenchMaxSize bytes, so the rows time a correct build of whichever backend was selected.
+
+static int	_CheckAESUtilsCTR( void )
+{
+	static const uint8_t		kKey[ 16 ]	= { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	static const uint8_t		kCounter[ 16 ] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+	static const uint8_t		kPlain[ 64 ] =
+	{
+		0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+		0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+		0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+		0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+	};
+	static const uint8_t		kCipher[ 64 ] =
+	{
+		0x87, 0x4d, 0x61, 0x91, 0xb6, 0x20, 0xe3, 0x26, 0x1b, 0xef, 0x68, 0x64, 0x99, 0x0d, 0xb6, 0xce,
+		0x98, 0x06, 0xf6, 0x6b, 0x79, 0x70, 0xfd, 0xff, 0x86, 0x17, 0x18, 0x7b, 0xb9, 0xff, 0xfd, 0xff,
+		0x5a, 0xe4, 0xdf, 0x3e, 0xdb, 0xd5, 0xd3, 0x5e, 0x5b, 0x4f, 0x09, 0x02, 0x0d, 0xb0, 0x3e, 0xab,
+		0x1e, 0x03, 0x1d, 0xda, 0x2f, 0xbe, 0x03, 0xd1, 0x79, 0x21, 0x70, 0xa0, 0xf3, 0x00, 0x9c, 0xee
+	};
+	static const size_t			kPieces[]	= { 5, 27, 0, 32 };
+	AES_CTR_Context				ctx;
+	uint8_t						out[ 64 ];
+	uint8_t						counter[ 16 ];
+	size_t						i, offset;
+	int							ok;
+
+	if( AES_CTR_Init( &ctx, kKey, kCounter ) != kNoErr ) return( -1 );
+	for( offset = 0, i = 0; i < sizeof( kPieces ) / sizeof( kPieces[ 0 ] ); offset += kPieces[ i++ ] )
+	{
+		if( AES_CTR_Update( &ctx, kPlain + offset, kPieces[ i ], out + offset ) != kNoErr ) break;
+	}
+	AES_CTR_Final( &ctx );
+	ok = ( offset == sizeof( kPlain ) ) && ( memcmp( out, kCipher, sizeof( kCipher ) ) == 0 );
+
+	if( ok && ( AES_CTR_Init( &ctx, gKey, gIV ) == kNoErr ) )
+	{
+		memcpy( counter, gIV, sizeof( counter ) );
+		aes_ctr_crypt( gIn, gSealed, kBenchMaxSize, counter, _AES_CTRIncrement, gAESEncrypt );
+		ok = ( AES_CTR_Update( &ctx, gIn, 1, gOut ) == kNoErr ) &&
+			 ( AES_CTR_Update( &ctx, gIn + 1, kBenchMaxSize - 1, gOut + 1 ) == kNoErr ) &&
+			 ( memcmp( gOut, gSealed, kBenchMaxSize ) == 0 );
+		AES_CTR_Final( &ctx );
+	}
+	return( ok ? 0 : -1 );
+}
+static void	_AESUtils_CBC( size_t inSize )	{ AES_CBCFrame_Update( &gAESUtilsCBC, gIn, inSize, gOut ); }
+
+static void	_AESUtils_GCM( size_t inSize )
+{
+	AES_GCM_InitMessage( &gAESUtilsGCM, gIV );
+	AES_GCM_AddAAD( &gAESUtilsGCM, gKey, 16 );
+	AES_GCM_Encrypt( &gAESUtilsGCM, gIn, inSize, gOut );
+	AES_GCM_FinalizeMessage( &gAESUtilsGCM, gOut + inSize );
+}
+#endif
+
+// A HAP frame: the 2-byte little endian length is the AD.
+
+static void	_ChaChaPolyEncrypt( size_t inSize )
+{
+	unsigned long long		len;
+	uint8_t					ad[ 2 ];
+
+	ad[ 0 ] = (uint8_t)( inSize & 0xFF );
+	ad[ 1 ] = (uint8_t)( inSize >> 8 );
+	crypto_aead_chacha20poly1305_encrypt( gOut, &len, gIn, inSize, ad, sizeof( ad ), NULL, gIV, gKey );
+}
+
+// Opens a frame sealed once per size so every run authenticates and decrypts; a bad tag would return early.
+
+static void	_ChaChaPolyDecrypt( size_t inSize )
+{
+	unsigned long long		len;
+	uint8_t					ad[ 2 ];
+
+	ad[ 0 ] = (uint8_t)( inSize & 0xFF );
+	ad[ 1 ] = (uint8_t)( inSize >> 8 );
+	if( gSealedSize != inSize )
+	{
+		crypto_aead_chacha20poly1305_encrypt( gSealed, &len, gIn, inSize, ad, sizeof( ad ), NULL, gIV, gKey );
+		gSealedSize = inSize;
+	}
+	if( crypto_aead_chacha20poly1305_decrypt( gOut, &len, NULL, gSealed, inSize + 16, ad, sizeof( ad ), gIV, gKey ) != 0 )
+	{
+		fprintf( stderr, "chacha20poly1305 open failed for %u bytes\n", (unsigned int) inSize );
+		exit( 1 );
+	}
+}
+
+static void	_Curve25519Ladder32( size_t inSize )	{ (void) inSize; curve25519_donna_32( gOut, gKey, gKey + 32 ); }
+static void	_Curve25519Base32( size_t inSize )		{ (void) inSize; curve25519_donna_base_32( gOut, gKey ); }
+static void	_Curve25519Ladder64( size_t inSize )	{ (void) inSize; curve25519_donna_64( gOut, gKey, gKey + 32 ); }
+
+//===========================================================================================================================
+//	Reporting
+//===========================================================================================================================
+
+typedef struct
+{
+	const char *	step;
+	double			ns;		// < 0 if not measured.
+
+}	PairVerifyStep;
+
+// MB/s of a result, 0 if it was not run.
+
+static double	_MBPerSecond( const BenchResult *inResult )
+{
+	return( ( inResult && ( inResult->medianNs > 0 ) ) ? ( ( inResult->size * 1000.0 ) / inResult->medianNs ) : 0 );
+}
+
+static void	_PrintGHashModes( int inJSON )
+{
+	const GHashModeRow *		row;
+	size_t						i;
+
+	if( inJSON )
+	{
+		printf( "  \"ghash_modes\": [\n" );
+		for( i = 0; i < sizeof( gGHashModes ) / sizeof( gGHashModes[ 0 ] ); ++i )
+		{
+			row = &gGHashModes[ i ];
+			printf( "    { \"name\": \"%s\", \"available\": %s, \"table_bytes\": %lu, \"context_bytes\": %lu, "
+				"\"mb_per_s_64\": %.1f, \"mb_per_s_1024\": %.1f }%s\n", row->name, row->available ? "true" : "false",
+				row->tableSize, (unsigned long) sizeof( gcm_ctx ), _MBPerSecond( row->results[ 0 ] ),
+				_MBPerSecond( row->results[ 1 ] ), ( i + 1 < sizeof( gGHashModes ) / sizeof( gGHashModes[ 0 ] ) ) ? "," : "" );
+		}
+		printf( "  ],\n" );
+		return;
+	}
+
+	printf( "\nAES-128-GCM by GHASH mode, RAM per key is the context plus the table:\n" );
+	printf( "  %-22s %10s %10s %12s %12s\n", "mode", "table B", "RAM B", "MB/s 64 B", "MB/s 1 KB" );
+	for( i = 0; i < sizeof( gGHashModes ) / sizeof( gGHashModes[ 0 ] ); ++i )
+	{
+		row = &gGHashModes[ i ];
+		if( !row->available )
+		{
+			printf( "  %-22s %10s\n", row->name, "not compiled in" );
+			continue;
+		}
+		printf( "  %-22s %10lu %10lu %12.1f %12.1f\n", row->name, row->tableSize,
+			(unsigned long)( sizeof( gcm_ctx ) + row->tableSize ), _MBPerSecond( row->results[ 0 ] ),
+			_MBPerSecond( row->results[ 1 ] ) );
+	}
+}
+
+static void	_PrintResults( const PairVerifyStep *inSteps, size_t inStepCount, double inTotalNs, int inComplete, int inJSON )
+{
+	size_t		i;
+
+	if( inJSON )
+	{
+		printf( "{\n  \"cycle_counter\": %s,\n  \"results\": [\n", CRYPTO_BENCH_HAS_TSC ? "true" : "false" );
+		for( i = 0; i < gResultCount; ++i )
+		{
+			const BenchResult * const		r = &gResults[ i ];
+
+			printf( "    { \"name\": \"%s\", \"size\": %u, \"median_ns\": %.1f, \"p99_ns\": %.1f, \"cycles_per_byte\": ",
+				r->name, (unsigned int) r->size, r->medianNs, r->p99Ns );
+			if( ( r->size > 0 ) && CRYPTO_BENCH_HAS_TSC )	printf( "%.2f }", r->cyclesPerByte );
+			else											printf( "null }" );
+			printf( "%s\n", ( i + 1 < gResultCount ) ? "," : "" );
+		}
+		printf( "  ],\n" );
+		_PrintGHashModes( inJSON );
+		printf( "  \"pair_verify\": {\n    \"steps\": [\n" );
+		for( i = 0; i < inStepCount; ++i )
+		{
+			printf( "      { \"step\": \"%s\", \"ns\": ", inSteps[ i ].step );
+			if( inSteps[ i ].ns >= 0 )	printf( "%.1f }", inSteps[ i ].ns );
+			else						printf( "null }" );
+			printf( "%s\n", ( i + 1 < inStepCount ) ? "," : "" );
+		}
+		printf( "    ],\n    \"total_ns\": %.1f,\n    \"complete\": %s\n  }\n}\n", inTotalNs, inComplete ? "true" : "false" );
+		return;
+	}
+
+	printf( "%-24s %8s %12s %12s %10s\n", "primitive", "bytes", "median ns", "p99 ns", "cyc/byte" );
+	for( i = 0; i < gResultCount; ++i )
+	{
+		const BenchResult * const		r = &gResults[ i ];
+
+		printf( "%-24s %8u %12.1f %12.1f", r->name, (unsigned int) r->size, r->medianNs, r->p99Ns );
+		if( ( r->size > 0 ) && CRYPTO_BENCH_HAS_TSC )	printf( " %10.2f\n", r->cyclesPerByte );
+		else											printf( " %10s\n", "-" );
+	}
+
+	_PrintGHashModes( inJSON );
+	printf( "\nPair-verify, accessory side:\n" );
+	for( i = 0; i < inStepCount; ++i )
+	{
+		if( inSteps[ i ].ns >= 0 )	printf( "  %-44s %10.1f us\n", inSteps[ i ].step, inSteps[ i ].ns / 1000 );
+		else						printf( "  %-44s %10s\n", inSteps[ i ].step, "not measured" );
+	}
+	printf( "  %-44s %10.1f us%s\n", "total", inTotalNs / 1000, inComplete ? "" : " (without Ed25519, see --ed25519)" );
+}
+
+//===========================================================================================================================
+//	main
+//===========================================================================================================================
+
+int	main( int argc, const char **argv )
+{
+	const BenchResult *		r;
+	PairVerifyStep			steps[ 10 ];
+	size_t					stepCount = 0, i;
+	double					signNs = -1, verifyNs = -1, totalNs;
+	unsigned long			tableSize;
+	int						json = 0, a;
+
+	for( a = 1; a < argc; ++a )
+	{
+		if(      strcmp( argv[ a ], "--json" ) == 0 )	json = 1;
+		else if( strcmp( argv[ a ], "--quick" ) == 0 )	{ gSampleCount = 21; gSampleNs = 20000; }
+		else if( ( strcmp( argv[ a ], "--ed25519" ) == 0 ) && ( ( a + 1 ) < argc ) )
+		{
+			if( sscanf( argv[ ++a ], "%lf,%lf", &signNs, &verifyNs ) != 2 ) signNs = verifyNs = -1;
+		}
+		else
+		{
+			fprintf( stderr, "usage: %s [--json] [--quick] [--ed25519 <sign ns>,<verify ns>]\n", argv[ 0 ] );
+			return( 1 );
+		}
+	}
+
+	for( i = 0; i < sizeof( gIn ); ++i )	gIn[ i ]  = (uint8_t)( i * 13 + 1 );
+	for( i = 0; i < sizeof( gKey ); ++i )	gKey[ i ] = (uint8_t)( i * 7 + 3 );
+	gKey[ 32 ] = 9;	// The second half doubles as a Curve25519 public key.
+	aes_encrypt_key128( gKey, gAESEncrypt );
+	tableSize = gcm_table_size( GHASH_DEFAULT );
+	gGCMTable = tableSize ? malloc( tableSize ) : NULL;
+	if( ( tableSize && !gGCMTable ) || ( gcm_init_and_key_mode( gKey, 16, GHASH_DEFAULT, gGCMTable, gGCM ) != RETURN_GOOD ) )
+	{
+		fprintf( stderr, "GCM setup failed\n" );
+		free( gGCMTable );
+		return( 1 );
+	}
+#if( CRYPTO_BENCH_AESUTILS )
+	if( _CheckAESUtilsCTR() != 0 )
+	{
+		fprintf( stderr, "AESUtils CTR does not match SP 800-38A F.5.1 or Gladman's CTR\n" );
+		return( 1 );
+	}
+	AES_CTR_Init( &gAESUtilsCTR, gKey, gIV );
+	AES_CBCFrame_Init( &gAESUtilsCBC, gKey, gIV, true );
+	AES_GCM_Init( &gAESUtilsGCM, gKey, kAES_CGM_Nonce_None );
+#endif
+
+	_BenchSizes( "sha1", _SHA1 );
+	_BenchSizes( "sha256", _SHA256 );
+	_BenchSizes( "sha512", _SHA512 );
+#if( CRYPTO_BENCH_SHAUTILS )
+	_BenchSizes( "sha3-256", _SHA3_256 );
+	_BenchSizes( "sha3-512", _SHA3_512 );
+	_BenchSizes( "keccak512-compat", _Keccak512 );
+	_BenchSizes( "shake128-32", _SHAKE128 );
+	_BenchSizes( "shake256-64", _SHAKE256 );
+#endif
+	_BenchSizes( "hmac-sha512", _HMAC_SHA512 );
+	_BenchSizes( "gladman-aes128-ecb", _AES_ECB );
+	_BenchSizes( "gladman-aes128-cbc", _AES_CBC );
+	_BenchSizes( "gladman-aes128-ctr", _AES_CTR );
+	_BenchSizes( "gladman-aes128-gcm", _AES_GCM );
+	if( _BenchGHashModes() != 0 )
+	{
+		fprintf( stderr, "GHASH table allocation failed\n" );
+		return( 1 );
+	}
+#if( CRYPTO_BENCH_AESUTILS )
+	_BenchSizes( kAESUtilsRowPrefix "ctr", _AESUtils_CTR );
+	_BenchSizes( kAESUtilsRowPrefix "cbcframe", _AESUtils_CBC );
+	_BenchSizes( kAESUtilsRowPrefix "gcm", _AESUtils_GCM );
+#endif
+	_BenchSizes( "chacha20poly1305-seal", _ChaChaPolyEncrypt );
+	_BenchSizes( "chacha20poly1305-open", _ChaChaPolyDecrypt );
+
+	// Fixed-size operations and the pair-verify steps that use them. M1 -> M2: new key pair, shared secret, sign,
+	// derive the pair-verify key, encrypt the ~85 byte sub-TLV. M3 -> M4: decrypt the ~110 byte sub-TLV, verify,
+	// derive the two session keys.
+
+	r = _BenchRun( "hkdf-sha512", _HKDF_SHA512, 0 );
+	steps[ stepCount ].step = "M2: HKDF-SHA512 pair-verify key";	steps[ stepCount++ ].ns = r->medianNs;
+	steps[ stepCount ].step = "M4: HKDF-SHA512 x2 session keys";	steps[ stepCount++ ].ns = 2 * r->medianNs;
+
+	r = _BenchRun( "curve25519-32-base", _Curve25519Base32, 0 );
+	steps[ stepCount ].step = "M2: Curve25519 key pair (32-bit base)";	steps[ stepCount++ ].ns = r->medianNs;
+	r = _BenchRun( "curve25519-32-ladder", _Curve25519Ladder32, 0 );
+	steps[ stepCount ].step = "M2: Curve25519 shared secret (32-bit ladder)";	steps[ stepCount++ ].ns = r->medianNs;
+	_BenchRun( "curve25519-64-ladder", _Curve25519Ladder64, 0 );
+
+	r = _BenchRun( "chacha20poly1305-seal", _ChaChaPolyEncrypt, 85 );
+	steps[ stepCount ].step = "M2: ChaCha20-Poly1305 seal 85 bytes";	steps[ stepCount++ ].ns = r->medianNs;
+	r = _BenchRun( "chacha20poly1305-open", _ChaChaPolyDecrypt, 110 );
+	steps[ stepCount ].step = "M4: ChaCha20-Poly1305 open 110 bytes";	steps[ stepCount++ ].ns = r->medianNs;
+
+	steps[ stepCount ].step = "M2: Ed25519 sign";	steps[ stepCount++ ].ns = signNs;
+	steps[ stepCount ].step = "M4: Ed25519 verify";	steps[ stepCount++ ].ns = verifyNs;
+
+	totalNs = 0;
+	for( i = 0; i < stepCount; ++i ) if( steps[ i ].ns > 0 ) totalNs += steps[ i ].ns;
+
+	_PrintResults( steps, stepCount, totalNs, ( signNs >= 0 ) && ( verifyNs >= 0 ), json );
+	gcm_end( gGCM );
+	free( gGCMTable );
+	return( 0 );
+}
@@ -0,0 +1,12 @@
+/*
+	File:    MICOAES.h
+
+	AESUtils.h includes "MICOAES.h", the header in the tree is include/MicoAES.h. This forwards to it for host builds
+	on a case-sensitive file system. Put -I$R/Tools/CryptoBench/host after -I$R/include.
+*/
+
+#if( defined( AES_BLOCK_SIZE ) )
+	#undef	AES_BLOCK_SIZE		// Gladman's aes.h defines it as a macro, MicoAES.h as an enum constant, both 16.
+#endif
+
+#include "../../../include/MicoAES.h"
@@ -0,0 +1,309 @@
+/*
+	File:    ecs_pool_host.c
+
+	POSIX half of the EasyCloud connection pool test: the host sockets behind the MICO socket calls that
+	ecs_pool_test.c replaces, and the stand-in EasyCloud servers on the loopback interface. This file can't see the
+	MICO headers, their socket calls and types have the same names as the POSIX ones.
+
+	Each server accepts any number of connections, one thread each, and answers every request with a small JSON
+	body. What it does with the next request is set by HostServerSetMode, see ecs_pool_host.h.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "ecs_pool_host.h"
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+#define	kServerMaxRequest		4096
+#define	kServerBody				"{\"device_id\":\"d\",\"master_device_key\":\"k\"}"
+
+typedef struct
+{
+	int				listenFd;
+	uint16_t		port;
+	int				mode;
+	int				accepts;
+	int				requests;
+	int				peerCloses;
+	int				serverCloses;
+	pthread_t		thread;
+
+}	HostServer;
+
+typedef struct
+{
+	HostServer *	server;
+	int				fd;
+
+}	HostConnection;
+
+static HostServer			gServers[ kHostServerMax ];
+static pthread_mutex_t		gLock = PTHREAD_MUTEX_INITIALIZER;
+
+//===========================================================================================================================
+//	Client sockets
+//===========================================================================================================================
+
+int	HostSocket( void )
+{
+	return( socket( AF_INET, SOCK_STREAM, IPPROTO_TCP ) );
+}
+
+int	HostSetTimeout( int inFd, int inMs, int inSend )
+{
+	struct timeval		tv;
+
+	tv.tv_sec  = inMs / 1000;
+	tv.tv_usec = ( inMs % 1000 ) * 1000;
+	return( setsockopt( inFd, SOL_SOCKET, inSend ? SO_SNDTIMEO : SO_RCVTIMEO, &tv, sizeof( tv ) ) );
+}
+
+int	HostConnect( int inFd, uint32_t inIP, uint16_t inPort )
+{
+	struct sockaddr_in		sin;
+
+	memset( &sin, 0, sizeof( sin ) );
+	sin.sin_family		= AF_INET;
+	sin.sin_port		= htons( inPort );
+	sin.sin_addr.s_addr	= htonl( inIP );
+	return( connect( inFd, (struct sockaddr *) &sin, sizeof( sin ) ) );
+}
+
+int	HostSelect( int inMaxFd, unsigned long *ioReadBits, unsigned long *ioWriteBits, long inTimeoutMs )
+{
+	fd_set				readSet, writeSet;
+	struct timeval		tv;
+	int					fd, n;
+
+	FD_ZERO( &readSet );
+	FD_ZERO( &writeSet );
+	for( fd = 0; fd < inMaxFd; ++fd )
+	{
+		if( ioReadBits  && ( *ioReadBits  & ( 1UL << fd ) ) ) FD_SET( fd, &readSet );
+		if( ioWriteBits && ( *ioWriteBits & ( 1UL << fd ) ) ) FD_SET( fd, &writeSet );
+	}
+	tv.tv_sec  = inTimeoutMs / 1000;
+	tv.tv_usec = ( inTimeoutMs % 1000 ) * 1000;
+	n = select( inMaxFd, &readSet, &writeSet, NULL, ( inTimeoutMs < 0 ) ? NULL : &tv );
+	if( n < 0 ) return( n );
+	for( fd = 0; fd < inMaxFd; ++fd )
+	{
+		if( ioReadBits  && !FD_ISSET( fd, &readSet ) )  *ioReadBits  &= ~( 1UL << fd );
+		if( ioWriteBits && !FD_ISSET( fd, &writeSet ) ) *ioWriteBits &= ~( 1UL << fd );
+	}
+	return( n );
+}
+
+long	HostRead( int inFd, void *inBuf, size_t inLen )			{ return( (long) recv( inFd, inBuf, inLen, 0 ) ); }
+long	HostWrite( int inFd, const void *inBuf, size_t inLen )	{ return( (long) send( inFd, inBuf, inLen, MSG_NOSIGNAL ) ); }
+int		HostClose( int inFd )									{ return( close( inFd ) ); }
+
+void	HostSleepMs( int inMs )
+{
+	struct timespec		ts;
+
+	ts.tv_sec  = inMs / 1000;
+	ts.tv_nsec = (long)( inMs % 1000 ) * 1000000;
+	nanosleep( &ts, NULL );
+}
+
+//===========================================================================================================================
+//	Stand-in servers
+//===========================================================================================================================
+
+// Reads one request, header and Content-Length body. Returns its length, 0 if the peer closed before sending a byte
+// or -1 on an error or a close in the middle of a request.
+
+static int	_ServerReadRequest( int inFd, char *inBuf, size_t inMax )
+{
+	size_t			len = 0;
+	char *			end;
+	const char *	field;
+	long			n;
+	size_t			need = 0;
+
+	for( ;; )
+	{
+		if( len >= inMax - 1 ) return( -1 );
+		n = recv( inFd, inBuf + len, inMax - 1 - len, 0 );
+		if( n <= 0 ) return( ( ( n == 0 ) && ( len == 0 ) ) ? 0 : -1 );
+		len += (size_t) n;
+		inBuf[ len ] = '\0';
+		end = strstr( inBuf, "\r\n\r\n" );
+		if( !end ) continue;
+		if( need == 0 )
+		{
+			field = strstr( inBuf, "Content-Length:" );
+			need = (size_t)( end + 4 - inBuf ) + ( ( field && ( field < end ) ) ? strtoul( field + 15, NULL, 10 ) : 0 );
+		}
+		if( len >= need ) return( (int) len );
+	}
+}
+
+static void	_ServerReset( int inFd )
+{
+	struct linger		lg;
+
+	lg.l_onoff  = 1;
+	lg.l_linger = 0;
+	setsockopt( inFd, SOL_SOCKET, SO_LINGER, &lg, sizeof( lg ) );
+	close( inFd );
+}
+
+static void *	_ServerConnectionThread( void *inArg )
+{
+	HostConnection * const		conn = (HostConnection *) inArg;
+	HostServer * const			server = conn->server;
+	char						request[ kServerMaxRequest ];
+	char						response[ 512 ];
+	int							served = 0;
+	int							mode, n, len;
+
+	for( ;; )
+	{
+		n = _ServerReadRequest( conn->fd, request, sizeof( request ) );
+		pthread_mutex_lock( &gLock );
+		if( n == 0 ) ++server->peerCloses;
+		if( n > 0 )  ++server->requests;
+		mode = server->mode;
+		if( ( n > 0 ) && ( mode == kHostServerResetNext ) && ( served > 0 ) ) server->mode = kHostServerKeepAlive;
+		pthread_mutex_unlock( &gLock );
+		if( n <= 0 )
+		{
+			close( conn->fd );
+			break;
+		}
+
+		if( ( mode == kHostServerResetAll ) || ( ( mode == kHostServerResetNext ) && ( served > 0 ) ) )
+		{
+			_ServerReset( conn->fd );
+			pthread_mutex_lock( &gLock );
+			++server->serverCloses;
+			pthread_mutex_unlock( &gLock );
+			break;
+		}
+
+		len = snprintf( response, sizeof( response ),
+			"HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\n%s\r\n%s",
+			(unsigned int) strlen( kServerBody ), ( mode == kHostServerClose ) ? "Connection: close\r\n" : "", kServerBody );
+		send( conn->fd, response, (size_t) len, MSG_NOSIGNAL );
+		++served;
+
+		if( ( mode == kHostServerClose ) || ( mode == kHostServerCloseAfter ) )
+		{
+			close( conn->fd );
+			pthread_mutex_lock( &gLock );
+			++server->serverCloses;
+			pthread_mutex_unlock( &gLock );
+			break;
+		}
+	}
+	free( conn );
+	return( NULL );
+}
+
+static void *	_ServerAcceptThread( void *inArg )
+{
+	HostServer * const		server = (HostServer *) inArg;
+	HostConnection *		conn;
+	pthread_t				thread;
+	int						fd;
+
+	for( ;; )
+	{
+		fd = accept( server->listenFd, NULL, NULL );
+		if( fd < 0 ) break;
+		conn = (HostConnection *) malloc( sizeof( *conn ) );
+		if( !conn ) { close( fd ); continue; }
+		conn->server = server;
+		conn->fd	 = fd;
+		pthread_mutex_lock( &gLock );
+		++server->accepts;
+		pthread_mutex_unlock( &gLock );
+		if( pthread_create( &thread, NULL, _ServerConnectionThread, conn ) != 0 ) { close( fd ); free( conn ); continue; }
+		pthread_detach( thread );
+	}
+	return( NULL );
+}
+
+int	HostServerStart( int inIndex )
+{
+	HostServer * const		server = &gServers[ inIndex ];
+	struct sockaddr_in		sin;
+	socklen_t				len = sizeof( sin );
+	int						on = 1;
+
+	memset( server, 0, sizeof( *server ) );
+	server->listenFd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if( server->listenFd < 0 ) return( -1 );
+	setsockopt( server->listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof( on ) );
+	memset( &sin, 0, sizeof( sin ) );
+	sin.sin_family		= AF_INET;
+	sin.sin_addr.s_addr	= htonl( INADDR_LOOPBACK );
+	if( ( bind( server->listenFd, (struct sockaddr *) &sin, sizeof( sin ) ) != 0 ) ||
+		( listen( server->listenFd, 8 ) != 0 ) ||
+		( getsockname( server->listenFd, (struct sockaddr *) &sin, &len ) != 0 ) ||
+		( pthread_create( &server->thread, NULL, _ServerAcceptThread, server ) != 0 ) )
+	{
+		close( server->listenFd );
+		return( -1 );
+	}
+	server->port = ntohs( sin.sin_port );
+	return( server->port );
+}
+
+void	HostServerStop( int inIndex )
+{
+	HostServer * const		server = &gServers[ inIndex ];
+
+	shutdown( server->listenFd, SHUT_RDWR );
+	close( server->listenFd );
+	pthread_join( server->thread, NULL );
+}
+
+void	HostServerSetMode( int inIndex, int inMode )
+{
+	pthread_mutex_lock( &gLock );
+	gServers[ inIndex ].mode = inMode;
+	pthread_mutex_unlock( &gLock );
+}
+
+void	HostServerGetCounts( int inIndex, HostServerCounts *outCounts )
+{
+	pthread_mutex_lock( &gLock );
+	outCounts->accepts		= gServers[ inIndex ].accepts;
+	outCounts->requests		= gServers[ inIndex ].requests;
+	outCounts->peerCloses	= gServers[ inIndex ].peerCloses;
+	outCounts->serverCloses	= gServers[ inIndex ].serverCloses;
+	pthread_mutex_unlock( &gLock );
+}
+
+// The server threads see a close by the client, or finish closing on their side, a little after the client moves
+// on. Waits up to a second for both counts to reach at least the values given.
+
+int	HostServerWait( int inIndex, int inPeerCloses, int inServerCloses )
+{
+	HostServerCounts		counts;
+	int						i;
+
+	for( i = 0; i < 1000; ++i )
+	{
+		HostServerGetCounts( inIndex, &counts );
+		if( ( counts.peerCloses >= inPeerCloses ) && ( counts.serverCloses >= inServerCloses ) ) return( 0 );
+		HostSleepMs( 1 );
+	}
+	return( -1 );
+}
@@ -0,0 +1,51 @@
+/*
+	File:    ecs_pool_host.h
+
+	Interface between ecs_pool_test.c, built against the MICO headers, and ecs_pool_host.c, built against the POSIX
+	ones. Only plain C types cross it.
+*/
+
+#ifndef __ecs_pool_host_h__
+#define __ecs_pool_host_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Client sockets. IP and port in host byte order, select bits are one word, bit n for fd n.
+
+int		HostSocket( void );
+int		HostSetTimeout( int inFd, int inMs, int inSend );
+int		HostConnect( int inFd, uint32_t inIP, uint16_t inPort );
+int		HostSelect( int inMaxFd, unsigned long *ioReadBits, unsigned long *ioWriteBits, long inTimeoutMs );
+long	HostRead( int inFd, void *inBuf, size_t inLen );
+long	HostWrite( int inFd, const void *inBuf, size_t inLen );
+int		HostClose( int inFd );
+void	HostSleepMs( int inMs );
+
+// Stand-in servers on 127.0.0.1. What a server does with each request it reads:
+
+#define	kHostServerMax				3
+
+#define	kHostServerKeepAlive		0	// Answer and keep the connection.
+#define	kHostServerClose			1	// Answer with "Connection: close" and close.
+#define	kHostServerCloseAfter		2	// Answer as keep-alive, then close anyway, as a server dropping idle clients.
+#define	kHostServerResetNext		3	// Reset the connection instead of answering a request that isn't its first,
+										// once, then back to kHostServerKeepAlive.
+#define	kHostServerResetAll			4	// Reset every connection on its first request.
+
+typedef struct
+{
+	int		accepts;		// Connections accepted.
+	int		requests;		// Complete requests read.
+	int		peerCloses;		// Connections the client closed between requests.
+	int		serverCloses;	// Connections closed or reset by the server.
+
+}	HostServerCounts;
+
+int		HostServerStart( int inIndex );	// Returns the port, or -1.
+void	HostServerStop( int inIndex );
+void	HostServerSetMode( int inIndex, int inMode );
+void	HostServerGetCounts( int inIndex, HostServerCounts *outCounts );
+int		HostServerWait( int inIndex, int inPeerCloses, int inServerCloses );
+
+#endif // __ecs_pool_host_h__
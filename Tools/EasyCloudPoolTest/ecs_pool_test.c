@@ -0,0 +1,394 @@
+/*
+	File:    ecs_pool_test.c
+
+	Host test for the keep-alive connection pool in Library/EasyCloud/EasyCloudService.c. EasyCloudService.c and
+	EasyCloudUtils.c are included here and their socket calls are renamed to the wrappers below, which run them on
+	real loopback sockets (ecs_pool_host.c) against stand-in EasyCloud servers that answer, close or reset as each
+	test needs. mico_get_time() is a clock the test advances, so idle times are exact.
+
+	Requests go through _requestToServer, the helper activate, authorize and reset share. Checked:
+
+		reuse				one connection carries every request to a server that keeps it open
+		Connection: close	the socket isn't pooled, the next request connects again
+		stale socket		a pooled socket the server closed while idle is dropped before a request is sent on it
+		retry on reset		a request reset on a reused socket is sent once more on a new connection, only once
+		idle eviction		a socket idle for longer than ECS_CONNECTION_IDLE_TIMEOUT is closed, not reused
+		LRU					with the pool full, the least recently used socket is the one closed
+		deinit				EasyCloudServiceDeInit closes what is left and no socket is leaked
+
+	Build from the top of the tree (Linux, gcc or clang):
+
+		R=.
+		I="-I$R/include -I$R/Library/support -I$R/Library/EasyCloud -I$R/Library/EasyCloud/EasyCloudMQTTClient \
+			-I$R/Library/EasyCloud/EasyCloudMQTTClient/MQTTClient-C/src \
+			-I$R/Library/EasyCloud/EasyCloudMQTTClient/MQTTClient-C/src/MICO \
+			-I$R/Library/EasyCloud/EasyCloudMQTTClient/MQTTPacket/src -I$R/Board/MiCOKit-3288 \
+			-I$R/Platform/Cortex-M4 -I$R/Demos/COM.Apple.HomeKit -I$R/External -I<host headers>"
+		cc -std=c99 -O1 -g -fsanitize=address,undefined $I -o ecs_pool_test.o -c $R/Tools/EasyCloudPoolTest/ecs_pool_test.c
+		cc -std=c99 -O1 -g -fsanitize=address,undefined $I -o StringUtils.o -c $R/Library/support/StringUtils.c
+		cc -std=c99 -O1 -g -fsanitize=address,undefined $I -o URLUtils.o -c $R/Library/support/URLUtils.c
+		cc -std=c99 -O1 -g -fsanitize=address,undefined -D_DEFAULT_SOURCE -o ecs_pool_test \
+			$R/Tools/EasyCloudPoolTest/ecs_pool_host.c ecs_pool_test.o StringUtils.o URLUtils.o -lpthread
+
+	The MICO headers include some files with another case than they have in the tree. On a case-sensitive file
+	system <host headers> holds common.h, MicoRTOS.h, MICOSocket.h and debug.h, each including Common.h, MICORTOS.h,
+	MicoSocket.h or Debug.h, and MicoDrivers/MICODriver*.h, each including the MicoDrivers/MicoDriver*.h of the
+	same name, e.g. MICODriverUART.h including MicoDriverUart.h.
+
+	Usage: ecs_pool_test
+*/
+
+#include "ecs_pool_host.h"
+
+// MICO's socket calls have the POSIX names but not their types, keep them apart from the C library's.
+
+#define	socket			EcsTestSocket
+#define	setsockopt		EcsTestSetsockopt
+#define	connect			EcsTestConnect
+#define	select			EcsTestSelect
+#define	read			EcsTestRead
+#define	write			EcsTestWrite
+#define	close			EcsTestClose
+#define	gethostbyname	EcsTestGetHostByName
+#define	inet_addr		EcsTestInetAddr
+
+#include "EasyCloudUtils.c"
+#include "SocketUtils.c"
+#include "EasyCloudService.c"
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+#define	kTestHost				"cloud.test"
+
+static uint32_t				gNowMs = 100000;
+static uint16_t				gPorts[ kHostServerMax ];
+static unsigned long		gOpenFds;		// Bit n: client fd n is open.
+static int					gConnects;		// gethostbyname() calls, one per new connection.
+static int					gRequestsSent;	// Writes that start a request.
+static int					gFailed;
+
+//===========================================================================================================================
+//	MICO replacements
+//===========================================================================================================================
+
+uint32_t	mico_get_time( void ) { return( gNowMs ); }
+void		msleep( int milliseconds ) { HostSleepMs( milliseconds ); }
+
+int	EcsTestSocket( int domain, int type, int protocol )
+{
+	int		fd;
+
+	(void) domain;
+	(void) type;
+	(void) protocol;
+
+	fd = HostSocket();
+	if( fd >= FD_SETSIZE ) { HostClose( fd ); return( -1 ); }	// MICO's fd_set only has FD_SETSIZE bits.
+	if( fd >= 0 ) gOpenFds |= 1UL << fd;
+	return( fd );
+}
+
+int	EcsTestSetsockopt( int sockfd, int level, int optname, const void *optval, socklen_t optlen )
+{
+	(void) optlen;
+
+	if( ( level == SOL_SOCKET ) && ( ( optname == SO_SNDTIMEO ) || ( optname == SO_RCVTIMEO ) ) )
+	{
+		return( HostSetTimeout( sockfd, *( (const int *) optval ), optname == SO_SNDTIMEO ) );
+	}
+	return( -1 );
+}
+
+int	EcsTestConnect( int sockfd, const struct sockaddr_t *addr, socklen_t addrlen )
+{
+	(void) addrlen;
+
+	return( HostConnect( sockfd, addr->s_ip, addr->s_port ) );
+}
+
+int	EcsTestSelect( int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval_t *timeout )
+{
+	(void) exceptfds;
+
+	return( HostSelect( nfds, readfds ? &readfds->fds_bits[ 0 ] : NULL, writefds ? &writefds->fds_bits[ 0 ] : NULL,
+		timeout ? (long)( ( timeout->tv_sec * 1000 ) + ( timeout->tv_usec / 1000 ) ) : -1 ) );
+}
+
+int	EcsTestRead( int sockfd, void *buf, size_t len ) { return( (int) HostRead( sockfd, buf, len ) ); }
+
+int	EcsTestWrite( int sockfd, void *buf, size_t len )
+{
+	if( ( len >= 5 ) && ( ( memcmp( buf, "POST ", 5 ) == 0 ) || ( memcmp( buf, "GET ", 4 ) == 0 ) ) ) ++gRequestsSent;
+	return( (int) HostWrite( sockfd, buf, len ) );
+}
+
+int	EcsTestClose( int fd )
+{
+	if( ( fd >= 0 ) && ( fd < FD_SETSIZE ) ) gOpenFds &= ~( 1UL << fd );
+	return( HostClose( fd ) );
+}
+
+int	EcsTestGetHostByName( const char *name, uint8_t *addr, uint8_t addrLen )
+{
+	if( ( strcmp( name, kTestHost ) != 0 ) || ( addrLen < 10 ) ) return( -1 );
+	++gConnects;
+	strcpy( (char *) addr, "127.0.0.1" );
+	return( 0 );
+}
+
+// Host byte order, as the MICO stack returns it.
+
+uint32_t	EcsTestInetAddr( char *s )
+{
+	uint32_t		addr = 0;
+	int				i;
+
+	for( i = 0; i < 4; ++i )
+	{
+		addr = ( addr << 8 ) | (uint32_t) strtoul( s, &s, 10 );
+		if( *s == '.' ) ++s;
+	}
+	return( addr );
+}
+
+// Requests run on the test's thread only, so the pool mutex only has to be non-NULL.
+
+OSStatus	mico_rtos_init_mutex( mico_mutex_t *mutex )		{ *mutex = (mico_mutex_t) &gNowMs; return( kNoErr ); }
+OSStatus	mico_rtos_lock_mutex( mico_mutex_t *mutex )		{ (void) mutex; return( kNoErr ); }
+OSStatus	mico_rtos_unlock_mutex( mico_mutex_t *mutex )	{ (void) mutex; return( kNoErr ); }
+
+// Not reached by these tests, only here to link.
+
+OSStatus	mico_rtos_create_thread( mico_thread_t *thread, uint8_t priority, const char *name, mico_thread_function_t function, uint32_t stack_size, void *arg )
+	{ (void) thread; (void) priority; (void) name; (void) function; (void) stack_size; (void) arg; return( kUnsupportedErr ); }
+OSStatus	mico_rtos_delete_thread( mico_thread_t *thread )	{ (void) thread; return( kUnsupportedErr ); }
+OSStatus	mico_rtos_thread_join( mico_thread_t *thread )		{ (void) thread; return( kUnsupportedErr ); }
+void		EasyCloudMQTTClientInit( mqtt_client_config_t init )	{ (void) init; }
+OSStatus	EasyCloudMQTTClientStart( void )					{ return( kUnsupportedErr ); }
+OSStatus	EasyCloudMQTTClientStop( void )						{ return( kUnsupportedErr ); }
+mqttClientState	EasyCloudMQTTClientState( void )				{ return( MQTT_CLIENT_STATUS_STOPPED ); }
+OSStatus	EasyCloudMQTTClientPublish( const unsigned char *msg, int msglen )	{ (void) msg; (void) msglen; return( kUnsupportedErr ); }
+OSStatus	EasyCloudMQTTClientPublishto( const char *topic, const unsigned char *msg, int msglen )
+	{ (void) topic; (void) msg; (void) msglen; return( kUnsupportedErr ); }
+OSStatus	EasyCloudMQTTClientPublishtoChannel( const char *channel, const unsigned char *msg, unsigned int msglen )
+	{ (void) channel; (void) msg; (void) msglen; return( kUnsupportedErr ); }
+void		InitMd5( md5_context *ctx )											{ (void) ctx; }
+void		Md5Update( md5_context *ctx, unsigned char *input, int ilen )		{ (void) ctx; (void) input; (void) ilen; }
+void		Md5Final( md5_context *ctx, unsigned char output[ 16 ] )			{ (void) ctx; memset( output, 0, 16 ); }
+OSStatus	MicoFlashInitialize( mico_flash_t inFlash )							{ (void) inFlash; return( kUnsupportedErr ); }
+OSStatus	MicoFlashFinalize( mico_flash_t inFlash )							{ (void) inFlash; return( kUnsupportedErr ); }
+OSStatus	MicoFlashErase( mico_flash_t inFlash, uint32_t inStartAddress, uint32_t inEndAddress )
+	{ (void) inFlash; (void) inStartAddress; (void) inEndAddress; return( kUnsupportedErr ); }
+OSStatus	MicoFlashWrite( mico_flash_t inFlash, volatile uint32_t *inFlashAddress, uint8_t *inBuffer, uint32_t inBufferLength )
+	{ (void) inFlash; (void) inFlashAddress; (void) inBuffer; (void) inBufferLength; return( kUnsupportedErr ); }
+struct json_object *	json_tokener_parse( const char *str )				{ (void) str; return( NULL ); }
+struct json_object *	json_object_new_object( void )						{ return( NULL ); }
+struct json_object *	json_object_new_string( const char *s )				{ (void) s; return( NULL ); }
+struct lh_table *		json_object_get_object( struct json_object *obj )	{ (void) obj; return( NULL ); }
+const char *			json_object_get_string( struct json_object *obj )	{ (void) obj; return( NULL ); }
+const char *			json_object_to_json_string( struct json_object *obj )	{ (void) obj; return( "" ); }
+void					json_object_object_add( struct json_object *obj, const char *key, struct json_object *val )
+	{ (void) obj; (void) key; (void) val; }
+void					json_object_put( struct json_object *obj )			{ (void) obj; }
+
+//===========================================================================================================================
+//	Checks
+//===========================================================================================================================
+
+// One request to server inIndex. Returns the result of _requestToServer.
+
+static OSStatus	_Request( int inIndex )
+{
+	static const char		kBody[] = "{\"login_id\":\"admin\",\"dev_passwd\":\"88888888\"}";
+	ECS_HTTPHeader_t *		header;
+	OSStatus				err;
+
+	header = ECS_HTTPHeaderCreate();
+	if( !header ) return( kNoMemoryErr );
+	err = _requestToServer( kTestHost, gPorts[ inIndex ], "POST", DEFAULT_DEVICE_ACTIVATE_URL,
+		(const uint8_t *) kBody, sizeof( kBody ) - 1, header );
+	ECS_HTTPHeaderClear( header );
+	free( header );
+	return( err );
+}
+
+// Number of idle sockets the pool holds for server inIndex.
+
+static int	_Pooled( int inIndex )
+{
+	int		i, n = 0;
+
+	for( i = 0; i < ECS_CONNECTION_POOL_SIZE; ++i )
+	{
+		if( ( ecsConnectionPool[ i ].host[ 0 ] != '\0' ) && ( ecsConnectionPool[ i ].port == gPorts[ inIndex ] ) ) ++n;
+	}
+	return( n );
+}
+
+static void	_Check( const char *inTest, int inOK, const char *inWhat )
+{
+	if( !inOK )
+	{
+		printf( "%s: %s\n", inTest, inWhat );
+		gFailed = 1;
+	}
+}
+
+// Checks the server's counts and the client's connects and sends against what a test expects of them since inBase.
+
+static void	_CheckCounts( const char *inTest, int inIndex, const HostServerCounts *inBase, int inBaseConnects, int inBaseSent,
+	int inAccepts, int inRequests, int inSent )
+{
+	HostServerCounts		now;
+
+	HostServerGetCounts( inIndex, &now );
+	_Check( inTest, now.accepts - inBase->accepts == inAccepts, "unexpected number of connections accepted" );
+	_Check( inTest, gConnects - inBaseConnects == inAccepts, "unexpected number of connections opened" );
+	_Check( inTest, now.requests - inBase->requests == inRequests, "unexpected number of requests received" );
+	_Check( inTest, gRequestsSent - inBaseSent == inSent, "unexpected number of requests sent" );
+}
+
+#define	_Begin( INDEX )		HostServerGetCounts( INDEX, &base ); baseConnects = gConnects; baseSent = gRequestsSent
+
+static int	_TestPool( void )
+{
+	HostServerCounts		base, now;
+	int						baseConnects, baseSent;
+	int						i, failed;
+
+	// Reuse: three requests, one connection.
+
+	failed = gFailed;
+	_Begin( 0 );
+	for( i = 0; i < 3; ++i ) _Check( "reuse", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "reuse", 0, &base, baseConnects, baseSent, 1, 3, 3 );
+	_Check( "reuse", _Pooled( 0 ) == 1, "socket not pooled" );
+	printf( "%-20s %s\n", "reuse", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	// Connection: close on the pooled socket, the next request connects again.
+
+	failed = gFailed;
+	_Begin( 0 );
+	HostServerSetMode( 0, kHostServerClose );
+	_Check( "connection close", _Request( 0 ) == kNoErr, "request failed" );
+	_Check( "connection close", _Pooled( 0 ) == 0, "closed socket pooled" );
+	HostServerSetMode( 0, kHostServerKeepAlive );
+	_Check( "connection close", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "connection close", 0, &base, baseConnects, baseSent, 1, 2, 2 );
+	printf( "%-20s %s\n", "connection close", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	// Stale socket: the server drops the pooled connection while it is idle. The next request must notice before
+	// sending, so it is sent once.
+
+	failed = gFailed;
+	_Begin( 0 );
+	HostServerSetMode( 0, kHostServerCloseAfter );
+	_Check( "stale socket", _Request( 0 ) == kNoErr, "request failed" );
+	HostServerSetMode( 0, kHostServerKeepAlive );
+	_Check( "stale socket", HostServerWait( 0, 0, base.serverCloses + 1 ) == 0, "server didn't close" );
+	_Check( "stale socket", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "stale socket", 0, &base, baseConnects, baseSent, 1, 2, 2 );
+	printf( "%-20s %s\n", "stale socket", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	// Retry on reset: the server resets the reused connection when the request arrives. It is sent once more on a
+	// new connection and succeeds.
+
+	failed = gFailed;
+	_Begin( 0 );
+	HostServerSetMode( 0, kHostServerResetNext );
+	_Check( "retry on reset", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "retry on reset", 0, &base, baseConnects, baseSent, 1, 2, 2 );
+
+	// A reset on the new connection too is returned, not retried again, and that socket isn't pooled.
+
+	_Begin( 0 );
+	HostServerSetMode( 0, kHostServerResetAll );
+	_Check( "retry on reset", _Request( 0 ) != kNoErr, "request reset twice succeeded" );
+	_CheckCounts( "retry on reset", 0, &base, baseConnects, baseSent, 1, 2, 2 );
+	HostServerSetMode( 0, kHostServerKeepAlive );
+	_Begin( 0 );
+	_Check( "retry on reset", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "retry on reset", 0, &base, baseConnects, baseSent, 1, 1, 1 );
+	printf( "%-20s %s\n", "retry on reset", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	// Idle eviction: just inside the timeout the socket is reused, past it the client closes it and connects again.
+
+	failed = gFailed;
+	_Begin( 0 );
+	gNowMs += ECS_CONNECTION_IDLE_TIMEOUT;
+	_Check( "idle eviction", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "idle eviction", 0, &base, baseConnects, baseSent, 0, 1, 1 );
+	_Begin( 0 );
+	gNowMs += ECS_CONNECTION_IDLE_TIMEOUT + 1;
+	_Check( "idle eviction", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "idle eviction", 0, &base, baseConnects, baseSent, 1, 1, 1 );
+	_Check( "idle eviction", HostServerWait( 0, base.peerCloses + 1, 0 ) == 0, "idle socket not closed" );
+	printf( "%-20s %s\n", "idle eviction", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	// LRU: the pool holds servers 0 and 1, 0 used last. Server 2 takes the place of 1, whose socket is closed; 0 is
+	// still reused and 1 needs a new connection.
+
+	failed = gFailed;
+	gNowMs += 1000;
+	_Check( "lru", _Request( 1 ) == kNoErr, "request failed" );
+	gNowMs += 1000;
+	_Check( "lru", _Request( 0 ) == kNoErr, "request failed" );
+	gNowMs += 1000;
+	HostServerGetCounts( 1, &base );
+	_Check( "lru", _Request( 2 ) == kNoErr, "request failed" );
+	_Check( "lru", HostServerWait( 1, base.peerCloses + 1, 0 ) == 0, "least recently used socket not closed" );
+	HostServerGetCounts( 0, &now );
+	baseConnects = gConnects;
+	baseSent = gRequestsSent;
+	gNowMs += 1000;
+	_Check( "lru", _Request( 0 ) == kNoErr, "request failed" );
+	_CheckCounts( "lru", 0, &now, baseConnects, baseSent, 0, 1, 1 );
+	_Begin( 1 );
+	_Check( "lru", _Request( 1 ) == kNoErr, "request failed" );
+	_CheckCounts( "lru", 1, &base, baseConnects, baseSent, 1, 1, 1 );
+	printf( "%-20s %s\n", "lru", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	return( gFailed );
+}
+
+//===========================================================================================================================
+//	main
+//===========================================================================================================================
+
+int	main( int argc, const char **argv )
+{
+	static easycloud_service_context_t		context;
+	HostServerCounts						counts[ kHostServerMax ];
+	int										i, port, pooled, failed;
+
+	(void) argv;
+
+	if( argc > 1 ) { fprintf( stderr, "Usage: ecs_pool_test\n" ); return( 2 ); }
+	for( i = 0; i < kHostServerMax; ++i )
+	{
+		port = HostServerStart( i );
+		if( port < 0 ) { fprintf( stderr, "can't start stand-in server %d\n", i ); return( 1 ); }
+		gPorts[ i ] = (uint16_t) port;
+	}
+
+	EasyCloudServiceInit( &context );
+	_TestPool();
+
+	// Deinit closes the pooled sockets, one to server 0 and one to server 1, and nothing is left open.
+
+	failed = gFailed;
+	for( i = 0; i < kHostServerMax; ++i ) HostServerGetCounts( i, &counts[ i ] );
+	for( pooled = 0, i = 0; i < ECS_CONNECTION_POOL_SIZE; ++i ) pooled += ( ecsConnectionPool[ i ].host[ 0 ] != '\0' );
+	EasyCloudServiceDeInit( &context );
+	_Check( "deinit", pooled == ECS_CONNECTION_POOL_SIZE, "pool not full" );
+	_Check( "deinit", HostServerWait( 0, counts[ 0 ].peerCloses + 1, 0 ) == 0, "socket to server 0 not closed" );
+	_Check( "deinit", HostServerWait( 1, counts[ 1 ].peerCloses + 1, 0 ) == 0, "socket to server 1 not closed" );
+	_Check( "deinit", gOpenFds == 0, "client sockets left open" );
+	printf( "%-20s %s\n", "deinit", ( gFailed != failed ) ? "FAILED" : "passed" );
+
+	for( i = 0; i < kHostServerMax; ++i ) HostServerStop( i );
+	printf( "%s\n", gFailed ? "FAILED" : "PASSED" );
+	return( gFailed ? 1 : 0 );
+}
@@ -0,0 +1,787 @@
+/*
+	File:    mdns_test.c
+
+	Host test for the mDNS responder in Library/support/MDNSUtils.c. MDNSUtils.c is included here so its packet
+	builders can be driven without a network: sendto() and the few MICO calls it makes are replaced below, every
+	packet sent is kept and decoded again by a separate, strict DNS parser. Announcements of one service and of
+	services packed into several packets, answers to queries with compressed names, answers with known answers left
+	out and the per-record rate limit are checked: every packet must decode to exactly the records expected, with
+	every compression pointer pointing back into the packet.
+
+	With --storm the same responder is then fed a stream of queries of each kind, once with every query answered and
+	once arriving every 10 ms of simulated time, so the rate limit answers at most one query per second. Each row gives
+	the process CPU time per query and the packets and bytes sent, sendto() only counts them in this mode.
+
+	Build from the top of the tree (Linux, gcc or clang):
+
+		R=.
+		cc -std=c99 -O1 -g -fsanitize=address,undefined -I$R/include -I$R/Library/support -I$R/Board/MiCOKit-3288 \
+			-I$R/Platform/Cortex-M4 -I$R/Demos/COM.Apple.HomeKit -I<host headers> \
+			$R/Tools/MDNSTest/mdns_test.c $R/Library/support/StringUtils.c -o mdns_test
+
+	The MICO headers include some files with another case than they have in the tree. On a case-sensitive file system
+	<host headers> holds common.h, MicoRTOS.h and MICOSocket.h, each including Common.h, MICORTOS.h or MicoSocket.h.
+
+	Usage: mdns_test [--verbose] [--storm <queries per row>]
+*/
+
+#include <time.h>
+
+#include "MDNSUtils.c"
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+#define	kTestMaxPackets			16
+#define	kTestMaxRecords			128
+#define	kTestNameMax			256
+#define	kTestServiceMax			12
+
+#define	kTestIP					"192.168.1.23"
+#define	kTestHostName			"EMW3162-1234.local."
+#define	kTestServiceName		"_easylink._tcp.local."
+#define	kTestInstanceName		"EMW3162 Module#1234"
+#define	kTestTXTRecord			"MAC=C8:93:46:11:22:33.Firmware Rev=MICO_1/.0.Seed=1"
+#define	kTestPort				8000
+
+typedef struct
+{
+	uint8_t			data[ 1500 ];
+	size_t			len;
+	uint32_t		dest;
+
+}	TestPacket;
+
+typedef struct
+{
+	char			name[ kTestNameMax ];
+	uint16_t		type;
+	uint16_t		rrclass;
+	uint32_t		ttl;
+	char			target[ kTestNameMax ];	// PTR and SRV target.
+	uint16_t		port;					// SRV
+	uint8_t			rdata[ 512 ];			// TXT and A as they are.
+	size_t			rdlen;
+
+}	TestRecord;
+
+static TestPacket		gPackets[ kTestMaxPackets ];
+static int				gPacketCount;
+static uint32_t			gTimeOffset;
+static int				gVerbose;
+static int				gCountOnly;		// sendto() counts packets and bytes instead of keeping them.
+static size_t			gSentBytes;
+
+//===========================================================================================================================
+//	MICO replacements
+//===========================================================================================================================
+
+uint32_t	mico_get_time( void )
+{
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (uint32_t)( ( ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 ) ) + gTimeOffset );
+}
+
+OSStatus	getNetPara( IPStatusTypedef *outNetpara, WiFi_Interface inInterface )
+{
+	(void) inInterface;
+
+	memset( outNetpara, 0, sizeof( *outNetpara ) );
+	strcpy( outNetpara->ip, kTestIP );
+	return( kNoErr );
+}
+
+// Host byte order, as the MICO stack returns it.
+
+uint32_t	inet_addr( char *s )
+{
+	uint32_t		addr = 0;
+	int				i;
+
+	for( i = 0; i < 4; ++i )
+	{
+		addr = ( addr << 8 ) | (uint32_t) strtoul( s, &s, 10 );
+		if( *s == '.' ) ++s;
+	}
+	return( addr );
+}
+
+ssize_t	sendto( int sockfd, const void *buf, size_t len, int flags, const struct sockaddr_t *dest_addr, socklen_t addrlen )
+{
+	TestPacket *		packet;
+
+	(void) sockfd;
+	(void) flags;
+	(void) addrlen;
+
+	if( gCountOnly )
+	{
+		++gPacketCount;
+		gSentBytes += len;
+		return( (ssize_t) len );
+	}
+	if( ( gPacketCount >= kTestMaxPackets ) || ( len > sizeof( packet->data ) ) ) return( -1 );
+	packet = &gPackets[ gPacketCount++ ];
+	memcpy( packet->data, buf, len );
+	packet->len  = len;
+	packet->dest = dest_addr->s_ip;
+	return( (ssize_t) len );
+}
+
+int	socket( int domain, int type, int protocol ) { (void) domain; (void) type; (void) protocol; return( -1 ); }
+int	setsockopt( int sockfd, int level, int optname, const void *optval, socklen_t optlen )
+	{ (void) sockfd; (void) level; (void) optname; (void) optval; (void) optlen; return( -1 ); }
+int	bind( int sockfd, const struct sockaddr_t *addr, socklen_t addrlen )
+	{ (void) sockfd; (void) addr; (void) addrlen; return( -1 ); }
+int	select( int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval_t *timeout )
+	{ (void) nfds; (void) readfds; (void) writefds; (void) exceptfds; (void) timeout; return( -1 ); }
+ssize_t	recvfrom( int sockfd, void *buf, size_t len, int flags, struct sockaddr_t *src_addr, socklen_t *addrlen )
+	{ (void) sockfd; (void) buf; (void) len; (void) flags; (void) src_addr; (void) addrlen; return( -1 ); }
+int	close( int fd ) { (void) fd; return( 0 ); }
+
+OSStatus	mico_rtos_init_mutex( mico_mutex_t *mutex )		{ *mutex = (mico_mutex_t) 1; return( kNoErr ); }
+OSStatus	mico_rtos_lock_mutex( mico_mutex_t *mutex )		{ (void) mutex; return( kNoErr ); }
+OSStatus	mico_rtos_unlock_mutex( mico_mutex_t *mutex )	{ (void) mutex; return( kNoErr ); }
+OSStatus	mico_rtos_create_thread( mico_thread_t *thread, uint8_t priority, const char *name, mico_thread_function_t function,
+				uint32_t stack_size, void *arg )
+	{ (void) thread; (void) priority; (void) name; (void) function; (void) stack_size; (void) arg; return( kNoErr ); }
+OSStatus	mico_rtos_delete_thread( mico_thread_t *thread ) { (void) thread; return( kNoErr ); }
+void	msleep( int milliseconds ) { (void) milliseconds; }
+
+//===========================================================================================================================
+//	Decoder
+//
+//	Written against RFC 1035 rather than on top of MDNSUtils.c: a pointer must point before the label it replaces, so a
+//	packet that decodes here has no loops, and every length must stay inside the packet and the rdata it belongs to.
+//===========================================================================================================================
+
+static int	_ReadU16( const uint8_t *p ) { return( ( p[ 0 ] << 8 ) | p[ 1 ] ); }
+
+// Returns the offset after the name in the packet, -1 if the name is malformed.
+
+static int	_DecodeName( const uint8_t *inPacket, int inLen, int inOffset, char *outName )
+{
+	int			offset	= inOffset;
+	int			next	= -1;
+	int			nameLen	= 0;
+	int			labelLen;
+
+	for( ;; )
+	{
+		if( offset >= inLen ) return( -1 );
+		labelLen = inPacket[ offset ];
+		if( ( labelLen & 0xC0 ) == 0xC0 )
+		{
+			if( offset + 2 > inLen ) return( -1 );
+			if( next < 0 ) next = offset + 2;
+			labelLen = ( ( labelLen & 0x3F ) << 8 ) | inPacket[ offset + 1 ];
+			if( ( labelLen < (int) sizeof( dns_message_header_t ) ) || ( labelLen >= offset ) ) return( -1 );
+			offset = labelLen;
+			continue;
+		}
+		if( labelLen & 0xC0 ) return( -1 );
+		if( labelLen == 0 ) break;
+		if( ( offset + 1 + labelLen > inLen ) || ( nameLen + labelLen + 2 > kTestNameMax ) ) return( -1 );
+		memcpy( outName + nameLen, inPacket + offset + 1, (size_t) labelLen );
+		nameLen += labelLen;
+		outName[ nameLen++ ] = '.';
+		offset += 1 + labelLen;
+	}
+	outName[ nameLen ] = '\0';
+	return( ( next < 0 ) ? offset + 1 : next );
+}
+
+// Decodes a multicast response, returns the record count or -1 if the packet is malformed.
+
+static int	_DecodeResponse( const TestPacket *inPacket, TestRecord *outRecords, int inMaxRecords )
+{
+	const uint8_t *		p	= inPacket->data;
+	int					len	= (int) inPacket->len;
+	int					offset, rdata, rdlen, count, i;
+	TestRecord *		r;
+
+	if( len < (int) sizeof( dns_message_header_t ) ) return( -1 );
+	if( _ReadU16( p ) != 0 || _ReadU16( p + 2 ) != 0x8400 ) return( -1 );
+	if( _ReadU16( p + 4 ) != 0 || _ReadU16( p + 8 ) != 0 || _ReadU16( p + 10 ) != 0 ) return( -1 );
+	count = _ReadU16( p + 6 );
+	if( count > inMaxRecords ) return( -1 );
+
+	offset = (int) sizeof( dns_message_header_t );
+	for( i = 0; i < count; ++i )
+	{
+		r = &outRecords[ i ];
+		memset( r, 0, sizeof( *r ) );
+		offset = _DecodeName( p, len, offset, r->name );
+		if( ( offset < 0 ) || ( offset + 10 > len ) ) return( -1 );
+		r->type		= (uint16_t) _ReadU16( p + offset );
+		r->rrclass	= (uint16_t) _ReadU16( p + offset + 2 );
+		r->ttl		= ( (uint32_t) _ReadU16( p + offset + 4 ) << 16 ) | (uint32_t) _ReadU16( p + offset + 6 );
+		rdlen		= _ReadU16( p + offset + 8 );
+		rdata		= offset + 10;
+		offset		= rdata + rdlen;
+		if( offset > len ) return( -1 );
+
+		switch( r->type )
+		{
+			case RR_TYPE_PTR:
+				if( _DecodeName( p, offset, rdata, r->target ) != offset ) return( -1 );
+				break;
+
+			case RR_TYPE_SRV:
+				if( rdlen < 7 ) return( -1 );
+				r->port = (uint16_t) _ReadU16( p + rdata + 4 );
+				if( _DecodeName( p, offset, rdata + 6, r->target ) != offset ) return( -1 );
+				break;
+
+			case RR_TYPE_A:
+				if( rdlen != 4 ) return( -1 );
+				// Fall through
+
+			default:
+				if( rdlen > (int) sizeof( r->rdata ) ) return( -1 );
+				memcpy( r->rdata, p + rdata, (size_t) rdlen );
+				r->rdlen = (size_t) rdlen;
+				break;
+		}
+	}
+	return( ( offset == len ) ? count : -1 );
+}
+
+//===========================================================================================================================
+//	Expected records
+//===========================================================================================================================
+
+static void	_ExpectPTR( TestRecord *r, const char *inName, const char *inTarget, uint32_t inTTL )
+{
+	memset( r, 0, sizeof( *r ) );
+	strcpy( r->name, inName );
+	strcpy( r->target, inTarget );
+	r->type		= RR_TYPE_PTR;
+	r->rrclass	= RR_CLASS_IN;
+	r->ttl		= inTTL;
+}
+
+static void	_ExpectTXT( TestRecord *r, const char *inName, const char *inTXT, uint32_t inTTL )
+{
+	size_t		lenOffset;
+
+	memset( r, 0, sizeof( *r ) );
+	strcpy( r->name, inName );
+	r->type		= RR_TYPE_TXT;
+	r->rrclass	= RR_CACHE_FLUSH | RR_CLASS_IN;
+	r->ttl		= inTTL;
+
+	// Character strings separated by '.', a '/' takes the next character as it is.
+
+	while( *inTXT )
+	{
+		lenOffset = r->rdlen++;
+		while( *inTXT && ( *inTXT != '.' ) )
+		{
+			if( *inTXT == '/' ) ++inTXT;
+			r->rdata[ r->rdlen++ ] = (uint8_t) *inTXT++;
+		}
+		r->rdata[ lenOffset ] = (uint8_t)( r->rdlen - lenOffset - 1 );
+		if( *inTXT == '.' ) ++inTXT;
+	}
+	r->rdata[ r->rdlen++ ] = 0;
+}
+
+static void	_ExpectSRV( TestRecord *r, const char *inName, const char *inTarget, uint16_t inPort, uint32_t inTTL )
+{
+	memset( r, 0, sizeof( *r ) );
+	strcpy( r->name, inName );
+	strcpy( r->target, inTarget );
+	r->type		= RR_TYPE_SRV;
+	r->rrclass	= RR_CACHE_FLUSH | RR_CLASS_IN;
+	r->ttl		= inTTL;
+	r->port		= inPort;
+}
+
+static void	_ExpectA( TestRecord *r, const char *inName, uint32_t inTTL )
+{
+	uint32_t		ip = inet_addr( (char *) kTestIP );
+
+	memset( r, 0, sizeof( *r ) );
+	strcpy( r->name, inName );
+	r->type		= RR_TYPE_A;
+	r->rrclass	= RR_CACHE_FLUSH | RR_CLASS_IN;
+	r->ttl		= inTTL;
+	r->rdata[ 0 ] = (uint8_t)( ip >> 24 );
+	r->rdata[ 1 ] = (uint8_t)( ip >> 16 );
+	r->rdata[ 2 ] = (uint8_t)( ip >> 8 );
+	r->rdata[ 3 ] = (uint8_t)( ip );
+	r->rdlen = 4;
+}
+
+static int	_RecordsEqual( const TestRecord *a, const TestRecord *b )
+{
+	return( ( strnicmp( a->name, b->name, kTestNameMax ) == 0 ) && ( a->type == b->type ) && ( a->rrclass == b->rrclass ) &&
+			( a->ttl == b->ttl ) && ( strnicmp( a->target, b->target, kTestNameMax ) == 0 ) && ( a->port == b->port ) &&
+			( a->rdlen == b->rdlen ) && ( memcmp( a->rdata, b->rdata, a->rdlen ) == 0 ) );
+}
+
+static void	_PrintRecord( const char *inPrefix, const TestRecord *r )
+{
+	printf( "%s%s type %u class 0x%04X ttl %u -> %s port %u, %u rdata bytes\n", inPrefix, r->name, r->type, r->rrclass,
+		r->ttl, r->target, r->port, (unsigned int) r->rdlen );
+}
+
+//===========================================================================================================================
+//	_CheckSent
+//
+//	Decodes the multicast packets sent since the last call, each must be followed by the same bytes to the broadcast
+//	address. The records of all of them must be exactly inExpected, in order.
+//===========================================================================================================================
+
+static int	_CheckSent( const char *inTest, const TestRecord *inExpected, int inExpectedCount, int inPacketCount )
+{
+	static TestRecord		records[ kTestMaxRecords ];
+	int						recordCount = 0;
+	int						n, i, count;
+	const TestPacket *		packet;
+	int						err = 0;
+
+	if( gPacketCount != 2 * inPacketCount )
+	{
+		printf( "%s: %d packets sent, expected %d\n", inTest, gPacketCount / 2, inPacketCount );
+		err = 1;
+		goto exit;
+	}
+	for( n = 0; n < gPacketCount; n += 2 )
+	{
+		packet = &gPackets[ n ];
+		if( ( packet->dest != inet_addr( (char *) "224.0.0.251" ) ) || ( gPackets[ n + 1 ].len != packet->len ) ||
+			( memcmp( gPackets[ n + 1 ].data, packet->data, packet->len ) != 0 ) )
+		{
+			printf( "%s: packet %d was not multicast and then broadcast\n", inTest, n / 2 );
+			err = 1;
+			goto exit;
+		}
+		if( packet->len > MDNS_PACKET_SIZE )
+		{
+			printf( "%s: packet %d is %u bytes\n", inTest, n / 2, (unsigned int) packet->len );
+			err = 1;
+			goto exit;
+		}
+		count = _DecodeResponse( packet, &records[ recordCount ], kTestMaxRecords - recordCount );
+		if( count < 0 )
+		{
+			printf( "%s: packet %d does not decode\n", inTest, n / 2 );
+			err = 1;
+			goto exit;
+		}
+		if( gVerbose ) printf( "%s: packet %d, %u bytes, %d records\n", inTest, n / 2, (unsigned int) packet->len, count );
+		recordCount += count;
+	}
+	if( recordCount != inExpectedCount )
+	{
+		printf( "%s: %d records, expected %d\n", inTest, recordCount, inExpectedCount );
+		err = 1;
+	}
+	for( i = 0; ( i < recordCount ) && ( i < inExpectedCount ); ++i )
+	{
+		if( !_RecordsEqual( &records[ i ], &inExpected[ i ] ) )
+		{
+			printf( "%s: record %d differs\n", inTest, i );
+			_PrintRecord( "    got      ", &records[ i ] );
+			_PrintRecord( "    expected ", &inExpected[ i ] );
+			err = 1;
+		}
+	}
+
+exit:
+	gPacketCount = 0;
+	printf( "%-32s %s\n", inTest, err ? "FAILED" : "passed" );
+	return( err );
+}
+
+//===========================================================================================================================
+//	Queries
+//===========================================================================================================================
+
+typedef struct
+{
+	uint8_t			data[ 512 ];
+	size_t			len;
+	uint16_t		questions;
+	uint16_t		answers;
+	size_t			offsets[ 64 ];	// Labels written so far, for compression.
+	int				offsetCount;
+
+}	TestQuery;
+
+static void	_QueryInit( TestQuery *q )
+{
+	memset( q, 0, sizeof( *q ) );
+	q->len = sizeof( dns_message_header_t );
+}
+
+// Writes a name, its longest suffix already in the query becomes a pointer.
+
+static void	_QueryName( TestQuery *q, const char *inName )
+{
+	char			suffix[ kTestNameMax ];
+	const char *	dot;
+	size_t			len;
+	int				i;
+
+	while( *inName )
+	{
+		for( i = 0; i < q->offsetCount; ++i )
+		{
+			if( ( _DecodeName( q->data, (int) q->len, (int) q->offsets[ i ], suffix ) > 0 ) &&
+				( strnicmp( suffix, inName, kTestNameMax ) == 0 ) )
+			{
+				q->data[ q->len++ ] = (uint8_t)( 0xC0 | ( q->offsets[ i ] >> 8 ) );
+				q->data[ q->len++ ] = (uint8_t)( q->offsets[ i ] );
+				return;
+			}
+		}
+		q->offsets[ q->offsetCount++ ] = q->len;
+		dot = strchr( inName, '.' );
+		len = dot ? (size_t)( dot - inName ) : strlen( inName );
+		q->data[ q->len++ ] = (uint8_t) len;
+		memcpy( &q->data[ q->len ], inName, len );
+		q->len += len;
+		inName += len + ( dot ? 1 : 0 );
+	}
+	q->data[ q->len++ ] = 0;
+}
+
+static void	_QueryU16( TestQuery *q, uint16_t inValue )
+{
+	q->data[ q->len++ ] = (uint8_t)( inValue >> 8 );
+	q->data[ q->len++ ] = (uint8_t)( inValue );
+}
+
+static void	_QueryQuestion( TestQuery *q, const char *inName, uint16_t inType )
+{
+	_QueryName( q, inName );
+	_QueryU16( q, inType );
+	_QueryU16( q, RR_CLASS_IN );
+	++q->questions;
+}
+
+static void	_QueryKnownAnswer( TestQuery *q, const TestRecord *r, uint32_t inTTL )
+{
+	size_t		rdlenOffset;
+
+	_QueryName( q, r->name );
+	_QueryU16( q, r->type );
+	_QueryU16( q, r->rrclass );
+	_QueryU16( q, (uint16_t)( inTTL >> 16 ) );
+	_QueryU16( q, (uint16_t) inTTL );
+	rdlenOffset = q->len;
+	q->len += 2;
+	switch( r->type )
+	{
+		case RR_TYPE_PTR:
+			_QueryName( q, r->target );
+			break;
+
+		case RR_TYPE_SRV:
+			_QueryU16( q, 0 );
+			_QueryU16( q, 0 );
+			_QueryU16( q, r->port );
+			_QueryName( q, r->target );
+			break;
+
+		default:
+			memcpy( &q->data[ q->len ], r->rdata, r->rdlen );
+			q->len += r->rdlen;
+			break;
+	}
+	q->data[ rdlenOffset ]		= (uint8_t)( ( q->len - rdlenOffset - 2 ) >> 8 );
+	q->data[ rdlenOffset + 1 ]	= (uint8_t)( q->len - rdlenOffset - 2 );
+	++q->answers;
+}
+
+static void	_QuerySend( TestQuery *q )
+{
+	uint8_t		packet[ 1500 ];
+
+	memset( q->data, 0, 4 );
+	q->data[ 4 ] = (uint8_t)( q->questions >> 8 );
+	q->data[ 5 ] = (uint8_t)( q->questions );
+	q->data[ 6 ] = (uint8_t)( q->answers >> 8 );
+	q->data[ 7 ] = (uint8_t)( q->answers );
+	memset( &q->data[ 8 ], 0, 4 );
+
+	// The responder parses in place from its receive buffer, which is larger than any query.
+
+	memcpy( packet, q->data, q->len );
+	mfi_mdns_handler( 1, packet, (int) q->len );
+}
+
+//===========================================================================================================================
+//	Tests
+//===========================================================================================================================
+
+static void	_ExpectService( TestRecord *r, const char *inService, const char *inInstance, const char *inTXT, uint32_t inTTL )
+{
+	_ExpectPTR( &r[ 0 ], inService, inInstance, inTTL );
+	_ExpectTXT( &r[ 1 ], inInstance, inTXT, inTTL );
+	_ExpectSRV( &r[ 2 ], inInstance, kTestHostName, kTestPort, inTTL );
+	_ExpectA( &r[ 3 ], kTestHostName, inTTL );
+}
+
+static void	_InitService( void )
+{
+	bonjour_init_t		init;
+
+	memset( &init, 0, sizeof( init ) );
+	init.service_name	= (char *) kTestServiceName;
+	init.host_name		= (char *) kTestHostName;
+	init.instance_name	= (char *) kTestInstanceName;
+	init.txt_record		= (char *) kTestTXTRecord;
+	init.service_port	= kTestPort;
+	bonjour_service_init( init );
+}
+
+static int	_TestOneService( void )
+{
+	TestRecord			expected[ 10 ];
+	TestQuery			q;
+	char				instance[ kTestNameMax ];
+	int					err = 0;
+
+	_InitService();
+	snprintf( instance, sizeof( instance ), "%s.%s", kTestInstanceName, kTestServiceName );
+
+	// Announcement: every record in one packet, names compressed.
+
+	gPacketCount = 0;
+	mfi_bonjour_send( 1 );
+	_ExpectPTR( &expected[ 0 ], MFi_SERVICE_QUERY_NAME, kTestServiceName, 1500 );
+	_ExpectService( &expected[ 1 ], kTestServiceName, instance, kTestTXTRecord, 1500 );
+	err |= _CheckSent( "announcement", expected, 5, 1 );
+
+	// Queries right after the announcement are rate limited.
+
+	_QueryInit( &q );
+	_QueryQuestion( &q, kTestServiceName, RR_TYPE_PTR );
+	_QuerySend( &q );
+	err |= _CheckSent( "query after announcement", expected, 0, 0 );
+
+	// Two questions, the second compressed against the first, answered from two cached packets.
+
+	gTimeOffset += 2000;
+	_QueryInit( &q );
+	_QueryQuestion( &q, kTestServiceName, RR_TYPE_PTR );
+	_QueryQuestion( &q, kTestHostName, RR_TYPE_A );
+	_QuerySend( &q );
+	_ExpectService( &expected[ 0 ], kTestServiceName, instance, kTestTXTRecord, 1500 );
+	_ExpectA( &expected[ 4 ], kTestHostName, 300 );
+	err |= _CheckSent( "compressed query", expected, 5, 2 );
+
+	// Known answers with more than half the TTL left are left out, the rest is copied into a new packet.
+
+	gTimeOffset += 2000;
+	_ExpectService( &expected[ 0 ], kTestServiceName, instance, kTestTXTRecord, 1500 );
+	_QueryInit( &q );
+	_QueryQuestion( &q, kTestServiceName, RR_TYPE_PTR );
+	_QueryKnownAnswer( &q, &expected[ 0 ], 1400 );
+	_QueryKnownAnswer( &q, &expected[ 1 ], 100 );
+	_QueryKnownAnswer( &q, &expected[ 2 ], 1500 );
+	_QuerySend( &q );
+	expected[ 0 ] = expected[ 1 ];
+	expected[ 1 ] = expected[ 3 ];
+	err |= _CheckSent( "known-answer suppression", expected, 2, 1 );
+
+	// The PTR and SRV records were not sent, so they are not rate limited, the TXT and A records are.
+
+	_ExpectService( &expected[ 0 ], kTestServiceName, instance, kTestTXTRecord, 1500 );
+	_QueryInit( &q );
+	_QueryQuestion( &q, kTestServiceName, RR_TYPE_PTR );
+	_QuerySend( &q );
+	expected[ 1 ] = expected[ 2 ];
+	err |= _CheckSent( "per-record rate limit", expected, 2, 1 );
+
+	// Service enumeration with the query name in upper case, names compare case-insensitively (RFC 6762 section 16).
+
+	_QueryInit( &q );
+	_QueryQuestion( &q, "_SERVICES._DNS-SD._UDP.LOCAL.", RR_TYPE_PTR );
+	_QuerySend( &q );
+	_ExpectPTR( &expected[ 0 ], MFi_SERVICE_QUERY_NAME, kTestServiceName, 1500 );
+	err |= _CheckSent( "service enumeration", expected, 1, 1 );
+	_QuerySend( &q );
+	err |= _CheckSent( "service enumeration repeated", expected, 0, 0 );
+
+	// Goodbye: the announcement with TTL 0, sent twice.
+
+	mfi_bonjour_remove_record( 1 );
+	_ExpectPTR( &expected[ 0 ], MFi_SERVICE_QUERY_NAME, kTestServiceName, 0 );
+	_ExpectService( &expected[ 1 ], kTestServiceName, instance, kTestTXTRecord, 0 );
+	memcpy( &expected[ 5 ], &expected[ 0 ], 5 * sizeof( expected[ 0 ] ) );
+	err |= _CheckSent( "goodbye", expected, 10, 2 );
+	return( err );
+}
+
+// More services than fit in one packet: the announcement is split where a record no longer fits.
+
+static int	_TestPackedServices( void )
+{
+	static dns_sd_service_record_t		services[ kTestServiceMax ];
+	static char							names[ kTestServiceMax ][ 3 ][ kTestNameMax ];
+	static TestRecord					expected[ kTestMaxRecords ];
+	dns_sd_service_record_t *			saved		= available_services;
+	uint8_t								savedCount	= available_service_count;
+	int									n, i, first, err;
+	size_t								sent = 0;
+
+	mdns_invalidate_responses();
+	for( n = 0; n < kTestServiceMax; ++n )
+	{
+		snprintf( names[ n ][ 0 ], kTestNameMax, "_svc%d._tcp.local.", n );
+		snprintf( names[ n ][ 1 ], kTestNameMax, "Accessory %d._svc%d._tcp.local.", n, n );
+		snprintf( names[ n ][ 2 ], kTestNameMax, "c#=%d.ff=0.id=C8:93:46:11:22:%02X.md=Test Accessory.pv=1.1.s#=1.sf=1.ci=5"
+			".sh=0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghij", n, n );
+		memset( &services[ n ], 0, sizeof( services[ n ] ) );
+		services[ n ].service_name	= names[ n ][ 0 ];
+		services[ n ].instance_name	= names[ n ][ 1 ];
+		services[ n ].txt_att		= names[ n ][ 2 ];
+		services[ n ].hostname		= (char *) kTestHostName;
+		services[ n ].port			= kTestPort;
+		_ExpectPTR( &expected[ n ], MFi_SERVICE_QUERY_NAME, names[ n ][ 0 ], 1500 );
+		_ExpectService( &expected[ kTestServiceMax + ( n * 4 ) ], names[ n ][ 0 ], names[ n ][ 1 ], names[ n ][ 2 ], 1500 );
+	}
+	available_services		= services;
+	available_service_count	= kTestServiceMax;
+
+	gPacketCount = 0;
+	mfi_bonjour_send( 1 );
+	for( n = 0; n < gPacketCount; n += 2 ) sent += gPackets[ n ].len;
+	err = _CheckSent( "packed announcement", expected, kTestServiceMax * 5, announce_count );
+	if( ( announce_count < 2 ) || ( announce_count > MDNS_ANNOUNCE_PACKET_MAX ) )
+	{
+		printf( "packed announcement: %u packets\n", announce_count );
+		err = 1;
+	}
+
+	// Each packet but the last must be too full for the first record of the next one.
+
+	for( n = 0; n + 1 < announce_count; ++n )
+	{
+		dns_record_spec_t		spec;
+
+		for( i = 0, first = 0; i <= n; ++i ) first += announce_responses[ i ].record_count;
+		mdns_service_record( first, &spec );
+		if( announce_responses[ n ].length + dns_record_size_max( &spec ) <= MDNS_PACKET_SIZE )
+		{
+			printf( "packed announcement: packet %d has room for the next record\n", n );
+			err = 1;
+		}
+	}
+	if( gVerbose ) printf( "packed announcement: %u bytes in %u packets\n", (unsigned int) sent, announce_count );
+
+	mdns_invalidate_responses();
+	available_services		= saved;
+	available_service_count	= savedCount;
+	return( err );
+}
+
+//===========================================================================================================================
+//	_Storm
+//===========================================================================================================================
+
+static uint64_t	_CPUTimeNs( void )
+{
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+	return( ( (uint64_t) ts.tv_sec * 1000000000 ) + (uint64_t) ts.tv_nsec );
+}
+
+static void	_Storm( int inQueries )
+{
+	static const uint32_t		kIntervals[] = { 2000, 10 };	// Simulated ms between queries.
+	TestQuery					queries[ 5 ];
+	const char *				names[ 5 ];
+	TestRecord					known[ 4 ];
+	char						instance[ kTestNameMax ];
+	uint64_t					start, ns;
+	int							k, n, i;
+
+	_InitService();
+	snprintf( instance, sizeof( instance ), "%s.%s", kTestInstanceName, kTestServiceName );
+
+	names[ 0 ] = "service ptr";
+	_QueryInit( &queries[ 0 ] );
+	_QueryQuestion( &queries[ 0 ], kTestServiceName, RR_TYPE_PTR );
+
+	names[ 1 ] = "service ptr, 2 known answers";
+	_ExpectService( known, kTestServiceName, instance, kTestTXTRecord, 1500 );
+	_QueryInit( &queries[ 1 ] );
+	_QueryQuestion( &queries[ 1 ], kTestServiceName, RR_TYPE_PTR );
+	_QueryKnownAnswer( &queries[ 1 ], &known[ 0 ], 1500 );
+	_QueryKnownAnswer( &queries[ 1 ], &known[ 2 ], 1500 );
+
+	names[ 2 ] = "service enumeration";
+	_QueryInit( &queries[ 2 ] );
+	_QueryQuestion( &queries[ 2 ], MFi_SERVICE_QUERY_NAME, RR_TYPE_PTR );
+
+	names[ 3 ] = "host a";
+	_QueryInit( &queries[ 3 ] );
+	_QueryQuestion( &queries[ 3 ], kTestHostName, RR_TYPE_A );
+
+	names[ 4 ] = "other service ptr";
+	_QueryInit( &queries[ 4 ] );
+	_QueryQuestion( &queries[ 4 ], "_airplay._tcp.local.", RR_TYPE_PTR );
+
+	printf( "\n%-32s %9s %10s %9s %11s\n", "query", "interval", "ns/query", "packets", "bytes" );
+	gCountOnly = 1;
+	for( k = 0; k < (int)( sizeof( queries ) / sizeof( queries[ 0 ] ) ); ++k )
+	{
+		for( i = 0; i < (int)( sizeof( kIntervals ) / sizeof( kIntervals[ 0 ] ) ); ++i )
+		{
+			gTimeOffset += 2000;
+			gPacketCount = 0;
+			gSentBytes = 0;
+			start = _CPUTimeNs();
+			for( n = 0; n < inQueries; ++n )
+			{
+				gTimeOffset += kIntervals[ i ];
+				_QuerySend( &queries[ k ] );
+			}
+			ns = _CPUTimeNs() - start;
+
+			// Every response is multicast and then broadcast.
+
+			printf( "%-32s %6u ms %10.0f %9d %11u\n", names[ k ], kIntervals[ i ], (double) ns / inQueries, gPacketCount / 2,
+				(unsigned int)( gSentBytes / 2 ) );
+		}
+	}
+	gCountOnly = 0;
+	gPacketCount = 0;
+}
+
+//===========================================================================================================================
+//	main
+//===========================================================================================================================
+
+int	main( int argc, const char **argv )
+{
+	int		err = 0;
+	int		storm = 0;
+	int		i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[ i ], "--verbose" ) == 0 ) gVerbose = 1;
+		else if( ( strcmp( argv[ i ], "--storm" ) == 0 ) && ( i + 1 < argc ) && ( ( storm = atoi( argv[ ++i ] ) ) > 0 ) ) {}
+		else { fprintf( stderr, "Usage: mdns_test [--verbose] [--storm <queries per row>]\n" ); return( 2 ); }
+	}
+
+	// Start well past 0, a record with last_sent 0 counts as never sent.
+
+	gTimeOffset = 100000;
+	err |= _TestPackedServices();
+	err |= _TestOneService();
+	printf( "%s\n", err ? "FAILED" : "PASSED" );
+	if( !err && storm ) _Storm( storm );
+	return( err ? 1 : 0 );
+}
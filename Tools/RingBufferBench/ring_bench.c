@@ -0,0 +1,268 @@
+/*
+	File:    ring_bench.c
+
+	Host benchmark for the ring buffer in Library/support/RingBufferUtils.c, the queue between the UART receive ISR or
+	DMA and the thread reading from it. Each row moves 16 MB through the ring in chunks of a given size, on a ring whose
+	size is a power of two (indexes wrap with a mask) and on one whose size is not (indexes wrap with a subtraction),
+	and reports the best of five runs in ns per byte and MB/s:
+
+		write/get_data		ring_buffer_write, then ring_buffer_get_data and ring_buffer_consume until empty
+		write/read			ring_buffer_write, then ring_buffer_read
+		reserve/read		ring_buffer_reserve and ring_buffer_commit, filled in place, then ring_buffer_read
+
+	It finishes with the producer and the consumer on two threads, each byte carrying a sequence number the consumer
+	checks, so a lost or reordered update of head or tail fails the run. A side that finds the ring full or empty
+	yields, as the UART thread would block, so this row also runs on a single core.
+
+	Build from the top of the tree (Linux, gcc or clang):
+
+		R=.
+		cc -std=c99 -O2 -D_POSIX_C_SOURCE=200809L -I$R/include -I$R/Library/support -I$R/Board/MiCOKit-3288 \
+			-I$R/Platform/Cortex-M4 -I$R/Demos/COM.Apple.HomeKit -I<host headers> \
+			$R/Tools/RingBufferBench/ring_bench.c $R/Library/support/RingBufferUtils.c -lpthread -o ring_bench
+
+	RingBufferUtils.c includes Library/support/Debug.h. On a case-sensitive file system <host headers> holds a
+	MicoRTOS.h that includes MICORTOS.h.
+
+	Add -DRING_BENCH_OLD_API=1 to build against a RingBufferUtils.c that only has ring_buffer_write, get_data and
+	consume, e.g. an older copy of the file ahead of the tree on the include path. Only the write/get_data rows are run,
+	the two-thread run needs the barriers.
+
+	Usage: ring_bench [--quick]
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "RingBufferUtils.h"
+
+#if( !defined( RING_BENCH_OLD_API ) )
+	#define	RING_BENCH_OLD_API		0
+#endif
+
+//===========================================================================================================================
+//	Internals
+//===========================================================================================================================
+
+#define	kBenchRuns				5
+#define	kBenchMaxChunk			512
+
+typedef uint32_t ( *BenchFunc )( ring_buffer_t *inRing, uint32_t inChunk, uint64_t inBytes );
+
+static const uint32_t		kBenchRingSizes[]	= { 1024, 1000 };
+static const uint32_t		kBenchChunks[]		= { 1, 16, 64, 512 };
+
+static uint8_t				gRingStorage[ 4096 ];
+static uint8_t				gIn[ kBenchMaxChunk ];
+static uint8_t				gOut[ kBenchMaxChunk ];
+static uint64_t				gBenchBytes			= 16 * 1024 * 1024;
+static volatile uint32_t	gSink;
+
+static uint64_t	_NowNs( void )
+{
+	struct timespec		ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ( (uint64_t) ts.tv_sec * 1000000000 ) + (uint64_t) ts.tv_nsec );
+}
+
+//===========================================================================================================================
+//	Single-thread rows
+//
+//	Each returns a checksum of the bytes read so the copies can't be optimized away.
+//===========================================================================================================================
+
+static uint32_t	_WriteGetData( ring_buffer_t *inRing, uint32_t inChunk, uint64_t inBytes )
+{
+	uint32_t		sum = 0;
+	uint32_t		len;
+	uint8_t *		data;
+	uint64_t		n;
+
+	for( n = 0; n < inBytes; n += inChunk )
+	{
+		ring_buffer_write( inRing, gIn, inChunk );
+		while( ring_buffer_used_space( inRing ) > 0 )
+		{
+			ring_buffer_get_data( inRing, &data, &len );
+			sum += data[ 0 ];
+			ring_buffer_consume( inRing, len );
+		}
+	}
+	return( sum );
+}
+
+#if( !RING_BENCH_OLD_API )
+static uint32_t	_WriteRead( ring_buffer_t *inRing, uint32_t inChunk, uint64_t inBytes )
+{
+	uint32_t		sum = 0;
+	uint64_t		n;
+
+	for( n = 0; n < inBytes; n += inChunk )
+	{
+		ring_buffer_write( inRing, gIn, inChunk );
+		sum += ring_buffer_read( inRing, gOut, inChunk );
+		sum += gOut[ 0 ];
+	}
+	return( sum );
+}
+
+static uint32_t	_ReserveRead( ring_buffer_t *inRing, uint32_t inChunk, uint64_t inBytes )
+{
+	uint32_t		sum = 0;
+	uint32_t		len, done;
+	uint8_t *		space;
+	uint64_t		n;
+
+	for( n = 0; n < inBytes; n += inChunk )
+	{
+		for( done = 0; done < inChunk; done += len )
+		{
+			len = ring_buffer_reserve( inRing, &space, inChunk - done );
+			memset( space, (int) n, len );
+			ring_buffer_commit( inRing, len );
+		}
+		sum += ring_buffer_read( inRing, gOut, inChunk );
+		sum += gOut[ 0 ];
+	}
+	return( sum );
+}
+#endif
+
+static void	_BenchRow( const char *inName, BenchFunc inFunc )
+{
+	ring_buffer_t		ring;
+	uint64_t			start, ns, best;
+	size_t				s, c;
+	int					run;
+
+	for( s = 0; s < sizeof( kBenchRingSizes ) / sizeof( kBenchRingSizes[ 0 ] ); ++s )
+	{
+		for( c = 0; c < sizeof( kBenchChunks ) / sizeof( kBenchChunks[ 0 ] ); ++c )
+		{
+			best = UINT64_MAX;
+			for( run = 0; run < kBenchRuns; ++run )
+			{
+				ring_buffer_init( &ring, gRingStorage, kBenchRingSizes[ s ] );
+				start = _NowNs();
+				gSink += inFunc( &ring, kBenchChunks[ c ], gBenchBytes );
+				ns = _NowNs() - start;
+				if( ns < best ) best = ns;
+			}
+			printf( "%-16s %6u %6u %10.3f %10.1f\n", inName, kBenchRingSizes[ s ], kBenchChunks[ c ],
+				(double) best / (double) gBenchBytes, ( (double) gBenchBytes / 1e6 ) / ( (double) best / 1e9 ) );
+		}
+	}
+}
+
+//===========================================================================================================================
+//	Two threads
+//
+//	The producer writes bytes numbered modulo 251 in chunks of varying size, the consumer reads them in chunks of
+//	another size and checks every one.
+//===========================================================================================================================
+
+#if( !RING_BENCH_OLD_API )
+static ring_buffer_t		gSPSCRing;
+static volatile int			gSPSCErrors;
+
+static void *	_SPSCProducer( void *inArg )
+{
+	uint8_t			chunk[ 97 ];
+	uint64_t		n = 0;
+	uint32_t		len, done, i;
+
+	(void) inArg;
+
+	while( n < gBenchBytes )
+	{
+		len = (uint32_t)( 1 + ( n % sizeof( chunk ) ) );
+		if( len > gBenchBytes - n ) len = (uint32_t)( gBenchBytes - n );
+		for( i = 0; i < len; ++i ) chunk[ i ] = (uint8_t)( ( n + i ) % 251 );
+		for( done = 0; done < len; )
+		{
+			i = ring_buffer_write( &gSPSCRing, chunk + done, len - done );
+			if( i == 0 ) sched_yield();
+			done += i;
+		}
+		n += len;
+	}
+	return( NULL );
+}
+
+static void *	_SPSCConsumer( void *inArg )
+{
+	uint8_t			chunk[ 61 ];
+	uint64_t		n = 0;
+	uint32_t		len, i;
+
+	(void) inArg;
+
+	while( n < gBenchBytes )
+	{
+		len = ring_buffer_read( &gSPSCRing, chunk, sizeof( chunk ) );
+		if( len == 0 ) sched_yield();
+		for( i = 0; i < len; ++i )
+		{
+			if( chunk[ i ] != (uint8_t)( ( n + i ) % 251 ) ) ++gSPSCErrors;
+		}
+		n += len;
+	}
+	return( NULL );
+}
+
+static int	_BenchSPSC( void )
+{
+	pthread_t		producer, consumer;
+	uint64_t		start, ns;
+	size_t			s;
+	int				err = 0;
+
+	for( s = 0; s < sizeof( kBenchRingSizes ) / sizeof( kBenchRingSizes[ 0 ] ); ++s )
+	{
+		gSPSCErrors = 0;
+		ring_buffer_init( &gSPSCRing, gRingStorage, kBenchRingSizes[ s ] );
+		start = _NowNs();
+		pthread_create( &consumer, NULL, _SPSCConsumer, NULL );
+		pthread_create( &producer, NULL, _SPSCProducer, NULL );
+		pthread_join( producer, NULL );
+		pthread_join( consumer, NULL );
+		ns = _NowNs() - start;
+		printf( "%-16s %6u %6s %10.3f %10.1f %s\n", "two threads", kBenchRingSizes[ s ], "-", (double) ns / (double) gBenchBytes,
+			( (double) gBenchBytes / 1e6 ) / ( (double) ns / 1e9 ), gSPSCErrors ? "CORRUPTED" : "checked" );
+		if( gSPSCErrors ) err = 1;
+	}
+	return( err );
+}
+#endif
+
+//===========================================================================================================================
+//	main
+//===========================================================================================================================
+
+int	main( int argc, const char **argv )
+{
+	int		err = 0;
+	int		i;
+
+	for( i = 1; i < argc; ++i )
+	{
+		if( strcmp( argv[ i ], "--quick" ) == 0 ) gBenchBytes = 1024 * 1024;
+		else { fprintf( stderr, "Usage: ring_bench [--quick]\n" ); return( 2 ); }
+	}
+	for( i = 0; i < kBenchMaxChunk; ++i ) gIn[ i ] = (uint8_t) i;
+
+	printf( "%-16s %6s %6s %10s %10s\n", "row", "ring", "chunk", "ns/byte", "MB/s" );
+	_BenchRow( "write/get_data", _WriteGetData );
+#if( !RING_BENCH_OLD_API )
+	_BenchRow( "write/read", _WriteRead );
+	_BenchRow( "reserve/read", _ReserveRead );
+	err = _BenchSPSC();
+#endif
+	return( err ? 1 : 0 );
+}